@@ -0,0 +1,501 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config/parser.h"
+#include "thread/thread.h"
+#include "thread/queue.h"
+#include "timer/timer.h"
+#include "timer/profile.h"
+
+#define THREAD_BENCH_PARAMETER_BENCHMARK        "BENCHMARK"
+
+#define THREAD_BENCH_QUEUE_OPTION_GROUP         "queue"
+#define THREAD_BENCH_PARAMETER_TYPE             "type"
+#define THREAD_BENCH_PARAMETER_ELEMENTS         "elements"
+#define THREAD_BENCH_PARAMETER_CAPACITY         "capacity"
+#define THREAD_BENCH_PARAMETER_BATCH_SIZE       "batch-size"
+#define THREAD_BENCH_PARAMETER_PRODUCERS        "producers"
+#define THREAD_BENCH_PARAMETER_CONSUMERS        "consumers"
+
+#define THREAD_BENCH_SLEEP_OPTION_GROUP         "sleep"
+#define THREAD_BENCH_PARAMETER_MODE             "mode"
+#define THREAD_BENCH_PARAMETER_PERIOD           "period"
+#define THREAD_BENCH_PARAMETER_SAMPLES          "samples"
+
+#define THREAD_BENCH_POP_TIMEOUT                1e-2
+#define THREAD_BENCH_CALIBRATION_SAMPLES        100
+
+typedef enum {
+  thread_bench_queue,
+  thread_bench_sleep
+} thread_bench_t;
+
+typedef enum {
+  thread_bench_queue_all,
+  thread_bench_queue_spsc,
+  thread_bench_queue_mpmc,
+  thread_bench_queue_mutex
+} thread_bench_queue_type_t;
+
+typedef enum {
+  thread_bench_sleep_all,
+  thread_bench_sleep_kernel,
+  thread_bench_sleep_spin
+} thread_bench_sleep_mode_t;
+
+typedef struct thread_bench_mutex_queue_t {
+  int64_t* elements;
+  size_t capacity;
+  size_t head;
+  size_t tail;
+
+  thread_condition_t condition;
+} thread_bench_mutex_queue_t;
+
+typedef struct thread_bench_queue_t {
+  thread_bench_queue_type_t type;
+  thread_queue_spsc_t spsc;
+  thread_queue_mpmc_t mpmc;
+  thread_bench_mutex_queue_t mutex;
+
+  size_t num_elements;
+  size_t num_total;
+  size_t batch_size;
+  atomic_size_t num_popped;
+} thread_bench_queue_t;
+
+typedef struct thread_bench_worker_t {
+  thread_t thread;
+  thread_bench_queue_t* queue;
+  timer_histogram_t histogram;
+} thread_bench_worker_t;
+
+const char* thread_bench_queue_types[] = {
+  "all",
+  "spsc",
+  "mpmc",
+  "mutex",
+};
+
+const char* thread_bench_sleep_modes[] = {
+  "all",
+  "kernel",
+  "spin",
+};
+
+config_param_t thread_bench_default_arguments_params[] = {
+  {THREAD_BENCH_PARAMETER_BENCHMARK,
+    config_param_type_enum,
+    "",
+    "queue|sleep",
+    "The benchmark to be run, where 'queue' measures the throughput and "
+    "latency of the lock-free queues against a queue protected by a "
+    "mutex and condition, and 'sleep' the wake-up error of periodic "
+    "sleeps until absolute deadlines"},
+};
+
+const config_default_t thread_bench_default_arguments = {
+  thread_bench_default_arguments_params,
+  sizeof(thread_bench_default_arguments_params)/sizeof(config_param_t),
+};
+
+config_param_t thread_bench_queue_default_options_params[] = {
+  {THREAD_BENCH_PARAMETER_TYPE,
+    config_param_type_enum,
+    "all",
+    "all|spsc|mpmc|mutex",
+    "The type of queue to be measured, where 'spsc' and 'mpmc' refer to "
+    "the lock-free single-producer single-consumer and multi-producer "
+    "multi-consumer queues, and 'mutex' to a queue protected by a mutex "
+    "and condition"},
+  {THREAD_BENCH_PARAMETER_ELEMENTS,
+    config_param_type_int,
+    "1000000",
+    "[1, 1000000000]",
+    "The number of elements pushed by each producer"},
+  {THREAD_BENCH_PARAMETER_CAPACITY,
+    config_param_type_int,
+    "1024",
+    "[1, 1048576]",
+    "The number of elements the queue can hold"},
+  {THREAD_BENCH_PARAMETER_BATCH_SIZE,
+    config_param_type_int,
+    "1",
+    "[1, 4096]",
+    "The number of elements transferred per push or pop operation"},
+  {THREAD_BENCH_PARAMETER_PRODUCERS,
+    config_param_type_int,
+    "1",
+    "[1, 64]",
+    "The number of producer threads, ignored by the 'spsc' queue"},
+  {THREAD_BENCH_PARAMETER_CONSUMERS,
+    config_param_type_int,
+    "1",
+    "[1, 64]",
+    "The number of consumer threads, ignored by the 'spsc' queue"},
+};
+
+const config_default_t thread_bench_queue_default_options = {
+  thread_bench_queue_default_options_params,
+  sizeof(thread_bench_queue_default_options_params)/sizeof(config_param_t),
+};
+
+config_param_t thread_bench_sleep_default_options_params[] = {
+  {THREAD_BENCH_PARAMETER_MODE,
+    config_param_type_enum,
+    "all",
+    "all|kernel|spin",
+    "The sleep mode to be measured, where 'kernel' sleeps in the kernel "
+    "until the deadline, and 'spin' busy-waits for the calibrated spin "
+    "threshold before the deadline"},
+  {THREAD_BENCH_PARAMETER_PERIOD,
+    config_param_type_float,
+    "0.001",
+    "(0.0, 1.0]",
+    "The period between consecutive deadlines in [s]"},
+  {THREAD_BENCH_PARAMETER_SAMPLES,
+    config_param_type_int,
+    "1000",
+    "[1, 1000000000]",
+    "The number of deadlines to sleep until"},
+};
+
+const config_default_t thread_bench_sleep_default_options = {
+  thread_bench_sleep_default_options_params,
+  sizeof(thread_bench_sleep_default_options_params)/sizeof(config_param_t),
+};
+
+void thread_bench_mutex_queue_init(thread_bench_mutex_queue_t* queue,
+  size_t capacity);
+void thread_bench_mutex_queue_destroy(thread_bench_mutex_queue_t* queue);
+size_t thread_bench_mutex_queue_push(thread_bench_mutex_queue_t* queue,
+  const int64_t* elements, size_t num_elements);
+ssize_t thread_bench_mutex_queue_pop(thread_bench_mutex_queue_t* queue,
+  int64_t* elements, size_t max_elements, double timeout);
+void* thread_bench_queue_produce(void* arg);
+void* thread_bench_queue_consume(void* arg);
+void thread_bench_queue_run(thread_bench_queue_type_t type, size_t
+  num_elements, size_t capacity, size_t batch_size, size_t num_producers,
+  size_t num_consumers);
+void thread_bench_sleep_run(thread_bench_sleep_mode_t mode, double period,
+  size_t num_samples);
+
+int main(int argc, char **argv) {
+  config_parser_t parser;
+
+  config_parser_init_default(&parser, &thread_bench_default_arguments, 0,
+    "Benchmark the thread library",
+    "The command measures the performance of primitives of the thread "
+    "library and of the sleep functions of the timer module, and prints "
+    "the results to stdout. Latencies are measured with the fast clock "
+    "of the timer module and reported as percentiles of a latency "
+    "histogram.");
+  config_parser_add_option_group(&parser, THREAD_BENCH_QUEUE_OPTION_GROUP,
+    &thread_bench_queue_default_options, "Queue benchmark options",
+    "These options control the queue benchmark performed by the command.");
+  config_parser_add_option_group(&parser, THREAD_BENCH_SLEEP_OPTION_GROUP,
+    &thread_bench_sleep_default_options, "Sleep benchmark options",
+    "These options control the sleep benchmark performed by the command.");
+  config_parser_parse(&parser, argc, argv, config_parser_exit_error);
+
+  thread_bench_t benchmark = config_get_enum(&parser.arguments,
+    THREAD_BENCH_PARAMETER_BENCHMARK);
+
+  config_parser_option_group_t* queue_option_group =
+    config_parser_get_option_group(&parser, THREAD_BENCH_QUEUE_OPTION_GROUP);
+  thread_bench_queue_type_t type = config_get_enum(
+    &queue_option_group->options, THREAD_BENCH_PARAMETER_TYPE);
+  size_t num_elements = config_get_int(&queue_option_group->options,
+    THREAD_BENCH_PARAMETER_ELEMENTS);
+  size_t capacity = config_get_int(&queue_option_group->options,
+    THREAD_BENCH_PARAMETER_CAPACITY);
+  size_t batch_size = config_get_int(&queue_option_group->options,
+    THREAD_BENCH_PARAMETER_BATCH_SIZE);
+  size_t num_producers = config_get_int(&queue_option_group->options,
+    THREAD_BENCH_PARAMETER_PRODUCERS);
+  size_t num_consumers = config_get_int(&queue_option_group->options,
+    THREAD_BENCH_PARAMETER_CONSUMERS);
+
+  config_parser_option_group_t* sleep_option_group =
+    config_parser_get_option_group(&parser, THREAD_BENCH_SLEEP_OPTION_GROUP);
+  thread_bench_sleep_mode_t mode = config_get_enum(
+    &sleep_option_group->options, THREAD_BENCH_PARAMETER_MODE);
+  double period = config_get_float(&sleep_option_group->options,
+    THREAD_BENCH_PARAMETER_PERIOD);
+  size_t num_samples = config_get_int(&sleep_option_group->options,
+    THREAD_BENCH_PARAMETER_SAMPLES);
+
+  timer_calibrate_fast(0.1);
+
+  if (benchmark == thread_bench_queue) {
+    fprintf(stdout, "%-6s %10s %12s %10s %10s %10s %10s\n", "queue",
+      "elements", "throughput", "mean", "p50", "p99", "max");
+    fprintf(stdout, "%-6s %10s %12s %10s %10s %10s %10s\n", "",
+      "", "[1/s]", "[ns]", "[ns]", "[ns]", "[ns]");
+
+    if (type == thread_bench_queue_all) {
+      for (type = thread_bench_queue_spsc; type <= thread_bench_queue_mutex;
+          ++type)
+        thread_bench_queue_run(type, num_elements, capacity, batch_size,
+          num_producers, num_consumers);
+    }
+    else
+      thread_bench_queue_run(type, num_elements, capacity, batch_size,
+        num_producers, num_consumers);
+  }
+  else if (benchmark == thread_bench_sleep) {
+    fprintf(stdout, "%-6s %10s %10s %10s %10s %10s %10s\n", "mode",
+      "samples", "spin", "mean", "p50", "p99", "max");
+    fprintf(stdout, "%-6s %10s %10s %10s %10s %10s %10s\n", "",
+      "", "[ns]", "[ns]", "[ns]", "[ns]", "[ns]");
+
+    if (mode == thread_bench_sleep_all) {
+      for (mode = thread_bench_sleep_kernel; mode <= thread_bench_sleep_spin;
+          ++mode)
+        thread_bench_sleep_run(mode, period, num_samples);
+    }
+    else
+      thread_bench_sleep_run(mode, period, num_samples);
+  }
+
+  config_parser_destroy(&parser);
+
+  return 0;
+}
+
+void thread_bench_mutex_queue_init(thread_bench_mutex_queue_t* queue,
+    size_t capacity) {
+  queue->elements = malloc(capacity*sizeof(int64_t));
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->tail = 0;
+
+  thread_condition_init(&queue->condition);
+}
+
+void thread_bench_mutex_queue_destroy(thread_bench_mutex_queue_t* queue) {
+  thread_condition_destroy(&queue->condition);
+  free(queue->elements);
+}
+
+size_t thread_bench_mutex_queue_push(thread_bench_mutex_queue_t* queue,
+    const int64_t* elements, size_t num_elements) {
+  size_t i;
+
+  thread_condition_lock(&queue->condition);
+
+  while (queue->head-queue->tail == queue->capacity)
+    thread_condition_wait(&queue->condition, THREAD_CONDITION_WAIT_FOREVER);
+
+  for (i = 0; (i < num_elements) &&
+      (queue->head-queue->tail < queue->capacity); ++i)
+    queue->elements[queue->head++ % queue->capacity] = elements[i];
+
+  thread_condition_broadcast(&queue->condition);
+  thread_condition_unlock(&queue->condition);
+
+  return i;
+}
+
+ssize_t thread_bench_mutex_queue_pop(thread_bench_mutex_queue_t* queue,
+    int64_t* elements, size_t max_elements, double timeout) {
+  size_t i;
+
+  thread_condition_lock(&queue->condition);
+
+  while (queue->head == queue->tail)
+    if (thread_condition_wait(&queue->condition, timeout)) {
+      thread_condition_unlock(&queue->condition);
+      return -THREAD_QUEUE_ERROR_TIMEOUT;
+    }
+
+  for (i = 0; (i < max_elements) && (queue->tail != queue->head); ++i)
+    elements[i] = queue->elements[queue->tail++ % queue->capacity];
+
+  thread_condition_broadcast(&queue->condition);
+  thread_condition_unlock(&queue->condition);
+
+  return i;
+}
+
+void* thread_bench_queue_produce(void* arg) {
+  thread_bench_worker_t* worker = arg;
+  thread_bench_queue_t* queue = worker->queue;
+  int64_t elements[queue->batch_size];
+  size_t num_pushed = 0, num_elements, i;
+  ssize_t result;
+
+  while (num_pushed < queue->num_elements) {
+    num_elements = (queue->num_elements-num_pushed < queue->batch_size) ?
+      queue->num_elements-num_pushed : queue->batch_size;
+    elements[0] = timer_get_fast_ns();
+    for (i = 1; i < num_elements; ++i)
+      elements[i] = elements[0];
+
+    for (i = 0; i < num_elements; i += result) {
+      if (queue->type == thread_bench_queue_spsc)
+        result = thread_queue_spsc_push_wait(&queue->spsc, &elements[i],
+          num_elements-i, THREAD_CONDITION_WAIT_FOREVER);
+      else if (queue->type == thread_bench_queue_mpmc)
+        result = thread_queue_mpmc_push_wait(&queue->mpmc, &elements[i],
+          num_elements-i, THREAD_CONDITION_WAIT_FOREVER);
+      else
+        result = thread_bench_mutex_queue_push(&queue->mutex, &elements[i],
+          num_elements-i);
+    }
+
+    num_pushed += num_elements;
+  }
+
+  return 0;
+}
+
+void* thread_bench_queue_consume(void* arg) {
+  thread_bench_worker_t* worker = arg;
+  thread_bench_queue_t* queue = worker->queue;
+  int64_t elements[queue->batch_size], now;
+  ssize_t result, i;
+
+  while (atomic_load(&queue->num_popped) < queue->num_total) {
+    if (queue->type == thread_bench_queue_spsc)
+      result = thread_queue_spsc_pop_wait(&queue->spsc, elements,
+        queue->batch_size, THREAD_BENCH_POP_TIMEOUT);
+    else if (queue->type == thread_bench_queue_mpmc)
+      result = thread_queue_mpmc_pop_wait(&queue->mpmc, elements,
+        queue->batch_size, THREAD_BENCH_POP_TIMEOUT);
+    else
+      result = thread_bench_mutex_queue_pop(&queue->mutex, elements,
+        queue->batch_size, THREAD_BENCH_POP_TIMEOUT);
+
+    if (result > 0) {
+      now = timer_get_fast_ns();
+      for (i = 0; i < result; ++i)
+        timer_histogram_add(&worker->histogram, now-elements[i]);
+
+      atomic_fetch_add(&queue->num_popped, result);
+    }
+  }
+
+  return 0;
+}
+
+void thread_bench_queue_run(thread_bench_queue_type_t type, size_t
+    num_elements, size_t capacity, size_t batch_size, size_t num_producers,
+    size_t num_consumers) {
+  thread_bench_queue_t queue;
+  thread_bench_worker_t* producers;
+  thread_bench_worker_t* consumers;
+  timer_histogram_t histogram;
+  int64_t start, duration;
+  size_t i;
+
+  if (type == thread_bench_queue_spsc) {
+    num_producers = 1;
+    num_consumers = 1;
+    thread_queue_spsc_init(&queue.spsc, capacity, sizeof(int64_t));
+  }
+  else if (type == thread_bench_queue_mpmc)
+    thread_queue_mpmc_init(&queue.mpmc, capacity, sizeof(int64_t));
+  else
+    thread_bench_mutex_queue_init(&queue.mutex, capacity);
+
+  queue.type = type;
+  queue.num_elements = num_elements;
+  queue.num_total = num_elements*num_producers;
+  queue.batch_size = batch_size;
+  atomic_init(&queue.num_popped, 0);
+
+  producers = malloc(num_producers*sizeof(thread_bench_worker_t));
+  consumers = malloc(num_consumers*sizeof(thread_bench_worker_t));
+
+  start = timer_get_fast_ns();
+
+  for (i = 0; i < num_consumers; ++i) {
+    consumers[i].queue = &queue;
+    timer_histogram_init(&consumers[i].histogram);
+    thread_start(&consumers[i].thread, thread_bench_queue_consume, 0,
+      &consumers[i], 0.0);
+  }
+  for (i = 0; i < num_producers; ++i) {
+    producers[i].queue = &queue;
+    thread_start(&producers[i].thread, thread_bench_queue_produce, 0,
+      &producers[i], 0.0);
+  }
+
+  for (i = 0; i < num_producers; ++i)
+    thread_wait_exit(&producers[i].thread);
+  for (i = 0; i < num_consumers; ++i)
+    thread_wait_exit(&consumers[i].thread);
+
+  duration = timer_get_fast_ns()-start;
+
+  timer_histogram_init(&histogram);
+  for (i = 0; i < num_consumers; ++i)
+    timer_histogram_merge(&histogram, &consumers[i].histogram);
+
+  fprintf(stdout, "%-6s %10zu %12.0f %10.0f %10lld %10lld %10lld\n",
+    thread_bench_queue_types[type], timer_histogram_get_count(&histogram),
+    timer_histogram_get_count(&histogram)/timer_ns_to_seconds(duration),
+    timer_histogram_get_mean(&histogram),
+    (long long)timer_histogram_get_percentile(&histogram, 0.5),
+    (long long)timer_histogram_get_percentile(&histogram, 0.99),
+    (long long)timer_histogram_get_max(&histogram));
+
+  free(producers);
+  free(consumers);
+
+  if (type == thread_bench_queue_spsc)
+    thread_queue_spsc_destroy(&queue.spsc);
+  else if (type == thread_bench_queue_mpmc)
+    thread_queue_mpmc_destroy(&queue.mpmc);
+  else
+    thread_bench_mutex_queue_destroy(&queue.mutex);
+}
+
+void thread_bench_sleep_run(thread_bench_sleep_mode_t mode, double period,
+    size_t num_samples) {
+  timer_histogram_t histogram;
+  int64_t threshold = 0, deadline;
+  size_t i;
+
+  if (mode == thread_bench_sleep_spin)
+    threshold = timer_calibrate_spin(THREAD_BENCH_CALIBRATION_SAMPLES);
+  else
+    timer_set_spin_threshold(0);
+
+  timer_histogram_init(&histogram);
+  deadline = timer_get_monotonic_ns();
+
+  for (i = 0; i < num_samples; ++i) {
+    deadline += timer_seconds_to_ns(period);
+    timer_histogram_add(&histogram, timer_sleep_until(deadline));
+  }
+
+  fprintf(stdout, "%-6s %10zu %10lld %10.0f %10lld %10lld %10lld\n",
+    thread_bench_sleep_modes[mode], timer_histogram_get_count(&histogram),
+    (long long)threshold, timer_histogram_get_mean(&histogram),
+    (long long)timer_histogram_get_percentile(&histogram, 0.5),
+    (long long)timer_histogram_get_percentile(&histogram, 0.99),
+    (long long)timer_histogram_get_max(&histogram));
+}
@@ -0,0 +1,313 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <string.h>
+
+#include "async.h"
+
+#define FILE_ASYNC_MIN_BUFFER_SIZE              4096
+
+file_async_segment_t* file_async_segment_new(size_t capacity);
+void file_async_segment_free(file_async_segment_t* segment);
+void file_async_wake(thread_condition_t* condition, atomic_int* waiting);
+size_t file_async_drain(file_async_t* async);
+int file_async_empty(file_async_t* async);
+void file_async_set_error(file_async_t* async, int error);
+void* file_async_run(void* arg);
+
+int file_async_start(file_async_t* async, file_t* file, size_t buffer_size,
+    file_async_policy_t policy, ssize_t (*write)(file_t*, const unsigned
+    char*, size_t), int (*flush)(file_t*)) {
+  async->file = file;
+  async->policy = policy;
+
+  async->write = write;
+  async->flush = flush;
+
+  if (buffer_size < FILE_ASYNC_MIN_BUFFER_SIZE)
+    buffer_size = FILE_ASYNC_MIN_BUFFER_SIZE;
+  async->write_segment = file_async_segment_new(buffer_size);
+  async->read_segment = async->write_segment;
+
+  thread_condition_init(&async->data_condition);
+  thread_condition_init(&async->space_condition);
+  atomic_init(&async->data_waiting, 0);
+  atomic_init(&async->space_waiting, 0);
+
+  atomic_init(&async->flush_request, 0);
+  atomic_init(&async->flush_done, 0);
+  atomic_init(&async->exit_request, 0);
+  atomic_init(&async->error, FILE_ERROR_NONE);
+
+  async->pos = file_tell(file);
+  async->num_written = 0;
+  atomic_init(&async->num_dropped, 0);
+  atomic_init(&async->num_dropped_writes, 0);
+
+  if (thread_start(&async->thread, file_async_run, 0, async, 0.0)) {
+    thread_condition_destroy(&async->data_condition);
+    thread_condition_destroy(&async->space_condition);
+    file_async_segment_free(async->write_segment);
+
+    return FILE_ERROR_OPEN;
+  }
+
+  return FILE_ERROR_NONE;
+}
+
+int file_async_stop(file_async_t* async) {
+  file_async_segment_t* segment;
+
+  atomic_store(&async->exit_request, 1);
+  file_async_wake(&async->data_condition, &async->data_waiting);
+
+  thread_wait_exit(&async->thread);
+
+  thread_condition_destroy(&async->data_condition);
+  thread_condition_destroy(&async->space_condition);
+
+  while (async->read_segment) {
+    segment = async->read_segment;
+    async->read_segment = atomic_load(&segment->next);
+    file_async_segment_free(segment);
+  }
+  async->write_segment = 0;
+
+  return atomic_load(&async->error);
+}
+
+ssize_t file_async_write(file_async_t* async, const unsigned char* data,
+    size_t size) {
+  file_async_segment_t* segment = async->write_segment;
+  file_async_segment_t* next;
+  size_t num_written = 0, head, tail, space, offset, length;
+  int error;
+
+  if ((error = atomic_load_explicit(&async->error, memory_order_relaxed)))
+    return -error;
+
+  while (num_written < size) {
+    head = atomic_load_explicit(&segment->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&segment->tail, memory_order_acquire);
+    space = segment->capacity-(head-tail);
+
+    if ((async->policy == file_async_policy_drop) && (space < size)) {
+      atomic_fetch_add_explicit(&async->num_dropped, size,
+        memory_order_relaxed);
+      atomic_fetch_add_explicit(&async->num_dropped_writes, 1,
+        memory_order_relaxed);
+      return 0;
+    }
+
+    if (!space) {
+      if (async->policy == file_async_policy_grow) {
+        next = file_async_segment_new(segment->capacity*2 > size-num_written ?
+          segment->capacity*2 : size-num_written);
+        atomic_store_explicit(&segment->next, next, memory_order_release);
+        segment = async->write_segment = next;
+      }
+      else {
+        thread_condition_lock(&async->space_condition);
+        atomic_store(&async->space_waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        while ((atomic_load(&segment->tail) == tail) &&
+            !atomic_load(&async->error))
+          thread_condition_wait(&async->space_condition,
+            THREAD_CONDITION_WAIT_FOREVER);
+
+        atomic_store(&async->space_waiting, 0);
+        thread_condition_unlock(&async->space_condition);
+
+        if ((error = atomic_load(&async->error)))
+          return num_written ? num_written : -error;
+      }
+
+      continue;
+    }
+
+    length = (space < size-num_written) ? space : size-num_written;
+    offset = head % segment->capacity;
+
+    if (offset+length > segment->capacity) {
+      memcpy(&segment->data[offset], &data[num_written],
+        segment->capacity-offset);
+      memcpy(segment->data, &data[num_written+segment->capacity-offset],
+        length-(segment->capacity-offset));
+    }
+    else
+      memcpy(&segment->data[offset], &data[num_written], length);
+
+    atomic_store_explicit(&segment->head, head+length, memory_order_release);
+    num_written += length;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    file_async_wake(&async->data_condition, &async->data_waiting);
+  }
+
+  async->num_written += num_written;
+
+  return num_written;
+}
+
+int file_async_flush(file_async_t* async) {
+  size_t request = atomic_fetch_add(&async->flush_request, 1)+1;
+
+  file_async_wake(&async->data_condition, &async->data_waiting);
+
+  thread_condition_lock(&async->space_condition);
+  atomic_store(&async->space_waiting, 1);
+  atomic_thread_fence(memory_order_seq_cst);
+
+  while (atomic_load(&async->flush_done) < request)
+    thread_condition_wait(&async->space_condition,
+      THREAD_CONDITION_WAIT_FOREVER);
+
+  atomic_store(&async->space_waiting, 0);
+  thread_condition_unlock(&async->space_condition);
+
+  return atomic_load(&async->error);
+}
+
+file_async_segment_t* file_async_segment_new(size_t capacity) {
+  file_async_segment_t* segment = malloc(sizeof(file_async_segment_t));
+
+  segment->data = malloc(capacity);
+  segment->capacity = capacity;
+
+  atomic_init(&segment->next, 0);
+  atomic_init(&segment->head, 0);
+  atomic_init(&segment->tail, 0);
+
+  return segment;
+}
+
+void file_async_segment_free(file_async_segment_t* segment) {
+  free(segment->data);
+  free(segment);
+}
+
+void file_async_wake(thread_condition_t* condition, atomic_int* waiting) {
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (atomic_load_explicit(waiting, memory_order_relaxed)) {
+    thread_condition_lock(condition);
+    thread_condition_signal(condition);
+    thread_condition_unlock(condition);
+  }
+}
+
+size_t file_async_drain(file_async_t* async) {
+  file_async_segment_t* segment = async->read_segment;
+  file_async_segment_t* next;
+  size_t num_drained = 0, head, tail, offset, length;
+  ssize_t result;
+
+  while (1) {
+    head = atomic_load_explicit(&segment->head, memory_order_acquire);
+    tail = atomic_load_explicit(&segment->tail, memory_order_relaxed);
+
+    if (head == tail) {
+      if (!(next = atomic_load_explicit(&segment->next,
+          memory_order_acquire)))
+        break;
+      if (atomic_load_explicit(&segment->head, memory_order_acquire) !=
+          tail)
+        continue;
+
+      file_async_segment_free(segment);
+      segment = async->read_segment = next;
+
+      continue;
+    }
+
+    offset = tail % segment->capacity;
+    length = (head-tail < segment->capacity-offset) ? head-tail :
+      segment->capacity-offset;
+
+    if (!atomic_load_explicit(&async->error, memory_order_relaxed) &&
+        ((result = async->write(async->file, &segment->data[offset],
+        length)) < 0))
+      file_async_set_error(async, -result);
+
+    atomic_store_explicit(&segment->tail, tail+length, memory_order_release);
+    num_drained += length;
+
+    file_async_wake(&async->space_condition, &async->space_waiting);
+  }
+
+  return num_drained;
+}
+
+int file_async_empty(file_async_t* async) {
+  file_async_segment_t* segment = async->read_segment;
+
+  return (atomic_load(&segment->head) == atomic_load(&segment->tail)) &&
+    !atomic_load(&segment->next);
+}
+
+void file_async_set_error(file_async_t* async, int error) {
+  int none = FILE_ERROR_NONE;
+
+  atomic_compare_exchange_strong(&async->error, &none, error);
+  file_async_wake(&async->space_condition, &async->space_waiting);
+}
+
+void* file_async_run(void* arg) {
+  file_async_t* async = arg;
+  size_t request;
+  int error, exit_request;
+
+  while (1) {
+    request = atomic_load(&async->flush_request);
+    exit_request = atomic_load(&async->exit_request);
+
+    file_async_drain(async);
+
+    if (request != atomic_load(&async->flush_done)) {
+      if (!atomic_load(&async->error) &&
+          (error = async->flush(async->file)))
+        file_async_set_error(async, error);
+
+      atomic_store(&async->flush_done, request);
+      file_async_wake(&async->space_condition, &async->space_waiting);
+
+      continue;
+    }
+
+    if (exit_request)
+      break;
+
+    thread_condition_lock(&async->data_condition);
+    atomic_store(&async->data_waiting, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (file_async_empty(async) && !atomic_load(&async->exit_request) &&
+        (atomic_load(&async->flush_request) ==
+          atomic_load(&async->flush_done)))
+      thread_condition_wait(&async->data_condition,
+        THREAD_CONDITION_WAIT_FOREVER);
+
+    atomic_store(&async->data_waiting, 0);
+    thread_condition_unlock(&async->data_condition);
+  }
+
+  return 0;
+}
@@ -0,0 +1,161 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef FILE_ASYNC_H
+#define FILE_ASYNC_H
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "file/file.h"
+
+#include "thread/thread.h"
+
+/** \file file/async.h
+  * \ingroup file
+  * \brief Asynchronous write-behind buffer
+  * \author Ralf Kaestner
+  *
+  * The write-behind buffer decouples the writing thread from the latency
+  * of the underlying stream and its compressor. Written data is copied
+  * into a lock-free single-producer single-consumer ring buffer, from
+  * which a background thread drains it in large chunks. The producer
+  * only ever synchronizes with the background thread if either of them
+  * has to sleep.
+  *
+  * The write-behind buffer is used internally by the file implementation
+  * and should not be required to be accessed directly.
+  */
+
+/** \brief Cache line size assumed for padding the ring buffer indices
+  */
+#define FILE_ASYNC_CACHE_LINE_SIZE              64
+
+/** \brief Write-behind ring buffer segment structure
+  *
+  * The head index is exclusively advanced by the producer and the tail
+  * index by the consumer. Both indices grow monotonically and are reduced
+  * modulo the capacity when accessing the data. Segments are chained only
+  * when the buffer is allowed to grow.
+  */
+typedef struct file_async_segment_t {
+  unsigned char* data;                      //!< The segment data.
+  size_t capacity;                          //!< The segment capacity.
+
+  _Atomic(struct file_async_segment_t*) next; //!< The next segment.
+
+  char head_padding[FILE_ASYNC_CACHE_LINE_SIZE];
+  atomic_size_t head;                       //!< The producer's index.
+  char tail_padding[FILE_ASYNC_CACHE_LINE_SIZE];
+  atomic_size_t tail;                       //!< The consumer's index.
+  char padding[FILE_ASYNC_CACHE_LINE_SIZE];
+} file_async_segment_t;
+
+/** \brief Write-behind buffer structure
+  */
+typedef struct file_async_t {
+  file_t* file;                             //!< The file being written.
+  file_async_policy_t policy;               //!< The buffer overflow policy.
+
+  ssize_t (*write)(file_t*, const unsigned char*, size_t);
+  //!< The function writing to the underlying stream.
+  int (*flush)(file_t*);
+  //!< The function flushing the underlying stream.
+
+  file_async_segment_t* write_segment;      //!< The producer's segment.
+  file_async_segment_t* read_segment;       //!< The consumer's segment.
+
+  thread_t thread;                          //!< The background thread.
+  thread_condition_t data_condition;        //!< Condition signaling data.
+  thread_condition_t space_condition;       //!< Condition signaling space.
+  atomic_int data_waiting;                  //!< The consumer is waiting.
+  atomic_int space_waiting;                 //!< The producer is waiting.
+
+  atomic_size_t flush_request;              //!< The requested flush count.
+  atomic_size_t flush_done;                 //!< The completed flush count.
+  atomic_int exit_request;                  //!< Flag requesting exit.
+  atomic_int error;                         //!< The first write error.
+
+  ssize_t pos;                              //!< The start file position.
+  size_t num_written;                       //!< The number of bytes accepted.
+  atomic_size_t num_dropped;                //!< The number of dropped bytes.
+  atomic_size_t num_dropped_writes;         //!< The number of dropped writes.
+} file_async_t;
+
+/** \brief Start write-behind buffer
+  * \param[in] async The write-behind buffer to be started.
+  * \param[in] file The open file to be written behind.
+  * \param[in] buffer_size The initial capacity of the ring buffer in bytes.
+  * \param[in] policy The policy applied if the ring buffer overflows.
+  * \param[in] write The function writing to the file's underlying stream.
+  *   It will be called exclusively from within the background thread and
+  *   must return the number of bytes written or the negative error code.
+  * \param[in] flush The function flushing the file's underlying stream.
+  *   It will be called exclusively from within the background thread and
+  *   must return the resulting error code.
+  * \return The resulting error code.
+  */
+int file_async_start(
+  file_async_t* async,
+  file_t* file,
+  size_t buffer_size,
+  file_async_policy_t policy,
+  ssize_t (*write)(file_t*, const unsigned char*, size_t),
+  int (*flush)(file_t*));
+
+/** \brief Stop write-behind buffer
+  * \param[in] async The started write-behind buffer to be stopped.
+  * \return The resulting error code.
+  *
+  * All buffered data will be written to the underlying stream before the
+  * background thread terminates.
+  */
+int file_async_stop(
+  file_async_t* async);
+
+/** \brief Write data to write-behind buffer
+  * \param[in] async The started write-behind buffer to write the data to.
+  * \param[in] data An array holding the data to be written.
+  * \param[in] size The requested number of bytes to write.
+  * \return The number of bytes accepted by the buffer or the negative
+  *   error code. Under file_async_policy_drop, zero bytes are accepted
+  *   if the data does not fit into the buffer.
+  *
+  * A write error encountered by the background thread will be reported
+  * by any subsequent write operation.
+  */
+ssize_t file_async_write(
+  file_async_t* async,
+  const unsigned char* data,
+  size_t size);
+
+/** \brief Flush write-behind buffer
+  * \param[in] async The started write-behind buffer to be flushed.
+  * \return The resulting error code.
+  *
+  * The flush operation acts as a barrier: it returns after all data
+  * written before has been passed on to the underlying stream and the
+  * stream has been flushed.
+  */
+int file_async_flush(
+  file_async_t* async);
+
+#endif
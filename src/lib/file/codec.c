@@ -0,0 +1,349 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <string.h>
+
+#include <zstd.h>
+#include <lz4frame.h>
+
+#include "codec.h"
+
+#define FILE_CODEC_LZ4_CHUNK_SIZE               65536
+#define FILE_CODEC_READ_BUFFER_SIZE             131072
+
+int file_codec_fill(file_codec_t* codec);
+int file_codec_drain(file_codec_t* codec);
+int file_codec_end(file_codec_t* codec);
+
+int file_codec_open(file_codec_t* codec, FILE* stream, file_compression_t
+    compression, file_mode_t mode, int level) {
+  LZ4F_preferences_t preferences;
+
+  codec->stream = stream;
+  codec->compression = compression;
+  codec->mode = mode;
+
+  codec->context = 0;
+
+  codec->buffer = 0;
+  codec->buffer_size = 0;
+  codec->buffer_pos = 0;
+  codec->buffer_capacity = 0;
+
+  codec->pos = 0;
+  codec->frame = 0;
+  codec->pending = 0;
+  codec->eof = 0;
+  codec->error = 0;
+
+  if (mode == file_mode_read) {
+    codec->buffer_capacity = FILE_CODEC_READ_BUFFER_SIZE;
+
+    if (compression == file_compression_zstd)
+      codec->context = ZSTD_createDStream();
+    else if ((compression != file_compression_lz4) ||
+        LZ4F_isError(LZ4F_createDecompressionContext(
+          (LZ4F_dctx**)&codec->context, LZ4F_VERSION)))
+      codec->context = 0;
+  }
+  else {
+    if (compression == file_compression_zstd) {
+      codec->buffer_capacity = ZSTD_CStreamOutSize();
+
+      if ((codec->context = ZSTD_createCStream()) &&
+          ZSTD_isError(ZSTD_initCStream(codec->context, level))) {
+        ZSTD_freeCStream(codec->context);
+        codec->context = 0;
+      }
+    }
+    else if (compression == file_compression_lz4) {
+      memset(&preferences, 0, sizeof(preferences));
+      preferences.compressionLevel = level;
+      codec->buffer_capacity = LZ4F_compressBound(
+        FILE_CODEC_LZ4_CHUNK_SIZE, &preferences);
+
+      if (LZ4F_isError(LZ4F_createCompressionContext(
+          (LZ4F_cctx**)&codec->context, LZ4F_VERSION)))
+        codec->context = 0;
+      else {
+        codec->buffer = malloc(codec->buffer_capacity);
+        codec->buffer_size = LZ4F_compressBegin(codec->context,
+          codec->buffer, codec->buffer_capacity, &preferences);
+
+        if (LZ4F_isError(codec->buffer_size)) {
+          LZ4F_freeCompressionContext(codec->context);
+          codec->context = 0;
+        }
+      }
+    }
+  }
+
+  if (!codec->context) {
+    if (codec->buffer)
+      free(codec->buffer);
+    codec->buffer = 0;
+
+    codec->stream = 0;
+    return FILE_ERROR_OPEN;
+  }
+
+  if (!codec->buffer)
+    codec->buffer = malloc(codec->buffer_capacity);
+
+  return FILE_ERROR_NONE;
+}
+
+int file_codec_close(file_codec_t* codec) {
+  int result = FILE_ERROR_NONE;
+
+  if (!codec->stream)
+    return result;
+
+  if (codec->mode != file_mode_read) {
+    if (file_codec_end(codec))
+      result = FILE_ERROR_FLUSH;
+
+    if (codec->compression == file_compression_zstd)
+      ZSTD_freeCStream(codec->context);
+    else
+      LZ4F_freeCompressionContext(codec->context);
+  }
+  else {
+    if (codec->compression == file_compression_zstd)
+      ZSTD_freeDStream(codec->context);
+    else
+      LZ4F_freeDecompressionContext(codec->context);
+  }
+  codec->context = 0;
+
+  free(codec->buffer);
+  codec->buffer = 0;
+
+  if (fclose(codec->stream) && !result)
+    result = FILE_ERROR_FLUSH;
+  codec->stream = 0;
+
+  return result;
+}
+
+ssize_t file_codec_read(file_codec_t* codec, unsigned char* data,
+    size_t size) {
+  size_t num_read = 0, result, dst_size, src_size;
+
+  if (codec->mode != file_mode_read)
+    return -FILE_ERROR_OPERATION;
+
+  while ((num_read < size) && !codec->eof && !codec->error) {
+    if ((codec->buffer_pos == codec->buffer_size) && !codec->pending &&
+        !file_codec_fill(codec))
+      break;
+
+    if (codec->compression == file_compression_zstd) {
+      ZSTD_outBuffer output = {&data[num_read], size-num_read, 0};
+      ZSTD_inBuffer input = {codec->buffer, codec->buffer_size,
+        codec->buffer_pos};
+
+      result = ZSTD_decompressStream(codec->context, &output, &input);
+
+      dst_size = output.pos;
+      codec->buffer_pos = input.pos;
+      codec->error = ZSTD_isError(result);
+    }
+    else {
+      dst_size = size-num_read;
+      src_size = codec->buffer_size-codec->buffer_pos;
+
+      result = LZ4F_decompress(codec->context, &data[num_read], &dst_size,
+        &codec->buffer[codec->buffer_pos], &src_size, 0);
+
+      codec->buffer_pos += src_size;
+      codec->error = LZ4F_isError(result);
+    }
+
+    if (!codec->error) {
+      codec->frame = (result != 0);
+      codec->pending = (dst_size == size-num_read);
+      num_read += dst_size;
+    }
+  }
+
+  codec->pos += num_read;
+
+  if (!num_read && codec->error)
+    return -FILE_ERROR_READ;
+  else
+    return num_read;
+}
+
+ssize_t file_codec_write(file_codec_t* codec, const unsigned char* data,
+    size_t size) {
+  size_t num_written = 0, result, src_size;
+
+  if (codec->mode == file_mode_read)
+    return -FILE_ERROR_OPERATION;
+
+  while (num_written < size) {
+    if (codec->compression == file_compression_zstd) {
+      ZSTD_outBuffer output = {codec->buffer, codec->buffer_capacity,
+        codec->buffer_size};
+      ZSTD_inBuffer input = {data, size, num_written};
+
+      result = ZSTD_compressStream(codec->context, &output, &input);
+      if (ZSTD_isError(result))
+        break;
+
+      codec->buffer_size = output.pos;
+      num_written = input.pos;
+    }
+    else {
+      src_size = (size-num_written < FILE_CODEC_LZ4_CHUNK_SIZE) ?
+        size-num_written : FILE_CODEC_LZ4_CHUNK_SIZE;
+
+      if (codec->buffer_capacity-codec->buffer_size <
+          LZ4F_compressBound(src_size, 0) && file_codec_drain(codec))
+        break;
+
+      result = LZ4F_compressUpdate(codec->context,
+        &codec->buffer[codec->buffer_size],
+        codec->buffer_capacity-codec->buffer_size,
+        &data[num_written], src_size, 0);
+      if (LZ4F_isError(result))
+        break;
+
+      codec->buffer_size += result;
+      num_written += src_size;
+    }
+
+    if ((codec->buffer_size == codec->buffer_capacity) &&
+        file_codec_drain(codec))
+      break;
+  }
+
+  codec->pos += num_written;
+
+  if (num_written < size) {
+    codec->error = 1;
+    if (!num_written)
+      return -FILE_ERROR_WRITE;
+  }
+
+  return num_written;
+}
+
+int file_codec_flush(file_codec_t* codec) {
+  size_t result;
+
+  if (codec->mode == file_mode_read)
+    return FILE_ERROR_OPERATION;
+
+  if (codec->compression == file_compression_zstd) {
+    do {
+      ZSTD_outBuffer output = {codec->buffer, codec->buffer_capacity,
+        codec->buffer_size};
+
+      result = ZSTD_flushStream(codec->context, &output);
+      codec->buffer_size = output.pos;
+
+      if (ZSTD_isError(result) || file_codec_drain(codec))
+        return FILE_ERROR_FLUSH;
+    }
+    while (result);
+  }
+  else {
+    if (codec->buffer_capacity-codec->buffer_size <
+        LZ4F_compressBound(0, 0) && file_codec_drain(codec))
+      return FILE_ERROR_FLUSH;
+
+    result = LZ4F_flush(codec->context, &codec->buffer[codec->buffer_size],
+      codec->buffer_capacity-codec->buffer_size, 0);
+    if (LZ4F_isError(result))
+      return FILE_ERROR_FLUSH;
+    codec->buffer_size += result;
+
+    if (file_codec_drain(codec))
+      return FILE_ERROR_FLUSH;
+  }
+
+  if (fflush(codec->stream))
+    return FILE_ERROR_FLUSH;
+
+  return FILE_ERROR_NONE;
+}
+
+int file_codec_fill(file_codec_t* codec) {
+  codec->buffer_pos = 0;
+  codec->buffer_size = fread(codec->buffer, 1, codec->buffer_capacity,
+    codec->stream);
+
+  if (!codec->buffer_size) {
+    if (ferror(codec->stream) || codec->frame)
+      codec->error = 1;
+    else
+      codec->eof = 1;
+  }
+
+  return codec->buffer_size;
+}
+
+int file_codec_drain(file_codec_t* codec) {
+  if (codec->buffer_size && (fwrite(codec->buffer, codec->buffer_size, 1,
+      codec->stream) != 1)) {
+    codec->error = 1;
+    return FILE_ERROR_WRITE;
+  }
+
+  codec->buffer_size = 0;
+  return FILE_ERROR_NONE;
+}
+
+int file_codec_end(file_codec_t* codec) {
+  size_t result;
+
+  if (codec->compression == file_compression_zstd) {
+    do {
+      ZSTD_outBuffer output = {codec->buffer, codec->buffer_capacity,
+        codec->buffer_size};
+
+      result = ZSTD_endStream(codec->context, &output);
+      codec->buffer_size = output.pos;
+
+      if (ZSTD_isError(result) || file_codec_drain(codec))
+        return FILE_ERROR_FLUSH;
+    }
+    while (result);
+  }
+  else {
+    if (codec->buffer_capacity-codec->buffer_size <
+        LZ4F_compressBound(0, 0) && file_codec_drain(codec))
+      return FILE_ERROR_FLUSH;
+
+    result = LZ4F_compressEnd(codec->context,
+      &codec->buffer[codec->buffer_size],
+      codec->buffer_capacity-codec->buffer_size, 0);
+    if (LZ4F_isError(result))
+      return FILE_ERROR_FLUSH;
+    codec->buffer_size += result;
+
+    if (file_codec_drain(codec))
+      return FILE_ERROR_FLUSH;
+  }
+
+  return FILE_ERROR_NONE;
+}
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef FILE_CODEC_H
+#define FILE_CODEC_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "file/file.h"
+
+/** \file file/codec.h
+  * \ingroup file
+  * \brief Streaming zstd and lz4 codec implementation
+  * \author Ralf Kaestner
+  *
+  * Unlike zlib and libbz2, the zstd and lz4 libraries do not provide
+  * stdio-like file access. The streaming codec therefore implements
+  * buffered compression and decompression of zstd and lz4 frames on top
+  * of an open stream. Concatenated frames, e.g., as resulting from
+  * appending to a compressed file, are decompressed transparently.
+  *
+  * The codec is used internally by the file implementation and should
+  * not be required to be accessed directly.
+  */
+
+/** \brief Streaming codec structure
+  */
+typedef struct file_codec_t {
+  FILE* stream;                     //!< The underlying compressed stream.
+  file_compression_t compression;   //!< The compression of the stream.
+  file_mode_t mode;                 //!< The mode of the stream.
+
+  void* context;                    //!< The opaque codec context.
+
+  unsigned char* buffer;            //!< The compressed data buffer.
+  size_t buffer_size;               //!< The size of the buffered data.
+  size_t buffer_pos;                //!< The position in the buffered data.
+  size_t buffer_capacity;           //!< The capacity of the data buffer.
+
+  ssize_t pos;                      //!< The uncompressed stream position.
+  int frame;                        //!< Flag signaling an incomplete frame.
+  int pending;                      //!< Flag signaling pending output.
+  int eof;                          //!< The end-of-file indicator.
+  int error;                        //!< The codec error indicator.
+} file_codec_t;
+
+/** \brief Open streaming codec
+  * \param[in] codec The streaming codec to be opened.
+  * \param[in] stream The open stream holding the compressed data. On
+  *   success, the codec takes ownership of the stream.
+  * \param[in] compression The compression type of the stream which must
+  *   either be file_compression_zstd or file_compression_lz4.
+  * \param[in] mode The mode of the open stream.
+  * \param[in] level The compression level used for writing, where zero
+  *   requests the codec's default level.
+  * \return The resulting error code.
+  */
+int file_codec_open(
+  file_codec_t* codec,
+  FILE* stream,
+  file_compression_t compression,
+  file_mode_t mode,
+  int level);
+
+/** \brief Close streaming codec
+  * \param[in] codec The open streaming codec to be closed.
+  * \return The resulting error code.
+  *
+  * Closing a codec opened for writing completes the current frame before
+  * the underlying stream is closed.
+  */
+int file_codec_close(
+  file_codec_t* codec);
+
+/** \brief Read uncompressed data from streaming codec
+  * \param[in] codec The open streaming codec to read the data from.
+  * \param[in,out] data An array of sufficient size to hold the read data.
+  * \param[in] size The requested number of bytes to read.
+  * \return The number of bytes actually read or the negative error code.
+  */
+ssize_t file_codec_read(
+  file_codec_t* codec,
+  unsigned char* data,
+  size_t size);
+
+/** \brief Write uncompressed data to streaming codec
+  * \param[in] codec The open streaming codec to write the data to.
+  * \param[in] data An array holding the data to be written.
+  * \param[in] size The requested number of bytes to write.
+  * \return The number of bytes actually written or the negative error code.
+  */
+ssize_t file_codec_write(
+  file_codec_t* codec,
+  const unsigned char* data,
+  size_t size);
+
+/** \brief Flush streaming codec
+  * \param[in] codec The open streaming codec to be flushed.
+  * \return The resulting error code.
+  *
+  * Flushing the codec forces all data written so far to be compressed
+  * and passed on to the underlying stream, such that it may be recovered
+  * by a reader.
+  */
+int file_codec_flush(
+  file_codec_t* codec);
+
+#endif
@@ -20,6 +20,8 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <math.h>
 #include <sys/stat.h>
 
 #include <zlib.h>
@@ -27,9 +29,15 @@
 
 #include "file.h"
 #include "path.h"
+#include "codec.h"
+#include "pipeline.h"
+#include "async.h"
+#include "uring.h"
 
 #include "string/string.h"
 
+#define FILE_FORMAT_DOUBLE_MAX_PRECISION        9
+
 const char* file_errors[] = {
   "Success",
   "No such file",
@@ -47,13 +55,45 @@ const char* file_modes[] = {
   "a",
 };
 
+void file_get_level_mode(const file_t* file, file_mode_t mode, char*
+  level_mode);
+file_codec_t* file_open_codec(file_t* file, FILE* stream, file_mode_t mode);
+int file_start_async(file_t* file, file_mode_t mode);
+ssize_t file_write_handle(file_t* file, const unsigned char* data, size_t
+  size);
+int file_flush_handle(file_t* file);
+ssize_t file_tell_handle(const file_t* file);
+int file_buffers_output(const file_t* file);
+int file_batches_output(const file_t* file);
+void file_reserve_buffer(file_t* file, size_t size);
+ssize_t file_drain_buffer(file_t* file);
+size_t file_format_long(char* str, long value);
+size_t file_format_double(char* str, double value, int precision);
+
 void file_init(file_t* file, const char* filename, file_compression_t
     compression) {
   string_init_copy(&file->name, filename);
   file->handle = 0;
   
   file->compression = compression;
+  file->level = 0;
   file->pos = -1;
+
+  file->num_threads = 0;
+  file->pipeline = 0;
+
+  file->async_buffer_size = 0;
+  file->async_policy = file_async_policy_block;
+  file->async = 0;
+
+  file->uring_depth = 0;
+  file->uring_buffer_size = 0;
+  file->uring_direct = 0;
+  file->uring = 0;
+
+  file->buffer = 0;
+  file->buffer_size = 0;
+  file->buffer_capacity = 0;
   
   error_init(&file->error, file_errors);
 }
@@ -65,12 +105,48 @@ void file_init_name(file_t* file, const char* filename) {
     file->compression = file_compression_gzip;
   else if (string_ends_with(file->name, ".bz2"))
     file->compression = file_compression_bzip2;
+  else if (string_ends_with(file->name, ".zst"))
+    file->compression = file_compression_zstd;
+  else if (string_ends_with(file->name, ".lz4"))
+    file->compression = file_compression_lz4;
+}
+
+void file_set_compression_level(file_t* file, int level) {
+  file->level = level;
+}
+
+void file_set_num_threads(file_t* file, size_t num_threads) {
+  file->num_threads = num_threads;
+}
+
+void file_set_async(file_t* file, size_t buffer_size, file_async_policy_t
+    policy) {
+  file->async_buffer_size = buffer_size;
+  file->async_policy = policy;
+}
+
+void file_set_uring(file_t* file, size_t queue_depth, size_t buffer_size,
+    int direct) {
+  file->uring_depth = queue_depth;
+  file->uring_buffer_size = buffer_size;
+  file->uring_direct = direct;
+}
+
+size_t file_get_num_dropped(const file_t* file, size_t* num_writes) {
+  if (num_writes)
+    *num_writes = file->async ?
+      atomic_load(&file->async->num_dropped_writes) : 0;
+
+  return file->async ? atomic_load(&file->async->num_dropped) : 0;
 }
 
 void file_destroy(file_t* file) {
-  if (file->handle)
+  if (file->handle || file->pipeline || file->uring)
     file_close(file);
   
+  if (file->buffer)
+    free(file->buffer);
+  
   string_destroy(&file->name);
   error_destroy(&file->error);
 }
@@ -141,6 +217,34 @@ ssize_t file_get_size(const file_t* file) {
       }
       else
         return 0;
+    case file_compression_zstd:
+    case file_compression_lz4:
+      if (!file_exists(file))
+        return 0;
+
+      handle = fopen(file->name, file_modes[file_mode_read]);
+      if (handle) {
+        file_codec_t codec;
+        unsigned char buffer[4096];
+        size_t size = 0;
+        ssize_t result;
+
+        if (file_codec_open(&codec, handle, file->compression,
+            file_mode_read, 0)) {
+          fclose(handle);
+          return 0;
+        }
+
+        while ((result = file_codec_read(&codec, buffer,
+            sizeof(buffer))) > 0)
+          size += result;
+
+        file_codec_close(&codec);
+
+        return (result < 0) ? 0 : size;
+      }
+      else
+        return 0;
     default:
       break;
   };
@@ -174,28 +278,72 @@ ssize_t file_get_actual_size(const file_t* file) {
 }
 
 int file_open(file_t* file, file_mode_t mode) {
-  if (file->handle)
+  if (file->handle || file->pipeline || file->uring)
     file_close(file);
 
   error_clear(&file->error);
+
+  if ((file->compression == file_compression_none) && file->uring_depth) {
+    file->uring = malloc(sizeof(file_uring_t));
+    
+    int error = file_uring_open(file->uring, file->name, mode,
+      file->uring_depth, file->uring_buffer_size, file->uring_direct);
+    if (!error)
+      return file_start_async(file, mode);
+    
+    free(file->uring);
+    file->uring = 0;
+    
+    if (error != FILE_ERROR_OPERATION) {
+      error_setf(&file->error, error, file->name);
+      return error_get(&file->error);
+    }
+  }
+
+  if ((mode == file_mode_read) && (file->num_threads > 1)) {
+    file->pipeline = malloc(sizeof(file_pipeline_t));
+    
+    int error = file_pipeline_init(file->pipeline, file->name,
+      file->compression, file->num_threads);
+    if (!error)
+      return error_get(&file->error);
+    
+    free(file->pipeline);
+    file->pipeline = 0;
+    
+    if (error != FILE_ERROR_OPERATION) {
+      error_setf(&file->error, error, file->name);
+      return error_get(&file->error);
+    }
+  }
+  
+  char level_mode[4];
+  file_get_level_mode(file, mode, level_mode);
   
   switch (file->compression) {
     case file_compression_gzip:
-      file->handle = gzopen(file->name, file_modes[mode]);
+      file->handle = gzopen(file->name, level_mode);
       break;
     case file_compression_bzip2:
       if ((mode == file_mode_read) || (mode == file_mode_write)) {
-        file->handle = BZ2_bzopen(file->name, file_modes[mode]);
+        file->handle = BZ2_bzopen(file->name, level_mode);
         if (file->handle)
           file->pos = 0;
       }
       break;
+    case file_compression_zstd:
+    case file_compression_lz4:
+      file->handle = file_open_codec(file, fopen(file->name,
+        file_modes[mode]), mode);
+      break;
     default:
       file->handle = fopen(file->name, file_modes[mode]);
   }
 
   if (!file->handle)
     error_setf(&file->error, FILE_ERROR_OPEN, file->name);
+  else
+    file_start_async(file, mode);
   
   return error_get(&file->error);
 }
@@ -204,29 +352,62 @@ int file_open_stream(file_t* file, FILE* stream, file_mode_t mode) {
   error_clear(&file->error);
   
   int fd = dup(fileno(stream));
+  char level_mode[4];
+  file_get_level_mode(file, mode, level_mode);
   
   switch (file->compression) {
     case file_compression_gzip:
-      file->handle = gzdopen(fd, file_modes[mode]);
+      file->handle = gzdopen(fd, level_mode);
       break;
     case file_compression_bzip2:
       if ((mode == file_mode_read) || (mode == file_mode_write)) {
-        file->handle = BZ2_bzdopen(fd, file_modes[mode]);
+        file->handle = BZ2_bzdopen(fd, level_mode);
         if (file->handle)
           file->pos = 0;
       }
       break;
+    case file_compression_zstd:
+    case file_compression_lz4:
+      file->handle = file_open_codec(file, fdopen(fd, file_modes[mode]),
+        mode);
+      break;
     default:
       file->handle = fdopen(fd, file_modes[mode]);
   }
 
   if (!file->handle)
     error_setf(&file->error, FILE_ERROR_OPEN, file->name);
+  else
+    file_start_async(file, mode);
 
   return error_get(&file->error);  
 }
 
 void file_close(file_t* file) {
+  if (file->buffer_size)
+    file_drain_buffer(file);
+  
+  if (file->async) {
+    file_async_stop(file->async);
+    free(file->async);
+    
+    file->async = 0;
+  }
+  
+  if (file->pipeline) {
+    file_pipeline_destroy(file->pipeline);
+    free(file->pipeline);
+    
+    file->pipeline = 0;
+  }
+  
+  if (file->uring) {
+    file_uring_close(file->uring);
+    free(file->uring);
+    
+    file->uring = 0;
+  }
+  
   if (!file->handle)
     return;
 
@@ -237,6 +418,11 @@ void file_close(file_t* file) {
     case file_compression_bzip2:
       BZ2_bzclose(file->handle);
       break;
+    case file_compression_zstd:
+    case file_compression_lz4:
+      file_codec_close(file->handle);
+      free(file->handle);
+      break;
     default:
       fclose(file->handle);
   }
@@ -246,6 +432,13 @@ void file_close(file_t* file) {
 }
 
 int file_eof(const file_t* file) {
+  if (file->pipeline)
+    return file->pipeline->eof;
+  if (file->async)
+    return 0;
+  if (file->uring)
+    return file->uring->eof;
+  
   if (file->handle) {
     int error;
     
@@ -255,6 +448,9 @@ int file_eof(const file_t* file) {
       case file_compression_bzip2:
         BZ2_bzerror(file->handle, &error);
         return (error == BZ_STREAM_END);
+      case file_compression_zstd:
+      case file_compression_lz4:
+        return ((file_codec_t*)file->handle)->eof;
       default:
         return (feof(file->handle) != 0);
     }
@@ -264,6 +460,13 @@ int file_eof(const file_t* file) {
 }
 
 int file_error(const file_t* file) {
+  if (file->pipeline)
+    return file->pipeline->error;
+  if (file->async)
+    return (atomic_load(&file->async->error) != FILE_ERROR_NONE);
+  if (file->uring)
+    return file->uring->error;
+  
   if (file->handle) {
     int error;
     
@@ -274,6 +477,9 @@ int file_error(const file_t* file) {
       case file_compression_bzip2:
         BZ2_bzerror(file->handle, &error);
         return (error != BZ_OK);
+      case file_compression_zstd:
+      case file_compression_lz4:
+        return ((file_codec_t*)file->handle)->error;
       default:
         return (ferror(file->handle) != 0);
     }
@@ -283,13 +489,27 @@ int file_error(const file_t* file) {
 }
 
 ssize_t file_seek(file_t* file, ssize_t offset, file_whence_t whence) {
-  if (!file->handle) {
+  if (!file->handle && !file->pipeline && !file->uring) {
     error_set(&file->error, FILE_ERROR_OPERATION);
     return -error_get(&file->error);
   }
 
   error_clear(&file->error);
   
+  ssize_t result;
+  if (file->buffer_size && ((result = file_drain_buffer(file)) < 0)) {
+    error_setf(&file->error, -result, file->name);
+    return -error_get(&file->error);
+  }
+  
+  if (file->async) {
+    int error = file_async_flush(file->async);
+    if (error) {
+      error_setf(&file->error, error, file->name);
+      return -error_get(&file->error);
+    }
+  }
+  
   int whence_int;
   switch (whence) {
     case file_whence_end:
@@ -302,7 +522,77 @@ ssize_t file_seek(file_t* file, ssize_t offset, file_whence_t whence) {
       whence_int = SEEK_SET;
   };
   
-  ssize_t pos, result;
+  file_codec_t* codec;
+  ssize_t pos;
+  if (file->uring) {
+    switch (whence) {
+      case file_whence_end:
+        pos = file->uring->size+offset;
+        break;
+      case file_whence_current:
+        pos = file->uring->pos+offset;
+        break;
+      default:
+        pos = offset;
+    };
+    
+    int error = file_uring_seek(file->uring, pos);
+    if (error) {
+      error_setf(&file->error, error, file->name);
+      return -error_get(&file->error);
+    }
+    
+    if (file->async) {
+      file->async->pos = pos;
+      file->async->num_written = 0;
+    }
+    
+    return pos;
+  }
+  else if (file->pipeline) {
+    switch (whence) {
+      case file_whence_end:
+        pos = file_get_size(file)+offset;
+        break;
+      case file_whence_current:
+        pos = file->pipeline->pos+offset;
+        break;
+      default:
+        pos = offset;
+    };
+    
+    if (pos >= file->pipeline->pos) {
+      unsigned char buffer[4096];
+      ssize_t num_read = 0;
+      
+      while ((file->pipeline->pos < pos) && ((num_read = file_pipeline_read(
+          file->pipeline, buffer, sizeof(buffer) < pos-file->pipeline->pos ?
+          sizeof(buffer) : pos-file->pipeline->pos)) > 0));
+      
+      if (num_read < 0) {
+        error_setf(&file->error, FILE_ERROR_READ, file->name);
+        return -error_get(&file->error);
+      }
+      else
+        return file->pipeline->pos;
+    }
+    else if (file->compression == file_compression_gzip) {
+      file_close(file);
+      
+      if (!(file->handle = gzopen(file->name, file_modes[file_mode_read]))) {
+        error_setf(&file->error, FILE_ERROR_OPEN, file->name);
+        return -error_get(&file->error);
+      }
+      
+      offset = pos;
+      whence_int = SEEK_SET;
+    }
+    else {
+      error_set(&file->error, FILE_ERROR_SEEK);
+      return -error_get(&file->error);
+    }
+  }
+  
   switch (file->compression) {
     case file_compression_gzip:
       if ((result = gzseek(file->handle, offset, whence_int)) < 0) {
@@ -346,6 +636,41 @@ ssize_t file_seek(file_t* file, ssize_t offset, file_whence_t whence) {
         return -error_get(&file->error);
       }
         
+      break;
+    case file_compression_zstd:
+    case file_compression_lz4:
+      codec = file->handle;
+      switch (whence) {
+        case file_whence_end:
+          pos = file_get_size(file)+offset;
+          break;
+        case file_whence_current:
+          pos = codec->pos+offset;
+          break;
+        default:
+          pos = offset;
+      };
+      
+      if (pos >= codec->pos) {
+        unsigned char buffer[4096];
+        ssize_t num_read = 0;
+
+        while ((codec->pos < pos) && ((num_read = file_codec_read(codec,
+          buffer, sizeof(buffer) < pos-codec->pos ? sizeof(buffer) :
+          pos-codec->pos)) > 0));
+          
+        if (num_read < 0) {
+          error_setf(&file->error, FILE_ERROR_READ, file->name);
+          return -error_get(&file->error);
+        }
+        else
+          result = codec->pos;
+      }
+      else {
+        error_set(&file->error, FILE_ERROR_SEEK);
+        return -error_get(&file->error);
+      }
+        
       break;
     default:
       if (!fseek(file->handle, offset, whence_int)) {
@@ -360,10 +685,29 @@ ssize_t file_seek(file_t* file, ssize_t offset, file_whence_t whence) {
       }
   }
 
+  if (file->async) {
+    file->async->pos = result;
+    file->async->num_written = 0;
+  }
+  
   return result;
 }
 
 ssize_t file_tell(const file_t* file) {
+  ssize_t result = file_tell_handle(file);
+  
+  return (result >= 0) ? result+file->buffer_size : result;
+}
+
+ssize_t file_tell_handle(const file_t* file) {
+  if (file->pipeline)
+    return file->pipeline->pos;
+  if (file->async)
+    return (file->async->pos >= 0) ?
+      file->async->pos+file->async->num_written : -1;
+  if (file->uring)
+    return file->uring->pos;
+  
   if (file->handle) {
     ssize_t result;
     
@@ -374,6 +718,9 @@ ssize_t file_tell(const file_t* file) {
         break;
       case file_compression_bzip2:
         return file->pos;
+      case file_compression_zstd:
+      case file_compression_lz4:
+        return ((file_codec_t*)file->handle)->pos;
       default:
         if ((result = ftell(file->handle)) >= 0)
           return result;
@@ -384,7 +731,7 @@ ssize_t file_tell(const file_t* file) {
 }
 
 ssize_t file_read(file_t* file, unsigned char* data, size_t size) {
-  if (!file->handle) {
+  if (!file->handle && !file->pipeline && !file->uring) {
     error_set(&file->error, FILE_ERROR_OPERATION);
     return -error_get(&file->error);
   }
@@ -392,6 +739,23 @@ ssize_t file_read(file_t* file, unsigned char* data, size_t size) {
   error_clear(&file->error);
   
   ssize_t result;
+  if (file->pipeline) {
+    if ((result = file_pipeline_read(file->pipeline, data, size)) <= 0) {
+      error_setf(&file->error, FILE_ERROR_READ, file->name);
+      return -error_get(&file->error);
+    }
+    
+    return result;
+  }
+  else if (file->uring) {
+    if ((result = file_uring_read(file->uring, data, size)) < 0) {
+      error_setf(&file->error, FILE_ERROR_READ, file->name);
+      return -error_get(&file->error);
+    }
+    
+    return result;
+  }
+  
   switch (file->compression) {
     case file_compression_gzip:
       if ((result = gzread(file->handle, data, size)) <= 0) {
@@ -407,8 +771,15 @@ ssize_t file_read(file_t* file, unsigned char* data, size_t size) {
       else
         file->pos += result;
       break;
+    case file_compression_zstd:
+    case file_compression_lz4:
+      if ((result = file_codec_read(file->handle, data, size)) <= 0) {
+        error_setf(&file->error, FILE_ERROR_READ, file->name);
+        return -error_get(&file->error);
+      }
+      break;
     default:
-      if (!(result = fread(data, size, 1, file->handle)) &&
+      if (!(result = fread(data, 1, size, file->handle)) &&
           ferror(file->handle)) {
         error_setf(&file->error, FILE_ERROR_READ, file->name);
         return -error_get(&file->error);
@@ -419,34 +790,27 @@ ssize_t file_read(file_t* file, unsigned char* data, size_t size) {
 }
 
 ssize_t file_write(file_t* file, const unsigned char* data, size_t size) {
-  if (!file->handle) {
+  if (!file->handle && !file->uring) {
     error_set(&file->error, FILE_ERROR_OPERATION);
     return -error_get(&file->error);
   }
 
   error_clear(&file->error);
   
-  ssize_t result;
-  switch (file->compression) {
-    case file_compression_gzip:
-      if (!(result = gzwrite(file->handle, data, size))) {
-        error_setf(&file->error, FILE_ERROR_WRITE, file->name);
-        return -error_get(&file->error);
-      }
-      break;
-    case file_compression_bzip2:
-      if (!(result = BZ2_bzwrite(file->handle, (unsigned char*)data, size))) {
-        error_setf(&file->error, FILE_ERROR_WRITE, file->name);
-        return -error_get(&file->error);
-      }
-      else
-        file->pos += result;
-      break;
-    default:
-      if (!(result = fwrite(data, size, 1, file->handle))) {
-        error_setf(&file->error, FILE_ERROR_WRITE, file->name);
-        return -error_get(&file->error);
-      }
+  ssize_t result = 0;
+  if (file->buffer_size)
+    result = file_drain_buffer(file);
+  
+  if (result >= 0) {
+    if (file->async)
+      result = file_async_write(file->async, data, size);
+    else
+      result = file_write_handle(file, data, size);
+  }
+  
+  if (result < 0) {
+    error_setf(&file->error, -result, file->name);
+    return -error_get(&file->error);
   }
   
   return result;
@@ -481,7 +845,7 @@ ssize_t file_read_line(file_t* file, char** line, size_t block_size) {
 }
 
 ssize_t file_printf(file_t* file, const char* format, ...) {
-  if (!file->handle) {
+  if (!file->handle && !file->uring) {
     error_set(&file->error, FILE_ERROR_OPERATION);
     return -error_get(&file->error);
   }
@@ -490,61 +854,373 @@ ssize_t file_printf(file_t* file, const char* format, ...) {
   
   va_list vargs;  
   ssize_t result;  
-  if ((file->compression == file_compression_gzip) ||
-      (file->compression == file_compression_bzip2)) {
-    size_t size = 256;
+  if (file_buffers_output(file)) {
     while (1) {
-      char buffer[size];
-      
       va_start(vargs, format);
-      result = vsnprintf(buffer, size, format, vargs);
+      result = vsnprintf(&file->buffer[file->buffer_size],
+        file->buffer_capacity-file->buffer_size, format, vargs);
       va_end(vargs);
       
-      if ((result > -1) && (result < size)) {
-        result = file_write(file, (unsigned char*)buffer,
-          string_length(buffer));
+      if (result < 0) {
+        error_setf(&file->error, FILE_ERROR_WRITE, file->name);
+        return -error_get(&file->error);
+      }
+      else if (file->buffer_size+result < file->buffer_capacity) {
+        file->buffer_size += result;
         break;
       }
       
-      if (result > -1)
-        size = result+1;
-      else
-        size *= 2;
-    }  
+      file_reserve_buffer(file, result+1);
+    }
+    
+    if (!file_batches_output(file) ||
+        (file->buffer_size >= FILE_BUFFER_BATCH_SIZE)) {
+      ssize_t error = file_drain_buffer(file);
+      
+      if (error < 0) {
+        error_setf(&file->error, -error, file->name);
+        return -error_get(&file->error);
+      }
+    }
   }
   else {
     va_start(vargs, format);
-    if ((result = vfprintf(file->handle, format, vargs)) <= 0) {
+    result = vfprintf(file->handle, format, vargs);
+    va_end(vargs);
+    
+    if (result <= 0) {
       error_setf(&file->error, FILE_ERROR_WRITE, file->name);
       return -error_get(&file->error);
     }
-    va_end(vargs);
+  }
+  
+  return result;
+}
+
+ssize_t file_write_doubles(file_t* file, const double* values, size_t
+    num_values, int precision, const char* separator) {
+  if (!file->handle && !file->uring) {
+    error_set(&file->error, FILE_ERROR_OPERATION);
+    return -error_get(&file->error);
+  }
+
+  error_clear(&file->error);
+  
+  size_t separator_length = string_length(separator), i;
+  size_t size = file->buffer_size;
+  ssize_t result;
+  
+  if (precision < 0)
+    precision = 6;
+  
+  for (i = 0; i < num_values; ++i) {
+    if (i) {
+      file_reserve_buffer(file, separator_length);
+      memcpy(&file->buffer[file->buffer_size], separator, separator_length);
+      file->buffer_size += separator_length;
+    }
+    
+    if (fabs(values[i]) < 1e18) {
+      file_reserve_buffer(file, precision+24);
+      file->buffer_size += file_format_double(
+        &file->buffer[file->buffer_size], values[i], precision);
+    }
+    else {
+      result = snprintf(0, 0, "%.*f", precision, values[i]);
+      file_reserve_buffer(file, result+1);
+      file->buffer_size += sprintf(&file->buffer[file->buffer_size],
+        "%.*f", precision, values[i]);
+    }
+  }
+  
+  file_reserve_buffer(file, 1);
+  file->buffer[file->buffer_size++] = '\n';
+  result = file->buffer_size-size;
+  
+  if (!file_batches_output(file) ||
+      (file->buffer_size >= FILE_BUFFER_BATCH_SIZE)) {
+    ssize_t error = file_drain_buffer(file);
+    
+    if (error < 0) {
+      error_setf(&file->error, -error, file->name);
+      return -error_get(&file->error);
+    }
+  }
+  
+  return result;
+}
+
+ssize_t file_write_longs(file_t* file, const long* values, size_t
+    num_values, const char* separator) {
+  if (!file->handle && !file->uring) {
+    error_set(&file->error, FILE_ERROR_OPERATION);
+    return -error_get(&file->error);
+  }
+
+  error_clear(&file->error);
+  
+  size_t separator_length = string_length(separator), i;
+  size_t size = file->buffer_size;
+  ssize_t result;
+  
+  file_reserve_buffer(file, num_values*(separator_length+21)+1);
+  
+  for (i = 0; i < num_values; ++i) {
+    if (i) {
+      memcpy(&file->buffer[file->buffer_size], separator, separator_length);
+      file->buffer_size += separator_length;
+    }
+    
+    file->buffer_size += file_format_long(&file->buffer[file->buffer_size],
+      values[i]);
+  }
+  
+  file->buffer[file->buffer_size++] = '\n';
+  result = file->buffer_size-size;
+  
+  if (!file_batches_output(file) ||
+      (file->buffer_size >= FILE_BUFFER_BATCH_SIZE)) {
+    ssize_t error = file_drain_buffer(file);
+    
+    if (error < 0) {
+      error_setf(&file->error, -error, file->name);
+      return -error_get(&file->error);
+    }
   }
   
   return result;
 }
 
 int file_flush(file_t* file) {
- if (!file->handle) {
+ if (!file->handle && !file->uring) {
     error_set(&file->error, FILE_ERROR_OPERATION);
     return error_get(&file->error);
  }
 
   error_clear(&file->error);
   
+  int error = FILE_ERROR_NONE;
+  ssize_t result = 0;
+  if (file->buffer_size && ((result = file_drain_buffer(file)) < 0))
+    error = -result;
+  else if (file->async)
+    error = file_async_flush(file->async);
+  else
+    error = file_flush_handle(file);
+  
+  if (error)
+    error_setf(&file->error, error, file->name);
+  
+  return error_get(&file->error);
+}
+
+void file_get_level_mode(const file_t* file, file_mode_t mode, char*
+    level_mode) {
+  if ((mode != file_mode_read) && (file->level > 0) && (file->level < 10))
+    sprintf(level_mode, "%s%d", file_modes[mode], file->level);
+  else
+    sprintf(level_mode, "%s", file_modes[mode]);
+}
+
+file_codec_t* file_open_codec(file_t* file, FILE* stream, file_mode_t mode) {
+  file_codec_t* codec = 0;
+  
+  if (stream) {
+    codec = malloc(sizeof(file_codec_t));
+    
+    if (file_codec_open(codec, stream, file->compression, mode,
+        file->level)) {
+      fclose(stream);
+      
+      free(codec);
+      codec = 0;
+    }
+  }
+  
+  return codec;
+}
+
+int file_start_async(file_t* file, file_mode_t mode) {
+  if ((mode == file_mode_read) || !file->async_buffer_size)
+    return error_get(&file->error);
+  
+  file_async_t* async = malloc(sizeof(file_async_t));
+  
+  if (file_async_start(async, file, file->async_buffer_size,
+      file->async_policy, file_write_handle, file_flush_handle)) {
+    free(async);
+    
+    file_close(file);
+    error_setf(&file->error, FILE_ERROR_OPEN, file->name);
+  }
+  else
+    file->async = async;
+  
+  return error_get(&file->error);
+}
+
+ssize_t file_write_handle(file_t* file, const unsigned char* data, size_t
+    size) {
+  ssize_t result;
+  
+  if (file->uring)
+    return file_uring_write(file->uring, data, size);
+  
+  switch (file->compression) {
+    case file_compression_gzip:
+      if (!(result = gzwrite(file->handle, data, size)))
+        return -FILE_ERROR_WRITE;
+      break;
+    case file_compression_bzip2:
+      if (!(result = BZ2_bzwrite(file->handle, (unsigned char*)data, size)))
+        return -FILE_ERROR_WRITE;
+      else
+        file->pos += result;
+      break;
+    case file_compression_zstd:
+    case file_compression_lz4:
+      if ((result = file_codec_write(file->handle, data, size)) <= 0)
+        return -FILE_ERROR_WRITE;
+      break;
+    default:
+      if ((result = fwrite(data, 1, size, file->handle)) < size)
+        return -FILE_ERROR_WRITE;
+  }
+  
+  return result;
+}
+
+int file_flush_handle(file_t* file) {
+  if (file->uring)
+    return file_uring_flush(file->uring);
+  
   switch (file->compression) {
     case file_compression_gzip:
       if (gzflush(file->handle, Z_SYNC_FLUSH) != Z_OK)
-        error_setf(&file->error, FILE_ERROR_FLUSH, file->name);
+        return FILE_ERROR_FLUSH;
       break;
     case file_compression_bzip2:
       if (BZ2_bzflush(file->handle))
-        error_setf(&file->error, FILE_ERROR_FLUSH, file->name);
+        return FILE_ERROR_FLUSH;
+      break;
+    case file_compression_zstd:
+    case file_compression_lz4:
+      if (file_codec_flush(file->handle))
+        return FILE_ERROR_FLUSH;
       break;
     default:
       if (fflush(file->handle))
-        error_setf(&file->error, FILE_ERROR_FLUSH, file->name);
+        return FILE_ERROR_FLUSH;
   }
   
-  return error_get(&file->error);
+  return FILE_ERROR_NONE;
+}
+
+int file_buffers_output(const file_t* file) {
+  return (file->compression != file_compression_none) || file->async ||
+    file->uring;
+}
+
+int file_batches_output(const file_t* file) {
+  return ((file->compression != file_compression_none) || file->uring) &&
+    !file->async;
+}
+
+void file_reserve_buffer(file_t* file, size_t size) {
+  if (file->buffer_size+size > file->buffer_capacity) {
+    file->buffer_capacity = file->buffer_capacity ?
+      2*file->buffer_capacity : 256;
+    if (file->buffer_capacity < file->buffer_size+size)
+      file->buffer_capacity = file->buffer_size+size;
+    
+    file->buffer = realloc(file->buffer, file->buffer_capacity);
+  }
+}
+
+ssize_t file_drain_buffer(file_t* file) {
+  ssize_t result;
+  
+  if (file->async)
+    result = file_async_write(file->async, (unsigned char*)file->buffer,
+      file->buffer_size);
+  else
+    result = file_write_handle(file, (unsigned char*)file->buffer,
+      file->buffer_size);
+  
+  file->buffer_size = 0;
+  
+  return result;
+}
+
+size_t file_format_long(char* str, long value) {
+  char digits[20];
+  unsigned long magnitude = (value < 0) ? -(unsigned long)value : value;
+  size_t length = 0, num_digits = 0;
+  
+  if (value < 0)
+    str[length++] = '-';
+  
+  do {
+    digits[num_digits++] = '0'+magnitude%10;
+    magnitude /= 10;
+  }
+  while (magnitude);
+  
+  while (num_digits)
+    str[length++] = digits[--num_digits];
+  
+  return length;
+}
+
+size_t file_format_double(char* str, double value, int precision) {
+  static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+    1e7, 1e8, 1e9};
+  char digits[20];
+  unsigned long long integer, fraction;
+  size_t length = 0, num_digits;
+  double magnitude = fabs(value), scaled;
+  int i;
+  
+  if (isnan(value))
+    return sprintf(str, "%s", signbit(value) ? "-nan" : "nan");
+  
+  if (signbit(value))
+    str[length++] = '-';
+  
+  if ((precision > FILE_FORMAT_DOUBLE_MAX_PRECISION) || (magnitude >= 1e18))
+    return length+sprintf(&str[length], "%.*f", precision, magnitude);
+  
+  integer = magnitude;
+  scaled = (magnitude-integer)*powers[precision];
+  fraction = scaled;
+  
+  if (fabs(scaled-fraction-0.5) < 1e-6)
+    return length+sprintf(&str[length], "%.*f", precision, magnitude);
+  if (scaled-fraction > 0.5)
+    ++fraction;
+  if (fraction >= powers[precision]) {
+    fraction = 0;
+    ++integer;
+  }
+  
+  num_digits = 0;
+  do {
+    digits[num_digits++] = '0'+integer%10;
+    integer /= 10;
+  }
+  while (integer);
+  
+  while (num_digits)
+    str[length++] = digits[--num_digits];
+  
+  if (precision > 0) {
+    str[length++] = '.';
+    for (i = precision-1; i >= 0; --i) {
+      str[length+i] = '0'+fraction%10;
+      fraction /= 10;
+    }
+    length += precision;
+  }
+  
+  return length;
 }
@@ -40,7 +40,11 @@
   * 
   * In addition to standard file input/ouput operations, this implementation
   * opaquely manages gzip-compressed and bzip2-compressed files through the
-  * same interface.
+  * same interface. Fast zstd and lz4 compression is provided for files
+  * which require high data rates. Compressed files which are opened for
+  * reading may further be decompressed in parallel by a read-ahead
+  * pipeline, whereas files opened for writing may be written behind by
+  * a background thread.
   */
 
 /** \name Error Codes
@@ -65,6 +69,10 @@
 //!< Illegal file operation
 //@}
 
+/** \brief Size of formatted output collected before it is written
+  */
+#define FILE_BUFFER_BATCH_SIZE                  65536
+
 /** \brief Predefined file error descriptions
   */
 extern const char* file_errors[];
@@ -74,7 +82,9 @@ extern const char* file_errors[];
 typedef enum {
   file_compression_none,        //!< File is not compressed.
   file_compression_gzip,        //!< File is gzip-compressed.
-  file_compression_bzip2        //!< File is bzip2-compressed.
+  file_compression_bzip2,       //!< File is bzip2-compressed.
+  file_compression_zstd,        //!< File is zstd-compressed.
+  file_compression_lz4          //!< File is lz4-compressed.
 } file_compression_t;
 
 /** \brief File modes
@@ -89,6 +99,14 @@ typedef enum {
   */
 extern const char* file_modes[];
 
+/** \brief Asynchronous write buffer overflow policies
+  */
+typedef enum {
+  file_async_policy_block,      //!< Writing blocks until space is available.
+  file_async_policy_drop,       //!< Data which does not fit is dropped.
+  file_async_policy_grow        //!< The buffer grows to fit the data.
+} file_async_policy_t;
+
 /** \brief File whence indicators
   */
 typedef enum {
@@ -104,8 +122,25 @@ typedef struct file_t {
   void* handle;                     //!< The opaque handle of the file.
 
   file_compression_t compression;   //!< The compression of the file.
+  int level;                        //!< The compression level of the file.
 
   ssize_t pos;                      //!< The bzip2-file position indicator.
+
+  size_t num_threads;               //!< The number of read-ahead threads.
+  struct file_pipeline_t* pipeline; //!< The read-ahead pipeline of the file.
+
+  size_t async_buffer_size;         //!< The size of the write-behind buffer.
+  file_async_policy_t async_policy; //!< The write-behind overflow policy.
+  struct file_async_t* async;       //!< The write-behind buffer of the file.
+
+  size_t uring_depth;               //!< The io_uring queue depth.
+  size_t uring_buffer_size;         //!< The size of the io_uring buffers.
+  int uring_direct;                 //!< Flag requesting O_DIRECT access.
+  struct file_uring_t* uring;       //!< The io_uring backend of the file.
+
+  char* buffer;                     //!< The formatted output buffer.
+  size_t buffer_size;               //!< The size of the buffered output.
+  size_t buffer_capacity;           //!< The capacity of the output buffer.
   
   error_t error;                    //!< The most recent file error.
 } file_t;
@@ -125,12 +160,95 @@ void file_init(
   * \param[in] filename The name of the file to be initialized.
   * 
   * This initializer will infer the file's compression type from the
-  * presented filename.
+  * presented filename. Recognized suffixes are .gz, .bz2, .zst, and .lz4.
   */
 void file_init_name(
   file_t* file,
   const char* filename);
 
+/** \brief Set the compression level
+  * \param[in] file The initialized file to set the compression level for.
+  * \param[in] level The compression level to be used when writing the
+  *   file. Valid levels range from 1 to 9 for gzip-compressed and
+  *   bzip2-compressed files, from 1 to 22 for zstd-compressed files, and
+  *   from 1 to 12 for lz4-compressed files. Level 0 requests the default
+  *   level of the respective compression.
+  * 
+  * The setting takes effect when the file is opened for writing next.
+  */
+void file_set_compression_level(
+  file_t* file,
+  int level);
+
+/** \brief Set the number of read-ahead decompression threads
+  * \param[in] file The initialized file to set the number of threads for.
+  * \param[in] num_threads The number of compressed blocks to be
+  *   decompressed concurrently when the file is opened for reading. If
+  *   the number of threads is smaller than 2, the file will be decompressed
+  *   sequentially.
+  * 
+  * The setting takes effect when the file is opened next. Note that only
+  * bzip2-compressed files and gzip-compressed files with multiple members
+  * may be decompressed in parallel. For all other files, this setting is
+  * being ignored.
+  */
+void file_set_num_threads(
+  file_t* file,
+  size_t num_threads);
+
+/** \brief Enable or disable asynchronous writing
+  * \param[in] file The initialized file to set the write-behind buffer for.
+  * \param[in] buffer_size The size of the write-behind buffer in bytes. A
+  *   size of zero disables asynchronous writing.
+  * \param[in] policy The policy to be applied if written data does not
+  *   fit into the write-behind buffer.
+  * 
+  * When writing asynchronously, file_write() and file_printf() merely
+  * copy the data into the write-behind buffer, and a background thread
+  * passes it on to the possibly compressed file. Errors encountered by the
+  * background thread will be reported by subsequent write operations, and
+  * file_flush() returns only after all data written before has reached
+  * the file. The setting takes effect when the file is opened for writing
+  * or appending next.
+  */
+void file_set_async(
+  file_t* file,
+  size_t buffer_size,
+  file_async_policy_t policy);
+
+/** \brief Enable or disable the io_uring backend
+  * \param[in] file The initialized file to set the io_uring backend for.
+  * \param[in] queue_depth The maximum number of outstanding read or write
+  *   requests. A queue depth of zero disables the io_uring backend.
+  * \param[in] buffer_size The size of each request's buffer in bytes. The
+  *   size will be rounded up to a multiple of the block alignment.
+  * \param[in] direct If non-zero, the file will be accessed with O_DIRECT,
+  *   thus bypassing the page cache.
+  * 
+  * The io_uring backend only applies to uncompressed files opened with
+  * file_open(). If the running kernel or the file system do not provide
+  * the requested features, the file will be accessed through the standard
+  * stream functions instead. The setting takes effect when the file is
+  * opened next.
+  */
+void file_set_uring(
+  file_t* file,
+  size_t queue_depth,
+  size_t buffer_size,
+  int direct);
+
+/** \brief Retrieve the number of bytes dropped by asynchronous writing
+  * \param[in] file The open file to retrieve the number of dropped
+  *   bytes for.
+  * \param[out] num_writes If not null, the number of dropped write
+  *   operations will be returned here.
+  * \return The number of bytes which have been dropped since the file was
+  *   opened, according to file_async_policy_drop.
+  */
+size_t file_get_num_dropped(
+  const file_t* file,
+  size_t* num_writes);
+
 /** \brief Destroy file
   * \param[in] file The file to be destroyed.
   * 
@@ -230,7 +348,10 @@ int file_error(
   * \note Depending on the file compression and the relative requested
   *   file position, the function may have to uncompress all data up to
   *   this position. Seeking reversely from the current file position is
-  *   further unsupported for bzip2-compressed files.
+  *   further unsupported for bzip2-compressed, zstd-compressed, and
+  *   lz4-compressed files. For gzip-compressed
+  *   files being decompressed in parallel, seeking reversely falls back to
+  *   sequential decompression.
   * \param[in] file The open file to set the file position indicator for.
   * \param[in] offset The offset of the file position pointer in bytes.
   * \param[in] whence The whence indicator of the seek operation.
@@ -300,15 +421,66 @@ ssize_t file_read_line(
   *   type.
   * \return The number of characters written to the file or the negative
   *   error code.
+  * 
+  * The data is formatted into an output buffer owned by the file. For
+  * compressed files and files being written through io_uring, the buffer
+  * further collects small records into larger writes. Buffered records
+  * are passed on to the file as soon as the buffer exceeds
+  * FILE_BUFFER_BATCH_SIZE, or when writing, seeking, flushing, or closing
+  * the file. Files being written asynchronously pass each record on to
+  * their ring buffer immediately, such that the drop policy discards
+  * individual records.
   */
 ssize_t file_printf(
   file_t* file,
   const char* format,
   ...);
 
+/** \brief Write a row of floating point values to file
+  * \param[in] file The open file to write the values to.
+  * \param[in] values An array holding the values to be written.
+  * \param[in] num_values The number of values to be written.
+  * \param[in] precision The number of digits to be written after the
+  *   decimal point of each value.
+  * \param[in] separator The string separating consecutive values.
+  * \return The number of characters written to the file or the negative
+  *   error code.
+  * 
+  * The values are written in the decimal notation of the printf-style
+  * conversion \%.*f, followed by a new-line character. Since the
+  * conversion bypasses the formatting functions of the standard library,
+  * this function is considerably faster than file_printf().
+  */
+ssize_t file_write_doubles(
+  file_t* file,
+  const double* values,
+  size_t num_values,
+  int precision,
+  const char* separator);
+
+/** \brief Write a row of integer values to file
+  * \param[in] file The open file to write the values to.
+  * \param[in] values An array holding the values to be written.
+  * \param[in] num_values The number of values to be written.
+  * \param[in] separator The string separating consecutive values.
+  * \return The number of characters written to the file or the negative
+  *   error code.
+  * 
+  * The values are written in decimal notation, followed by a new-line
+  * character.
+  */
+ssize_t file_write_longs(
+  file_t* file,
+  const long* values,
+  size_t num_values,
+  const char* separator);
+
 /** \brief Write buffered data to file
   * \param[in] file The open file to flush.
   * \return The resulting error code.
+  * 
+  * For a file being written asynchronously, this function blocks until
+  * all data written before has been passed on to the file.
   */
 int file_flush(
   file_t* file);
@@ -19,9 +19,52 @@
  ***************************************************************************/
 
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <fnmatch.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include "path.h"
+#include "file.h"
+
+#include "thread/thread.h"
+
+/* Raw directory entry as returned by the getdents64 system call */
+typedef struct file_path_dirent_t {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+} file_path_dirent_t;
+
+/* Shared state of the threads walking a directory tree */
+typedef struct file_path_walker_t {
+  thread_condition_t condition;
+  char** directories;
+  size_t num_directories;
+  size_t capacity;
+  size_t num_busy;
+  const char* pattern;
+} file_path_walker_t;
+
+/* State of a single thread walking a directory tree */
+typedef struct file_path_worker_t {
+  thread_t thread;
+  file_path_walker_t* walker;
+  file_path_list_t list;
+} file_path_worker_t;
+
+file_path_type_t file_path_get_type(int fd, const char* name, unsigned char
+  d_type);
+void file_path_walk_push(file_path_walker_t* walker, const char* directory,
+  const char* name);
+void file_path_walk_directory(file_path_walker_t* walker, file_path_list_t*
+  list, const char* directory);
+void* file_path_walk_run(void* arg);
+void file_path_list_merge(file_path_list_t* list, file_path_list_t* source);
 
 int file_path_exits(const char* path) {
   struct stat stat_buffer;
@@ -39,3 +82,334 @@ int file_path_is_directory(const char* path) {
   return ((stat(path, &stat_buffer) == 0) &&
     S_ISDIR(stat_buffer.st_mode));
 }
+
+int file_path_iterator_init(file_path_iterator_t* iterator, const char* path,
+    const char* pattern) {
+  if ((iterator->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+    return file_path_exits(path) ? FILE_ERROR_OPEN : FILE_ERROR_NOT_FOUND;
+
+  iterator->pattern = pattern ? strdup(pattern) : 0;
+
+  iterator->buffer = malloc(FILE_PATH_ITERATOR_BUFFER_SIZE);
+  iterator->buffer_size = 0;
+  iterator->buffer_pos = 0;
+
+  iterator->entry.name = 0;
+  iterator->entry.type = file_path_type_unknown;
+
+  return FILE_ERROR_NONE;
+}
+
+void file_path_iterator_destroy(file_path_iterator_t* iterator) {
+  if (iterator->fd >= 0)
+    close(iterator->fd);
+  iterator->fd = -1;
+
+  if (iterator->pattern)
+    free(iterator->pattern);
+  iterator->pattern = 0;
+
+  if (iterator->buffer)
+    free(iterator->buffer);
+  iterator->buffer = 0;
+}
+
+const file_path_entry_t* file_path_iterator_next(file_path_iterator_t*
+    iterator) {
+  file_path_dirent_t* dirent;
+  long result;
+
+  while (1) {
+    if (iterator->buffer_pos >= iterator->buffer_size) {
+      result = syscall(SYS_getdents64, iterator->fd, iterator->buffer,
+        FILE_PATH_ITERATOR_BUFFER_SIZE);
+      if (result <= 0)
+        return 0;
+
+      iterator->buffer_size = result;
+      iterator->buffer_pos = 0;
+    }
+
+    dirent = (file_path_dirent_t*)&iterator->buffer[iterator->buffer_pos];
+    iterator->buffer_pos += dirent->d_reclen;
+
+    if ((dirent->d_name[0] == '.') && (!dirent->d_name[1] ||
+        ((dirent->d_name[1] == '.') && !dirent->d_name[2])))
+      continue;
+    if (iterator->pattern && fnmatch(iterator->pattern, dirent->d_name, 0))
+      continue;
+
+    iterator->entry.name = dirent->d_name;
+    iterator->entry.type = file_path_get_type(iterator->fd, dirent->d_name,
+      dirent->d_type);
+
+    return &iterator->entry;
+  }
+}
+
+void file_path_list_init(file_path_list_t* list) {
+  list->entries = 0;
+  list->num_entries = 0;
+  list->capacity = 0;
+
+  list->chunks = 0;
+  list->num_chunks = 0;
+  list->chunk_pos = 0;
+}
+
+void file_path_list_destroy(file_path_list_t* list) {
+  size_t i;
+
+  for (i = 0; i < list->num_chunks; ++i)
+    free(list->chunks[i]);
+
+  if (list->chunks)
+    free(list->chunks);
+  if (list->entries)
+    free(list->entries);
+
+  file_path_list_init(list);
+}
+
+const file_path_entry_t* file_path_list_add(file_path_list_t* list, const
+    char* directory, const char* name, file_path_type_t type) {
+  size_t directory_length = directory ? strlen(directory) : 0;
+  size_t name_length = strlen(name), length;
+  char* string;
+
+  if (directory_length && (directory[directory_length-1] == '/'))
+    --directory_length;
+  length = directory_length+(directory ? 1 : 0)+name_length+1;
+
+  if (!list->num_chunks || (list->chunk_pos+length >
+      FILE_PATH_LIST_CHUNK_SIZE)) {
+    list->chunks = realloc(list->chunks, (list->num_chunks+1)*sizeof(char*));
+    list->chunks[list->num_chunks++] = malloc(
+      length > FILE_PATH_LIST_CHUNK_SIZE ? length : FILE_PATH_LIST_CHUNK_SIZE);
+    list->chunk_pos = 0;
+  }
+
+  string = &list->chunks[list->num_chunks-1][list->chunk_pos];
+  list->chunk_pos += length;
+
+  if (directory) {
+    memcpy(string, directory, directory_length);
+    string[directory_length] = '/';
+    memcpy(&string[directory_length+1], name, name_length+1);
+  }
+  else
+    memcpy(string, name, name_length+1);
+
+  if (list->num_entries == list->capacity) {
+    list->capacity = list->capacity ? 2*list->capacity : 256;
+    list->entries = realloc(list->entries, list->capacity*
+      sizeof(file_path_entry_t));
+  }
+
+  list->entries[list->num_entries].name = string;
+  list->entries[list->num_entries].type = type;
+
+  return &list->entries[list->num_entries++];
+}
+
+ssize_t file_path_walk(file_path_list_t* list, const char* path, const char*
+    pattern, size_t num_threads) {
+  file_path_walker_t walker;
+  size_t num_entries = list->num_entries, i;
+
+  if (!file_path_is_directory(path))
+    return -FILE_ERROR_NOT_FOUND;
+
+  thread_condition_init(&walker.condition);
+  walker.directories = 0;
+  walker.num_directories = 0;
+  walker.capacity = 0;
+  walker.num_busy = 0;
+  walker.pattern = pattern;
+
+  file_path_walk_push(&walker, 0, path);
+
+  if (num_threads > 1) {
+    file_path_worker_t workers[num_threads];
+
+    for (i = 0; i < num_threads; ++i) {
+      workers[i].walker = &walker;
+      file_path_list_init(&workers[i].list);
+
+      if (thread_start(&workers[i].thread, file_path_walk_run, 0,
+          &workers[i], 0.0))
+        break;
+    }
+
+    if (!i) {
+      file_path_walk_run(&workers[0]);
+      file_path_list_merge(list, &workers[0].list);
+    }
+
+    while (i) {
+      --i;
+      thread_wait_exit(&workers[i].thread);
+
+      file_path_list_merge(list, &workers[i].list);
+    }
+  }
+  else {
+    file_path_worker_t worker;
+
+    worker.walker = &walker;
+    file_path_list_init(&worker.list);
+    file_path_walk_run(&worker);
+
+    file_path_list_merge(list, &worker.list);
+  }
+
+  if (walker.directories)
+    free(walker.directories);
+  thread_condition_destroy(&walker.condition);
+
+  return list->num_entries-num_entries;
+}
+
+file_path_type_t file_path_get_type(int fd, const char* name, unsigned char
+    d_type) {
+  struct stat stat_buffer;
+
+  switch (d_type) {
+    case DT_REG:
+      return file_path_type_file;
+    case DT_DIR:
+      return file_path_type_directory;
+    case DT_LNK:
+      return file_path_type_link;
+    case DT_UNKNOWN:
+      if (fstatat(fd, name, &stat_buffer, AT_SYMLINK_NOFOLLOW))
+        return file_path_type_unknown;
+      else if (S_ISREG(stat_buffer.st_mode))
+        return file_path_type_file;
+      else if (S_ISDIR(stat_buffer.st_mode))
+        return file_path_type_directory;
+      else if (S_ISLNK(stat_buffer.st_mode))
+        return file_path_type_link;
+      else
+        return file_path_type_other;
+    default:
+      return file_path_type_other;
+  }
+}
+
+void file_path_walk_push(file_path_walker_t* walker, const char* directory,
+    const char* name) {
+  size_t directory_length = directory ? strlen(directory) : 0;
+  char* path = malloc(directory_length+strlen(name)+2);
+
+  if (directory_length && (directory[directory_length-1] == '/'))
+    --directory_length;
+
+  if (directory) {
+    memcpy(path, directory, directory_length);
+    path[directory_length] = '/';
+    strcpy(&path[directory_length+1], name);
+  }
+  else
+    strcpy(path, name);
+
+  thread_condition_lock(&walker->condition);
+
+  if (walker->num_directories == walker->capacity) {
+    walker->capacity = walker->capacity ? 2*walker->capacity : 64;
+    walker->directories = realloc(walker->directories, walker->capacity*
+      sizeof(char*));
+  }
+  walker->directories[walker->num_directories++] = path;
+
+  thread_condition_signal(&walker->condition);
+  thread_condition_unlock(&walker->condition);
+}
+
+void file_path_walk_directory(file_path_walker_t* walker, file_path_list_t*
+    list, const char* directory) {
+  file_path_iterator_t iterator;
+  const file_path_entry_t* entry;
+
+  if (file_path_iterator_init(&iterator, directory, 0))
+    return;
+
+  while ((entry = file_path_iterator_next(&iterator))) {
+    if (entry->type == file_path_type_directory)
+      file_path_walk_push(walker, directory, entry->name);
+    else if (!walker->pattern || !fnmatch(walker->pattern, entry->name, 0))
+      file_path_list_add(list, directory, entry->name, entry->type);
+  }
+
+  file_path_iterator_destroy(&iterator);
+}
+
+void* file_path_walk_run(void* arg) {
+  file_path_worker_t* worker = arg;
+  file_path_walker_t* walker = worker->walker;
+  char* directory;
+
+  thread_condition_lock(&walker->condition);
+
+  while (1) {
+    if (walker->num_directories) {
+      directory = walker->directories[--walker->num_directories];
+      ++walker->num_busy;
+      thread_condition_unlock(&walker->condition);
+
+      file_path_walk_directory(walker, &worker->list, directory);
+      free(directory);
+
+      thread_condition_lock(&walker->condition);
+      --walker->num_busy;
+    }
+    else if (!walker->num_busy) {
+      thread_condition_broadcast(&walker->condition);
+      break;
+    }
+    else
+      thread_condition_wait(&walker->condition,
+        THREAD_CONDITION_WAIT_FOREVER);
+  }
+
+  thread_condition_unlock(&walker->condition);
+
+  return 0;
+}
+
+void file_path_list_merge(file_path_list_t* list, file_path_list_t* source) {
+  if (!list->num_chunks && !list->num_entries) {
+    *list = *source;
+    file_path_list_init(source);
+
+    return;
+  }
+
+  if (list->num_entries+source->num_entries > list->capacity) {
+    list->capacity = list->num_entries+source->num_entries;
+    list->entries = realloc(list->entries, list->capacity*
+      sizeof(file_path_entry_t));
+  }
+  memcpy(&list->entries[list->num_entries], source->entries,
+    source->num_entries*sizeof(file_path_entry_t));
+  list->num_entries += source->num_entries;
+
+  if (source->num_chunks) {
+    list->chunks = realloc(list->chunks, (list->num_chunks+
+      source->num_chunks)*sizeof(char*));
+    memcpy(&list->chunks[list->num_chunks], source->chunks,
+      source->num_chunks*sizeof(char*));
+    list->num_chunks += source->num_chunks;
+
+    list->chunks[list->num_chunks-1] = list->chunks[list->num_chunks-
+      source->num_chunks-1];
+    list->chunks[list->num_chunks-source->num_chunks-1] =
+      source->chunks[source->num_chunks-1];
+  }
+
+  if (source->entries)
+    free(source->entries);
+  if (source->chunks)
+    free(source->chunks);
+  file_path_list_init(source);
+}
@@ -22,6 +22,7 @@
 #define FILE_PATH_H
 
 #include <stdlib.h>
+#include <unistd.h>
 
 /** \file file/path.h
   * \ingroup file
@@ -29,9 +30,67 @@
   * \author Ralf Kaestner
   * 
   * The current filesystem path interface provides very basic access to
-  * the filesystem status related to path names.
+  * the filesystem status related to path names. In addition, directories
+  * may be scanned by an iterator which reads the directory entries in
+  * large batches and reports their types without querying the status
+  * of each entry. Entire directory trees may be enumerated by a walker
+  * which distributes the subdirectories among multiple threads.
   */
 
+/** \brief Size of the buffer holding the raw directory entries
+  */
+#define FILE_PATH_ITERATOR_BUFFER_SIZE          32768
+
+/** \brief Size of the memory chunks holding the names of listed paths
+  */
+#define FILE_PATH_LIST_CHUNK_SIZE               65536
+
+/** \brief Path type
+  */
+typedef enum {
+  file_path_type_unknown,       //!< Path type is unknown.
+  file_path_type_file,          //!< Path points to a regular file.
+  file_path_type_directory,     //!< Path points to a directory.
+  file_path_type_link,          //!< Path is a symbolic link.
+  file_path_type_other          //!< Path points to a special file.
+} file_path_type_t;
+
+/** \brief Path entry structure
+  */
+typedef struct file_path_entry_t {
+  const char* name;             //!< The name of the entry.
+  file_path_type_t type;        //!< The type of the entry.
+} file_path_entry_t;
+
+/** \brief Directory iterator structure
+  */
+typedef struct file_path_iterator_t {
+  int fd;                       //!< The directory file descriptor.
+  char* pattern;                //!< The glob pattern filtering the entries.
+
+  unsigned char* buffer;        //!< The buffer of raw directory entries.
+  size_t buffer_size;           //!< The size of the buffered entries.
+  size_t buffer_pos;            //!< The position in the buffered entries.
+
+  file_path_entry_t entry;      //!< The current entry.
+} file_path_iterator_t;
+
+/** \brief Path list structure
+  * 
+  * The entry names of a path list are allocated from a small number of
+  * large memory chunks which are released at once when the list is
+  * destroyed.
+  */
+typedef struct file_path_list_t {
+  file_path_entry_t* entries;   //!< The listed entries.
+  size_t num_entries;           //!< The number of listed entries.
+  size_t capacity;              //!< The capacity of the entry array.
+
+  char** chunks;                //!< The memory chunks holding the names.
+  size_t num_chunks;            //!< The number of memory chunks.
+  size_t chunk_pos;             //!< The position in the last chunk.
+} file_path_list_t;
+
 /** \brief Check if path exists
   * \note This function is ignorant about the type of file the path is
   *   pointing to.
@@ -55,4 +114,83 @@ int file_path_is_file(
 int file_path_is_directory(
   const char* path);
 
+/** \brief Initialize directory iterator
+  * \param[in] iterator The directory iterator to be initialized.
+  * \param[in] path The path of the directory to be scanned.
+  * \param[in] pattern The optional glob pattern which the names of the
+  *   reported entries must match, e.g., "*.gz". If null, all entries will
+  *   be reported.
+  * \return The resulting error code.
+  */
+int file_path_iterator_init(
+  file_path_iterator_t* iterator,
+  const char* path,
+  const char* pattern);
+
+/** \brief Destroy directory iterator
+  * \param[in] iterator The initialized directory iterator to be destroyed.
+  */
+void file_path_iterator_destroy(
+  file_path_iterator_t* iterator);
+
+/** \brief Advance directory iterator
+  * \param[in] iterator The initialized directory iterator to be advanced.
+  * \return The next directory entry or null if the directory does not
+  *   hold any more entries. The entry remains valid until the iterator is
+  *   advanced or destroyed. The entries "." and ".." are never reported.
+  * 
+  * If the file system does not report an entry's type along with its
+  * name, the type will be determined from the status of the entry.
+  */
+const file_path_entry_t* file_path_iterator_next(
+  file_path_iterator_t* iterator);
+
+/** \brief Initialize path list
+  * \param[in] list The path list to be initialized.
+  */
+void file_path_list_init(
+  file_path_list_t* list);
+
+/** \brief Destroy path list
+  * \param[in] list The initialized path list to be destroyed.
+  */
+void file_path_list_destroy(
+  file_path_list_t* list);
+
+/** \brief Add entry to path list
+  * \param[in] list The initialized path list to add the entry to.
+  * \param[in] directory The optional directory name to be prepended to
+  *   the entry name, separated by a slash.
+  * \param[in] name The name of the entry to be added.
+  * \param[in] type The type of the entry to be added.
+  * \return The added list entry.
+  */
+const file_path_entry_t* file_path_list_add(
+  file_path_list_t* list,
+  const char* directory,
+  const char* name,
+  file_path_type_t type);
+
+/** \brief Recursively enumerate a directory tree
+  * \param[in] list The initialized path list to add the entries to.
+  * \param[in] path The path of the root directory of the tree.
+  * \param[in] pattern The optional glob pattern which the names of the
+  *   listed entries must match. If null, all entries will be listed.
+  * \param[in] num_threads The number of threads scanning subdirectories
+  *   concurrently. If the number of threads is smaller than 2, the tree
+  *   will be scanned by the calling thread.
+  * \return The number of entries added to the list or the negative error
+  *   code.
+  * 
+  * The path of each listed entry is prefixed by the root path. All entries
+  * except for directories are listed, and symbolic links are not followed.
+  * Subdirectories which cannot be opened are skipped silently. The order of
+  * the listed entries is unspecified.
+  */
+ssize_t file_path_walk(
+  file_path_list_t* list,
+  const char* path,
+  const char* pattern,
+  size_t num_threads);
+
 #endif
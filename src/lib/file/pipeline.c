@@ -0,0 +1,474 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+#include <bzlib.h>
+
+#include "pipeline.h"
+
+#define FILE_PIPELINE_BZIP2_BLOCK_MAGIC         0x314159265359ULL
+#define FILE_PIPELINE_BZIP2_EOS_MAGIC           0x177245385090ULL
+#define FILE_PIPELINE_BZIP2_MAGIC_BITS          48
+#define FILE_PIPELINE_BZIP2_MAX_MERGES          16
+
+#define FILE_PIPELINE_MIN_CAPACITY              65536
+#define FILE_PIPELINE_MAX_LOOKAHEAD             (1UL << 24)
+
+int file_pipeline_bzip2_scan(const unsigned char* input, size_t input_size,
+  size_t offset, size_t* magic_offset, int* block);
+int file_pipeline_gzip_scan(const unsigned char* input, size_t input_size,
+  size_t offset, size_t* member_offset);
+int file_pipeline_next(file_pipeline_t* pipeline, size_t* start,
+  size_t* end);
+void file_pipeline_fill(file_pipeline_t* pipeline);
+void file_pipeline_release(file_pipeline_t* pipeline);
+int file_pipeline_advance(file_pipeline_t* pipeline);
+void* file_pipeline_block_decompress(void* arg);
+int file_pipeline_block_bzip2(file_pipeline_block_t* block);
+int file_pipeline_block_gzip(file_pipeline_block_t* block);
+void file_pipeline_block_reserve(file_pipeline_block_t* block);
+
+int file_pipeline_init(file_pipeline_t* pipeline, const char* filename,
+    file_compression_t compression, size_t num_threads) {
+  struct stat stat_buffer;
+  size_t member_offset;
+  int i;
+
+  pipeline->fd = -1;
+  pipeline->input = 0;
+  pipeline->input_size = 0;
+  pipeline->compression = compression;
+
+  pipeline->scan_pos = 0;
+  pipeline->input_pos = 0;
+
+  pipeline->blocks = 0;
+  pipeline->num_blocks = 0;
+  pipeline->first_block = 0;
+  pipeline->num_pending = 0;
+  pipeline->block_pos = 0;
+
+  pipeline->pos = 0;
+  pipeline->eof = 0;
+  pipeline->error = 0;
+
+  if ((num_threads < 2) || ((compression != file_compression_gzip) &&
+      (compression != file_compression_bzip2)))
+    return FILE_ERROR_OPERATION;
+
+  if ((pipeline->fd = open(filename, O_RDONLY)) < 0)
+    return FILE_ERROR_OPEN;
+
+  if (fstat(pipeline->fd, &stat_buffer) || !S_ISREG(stat_buffer.st_mode) ||
+      !stat_buffer.st_size) {
+    file_pipeline_destroy(pipeline);
+    return FILE_ERROR_OPERATION;
+  }
+
+  pipeline->input_size = stat_buffer.st_size;
+  pipeline->input = mmap(0, pipeline->input_size, PROT_READ, MAP_PRIVATE,
+    pipeline->fd, 0);
+  if (pipeline->input == MAP_FAILED) {
+    pipeline->input = 0;
+    file_pipeline_destroy(pipeline);
+    return FILE_ERROR_OPEN;
+  }
+  madvise((void*)pipeline->input, pipeline->input_size, MADV_SEQUENTIAL);
+
+  if ((compression == file_compression_gzip) &&
+      (!file_pipeline_gzip_scan(pipeline->input, pipeline->input_size, 1,
+        &member_offset))) {
+    file_pipeline_destroy(pipeline);
+    return FILE_ERROR_OPERATION;
+  }
+
+  pipeline->num_blocks = num_threads;
+  pipeline->blocks = malloc(num_threads*sizeof(file_pipeline_block_t));
+  for (i = 0; i < num_threads; ++i) {
+    pipeline->blocks[i].running = 0;
+
+    pipeline->blocks[i].input = pipeline->input;
+    pipeline->blocks[i].input_size = pipeline->input_size;
+    pipeline->blocks[i].compression = compression;
+
+    pipeline->blocks[i].start = 0;
+    pipeline->blocks[i].end = 0;
+    pipeline->blocks[i].max_size = 0;
+
+    pipeline->blocks[i].data = 0;
+    pipeline->blocks[i].size = 0;
+    pipeline->blocks[i].capacity = 0;
+
+    pipeline->blocks[i].error = FILE_ERROR_NONE;
+  }
+
+  return FILE_ERROR_NONE;
+}
+
+void file_pipeline_destroy(file_pipeline_t* pipeline) {
+  int i;
+
+  for (i = 0; i < pipeline->num_blocks; ++i) {
+    if (pipeline->blocks[i].running)
+      thread_wait_exit(&pipeline->blocks[i].thread);
+    if (pipeline->blocks[i].data)
+      free(pipeline->blocks[i].data);
+  }
+
+  if (pipeline->blocks) {
+    free(pipeline->blocks);
+    pipeline->blocks = 0;
+  }
+  pipeline->num_blocks = 0;
+  pipeline->num_pending = 0;
+
+  if (pipeline->input) {
+    munmap((void*)pipeline->input, pipeline->input_size);
+    pipeline->input = 0;
+  }
+  pipeline->input_size = 0;
+
+  if (pipeline->fd >= 0) {
+    close(pipeline->fd);
+    pipeline->fd = -1;
+  }
+}
+
+ssize_t file_pipeline_read(file_pipeline_t* pipeline, unsigned char* data,
+    size_t size) {
+  size_t num_read = 0;
+
+  while ((num_read < size) && !pipeline->eof && !pipeline->error) {
+    if (!pipeline->block_pos && file_pipeline_advance(pipeline))
+      break;
+
+    file_pipeline_block_t* block =
+      &pipeline->blocks[pipeline->first_block];
+    size_t num_copied = block->size-pipeline->block_pos;
+    if (num_copied > size-num_read)
+      num_copied = size-num_read;
+
+    memcpy(&data[num_read], &block->data[pipeline->block_pos], num_copied);
+    num_read += num_copied;
+    pipeline->block_pos += num_copied;
+    pipeline->pos += num_copied;
+
+    if (pipeline->block_pos == block->size) {
+      file_pipeline_release(pipeline);
+      file_pipeline_fill(pipeline);
+    }
+  }
+
+  if (!num_read && pipeline->error)
+    return -FILE_ERROR_READ;
+  else
+    return num_read;
+}
+
+int file_pipeline_bzip2_scan(const unsigned char* input, size_t input_size,
+    size_t offset, size_t* magic_offset, int* block) {
+  uint64_t bits = 0;
+  size_t i, end;
+  int shift;
+
+  for (i = offset/8; i < input_size; ++i) {
+    bits = (bits << 8) | input[i];
+
+    for (shift = 7; shift >= 0; --shift) {
+      end = i*8+8-shift;
+      if (end < offset+FILE_PIPELINE_BZIP2_MAGIC_BITS)
+        continue;
+
+      uint64_t magic = (bits >> shift) & 0xffffffffffffULL;
+      if ((magic == FILE_PIPELINE_BZIP2_BLOCK_MAGIC) ||
+          (magic == FILE_PIPELINE_BZIP2_EOS_MAGIC)) {
+        *magic_offset = end-FILE_PIPELINE_BZIP2_MAGIC_BITS;
+        *block = (magic == FILE_PIPELINE_BZIP2_BLOCK_MAGIC);
+
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int file_pipeline_gzip_scan(const unsigned char* input, size_t input_size,
+    size_t offset, size_t* member_offset) {
+  const unsigned char* member;
+
+  while ((offset+10 < input_size) &&
+      (member = memchr(&input[offset], 0x1f, input_size-offset-10))) {
+    offset = member-input;
+
+    if ((member[1] == 0x8b) && (member[2] == Z_DEFLATED) &&
+        !(member[3] & 0xe0) && !(member[8] & ~0x06) &&
+        ((member[9] <= 13) || (member[9] == 255))) {
+      *member_offset = offset;
+      return 1;
+    }
+
+    ++offset;
+  }
+
+  return 0;
+}
+
+int file_pipeline_next(file_pipeline_t* pipeline, size_t* start,
+    size_t* end) {
+  size_t offset = pipeline->scan_pos;
+  int block = 0;
+
+  if (pipeline->compression == file_compression_bzip2) {
+    while (!block) {
+      if (!file_pipeline_bzip2_scan(pipeline->input, pipeline->input_size,
+          offset, start, &block))
+        return 0;
+      offset = *start+FILE_PIPELINE_BZIP2_MAGIC_BITS;
+    }
+
+    if (!file_pipeline_bzip2_scan(pipeline->input, pipeline->input_size,
+        offset, end, &block))
+      *end = pipeline->input_size*8;
+    pipeline->scan_pos = *end;
+  }
+  else {
+    if (!file_pipeline_gzip_scan(pipeline->input, pipeline->input_size,
+        offset, start))
+      return 0;
+
+    *end = *start;
+    pipeline->scan_pos = *start+1;
+  }
+
+  return 1;
+}
+
+void file_pipeline_fill(file_pipeline_t* pipeline) {
+  size_t start, end;
+
+  while ((pipeline->num_pending < pipeline->num_blocks) &&
+      file_pipeline_next(pipeline, &start, &end)) {
+    file_pipeline_block_t* block = &pipeline->blocks[
+      (pipeline->first_block+pipeline->num_pending) % pipeline->num_blocks];
+
+    block->start = start;
+    block->end = end;
+    block->max_size = (start > pipeline->input_pos) ?
+      FILE_PIPELINE_MAX_LOOKAHEAD : 0;
+    block->size = 0;
+    block->error = FILE_ERROR_NONE;
+
+    if (!thread_start(&block->thread, file_pipeline_block_decompress, 0,
+        block, 0.0))
+      block->running = 1;
+    else
+      file_pipeline_block_decompress(block);
+
+    ++pipeline->num_pending;
+  }
+}
+
+void file_pipeline_release(file_pipeline_t* pipeline) {
+  pipeline->first_block = (pipeline->first_block+1) % pipeline->num_blocks;
+  --pipeline->num_pending;
+  pipeline->block_pos = 0;
+}
+
+int file_pipeline_advance(file_pipeline_t* pipeline) {
+  size_t end;
+  int block_magic, i;
+
+  while (1) {
+    file_pipeline_fill(pipeline);
+
+    if (!pipeline->num_pending) {
+      pipeline->eof = 1;
+      return 1;
+    }
+
+    file_pipeline_block_t* block =
+      &pipeline->blocks[pipeline->first_block];
+    if (block->running) {
+      thread_wait_exit(&block->thread);
+      block->running = 0;
+    }
+
+    if (block->start < pipeline->input_pos) {
+      file_pipeline_release(pipeline);
+      continue;
+    }
+
+    if (pipeline->compression == file_compression_bzip2) {
+      for (i = 0; block->error && (i < FILE_PIPELINE_BZIP2_MAX_MERGES) &&
+          file_pipeline_bzip2_scan(pipeline->input, pipeline->input_size,
+            block->end+1, &end, &block_magic); ++i) {
+        block->end = end;
+        block->size = 0;
+        block->error = FILE_ERROR_NONE;
+
+        file_pipeline_block_decompress(block);
+      }
+    }
+    else if (block->start > pipeline->input_pos) {
+      pipeline->eof = 1;
+      return 1;
+    }
+    else if (block->max_size && (block->size >= block->max_size)) {
+      block->max_size = 0;
+      block->size = 0;
+      block->error = FILE_ERROR_NONE;
+
+      file_pipeline_block_decompress(block);
+    }
+
+    if (block->error) {
+      pipeline->error = 1;
+      return 1;
+    }
+
+    pipeline->input_pos = block->end;
+    if (block->size)
+      return 0;
+
+    file_pipeline_release(pipeline);
+  }
+}
+
+void* file_pipeline_block_decompress(void* arg) {
+  file_pipeline_block_t* block = arg;
+
+  if (block->compression == file_compression_bzip2)
+    block->error = file_pipeline_block_bzip2(block);
+  else
+    block->error = file_pipeline_block_gzip(block);
+
+  return 0;
+}
+
+int file_pipeline_block_bzip2(file_pipeline_block_t* block) {
+  size_t num_bits = block->end-block->start;
+  size_t stream_size = 4+(num_bits+80+7)/8;
+  unsigned char* stream = calloc(stream_size, 1);
+  unsigned char* stream_bits = &stream[4];
+  uint64_t crc = 0, eos = FILE_PIPELINE_BZIP2_EOS_MAGIC;
+  size_t i, j, bit;
+  int shift, result;
+
+  memcpy(stream, "BZh9", 4);
+
+  for (i = 0; i < (num_bits+7)/8; ++i) {
+    j = (block->start+8*i)/8;
+    shift = (block->start+8*i)%8;
+
+    stream_bits[i] = block->input[j] << shift;
+    if (shift && (j+1 < block->input_size))
+      stream_bits[i] |= block->input[j+1] >> (8-shift);
+  }
+  if (num_bits % 8)
+    stream_bits[num_bits/8] &= 0xff << (8-num_bits%8);
+
+  for (i = 0; i < 32; ++i) {
+    bit = block->start+FILE_PIPELINE_BZIP2_MAGIC_BITS+i;
+    crc = (crc << 1) | ((bit < block->end) ?
+      (block->input[bit/8] >> (7-bit%8)) & 1 : 0);
+  }
+  for (i = 0; i < 80; ++i, ++num_bits)
+    if ((i < FILE_PIPELINE_BZIP2_MAGIC_BITS) ?
+        (eos >> (FILE_PIPELINE_BZIP2_MAGIC_BITS-1-i)) & 1 :
+        (crc >> (79-i)) & 1)
+      stream_bits[num_bits/8] |= 0x80 >> (num_bits%8);
+
+  bz_stream bz_stream;
+  memset(&bz_stream, 0, sizeof(bz_stream));
+  if (BZ2_bzDecompressInit(&bz_stream, 0, 0) != BZ_OK) {
+    free(stream);
+    return FILE_ERROR_READ;
+  }
+
+  bz_stream.next_in = (char*)stream;
+  bz_stream.avail_in = stream_size;
+
+  do {
+    file_pipeline_block_reserve(block);
+
+    bz_stream.next_out = (char*)&block->data[block->size];
+    bz_stream.avail_out = block->capacity-block->size;
+
+    result = BZ2_bzDecompress(&bz_stream);
+    block->size = block->capacity-bz_stream.avail_out;
+  }
+  while ((result == BZ_OK) && (bz_stream.avail_in || !bz_stream.avail_out));
+
+  BZ2_bzDecompressEnd(&bz_stream);
+  free(stream);
+
+  return (result == BZ_STREAM_END) ? FILE_ERROR_NONE : FILE_ERROR_READ;
+}
+
+int file_pipeline_block_gzip(file_pipeline_block_t* block) {
+  size_t offset = block->start;
+  int result;
+
+  z_stream z_stream;
+  memset(&z_stream, 0, sizeof(z_stream));
+  if (inflateInit2(&z_stream, 16+MAX_WBITS) != Z_OK)
+    return FILE_ERROR_READ;
+
+  do {
+    if (!z_stream.avail_in) {
+      z_stream.next_in = (unsigned char*)&block->input[offset];
+      z_stream.avail_in = (block->input_size-offset < (1UL << 30)) ?
+        block->input_size-offset : (1UL << 30);
+      offset += z_stream.avail_in;
+    }
+
+    file_pipeline_block_reserve(block);
+
+    z_stream.next_out = &block->data[block->size];
+    z_stream.avail_out = block->capacity-block->size;
+
+    result = inflate(&z_stream, Z_NO_FLUSH);
+    block->size = block->capacity-z_stream.avail_out;
+  }
+  while ((result == Z_OK) && (z_stream.avail_in || !z_stream.avail_out ||
+    (offset < block->input_size)) && (!block->max_size ||
+    (block->size < block->max_size)));
+
+  block->end = offset-z_stream.avail_in;
+  inflateEnd(&z_stream);
+
+  return (result == Z_STREAM_END) ? FILE_ERROR_NONE : FILE_ERROR_READ;
+}
+
+void file_pipeline_block_reserve(file_pipeline_block_t* block) {
+  if (block->size < block->capacity)
+    return;
+
+  block->capacity = (block->capacity < FILE_PIPELINE_MIN_CAPACITY) ?
+    FILE_PIPELINE_MIN_CAPACITY : 2*block->capacity;
+  block->data = realloc(block->data, block->capacity);
+}
@@ -0,0 +1,131 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef FILE_PIPELINE_H
+#define FILE_PIPELINE_H
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "file/file.h"
+
+#include "thread/thread.h"
+
+/** \file file/pipeline.h
+  * \ingroup file
+  * \brief Parallel read-ahead decompression pipeline
+  * \author Ralf Kaestner
+  *
+  * The read-ahead pipeline decompresses independent chunks of a compressed
+  * file concurrently and delivers the uncompressed data in the original
+  * order. For bzip2-compressed files, the chunks are the compressed blocks
+  * which are located by scanning the file for the bit-aligned block magic.
+  * For gzip-compressed files, the chunks are the file's members. Since
+  * each member is decompressed into memory, the pipeline is only employed
+  * for gzip-compressed files with multiple members. Members are located
+  * by their header, which may also occur within the data of a preceding
+  * member, so members ahead of the read position are decompressed
+  * speculatively into a limited look-ahead buffer only. A member
+  * exceeding the limit is decompressed again once it has been confirmed
+  * to start at the end of the preceding member.
+  *
+  * The pipeline is used internally by the file implementation and should
+  * not be required to be accessed directly.
+  */
+
+/** \brief Pipeline block structure
+  */
+typedef struct file_pipeline_block_t {
+  thread_t thread;                     //!< The decompressing thread.
+  int running;                         //!< Flag signaling a running thread.
+
+  const unsigned char* input;          //!< The compressed file data.
+  size_t input_size;                   //!< The size of the compressed data.
+  file_compression_t compression;      //!< The compression of the block.
+
+  size_t start;                        //!< The start offset of the block.
+  size_t end;                          //!< The end offset of the block.
+  size_t max_size;                     //!< The look-ahead limit, or zero.
+
+  unsigned char* data;                 //!< The uncompressed block data.
+  size_t size;                         //!< The size of the uncompressed data.
+  size_t capacity;                     //!< The capacity of the data buffer.
+
+  int error;                           //!< The decompression error code.
+} file_pipeline_block_t;
+
+/** \brief Pipeline structure
+  */
+typedef struct file_pipeline_t {
+  int fd;                              //!< The file descriptor.
+  const unsigned char* input;          //!< The memory-mapped file data.
+  size_t input_size;                   //!< The size of the file data.
+  file_compression_t compression;      //!< The compression of the file.
+
+  size_t scan_pos;                     //!< The offset of the block scanner.
+  size_t input_pos;                    //!< The offset of the next block.
+
+  file_pipeline_block_t* blocks;       //!< The reorder buffer of blocks.
+  size_t num_blocks;                   //!< The number of buffered blocks.
+  size_t first_block;                  //!< The index of the first block.
+  size_t num_pending;                  //!< The number of pending blocks.
+  size_t block_pos;                    //!< The position in the first block.
+
+  ssize_t pos;                         //!< The uncompressed file position.
+  int eof;                             //!< The end-of-file indicator.
+  int error;                           //!< The pipeline error indicator.
+} file_pipeline_t;
+
+/** \brief Initialize pipeline
+  * \param[in] pipeline The pipeline to be initialized.
+  * \param[in] filename The name of the compressed file to be read.
+  * \param[in] compression The compression type of the file.
+  * \param[in] num_threads The number of blocks being decompressed
+  *   concurrently.
+  * \return The resulting error code. If the file does not qualify for
+  *   parallel decompression, FILE_ERROR_OPERATION will be returned.
+  */
+int file_pipeline_init(
+  file_pipeline_t* pipeline,
+  const char* filename,
+  file_compression_t compression,
+  size_t num_threads);
+
+/** \brief Destroy pipeline
+  * \param[in] pipeline The initialized pipeline to be destroyed.
+  *
+  * Pending blocks will be waited for before the pipeline is destroyed.
+  */
+void file_pipeline_destroy(
+  file_pipeline_t* pipeline);
+
+/** \brief Read uncompressed data from pipeline
+  * \param[in] pipeline The initialized pipeline to read the data from.
+  * \param[in,out] data An array of sufficient size to hold the read data.
+  * \param[in] size The requested number of bytes to read from the pipeline.
+  * \return The number of bytes actually read from the pipeline or the
+  *   negative error code.
+  */
+ssize_t file_pipeline_read(
+  file_pipeline_t* pipeline,
+  unsigned char* data,
+  size_t size);
+
+#endif
@@ -0,0 +1,508 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <linux/io_uring.h>
+
+#include "uring.h"
+
+#ifndef O_DIRECT
+#define O_DIRECT __O_DIRECT
+#endif
+
+int file_uring_setup(file_uring_t* uring, size_t queue_depth);
+void file_uring_teardown(file_uring_t* uring);
+void file_uring_queue(file_uring_t* uring, file_uring_buffer_t* buffer,
+  off_t offset, size_t size);
+void file_uring_submit(file_uring_t* uring, size_t num_requests);
+int file_uring_reap(file_uring_t* uring, int wait);
+int file_uring_wait(file_uring_t* uring, file_uring_buffer_t* buffer);
+int file_uring_wait_all(file_uring_t* uring);
+void file_uring_prefetch(file_uring_t* uring);
+int file_uring_load(file_uring_t* uring, size_t block);
+
+int file_uring_open(file_uring_t* uring, const char* filename, file_mode_t
+    mode, size_t queue_depth, size_t buffer_size, int direct) {
+  struct stat stat;
+  int flags;
+  size_t i;
+
+  memset(uring, 0, sizeof(file_uring_t));
+  uring->fd = -1;
+  uring->ring_fd = -1;
+  uring->mode = mode;
+  uring->direct = direct;
+
+  if (!queue_depth)
+    return FILE_ERROR_OPERATION;
+  if (file_uring_setup(uring, queue_depth))
+    return FILE_ERROR_OPERATION;
+
+  if (mode == file_mode_read)
+    flags = O_RDONLY;
+  else if (mode == file_mode_write)
+    flags = O_RDWR | O_CREAT | O_TRUNC;
+  else
+    flags = O_RDWR | O_CREAT;
+  if (direct)
+    flags |= O_DIRECT;
+
+  if ((uring->fd = open(filename, flags, 0666)) < 0) {
+    file_uring_teardown(uring);
+    return (direct && (errno == EINVAL)) ? FILE_ERROR_OPERATION :
+      FILE_ERROR_OPEN;
+  }
+
+  buffer_size = (buffer_size+FILE_URING_ALIGNMENT-1)/FILE_URING_ALIGNMENT*
+    FILE_URING_ALIGNMENT;
+  if (!buffer_size)
+    buffer_size = FILE_URING_ALIGNMENT;
+
+  uring->buffers = calloc(queue_depth, sizeof(file_uring_buffer_t));
+  uring->num_buffers = queue_depth;
+  uring->buffer_size = buffer_size;
+
+  for (i = 0; i < queue_depth; ++i) {
+    if (posix_memalign((void**)&uring->buffers[i].data,
+        FILE_URING_ALIGNMENT, buffer_size)) {
+      file_uring_teardown(uring);
+      return FILE_ERROR_OPEN;
+    }
+
+    uring->buffers[i].iovec.iov_base = uring->buffers[i].data;
+    uring->buffers[i].iovec.iov_len = buffer_size;
+  }
+
+  if (direct && posix_memalign((void**)&uring->block, FILE_URING_ALIGNMENT,
+      FILE_URING_ALIGNMENT)) {
+    file_uring_teardown(uring);
+    return FILE_ERROR_OPEN;
+  }
+
+  struct iovec iovecs[queue_depth];
+  for (i = 0; i < queue_depth; ++i)
+    iovecs[i] = uring->buffers[i].iovec;
+  uring->registered = !syscall(__NR_io_uring_register, uring->ring_fd,
+    IORING_REGISTER_BUFFERS, iovecs, queue_depth);
+
+  if (fstat(uring->fd, &stat)) {
+    file_uring_teardown(uring);
+    return FILE_ERROR_OPEN;
+  }
+  uring->size = stat.st_size;
+
+  if (mode == file_mode_append) {
+    if (file_uring_seek(uring, uring->size)) {
+      file_uring_teardown(uring);
+      return FILE_ERROR_SEEK;
+    }
+  }
+  else if (mode == file_mode_read)
+    file_uring_prefetch(uring);
+
+  return FILE_ERROR_NONE;
+}
+
+int file_uring_close(file_uring_t* uring) {
+  int result = FILE_ERROR_NONE;
+
+  if (uring->mode != file_mode_read)
+    result = file_uring_flush(uring);
+  else
+    file_uring_wait_all(uring);
+
+  file_uring_teardown(uring);
+
+  return result;
+}
+
+int file_uring_seek(file_uring_t* uring, ssize_t pos) {
+  off_t offset = pos;
+
+  if (pos < 0)
+    return FILE_ERROR_SEEK;
+
+  if (uring->mode != file_mode_read) {
+    if (file_uring_flush(uring))
+      return FILE_ERROR_WRITE;
+  }
+  else
+    file_uring_wait_all(uring);
+
+  if (uring->direct)
+    offset = pos/FILE_URING_ALIGNMENT*FILE_URING_ALIGNMENT;
+
+  uring->offset = offset;
+  uring->buffer_pos = pos-offset;
+  uring->buffer_valid = 0;
+  uring->pos = pos;
+  uring->eof = 0;
+
+  if (uring->mode != file_mode_read) {
+    if (uring->buffer_pos && file_uring_load(uring, 0))
+      return FILE_ERROR_SEEK;
+  }
+  else
+    file_uring_prefetch(uring);
+
+  return FILE_ERROR_NONE;
+}
+
+ssize_t file_uring_read(file_uring_t* uring, unsigned char* data, size_t
+    size) {
+  file_uring_buffer_t* buffer;
+  size_t num_read = 0, length;
+
+  if (uring->mode != file_mode_read)
+    return -FILE_ERROR_OPERATION;
+
+  while ((num_read < size) && !uring->eof && !uring->error) {
+    buffer = &uring->buffers[uring->current];
+    if (file_uring_wait(uring, buffer) || (buffer->result < 0)) {
+      uring->error = 1;
+      break;
+    }
+
+    if (buffer->result > (ssize_t)uring->buffer_pos) {
+      length = buffer->result-uring->buffer_pos;
+      if (length > size-num_read)
+        length = size-num_read;
+
+      memcpy(&data[num_read], &buffer->data[uring->buffer_pos], length);
+      uring->buffer_pos += length;
+      uring->pos += length;
+      num_read += length;
+    }
+    else if (buffer->result < (ssize_t)buffer->size)
+      uring->eof = 1;
+    else {
+      file_uring_queue(uring, buffer, uring->offset, uring->buffer_size);
+      file_uring_submit(uring, 1);
+      uring->offset += uring->buffer_size;
+
+      uring->current = (uring->current+1) % uring->num_buffers;
+      uring->buffer_pos = 0;
+    }
+  }
+
+  if (!num_read && uring->error)
+    return -FILE_ERROR_READ;
+  else
+    return num_read;
+}
+
+ssize_t file_uring_write(file_uring_t* uring, const unsigned char* data,
+    size_t size) {
+  file_uring_buffer_t* buffer;
+  size_t num_written = 0, length;
+
+  if (uring->mode == file_mode_read)
+    return -FILE_ERROR_OPERATION;
+
+  while ((num_written < size) && !uring->error) {
+    buffer = &uring->buffers[uring->current];
+    if (file_uring_wait(uring, buffer))
+      break;
+
+    length = uring->buffer_size-uring->buffer_pos;
+    if (length > size-num_written)
+      length = size-num_written;
+
+    memcpy(&buffer->data[uring->buffer_pos], &data[num_written], length);
+    uring->buffer_pos += length;
+    uring->pos += length;
+    num_written += length;
+
+    if (uring->buffer_pos == uring->buffer_size) {
+      file_uring_queue(uring, buffer, uring->offset, uring->buffer_size);
+      file_uring_submit(uring, 1);
+      uring->offset += uring->buffer_size;
+
+      uring->current = (uring->current+1) % uring->num_buffers;
+      uring->buffer_pos = 0;
+      uring->buffer_valid = 0;
+    }
+  }
+
+  if (uring->pos > uring->size)
+    uring->size = uring->pos;
+
+  if (!num_written && uring->error)
+    return -FILE_ERROR_WRITE;
+  else
+    return num_written;
+}
+
+int file_uring_flush(file_uring_t* uring) {
+  file_uring_buffer_t* buffer = &uring->buffers[uring->current];
+  size_t size = uring->buffer_pos, block;
+
+  if (uring->mode == file_mode_read)
+    return FILE_ERROR_OPERATION;
+
+  if (size && !file_uring_wait(uring, buffer)) {
+    if (uring->buffer_valid < uring->buffer_pos)
+      uring->buffer_valid = uring->buffer_pos;
+
+    if (uring->direct) {
+      size = (size+FILE_URING_ALIGNMENT-1)/FILE_URING_ALIGNMENT*
+        FILE_URING_ALIGNMENT;
+      if ((size > uring->buffer_valid) && file_uring_load(uring,
+          size-FILE_URING_ALIGNMENT))
+        return FILE_ERROR_FLUSH;
+    }
+
+    file_uring_queue(uring, buffer, uring->offset, size);
+    file_uring_submit(uring, 1);
+  }
+
+  if (file_uring_wait_all(uring))
+    return FILE_ERROR_FLUSH;
+
+  if (uring->direct) {
+    if (size) {
+      block = size-FILE_URING_ALIGNMENT;
+
+      if (uring->buffer_pos % FILE_URING_ALIGNMENT) {
+        memmove(buffer->data, &buffer->data[block], FILE_URING_ALIGNMENT);
+        uring->offset += block;
+        uring->buffer_pos -= block;
+        uring->buffer_valid = FILE_URING_ALIGNMENT;
+      }
+      else {
+        uring->offset += size;
+        uring->buffer_pos = 0;
+        uring->buffer_valid = 0;
+      }
+    }
+
+    if (ftruncate(uring->fd, uring->size))
+      return FILE_ERROR_FLUSH;
+  }
+  else {
+    uring->offset += size;
+    uring->buffer_pos = 0;
+  }
+
+  return FILE_ERROR_NONE;
+}
+
+int file_uring_setup(file_uring_t* uring, size_t queue_depth) {
+  struct io_uring_params params;
+
+  memset(&params, 0, sizeof(params));
+  if ((uring->ring_fd = syscall(__NR_io_uring_setup, queue_depth,
+      &params)) < 0)
+    return FILE_ERROR_OPERATION;
+
+  uring->sq_ring_size = params.sq_off.array+params.sq_entries*
+    sizeof(unsigned);
+  uring->cq_ring_size = params.cq_off.cqes+params.cq_entries*
+    sizeof(struct io_uring_cqe);
+  uring->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+
+  uring->sq_ring = mmap(0, uring->sq_ring_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQ_RING);
+  uring->cq_ring = mmap(0, uring->cq_ring_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_CQ_RING);
+  uring->sqes = mmap(0, uring->sqes_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQES);
+
+  if ((uring->sq_ring == MAP_FAILED) || (uring->cq_ring == MAP_FAILED) ||
+      (uring->sqes == MAP_FAILED)) {
+    file_uring_teardown(uring);
+    return FILE_ERROR_OPERATION;
+  }
+
+  uring->sq_head = (void*)((char*)uring->sq_ring+params.sq_off.head);
+  uring->sq_tail = (void*)((char*)uring->sq_ring+params.sq_off.tail);
+  uring->sq_mask = (void*)((char*)uring->sq_ring+params.sq_off.ring_mask);
+  uring->sq_array = (void*)((char*)uring->sq_ring+params.sq_off.array);
+
+  uring->cq_head = (void*)((char*)uring->cq_ring+params.cq_off.head);
+  uring->cq_tail = (void*)((char*)uring->cq_ring+params.cq_off.tail);
+  uring->cq_mask = (void*)((char*)uring->cq_ring+params.cq_off.ring_mask);
+  uring->cqes = (void*)((char*)uring->cq_ring+params.cq_off.cqes);
+
+  return FILE_ERROR_NONE;
+}
+
+void file_uring_teardown(file_uring_t* uring) {
+  size_t i;
+
+  if (uring->buffers) {
+    for (i = 0; i < uring->num_buffers; ++i)
+      free(uring->buffers[i].data);
+    free(uring->buffers);
+    uring->buffers = 0;
+  }
+  free(uring->block);
+  uring->block = 0;
+
+  if (uring->sq_ring && (uring->sq_ring != MAP_FAILED))
+    munmap(uring->sq_ring, uring->sq_ring_size);
+  if (uring->cq_ring && (uring->cq_ring != MAP_FAILED))
+    munmap(uring->cq_ring, uring->cq_ring_size);
+  if (uring->sqes && (uring->sqes != MAP_FAILED))
+    munmap(uring->sqes, uring->sqes_size);
+  uring->sq_ring = 0;
+  uring->cq_ring = 0;
+  uring->sqes = 0;
+
+  if (uring->ring_fd >= 0)
+    close(uring->ring_fd);
+  uring->ring_fd = -1;
+
+  if (uring->fd >= 0)
+    close(uring->fd);
+  uring->fd = -1;
+}
+
+void file_uring_queue(file_uring_t* uring, file_uring_buffer_t* buffer,
+    off_t offset, size_t size) {
+  unsigned tail = *uring->sq_tail, index = tail & *uring->sq_mask;
+  struct io_uring_sqe* sqe = &uring->sqes[index];
+  int read = (uring->mode == file_mode_read);
+
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->fd = uring->fd;
+  sqe->off = offset;
+  sqe->user_data = buffer-uring->buffers;
+
+  if (uring->registered) {
+    sqe->opcode = read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+    sqe->addr = (unsigned long)buffer->data;
+    sqe->len = size;
+    sqe->buf_index = buffer-uring->buffers;
+  }
+  else {
+    buffer->iovec.iov_len = size;
+
+    sqe->opcode = read ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->addr = (unsigned long)&buffer->iovec;
+    sqe->len = 1;
+  }
+
+  buffer->offset = offset;
+  buffer->size = size;
+  buffer->result = 0;
+  buffer->pending = 1;
+
+  uring->sq_array[index] = index;
+  __atomic_store_n(uring->sq_tail, tail+1, __ATOMIC_RELEASE);
+}
+
+void file_uring_submit(file_uring_t* uring, size_t num_requests) {
+  while ((syscall(__NR_io_uring_enter, uring->ring_fd, num_requests, 0, 0,
+    0, 0) < 0) && (errno == EINTR));
+}
+
+int file_uring_reap(file_uring_t* uring, int wait) {
+  file_uring_buffer_t* buffer;
+  struct io_uring_cqe* cqe;
+  unsigned head, tail;
+  int num_reaped = 0;
+
+  while (1) {
+    head = *uring->cq_head;
+    tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+      cqe = &uring->cqes[head & *uring->cq_mask];
+      buffer = &uring->buffers[cqe->user_data];
+
+      buffer->result = cqe->res;
+      buffer->pending = 0;
+      if ((uring->mode != file_mode_read) && (buffer->result !=
+          (ssize_t)buffer->size))
+        uring->error = 1;
+
+      ++head;
+      ++num_reaped;
+    }
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+
+    if (num_reaped || !wait)
+      break;
+
+    if ((syscall(__NR_io_uring_enter, uring->ring_fd, 0, 1,
+        IORING_ENTER_GETEVENTS, 0, 0) < 0) && (errno != EINTR))
+      return FILE_ERROR_OPERATION;
+  }
+
+  return FILE_ERROR_NONE;
+}
+
+int file_uring_wait(file_uring_t* uring, file_uring_buffer_t* buffer) {
+  while (buffer->pending)
+    if (file_uring_reap(uring, 1))
+      return FILE_ERROR_OPERATION;
+
+  return uring->error ? FILE_ERROR_OPERATION : FILE_ERROR_NONE;
+}
+
+int file_uring_wait_all(file_uring_t* uring) {
+  size_t i;
+
+  for (i = 0; i < uring->num_buffers; ++i)
+    if (file_uring_wait(uring, &uring->buffers[i]))
+      return FILE_ERROR_OPERATION;
+
+  return FILE_ERROR_NONE;
+}
+
+void file_uring_prefetch(file_uring_t* uring) {
+  size_t i;
+
+  for (i = 0; i < uring->num_buffers; ++i) {
+    file_uring_queue(uring, &uring->buffers[(uring->current+i) %
+      uring->num_buffers], uring->offset, uring->buffer_size);
+    uring->offset += uring->buffer_size;
+  }
+
+  file_uring_submit(uring, uring->num_buffers);
+}
+
+int file_uring_load(file_uring_t* uring, size_t block) {
+  file_uring_buffer_t* buffer = &uring->buffers[uring->current];
+  size_t begin = 0;
+  ssize_t result;
+
+  result = pread(uring->fd, uring->block, FILE_URING_ALIGNMENT,
+    uring->offset+block);
+  if (result < 0)
+    return FILE_ERROR_READ;
+  if (result < FILE_URING_ALIGNMENT)
+    memset(&uring->block[result], 0, FILE_URING_ALIGNMENT-result);
+
+  if (uring->buffer_valid > block)
+    begin = uring->buffer_valid-block;
+  memcpy(&buffer->data[block+begin], &uring->block[begin],
+    FILE_URING_ALIGNMENT-begin);
+  uring->buffer_valid = block+FILE_URING_ALIGNMENT;
+
+  return FILE_ERROR_NONE;
+}
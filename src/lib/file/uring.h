@@ -0,0 +1,176 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef FILE_URING_H
+#define FILE_URING_H
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "file/file.h"
+
+/** \file file/uring.h
+  * \ingroup file
+  * \brief Batched io_uring input/output of uncompressed files
+  * \author Ralf Kaestner
+  *
+  * The io_uring backend accesses uncompressed files through a ring of
+  * buffers, each of which is transferred by an individual asynchronous
+  * request. When reading, all buffers ahead of the current one are kept
+  * in flight. When writing, filled buffers are submitted while the next
+  * buffer is being filled. The buffers are registered with the kernel
+  * if possible, and files may be accessed with O_DIRECT, in which case
+  * the backend takes care of block alignment.
+  *
+  * The kernel interface is accessed through system calls directly, such
+  * that the backend is available whenever the running kernel supports
+  * io_uring. The backend is used internally by the file implementation
+  * and should not be required to be accessed directly.
+  */
+
+/** \brief Alignment of buffers, offsets, and sizes for O_DIRECT access
+  */
+#define FILE_URING_ALIGNMENT                    4096
+
+/** \brief io_uring buffer structure
+  */
+typedef struct file_uring_buffer_t {
+  unsigned char* data;              //!< The buffer data.
+  struct iovec iovec;               //!< The buffer vector.
+
+  off_t offset;                     //!< The file offset of the buffer.
+  size_t size;                      //!< The size of the requested transfer.
+  ssize_t result;                   //!< The result of the completed transfer.
+  int pending;                      //!< Flag signaling a pending request.
+} file_uring_buffer_t;
+
+/** \brief io_uring backend structure
+  */
+typedef struct file_uring_t {
+  int fd;                           //!< The file descriptor.
+  file_mode_t mode;                 //!< The mode of the file.
+  int direct;                       //!< Flag signaling O_DIRECT access.
+
+  int ring_fd;                      //!< The io_uring file descriptor.
+  void* sq_ring;                    //!< The mapped submission queue ring.
+  size_t sq_ring_size;              //!< The size of the submission ring.
+  unsigned* sq_head;                //!< The submission queue head.
+  unsigned* sq_tail;                //!< The submission queue tail.
+  unsigned* sq_mask;                //!< The submission queue mask.
+  unsigned* sq_array;               //!< The submission queue index array.
+  struct io_uring_sqe* sqes;        //!< The mapped submission queue entries.
+  size_t sqes_size;                 //!< The size of the submission entries.
+  void* cq_ring;                    //!< The mapped completion queue ring.
+  size_t cq_ring_size;              //!< The size of the completion ring.
+  unsigned* cq_head;                //!< The completion queue head.
+  unsigned* cq_tail;                //!< The completion queue tail.
+  unsigned* cq_mask;                //!< The completion queue mask.
+  struct io_uring_cqe* cqes;        //!< The mapped completion queue entries.
+
+  file_uring_buffer_t* buffers;     //!< The ring of buffers.
+  size_t num_buffers;               //!< The number of buffers.
+  size_t buffer_size;               //!< The size of each buffer.
+  int registered;                   //!< Flag signaling registered buffers.
+  unsigned char* block;             //!< The aligned block for read-back.
+
+  size_t current;                   //!< The index of the current buffer.
+  size_t buffer_pos;                //!< The position in the current buffer.
+  size_t buffer_valid;              //!< The valid file data in the buffer.
+  off_t offset;                     //!< The file offset of the next request.
+
+  ssize_t pos;                      //!< The file position.
+  ssize_t size;                     //!< The size of the written file.
+  int eof;                          //!< The end-of-file indicator.
+  int error;                        //!< The error indicator.
+} file_uring_t;
+
+/** \brief Open io_uring backend
+  * \param[in] uring The io_uring backend to be opened.
+  * \param[in] filename The name of the uncompressed file to be opened.
+  * \param[in] mode The mode for opening the file.
+  * \param[in] queue_depth The number of buffers and hence the maximum
+  *   number of outstanding requests.
+  * \param[in] buffer_size The size of each buffer in bytes.
+  * \param[in] direct If non-zero, the file will be opened with O_DIRECT.
+  * \return The resulting error code. If the running kernel does not
+  *   support io_uring or the file system does not support O_DIRECT,
+  *   FILE_ERROR_OPERATION will be returned.
+  */
+int file_uring_open(
+  file_uring_t* uring,
+  const char* filename,
+  file_mode_t mode,
+  size_t queue_depth,
+  size_t buffer_size,
+  int direct);
+
+/** \brief Close io_uring backend
+  * \param[in] uring The open io_uring backend to be closed.
+  * \return The resulting error code.
+  *
+  * Buffered data of a file opened for writing will be written before the
+  * file is closed.
+  */
+int file_uring_close(
+  file_uring_t* uring);
+
+/** \brief Set the file position of io_uring backend
+  * \param[in] uring The open io_uring backend to set the position for.
+  * \param[in] pos The requested position relative to the file start.
+  * \return The resulting error code.
+  */
+int file_uring_seek(
+  file_uring_t* uring,
+  ssize_t pos);
+
+/** \brief Read data through io_uring backend
+  * \param[in] uring The open io_uring backend to read the data from.
+  * \param[in,out] data An array of sufficient size to hold the read data.
+  * \param[in] size The requested number of bytes to read.
+  * \return The number of bytes actually read or the negative error code.
+  */
+ssize_t file_uring_read(
+  file_uring_t* uring,
+  unsigned char* data,
+  size_t size);
+
+/** \brief Write data through io_uring backend
+  * \param[in] uring The open io_uring backend to write the data to.
+  * \param[in] data An array holding the data to be written.
+  * \param[in] size The requested number of bytes to write.
+  * \return The number of bytes actually written or the negative error code.
+  */
+ssize_t file_uring_write(
+  file_uring_t* uring,
+  const unsigned char* data,
+  size_t size);
+
+/** \brief Flush io_uring backend
+  * \param[in] uring The open io_uring backend to be flushed.
+  * \return The resulting error code.
+  *
+  * Flushing submits the partially filled current buffer and waits for
+  * all outstanding requests to complete.
+  */
+int file_uring_flush(
+  file_uring_t* uring);
+
+#endif
@@ -19,6 +19,8 @@
  ***************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <ftdi.h>
 
@@ -60,6 +62,7 @@ const char* ftdi_errors[] = {
   "FTDI device select timeout",
   "Error reading from FTDI device",
   "Error writing to FTDI device",
+  "Insufficient memory",
 };
 
 const char* ftdi_chips[] = {
@@ -294,6 +297,9 @@ void ftdi_device_init(ftdi_device_t* dev, struct ftdi_context* libftdi_context,
   
   dev->num_read = 0;
   dev->num_written = 0;
+
+  dev->tx_buffer = 0;
+  dev->tx_capacity = 0;
   
   error_init(&dev->error, ftdi_errors);
 }
@@ -301,6 +307,10 @@ void ftdi_device_init(ftdi_device_t* dev, struct ftdi_context* libftdi_context,
 void ftdi_device_destroy(ftdi_device_t* dev) {
   ftdi_deinit(dev->libftdi_context);
   ftdi_free(dev->libftdi_context);
+
+  free(dev->tx_buffer);
+  dev->tx_buffer = 0;
+  dev->tx_capacity = 0;
   
   error_destroy(&dev->error);
 }
@@ -518,6 +528,34 @@ int ftdi_device_write(ftdi_device_t* dev, unsigned char* data, size_t num) {
   return result;
 }
 
+int ftdi_device_writev(ftdi_device_t* dev, const struct iovec* iov, int
+    iovcnt) {
+  size_t num = 0;
+  int i;
+
+  for (i = 0; i < iovcnt; ++i)
+    num += iov[i].iov_len;
+
+  if (num > dev->tx_capacity) {
+    free(dev->tx_buffer);
+    dev->tx_capacity = 0;
+
+    if (!(dev->tx_buffer = malloc(num))) {
+      error_setf(&dev->error, FTDI_ERROR_NO_MEMORY, "Bus %03d Device %03d",
+        dev->bus, dev->address);
+      return -error_get(&dev->error);
+    }
+    dev->tx_capacity = num;
+  }
+
+  for (i = 0, num = 0; i < iovcnt; ++i) {
+    memcpy(&dev->tx_buffer[num], iov[i].iov_base, iov[i].iov_len);
+    num += iov[i].iov_len;
+  }
+
+  return ftdi_device_write(dev, dev->tx_buffer, num);
+}
+
 void ftdi_device_print(FILE* stream, const ftdi_device_t* dev) {
   fprintf(stream, "Bus %03d Device %03d: ID %04x:%04x %s",
     dev->bus, dev->address, FTDI_VENDOR_ID, dev->product_id,
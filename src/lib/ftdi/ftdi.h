@@ -39,6 +39,7 @@
   */
 
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include "error/error.h"
 
@@ -88,6 +89,8 @@
 //!< Error reading from FTDI device
 #define FTDI_ERROR_WRITE                    18
 //!< Error writing to FTDI device
+#define FTDI_ERROR_NO_MEMORY                19
+//!< Insufficient memory
 //@}
 
 /** \brief Predefined FTDI error descriptions
@@ -173,6 +176,9 @@ typedef struct ftdi_device_t {
 
   size_t num_read;                //!< Number of bytes read from device.
   size_t num_written;             //!< Number of bytes written to device.
+
+  unsigned char* tx_buffer;       //!< Buffer coalescing gathered writes.
+  size_t tx_capacity;             //!< Capacity of the coalescing buffer.
   
   error_t error;                  //!< The most recent device error.
 } ftdi_device_t;
@@ -306,6 +312,24 @@ int ftdi_device_write(
   unsigned char* data,
   size_t num);
 
+/** \brief Write gathered data to open FTDI device
+  * \param[in] dev The open FTDI device to write data to.
+  * \param[in] iov An array of buffers containing the data to be written
+  *   to the device in order.
+  * \param[in] iovcnt The number of buffers.
+  * \return The number of bytes written to the FTDI device or the
+  *   negative error code.
+  * 
+  * The buffers are coalesced into the device's transfer buffer, which is
+  * retained between calls, and written in a single transfer. Protocol
+  * layers thus do not need to assemble packets from their header,
+  * payload, and checksum themselves.
+  */
+int ftdi_device_writev(
+  ftdi_device_t* dev,
+  const struct iovec* iov,
+  int iovcnt);
+
 /** \brief Print FTDI device
   * \param[in] stream The output stream that will be used for printing the
   *   FTDI device.
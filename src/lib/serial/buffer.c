@@ -0,0 +1,172 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <string.h>
+#include <sys/uio.h>
+
+#include "buffer.h"
+
+size_t serial_buffer_get_capacity(size_t capacity);
+
+void serial_buffer_init(serial_buffer_t* buffer, size_t capacity) {
+  buffer->capacity = serial_buffer_get_capacity(capacity);
+  buffer->data = malloc(buffer->capacity);
+
+  buffer->head = 0;
+  buffer->tail = 0;
+}
+
+void serial_buffer_destroy(serial_buffer_t* buffer) {
+  free(buffer->data);
+
+  buffer->data = 0;
+  buffer->capacity = 0;
+  buffer->head = 0;
+  buffer->tail = 0;
+}
+
+void serial_buffer_resize(serial_buffer_t* buffer, size_t capacity) {
+  size_t size = serial_buffer_get_size(buffer);
+  unsigned char* data;
+
+  if (capacity < size)
+    capacity = size;
+  capacity = serial_buffer_get_capacity(capacity);
+
+  if (capacity != buffer->capacity) {
+    data = malloc(capacity);
+    serial_buffer_copy(buffer, 0, data, size);
+    free(buffer->data);
+
+    buffer->data = data;
+    buffer->capacity = capacity;
+    buffer->head = size;
+    buffer->tail = 0;
+  }
+}
+
+void serial_buffer_clear(serial_buffer_t* buffer) {
+  buffer->head = 0;
+  buffer->tail = 0;
+}
+
+size_t serial_buffer_get_size(const serial_buffer_t* buffer) {
+  return buffer->head-buffer->tail;
+}
+
+size_t serial_buffer_get_space(const serial_buffer_t* buffer) {
+  return buffer->capacity-(buffer->head-buffer->tail);
+}
+
+ssize_t serial_buffer_fill(serial_buffer_t* buffer, int fd) {
+  struct iovec iov[2];
+  size_t space = serial_buffer_get_space(buffer);
+  size_t offset = buffer->head & (buffer->capacity-1);
+  ssize_t result;
+  int num_iov = 1;
+
+  if (!space)
+    return 0;
+
+  iov[0].iov_base = &buffer->data[offset];
+  if (offset+space > buffer->capacity) {
+    iov[0].iov_len = buffer->capacity-offset;
+    iov[1].iov_base = buffer->data;
+    iov[1].iov_len = space-iov[0].iov_len;
+    num_iov = 2;
+  }
+  else
+    iov[0].iov_len = space;
+
+  if ((result = readv(fd, iov, num_iov)) > 0)
+    buffer->head += result;
+
+  return result;
+}
+
+unsigned char serial_buffer_peek(const serial_buffer_t* buffer, size_t
+    offset) {
+  return buffer->data[(buffer->tail+offset) & (buffer->capacity-1)];
+}
+
+size_t serial_buffer_copy(const serial_buffer_t* buffer, size_t offset,
+    unsigned char* data, size_t num) {
+  size_t size = serial_buffer_get_size(buffer), start, length;
+
+  if (offset >= size)
+    return 0;
+  if (num > size-offset)
+    num = size-offset;
+
+  start = (buffer->tail+offset) & (buffer->capacity-1);
+  length = (num < buffer->capacity-start) ? num : buffer->capacity-start;
+
+  memcpy(data, &buffer->data[start], length);
+  memcpy(&data[length], buffer->data, num-length);
+
+  return num;
+}
+
+size_t serial_buffer_read(serial_buffer_t* buffer, unsigned char* data,
+    size_t num) {
+  size_t size = serial_buffer_get_size(buffer);
+
+  if (num > size)
+    num = size;
+  if (data)
+    serial_buffer_copy(buffer, 0, data, num);
+
+  buffer->tail += num;
+  if (buffer->tail == buffer->head) {
+    buffer->head = 0;
+    buffer->tail = 0;
+  }
+
+  return num;
+}
+
+ssize_t serial_buffer_find(const serial_buffer_t* buffer, unsigned char
+    delim, size_t offset) {
+  size_t size = serial_buffer_get_size(buffer), start, length;
+  const unsigned char* found;
+
+  if (offset >= size)
+    return -1;
+
+  start = (buffer->tail+offset) & (buffer->capacity-1);
+  length = (size-offset < buffer->capacity-start) ? size-offset :
+    buffer->capacity-start;
+
+  if ((found = memchr(&buffer->data[start], delim, length)))
+    return offset+(found-&buffer->data[start]);
+  if ((found = memchr(buffer->data, delim, size-offset-length)))
+    return offset+length+(found-buffer->data);
+
+  return -1;
+}
+
+size_t serial_buffer_get_capacity(size_t capacity) {
+  size_t result = 1;
+
+  while (result < capacity)
+    result <<= 1;
+
+  return result;
+}
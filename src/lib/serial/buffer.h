@@ -0,0 +1,157 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SERIAL_BUFFER_H
+#define SERIAL_BUFFER_H
+
+/** \file serial/buffer.h
+  * \ingroup serial
+  * \brief Serial receive ring buffer
+  * \author Ralf Kaestner
+  * 
+  * The receive ring buffer collects all data available from a serial
+  * device with a single vectored read, regardless of how the data wraps
+  * around the end of the ring. Callers scan the buffered data for
+  * delimiters and extract complete frames from it, such that a protocol
+  * parser no longer requires a system call per byte.
+  */
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+/** \brief Serial receive ring buffer structure
+  * 
+  * The head and tail indices grow monotonically and are reduced modulo
+  * the capacity, which is a power of two, when accessing the data.
+  */
+typedef struct serial_buffer_t {
+  unsigned char* data;            //!< The buffer data.
+  size_t capacity;                //!< The buffer capacity.
+
+  size_t head;                    //!< The index of the next byte to fill.
+  size_t tail;                    //!< The index of the next byte to consume.
+} serial_buffer_t;
+
+/** \brief Initialize serial receive buffer
+  * \param[in] buffer The buffer to be initialized.
+  * \param[in] capacity The requested capacity of the buffer in bytes,
+  *   which will be rounded up to the next power of two.
+  */
+void serial_buffer_init(
+  serial_buffer_t* buffer,
+  size_t capacity);
+
+/** \brief Destroy serial receive buffer
+  * \param[in] buffer The initialized buffer to be destroyed.
+  */
+void serial_buffer_destroy(
+  serial_buffer_t* buffer);
+
+/** \brief Resize serial receive buffer
+  * \param[in] buffer The initialized buffer to be resized.
+  * \param[in] capacity The requested capacity of the buffer in bytes,
+  *   which will be rounded up to the next power of two. The capacity
+  *   will not be reduced below the size of the buffered data.
+  */
+void serial_buffer_resize(
+  serial_buffer_t* buffer,
+  size_t capacity);
+
+/** \brief Clear serial receive buffer
+  * \param[in] buffer The initialized buffer to be cleared.
+  */
+void serial_buffer_clear(
+  serial_buffer_t* buffer);
+
+/** \brief Retrieve the size of the buffered data
+  * \param[in] buffer The initialized buffer to retrieve the size for.
+  * \return The number of buffered bytes.
+  */
+size_t serial_buffer_get_size(
+  const serial_buffer_t* buffer);
+
+/** \brief Retrieve the free space of serial receive buffer
+  * \param[in] buffer The initialized buffer to retrieve the space for.
+  * \return The number of bytes which may be filled into the buffer.
+  */
+size_t serial_buffer_get_space(
+  const serial_buffer_t* buffer);
+
+/** \brief Fill serial receive buffer from file descriptor
+  * \param[in] buffer The initialized buffer to be filled.
+  * \param[in] fd The file descriptor to read from.
+  * \return The number of bytes read, or -1 if the read failed, in which
+  *   case errno will be set.
+  * 
+  * All free space of the buffer is filled with a single system call.
+  */
+ssize_t serial_buffer_fill(
+  serial_buffer_t* buffer,
+  int fd);
+
+/** \brief Retrieve a buffered byte
+  * \param[in] buffer The initialized buffer to retrieve the byte from.
+  * \param[in] offset The offset of the byte from the oldest buffered
+  *   byte, which must be smaller than the size of the buffered data.
+  * \return The buffered byte.
+  */
+unsigned char serial_buffer_peek(
+  const serial_buffer_t* buffer,
+  size_t offset);
+
+/** \brief Copy buffered data without consuming it
+  * \param[in] buffer The initialized buffer to copy the data from.
+  * \param[in] offset The offset of the data from the oldest buffered byte.
+  * \param[out] data An array of sufficient size to hold the copied data.
+  * \param[in] num The maximum number of bytes to be copied.
+  * \return The number of bytes copied.
+  */
+size_t serial_buffer_copy(
+  const serial_buffer_t* buffer,
+  size_t offset,
+  unsigned char* data,
+  size_t num);
+
+/** \brief Consume buffered data
+  * \param[in] buffer The initialized buffer to consume the data from.
+  * \param[out] data An array of sufficient size to hold the consumed data,
+  *   or null if the data should be discarded.
+  * \param[in] num The maximum number of bytes to be consumed.
+  * \return The number of bytes consumed.
+  */
+size_t serial_buffer_read(
+  serial_buffer_t* buffer,
+  unsigned char* data,
+  size_t num);
+
+/** \brief Find a delimiter in the buffered data
+  * \param[in] buffer The initialized buffer to search.
+  * \param[in] delim The delimiter to be found.
+  * \param[in] offset The offset from the oldest buffered byte at which
+  *   the search starts.
+  * \return The offset of the first delimiter found or -1 if the buffered
+  *   data contains no delimiter.
+  */
+ssize_t serial_buffer_find(
+  const serial_buffer_t* buffer,
+  unsigned char delim,
+  size_t offset);
+
+#endif
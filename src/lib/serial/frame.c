@@ -0,0 +1,292 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame.h"
+
+#include "timer/timer.h"
+
+ssize_t serial_frame_extract_length(serial_buffer_t* buffer, size_t
+  prefix, unsigned char* data, size_t num);
+ssize_t serial_frame_extract_cobs(serial_buffer_t* buffer, unsigned char*
+  data, size_t num);
+ssize_t serial_frame_extract_slip(serial_buffer_t* buffer, unsigned char*
+  data, size_t num);
+ssize_t serial_frame_encode_cobs(const unsigned char* data, size_t size,
+  unsigned char* frame, size_t num);
+ssize_t serial_frame_encode_slip(const unsigned char* data, size_t size,
+  unsigned char* frame, size_t num);
+
+ssize_t serial_frame_extract(serial_buffer_t* buffer, serial_frame_t type,
+    unsigned char* data, size_t num) {
+  switch (type) {
+    case serial_frame_length8:
+      return serial_frame_extract_length(buffer, 1, data, num);
+    case serial_frame_length16:
+      return serial_frame_extract_length(buffer, 2, data, num);
+    case serial_frame_cobs:
+      return serial_frame_extract_cobs(buffer, data, num);
+    case serial_frame_slip:
+      return serial_frame_extract_slip(buffer, data, num);
+  }
+
+  return -SERIAL_ERROR_FRAME;
+}
+
+ssize_t serial_frame_encode(serial_frame_t type, const unsigned char* data,
+    size_t size, unsigned char* frame, size_t num) {
+  size_t prefix = (type == serial_frame_length8) ? 1 : 2;
+
+  switch (type) {
+    case serial_frame_length8:
+    case serial_frame_length16:
+      if ((size >= (1UL << (8*prefix))) || (size+prefix > num))
+        return -SERIAL_ERROR_FRAME;
+
+      if (prefix == 2)
+        frame[0] = size >> 8;
+      frame[prefix-1] = size & 0xFF;
+      memcpy(&frame[prefix], data, size);
+
+      return size+prefix;
+    case serial_frame_cobs:
+      return serial_frame_encode_cobs(data, size, frame, num);
+    case serial_frame_slip:
+      return serial_frame_encode_slip(data, size, frame, num);
+  }
+
+  return -SERIAL_ERROR_FRAME;
+}
+
+int serial_frame_read(serial_device_t* dev, serial_frame_t type,
+    unsigned char* data, size_t num) {
+  int64_t deadline = timer_get_monotonic_ns()+
+    timer_seconds_to_ns(dev->timeout);
+  ssize_t result;
+
+  error_clear(&dev->error);
+
+  while (!(result = serial_frame_extract(&dev->buffer, type, data, num))) {
+    if (!serial_buffer_get_space(&dev->buffer)) {
+      serial_buffer_clear(&dev->buffer);
+      result = -SERIAL_ERROR_FRAME;
+      break;
+    }
+
+    if ((result = serial_device_fill(dev, timer_ns_to_seconds(deadline-
+        timer_get_monotonic_ns()))) < 0)
+      return result;
+  }
+
+  if (result < 0)
+    error_setf(&dev->error, -result, dev->name);
+
+  return result;
+}
+
+int serial_frame_write(serial_device_t* dev, serial_frame_t type,
+    const unsigned char* data, size_t size) {
+  size_t max_size = serial_frame_get_max_size(type, size);
+  unsigned char* frame = malloc(max_size);
+  ssize_t result;
+
+  error_clear(&dev->error);
+
+  if ((result = serial_frame_encode(type, data, size, frame, max_size)) <
+      0)
+    error_setf(&dev->error, -result, dev->name);
+  else if ((result = serial_device_write(dev, frame, result)) >= 0)
+    result = size;
+
+  free(frame);
+
+  return result;
+}
+
+size_t serial_frame_get_max_size(serial_frame_t type, size_t size) {
+  switch (type) {
+    case serial_frame_length8:
+      return size+1;
+    case serial_frame_length16:
+      return size+2;
+    case serial_frame_cobs:
+      return size+size/254+2;
+    case serial_frame_slip:
+      return 2*size+2;
+  }
+
+  return 0;
+}
+
+ssize_t serial_frame_extract_length(serial_buffer_t* buffer, size_t
+    prefix, unsigned char* data, size_t num) {
+  size_t size;
+
+  while (serial_buffer_get_size(buffer) >= prefix) {
+    size = serial_buffer_peek(buffer, prefix-1);
+    if (prefix == 2)
+      size |= serial_buffer_peek(buffer, 0) << 8;
+
+    if (!size) {
+      serial_buffer_read(buffer, 0, prefix);
+      continue;
+    }
+    if (size > num) {
+      serial_buffer_read(buffer, 0, prefix);
+      return -SERIAL_ERROR_FRAME;
+    }
+    if (serial_buffer_get_size(buffer) < prefix+size)
+      break;
+
+    serial_buffer_read(buffer, 0, prefix);
+    return serial_buffer_read(buffer, data, size);
+  }
+
+  return 0;
+}
+
+ssize_t serial_frame_extract_cobs(serial_buffer_t* buffer, unsigned char*
+    data, size_t num) {
+  ssize_t end;
+  size_t i, size;
+  unsigned char code;
+
+  while ((end = serial_buffer_find(buffer, 0, 0)) == 0)
+    serial_buffer_read(buffer, 0, 1);
+  if (end < 0)
+    return 0;
+
+  for (i = 0, size = 0; i < end; ) {
+    code = serial_buffer_peek(buffer, i++);
+
+    if ((i+code-1 > end) || (size+code-1 > num)) {
+      serial_buffer_read(buffer, 0, end+1);
+      return -SERIAL_ERROR_FRAME;
+    }
+    serial_buffer_copy(buffer, i, &data[size], code-1);
+    i += code-1;
+    size += code-1;
+
+    if ((code < 0xFF) && (i < end)) {
+      if (size >= num) {
+        serial_buffer_read(buffer, 0, end+1);
+        return -SERIAL_ERROR_FRAME;
+      }
+      data[size++] = 0;
+    }
+  }
+
+  serial_buffer_read(buffer, 0, end+1);
+
+  return size ? size : serial_frame_extract_cobs(buffer, data, num);
+}
+
+ssize_t serial_frame_extract_slip(serial_buffer_t* buffer, unsigned char*
+    data, size_t num) {
+  ssize_t end;
+  size_t i, size;
+  unsigned char byte;
+
+  while ((end = serial_buffer_find(buffer, SERIAL_FRAME_SLIP_END, 0)) == 0)
+    serial_buffer_read(buffer, 0, 1);
+  if (end < 0)
+    return 0;
+
+  for (i = 0, size = 0; i < end; ++i) {
+    byte = serial_buffer_peek(buffer, i);
+
+    if (byte == SERIAL_FRAME_SLIP_ESC) {
+      byte = (i+1 < end) ? serial_buffer_peek(buffer, ++i) : 0;
+
+      if (byte == SERIAL_FRAME_SLIP_ESC_END)
+        byte = SERIAL_FRAME_SLIP_END;
+      else if (byte == SERIAL_FRAME_SLIP_ESC_ESC)
+        byte = SERIAL_FRAME_SLIP_ESC;
+      else {
+        serial_buffer_read(buffer, 0, end+1);
+        return -SERIAL_ERROR_FRAME;
+      }
+    }
+
+    if (size >= num) {
+      serial_buffer_read(buffer, 0, end+1);
+      return -SERIAL_ERROR_FRAME;
+    }
+    data[size++] = byte;
+  }
+
+  serial_buffer_read(buffer, 0, end+1);
+
+  return size;
+}
+
+ssize_t serial_frame_encode_cobs(const unsigned char* data, size_t size,
+    unsigned char* frame, size_t num) {
+  size_t i, code_pos = 0, pos = 1;
+  unsigned char code = 1;
+
+  if (num < serial_frame_get_max_size(serial_frame_cobs, size))
+    return -SERIAL_ERROR_FRAME;
+
+  for (i = 0; i < size; ++i) {
+    if (data[i]) {
+      frame[pos++] = data[i];
+      ++code;
+    }
+
+    if (!data[i] || (code == 0xFF)) {
+      frame[code_pos] = code;
+      code_pos = pos++;
+      code = 1;
+    }
+  }
+
+  frame[code_pos] = code;
+  frame[pos++] = 0;
+
+  return pos;
+}
+
+ssize_t serial_frame_encode_slip(const unsigned char* data, size_t size,
+    unsigned char* frame, size_t num) {
+  size_t i, pos = 0;
+
+  if (num < serial_frame_get_max_size(serial_frame_slip, size))
+    return -SERIAL_ERROR_FRAME;
+
+  frame[pos++] = SERIAL_FRAME_SLIP_END;
+  for (i = 0; i < size; ++i) {
+    if (data[i] == SERIAL_FRAME_SLIP_END) {
+      frame[pos++] = SERIAL_FRAME_SLIP_ESC;
+      frame[pos++] = SERIAL_FRAME_SLIP_ESC_END;
+    }
+    else if (data[i] == SERIAL_FRAME_SLIP_ESC) {
+      frame[pos++] = SERIAL_FRAME_SLIP_ESC;
+      frame[pos++] = SERIAL_FRAME_SLIP_ESC_ESC;
+    }
+    else
+      frame[pos++] = data[i];
+  }
+  frame[pos++] = SERIAL_FRAME_SLIP_END;
+
+  return pos;
+}
@@ -0,0 +1,142 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SERIAL_FRAME_H
+#define SERIAL_FRAME_H
+
+/** \file serial/frame.h
+  * \ingroup serial
+  * \brief Serial frame encoding and extraction
+  * \author Ralf Kaestner
+  * 
+  * Frames are extracted from a serial receive buffer in place, i.e.,
+  * the buffered data is scanned and decoded directly into the caller's
+  * array without being copied or linearized first. Supported framings
+  * are length prefixes, Consistent Overhead Byte Stuffing (COBS), and
+  * the Serial Line Internet Protocol (SLIP, RFC 1055).
+  */
+
+#include "serial/serial.h"
+#include "serial/buffer.h"
+
+/** \name SLIP Special Characters
+  * \brief Special characters of the SLIP framing
+  */
+//@{
+#define SERIAL_FRAME_SLIP_END             0xC0
+//!< Frame delimiter
+#define SERIAL_FRAME_SLIP_ESC             0xDB
+//!< Escape character
+#define SERIAL_FRAME_SLIP_ESC_END         0xDC
+//!< Escaped frame delimiter
+#define SERIAL_FRAME_SLIP_ESC_ESC         0xDD
+//!< Escaped escape character
+//@}
+
+/** \brief Serial framing enumerable type
+  */
+typedef enum {
+  serial_frame_length8,           //!< One length byte and the payload.
+  serial_frame_length16,          //!< Two big-endian length bytes and the
+                                  //!< payload.
+  serial_frame_cobs,              //!< COBS-encoded payload and a zero byte.
+  serial_frame_slip               //!< SLIP-encoded payload between END bytes.
+} serial_frame_t;
+
+/** \brief Extract a frame from serial receive buffer
+  * \param[in] buffer The initialized buffer to extract the frame from.
+  * \param[in] type The framing of the buffered data.
+  * \param[out] data An array of sufficient size to hold the payload.
+  * \param[in] num The size of the array in bytes.
+  * \return The size of the extracted payload, 0 if the buffer contains
+  *   no complete frame, or the negative error code. Malformed frames and
+  *   frames exceeding the array size are discarded, and -SERIAL_ERROR_FRAME
+  *   is returned for them.
+  * 
+  * Frames with an empty payload are discarded silently. For length
+  * prefixed frames, only the prefix of an oversized frame is discarded.
+  */
+ssize_t serial_frame_extract(
+  serial_buffer_t* buffer,
+  serial_frame_t type,
+  unsigned char* data,
+  size_t num);
+
+/** \brief Encode a frame
+  * \param[in] type The framing to be applied.
+  * \param[in] data An array containing the payload to be encoded.
+  * \param[in] size The size of the payload in bytes.
+  * \param[out] frame An array of sufficient size to hold the frame.
+  * \param[in] num The size of the frame array in bytes.
+  * \return The size of the encoded frame or the negative error code. If
+  *   the payload cannot be represented with the framing or the frame
+  *   exceeds the array size, -SERIAL_ERROR_FRAME is returned.
+  */
+ssize_t serial_frame_encode(
+  serial_frame_t type,
+  const unsigned char* data,
+  size_t size,
+  unsigned char* frame,
+  size_t num);
+
+/** \brief Read a frame from open serial device
+  * \param[in] dev The open serial device to read the frame from.
+  * \param[in] type The framing of the data received from the device.
+  * \param[out] data An array of sufficient size to hold the payload.
+  * \param[in] num The size of the array in bytes.
+  * \return The payload size of the frame read from the serial device or
+  *   the negative error code. Malformed frames and frames exceeding the
+  *   array size or the device's receive buffer are discarded, and
+  *   -SERIAL_ERROR_FRAME is returned for them.
+  * 
+  * The frame is extracted from the device's receive buffer, which is
+  * filled as required. The device timeout bounds the overall duration of
+  * the read operation.
+  */
+int serial_frame_read(
+  serial_device_t* dev,
+  serial_frame_t type,
+  unsigned char* data,
+  size_t num);
+
+/** \brief Write a frame to open serial device
+  * \param[in] dev The open serial device to write the frame to.
+  * \param[in] type The framing to be applied.
+  * \param[in] data An array containing the payload to be written.
+  * \param[in] size The size of the payload in bytes.
+  * \return The payload size of the frame written to the serial device
+  *   or the negative error code.
+  */
+int serial_frame_write(
+  serial_device_t* dev,
+  serial_frame_t type,
+  const unsigned char* data,
+  size_t size);
+
+/** \brief Retrieve the maximum size of an encoded frame
+  * \param[in] type The framing to be applied.
+  * \param[in] size The size of the payload in bytes.
+  * \return The maximum size of the encoded frame in bytes.
+  */
+size_t serial_frame_get_max_size(
+  serial_frame_t type,
+  size_t size);
+
+#endif
@@ -0,0 +1,465 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "loop.h"
+#include "recorder.h"
+
+#include "timer/timer.h"
+
+serial_loop_entry_t* serial_loop_find(serial_loop_t* loop, serial_device_t*
+  dev, size_t* index);
+void serial_loop_wake(serial_loop_t* loop);
+int64_t serial_loop_get_deadline(serial_device_t* dev);
+int serial_loop_get_wait(serial_loop_t* loop, int64_t end);
+void serial_loop_transmit(serial_loop_t* loop, serial_loop_entry_t* entry);
+void serial_loop_receive(serial_loop_t* loop, serial_loop_entry_t* entry,
+  uint32_t events);
+void serial_loop_check_timeouts(serial_loop_t* loop);
+void serial_loop_fail(serial_loop_t* loop, serial_loop_entry_t* entry,
+  int error);
+void serial_device_record(serial_device_t* dev, serial_record_type_t type,
+  const unsigned char* data, size_t size);
+
+int serial_loop_init(serial_loop_t* loop) {
+  struct epoll_event event;
+
+  loop->entries = 0;
+  loop->num_entries = 0;
+  loop->removed = 0;
+  loop->num_removed = 0;
+
+  thread_mutex_init(&loop->mutex);
+  atomic_init(&loop->exit_request, 0);
+
+  error_init(&loop->error, serial_errors);
+
+  loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  loop->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = EPOLLIN;
+  event.data.ptr = 0;
+
+  if ((loop->epoll_fd < 0) || (loop->wakeup_fd < 0) ||
+      epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wakeup_fd, &event)) {
+    if (loop->epoll_fd >= 0)
+      close(loop->epoll_fd);
+    if (loop->wakeup_fd >= 0)
+      close(loop->wakeup_fd);
+    loop->epoll_fd = -1;
+    loop->wakeup_fd = -1;
+
+    error_setf(&loop->error, SERIAL_ERROR_EVENT_LOOP, "%s",
+      strerror(errno));
+  }
+
+  return error_get(&loop->error);
+}
+
+void serial_loop_destroy(serial_loop_t* loop) {
+  size_t i;
+
+  for (i = 0; i < loop->num_entries; ++i) {
+    free(loop->entries[i]->tx_data);
+    free(loop->entries[i]);
+  }
+  free(loop->entries);
+  loop->entries = 0;
+  loop->num_entries = 0;
+
+  for (i = 0; i < loop->num_removed; ++i) {
+    free(loop->removed[i]->tx_data);
+    free(loop->removed[i]);
+  }
+  free(loop->removed);
+  loop->removed = 0;
+  loop->num_removed = 0;
+
+  if (loop->epoll_fd >= 0)
+    close(loop->epoll_fd);
+  if (loop->wakeup_fd >= 0)
+    close(loop->wakeup_fd);
+  loop->epoll_fd = -1;
+  loop->wakeup_fd = -1;
+
+  thread_mutex_destroy(&loop->mutex);
+  error_destroy(&loop->error);
+}
+
+int serial_loop_add(serial_loop_t* loop, serial_device_t* dev,
+    serial_loop_callback_t callback, void* arg) {
+  serial_loop_entry_t* entry;
+  struct epoll_event event;
+
+  error_clear(&loop->error);
+
+  thread_mutex_lock(&loop->mutex);
+
+  if (serial_loop_find(loop, dev, 0)) {
+    thread_mutex_unlock(&loop->mutex);
+    error_setf(&loop->error, SERIAL_ERROR_EVENT_LOOP, dev->name);
+
+    return error_get(&loop->error);
+  }
+
+  entry = malloc(sizeof(serial_loop_entry_t));
+  entry->dev = dev;
+  entry->callback = callback;
+  entry->arg = arg;
+
+  entry->tx_data = 0;
+  entry->tx_size = 0;
+  entry->tx_capacity = 0;
+  entry->events = EPOLLIN;
+
+  entry->deadline = serial_loop_get_deadline(dev);
+
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = entry->events;
+  event.data.ptr = entry;
+
+  if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, dev->fd, &event)) {
+    thread_mutex_unlock(&loop->mutex);
+    free(entry);
+    error_setf(&loop->error, SERIAL_ERROR_EVENT_LOOP, dev->name);
+
+    return error_get(&loop->error);
+  }
+
+  loop->entries = realloc(loop->entries, (loop->num_entries+1)*
+    sizeof(serial_loop_entry_t*));
+  loop->entries[loop->num_entries++] = entry;
+
+  thread_mutex_unlock(&loop->mutex);
+
+  serial_loop_wake(loop);
+
+  return error_get(&loop->error);
+}
+
+int serial_loop_remove(serial_loop_t* loop, serial_device_t* dev) {
+  serial_loop_entry_t* entry;
+  size_t index;
+
+  error_clear(&loop->error);
+
+  thread_mutex_lock(&loop->mutex);
+
+  if ((entry = serial_loop_find(loop, dev, &index))) {
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, dev->fd, 0);
+    loop->entries[index] = loop->entries[--loop->num_entries];
+    entry->dev = 0;
+
+    loop->removed = realloc(loop->removed, (loop->num_removed+1)*
+      sizeof(serial_loop_entry_t*));
+    loop->removed[loop->num_removed++] = entry;
+  }
+  else
+    error_setf(&loop->error, SERIAL_ERROR_EVENT_LOOP, dev->name);
+
+  thread_mutex_unlock(&loop->mutex);
+
+  return error_get(&loop->error);
+}
+
+ssize_t serial_loop_write(serial_loop_t* loop, serial_device_t* dev,
+    const unsigned char* data, size_t num) {
+  serial_loop_entry_t* entry;
+  struct epoll_event event;
+  ssize_t n = 0;
+
+  error_clear(&loop->error);
+
+  thread_mutex_lock(&loop->mutex);
+
+  if (!(entry = serial_loop_find(loop, dev, 0))) {
+    thread_mutex_unlock(&loop->mutex);
+    error_setf(&loop->error, SERIAL_ERROR_EVENT_LOOP, dev->name);
+
+    return -error_get(&loop->error);
+  }
+
+  if (!entry->tx_size) {
+    n = write(dev->fd, data, num);
+
+    if ((n < 0) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+      thread_mutex_unlock(&loop->mutex);
+      error_setf(&loop->error, SERIAL_ERROR_WRITE, dev->name);
+
+      return -error_get(&loop->error);
+    }
+    else if (n > 0) {
+      serial_device_record(dev, serial_record_write, data, n);
+      dev->num_written += n;
+    }
+    else
+      n = 0;
+  }
+
+  if (n < num) {
+    if (entry->tx_size+num-n > entry->tx_capacity) {
+      entry->tx_capacity = 2*(entry->tx_size+num-n);
+      entry->tx_data = realloc(entry->tx_data, entry->tx_capacity);
+    }
+    memcpy(&entry->tx_data[entry->tx_size], &data[n], num-n);
+    entry->tx_size += num-n;
+
+    if (!(entry->events & EPOLLOUT)) {
+      entry->events |= EPOLLOUT;
+
+      memset(&event, 0, sizeof(struct epoll_event));
+      event.events = entry->events;
+      event.data.ptr = entry;
+      epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, dev->fd, &event);
+    }
+  }
+
+  thread_mutex_unlock(&loop->mutex);
+
+  return num;
+}
+
+size_t serial_loop_get_pending(serial_loop_t* loop, serial_device_t* dev) {
+  serial_loop_entry_t* entry;
+  size_t pending = 0;
+
+  thread_mutex_lock(&loop->mutex);
+  if ((entry = serial_loop_find(loop, dev, 0)))
+    pending = entry->tx_size;
+  thread_mutex_unlock(&loop->mutex);
+
+  return pending;
+}
+
+int serial_loop_run(serial_loop_t* loop, double timeout) {
+  struct epoll_event events[SERIAL_LOOP_MAX_EVENTS];
+  serial_loop_entry_t* entry;
+  int64_t end = (timeout >= 0.0) ? timer_get_monotonic_ns()+
+    timer_seconds_to_ns(timeout) : -1;
+  uint64_t value;
+  size_t i;
+  int n;
+
+  error_clear(&loop->error);
+
+  while (!atomic_load(&loop->exit_request)) {
+    if ((end >= 0) && (timer_get_monotonic_ns() >= end))
+      break;
+
+    n = epoll_wait(loop->epoll_fd, events, SERIAL_LOOP_MAX_EVENTS,
+      serial_loop_get_wait(loop, end));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+
+      error_setf(&loop->error, SERIAL_ERROR_EVENT_LOOP, "%s",
+        strerror(errno));
+      break;
+    }
+
+    for (i = 0; i < n; ++i) {
+      if (!(entry = events[i].data.ptr)) {
+        while (read(loop->wakeup_fd, &value, sizeof(value)) > 0);
+        continue;
+      }
+
+      if (events[i].events & EPOLLOUT)
+        serial_loop_transmit(loop, entry);
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        serial_loop_receive(loop, entry, events[i].events);
+    }
+
+    serial_loop_check_timeouts(loop);
+
+    thread_mutex_lock(&loop->mutex);
+    for (i = 0; i < loop->num_removed; ++i) {
+      free(loop->removed[i]->tx_data);
+      free(loop->removed[i]);
+    }
+    loop->num_removed = 0;
+    thread_mutex_unlock(&loop->mutex);
+  }
+
+  atomic_store(&loop->exit_request, 0);
+
+  return error_get(&loop->error);
+}
+
+void serial_loop_stop(serial_loop_t* loop) {
+  atomic_store(&loop->exit_request, 1);
+  serial_loop_wake(loop);
+}
+
+serial_loop_entry_t* serial_loop_find(serial_loop_t* loop, serial_device_t*
+    dev, size_t* index) {
+  size_t i;
+
+  for (i = 0; i < loop->num_entries; ++i)
+    if (loop->entries[i]->dev == dev) {
+      if (index)
+        *index = i;
+      return loop->entries[i];
+    }
+
+  return 0;
+}
+
+void serial_loop_wake(serial_loop_t* loop) {
+  uint64_t value = 1;
+
+  if (write(loop->wakeup_fd, &value, sizeof(value)) < 0)
+    return;
+}
+
+int64_t serial_loop_get_deadline(serial_device_t* dev) {
+  return (dev->timeout > 0.0) ? timer_get_monotonic_ns()+
+    timer_seconds_to_ns(dev->timeout) : -1;
+}
+
+int serial_loop_get_wait(serial_loop_t* loop, int64_t end) {
+  int64_t deadline = end;
+  size_t i;
+
+  thread_mutex_lock(&loop->mutex);
+  for (i = 0; i < loop->num_entries; ++i)
+    if ((loop->entries[i]->deadline >= 0) && ((deadline < 0) ||
+        (loop->entries[i]->deadline < deadline)))
+      deadline = loop->entries[i]->deadline;
+  thread_mutex_unlock(&loop->mutex);
+
+  if (deadline < 0)
+    return -1;
+
+  deadline -= timer_get_monotonic_ns();
+
+  return (deadline > 0) ? (deadline+999999)/1000000 : 0;
+}
+
+void serial_loop_transmit(serial_loop_t* loop, serial_loop_entry_t* entry) {
+  struct epoll_event event;
+  serial_device_t* dev;
+  ssize_t n = 0;
+
+  thread_mutex_lock(&loop->mutex);
+
+  if ((dev = entry->dev) && entry->tx_size) {
+    n = write(dev->fd, entry->tx_data, entry->tx_size);
+
+    if (n > 0) {
+      serial_device_record(dev, serial_record_write, entry->tx_data, n);
+      memmove(entry->tx_data, &entry->tx_data[n], entry->tx_size-n);
+      entry->tx_size -= n;
+      dev->num_written += n;
+    }
+    else if ((n < 0) && ((errno == EWOULDBLOCK) || (errno == EINTR)))
+      n = 0;
+  }
+
+  if (dev && !entry->tx_size) {
+    entry->events &= ~EPOLLOUT;
+
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.events = entry->events;
+    event.data.ptr = entry;
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, dev->fd, &event);
+  }
+
+  thread_mutex_unlock(&loop->mutex);
+
+  if (n < 0)
+    serial_loop_fail(loop, entry, SERIAL_ERROR_WRITE);
+}
+
+void serial_loop_receive(serial_loop_t* loop, serial_loop_entry_t* entry,
+    uint32_t events) {
+  unsigned char data[SERIAL_LOOP_READ_BUFFER_SIZE];
+  serial_device_t* dev;
+  ssize_t n;
+
+  thread_mutex_lock(&loop->mutex);
+  dev = entry->dev;
+  thread_mutex_unlock(&loop->mutex);
+
+  if (!dev)
+    return;
+
+  n = read(dev->fd, data, sizeof(data));
+
+  if (n > 0) {
+    serial_device_record(dev, serial_record_read, data, n);
+    dev->num_read += n;
+    entry->deadline = serial_loop_get_deadline(dev);
+
+    entry->callback(dev, data, n, entry->arg);
+  }
+  else if (((n < 0) && (errno != EWOULDBLOCK) && (errno != EINTR)) ||
+      (!n && (events & (EPOLLERR | EPOLLHUP))))
+    serial_loop_fail(loop, entry, SERIAL_ERROR_READ);
+}
+
+void serial_loop_check_timeouts(serial_loop_t* loop) {
+  serial_loop_entry_t* entry;
+  serial_device_t* dev;
+  int64_t now = timer_get_monotonic_ns();
+  size_t i;
+
+  while (1) {
+    entry = 0;
+    dev = 0;
+
+    thread_mutex_lock(&loop->mutex);
+    for (i = 0; i < loop->num_entries; ++i)
+      if ((loop->entries[i]->deadline >= 0) &&
+          (loop->entries[i]->deadline <= now)) {
+        entry = loop->entries[i];
+        dev = entry->dev;
+        entry->deadline = serial_loop_get_deadline(dev);
+        break;
+      }
+    thread_mutex_unlock(&loop->mutex);
+
+    if (!entry)
+      break;
+
+    entry->callback(dev, 0, -SERIAL_ERROR_TIMEOUT, entry->arg);
+  }
+}
+
+void serial_loop_fail(serial_loop_t* loop, serial_loop_entry_t* entry,
+    int error) {
+  serial_device_t* dev;
+
+  thread_mutex_lock(&loop->mutex);
+  dev = entry->dev;
+  thread_mutex_unlock(&loop->mutex);
+
+  if (dev) {
+    error_setf(&dev->error, error, dev->name);
+    entry->callback(dev, 0, -error, entry->arg);
+
+    serial_loop_remove(loop, dev);
+  }
+}
@@ -0,0 +1,194 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SERIAL_LOOP_H
+#define SERIAL_LOOP_H
+
+/** \file serial/loop.h
+  * \ingroup serial
+  * \brief Serial event loop
+  * \author Ralf Kaestner
+  * 
+  * The serial event loop multiplexes any number of open serial devices
+  * on a single epoll instance. Received data is delivered to a callback
+  * per device as soon as it arrives. Data written through the loop is
+  * sent immediately as far as the device accepts it, and the remainder
+  * is buffered and sent once epoll reports the device writable, such
+  * that no thread ever spins on a full output buffer.
+  * 
+  * The read timeout of each device is enforced as an idle timeout: if no
+  * data has been received within the timeout, the callback is notified.
+  * The loop may be run from a dedicated thread, while other threads add
+  * and remove devices, write data, or stop the loop.
+  */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "serial/serial.h"
+
+#include "thread/mutex.h"
+
+/** \brief Size of the buffer for reading data in the event loop
+  */
+#define SERIAL_LOOP_READ_BUFFER_SIZE      4096
+
+/** \brief Maximum number of events processed per wait of the event loop
+  */
+#define SERIAL_LOOP_MAX_EVENTS            64
+
+/** \brief Serial event loop callback type
+  * 
+  * The callback receives the device, the received data and its size, and
+  * the argument given when the device was added to the loop. A negative
+  * size indicates the negative error code of a failed read or write, or
+  * -SERIAL_ERROR_TIMEOUT if the device has been idle for its read
+  * timeout. A device which failed is removed from the loop after its
+  * callback has returned.
+  */
+typedef void (*serial_loop_callback_t)(serial_device_t* dev,
+  const unsigned char* data, ssize_t size, void* arg);
+
+/** \brief Serial event loop entry structure
+  */
+typedef struct serial_loop_entry_t {
+  serial_device_t* dev;             //!< The serial device.
+  serial_loop_callback_t callback;  //!< The receive callback.
+  void* arg;                        //!< The argument of the callback.
+
+  unsigned char* tx_data;           //!< The buffered transmit data.
+  size_t tx_size;                   //!< The size of the buffered data.
+  size_t tx_capacity;               //!< The capacity of the buffer.
+  uint32_t events;                  //!< The events monitored by epoll.
+
+  int64_t deadline;                 //!< The idle deadline in [ns].
+} serial_loop_entry_t;
+
+/** \brief Serial event loop structure
+  */
+typedef struct serial_loop_t {
+  int epoll_fd;                     //!< The epoll file descriptor.
+  int wakeup_fd;                    //!< The eventfd waking the loop.
+
+  serial_loop_entry_t** entries;    //!< The entries of the devices.
+  size_t num_entries;               //!< The number of entries.
+  serial_loop_entry_t** removed;    //!< The entries pending release.
+  size_t num_removed;               //!< The number of removed entries.
+
+  thread_mutex_t mutex;             //!< The mutex protecting the entries.
+  atomic_int exit_request;          //!< Flag requesting the loop to exit.
+
+  error_t error;                    //!< The most recent loop error.
+} serial_loop_t;
+
+/** \brief Initialize serial event loop
+  * \param[in] loop The serial event loop to be initialized.
+  * \return The resulting error code.
+  */
+int serial_loop_init(
+  serial_loop_t* loop);
+
+/** \brief Destroy serial event loop
+  * \param[in] loop The serial event loop to be destroyed.
+  * 
+  * The devices of the loop are removed, but remain open. Buffered
+  * transmit data is discarded.
+  */
+void serial_loop_destroy(
+  serial_loop_t* loop);
+
+/** \brief Add serial device to event loop
+  * \param[in] loop The initialized serial event loop to add the device to.
+  * \param[in] dev The open serial device to be added.
+  * \param[in] callback The callback receiving data from the device.
+  * \param[in] arg The argument passed to the callback.
+  * \return The resulting error code.
+  */
+int serial_loop_add(
+  serial_loop_t* loop,
+  serial_device_t* dev,
+  serial_loop_callback_t callback,
+  void* arg);
+
+/** \brief Remove serial device from event loop
+  * \param[in] loop The initialized serial event loop to remove the
+  *   device from.
+  * \param[in] dev The serial device to be removed.
+  * \return The resulting error code.
+  * 
+  * Buffered transmit data of the device is discarded. The device may be
+  * removed from within its callback or concurrently to the running loop.
+  * Since events already returned by the kernel may still refer to the
+  * device's entry, the entry is released by the loop after dispatching
+  * these events, or when the loop is destroyed.
+  */
+int serial_loop_remove(
+  serial_loop_t* loop,
+  serial_device_t* dev);
+
+/** \brief Write data to serial device of event loop
+  * \param[in] loop The initialized serial event loop containing the device.
+  * \param[in] dev The serial device to write data to.
+  * \param[in] data An array containing the data to be written to the device.
+  * \param[in] num The number of data bytes to be written.
+  * \return The number of bytes accepted for writing or the negative
+  *   error code.
+  * 
+  * The data is written immediately as far as the device accepts it. The
+  * remaining data is buffered and written by the event loop in order.
+  */
+ssize_t serial_loop_write(
+  serial_loop_t* loop,
+  serial_device_t* dev,
+  const unsigned char* data,
+  size_t num);
+
+/** \brief Retrieve the amount of buffered transmit data of serial device
+  * \param[in] loop The initialized serial event loop containing the device.
+  * \param[in] dev The serial device to retrieve the buffered data for.
+  * \return The number of bytes waiting to be written by the event loop.
+  */
+size_t serial_loop_get_pending(
+  serial_loop_t* loop,
+  serial_device_t* dev);
+
+/** \brief Run serial event loop
+  * \param[in] loop The initialized serial event loop to be run.
+  * \param[in] timeout The duration in [s] for which the loop will be
+  *   run. A negative timeout runs the loop until it is stopped.
+  * \return The resulting error code.
+  * 
+  * Callbacks are invoked from within the calling thread.
+  */
+int serial_loop_run(
+  serial_loop_t* loop,
+  double timeout);
+
+/** \brief Stop serial event loop
+  * \param[in] loop The serial event loop to be stopped.
+  * 
+  * This function may be called from any thread or callback. A running
+  * loop returns after dispatching the current events.
+  */
+void serial_loop_stop(
+  serial_loop_t* loop);
+
+#endif
@@ -0,0 +1,112 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <string.h>
+
+#include "packet.h"
+
+int serial_packet_grow(serial_packet_t* packet, size_t capacity);
+
+void serial_packet_init(serial_packet_t* packet, size_t headroom, size_t
+    capacity) {
+  packet->capacity = (capacity > headroom) ? capacity : headroom;
+  if (!(packet->buffer = malloc(packet->capacity)))
+    packet->capacity = 0;
+
+  packet->offset = packet->capacity ? headroom : 0;
+  packet->size = 0;
+}
+
+void serial_packet_destroy(serial_packet_t* packet) {
+  free(packet->buffer);
+
+  packet->buffer = 0;
+  packet->capacity = 0;
+  packet->offset = 0;
+  packet->size = 0;
+}
+
+void serial_packet_reset(serial_packet_t* packet, size_t headroom) {
+  if ((headroom > packet->capacity) && serial_packet_grow(packet,
+      headroom))
+    headroom = 0;
+
+  packet->offset = headroom;
+  packet->size = 0;
+}
+
+unsigned char* serial_packet_put(serial_packet_t* packet, size_t size) {
+  unsigned char* data;
+
+  if ((packet->offset+packet->size+size > packet->capacity) &&
+      serial_packet_grow(packet, 2*(packet->offset+packet->size+size)))
+    return 0;
+
+  data = &packet->buffer[packet->offset+packet->size];
+  packet->size += size;
+
+  return data;
+}
+
+unsigned char* serial_packet_push(serial_packet_t* packet, size_t size) {
+  size_t offset;
+
+  if (size > packet->offset) {
+    offset = 2*size;
+    if ((offset+packet->size > packet->capacity) &&
+        serial_packet_grow(packet, offset+packet->size))
+      return 0;
+
+    memmove(&packet->buffer[offset], &packet->buffer[packet->offset],
+      packet->size);
+    packet->offset = offset;
+  }
+
+  packet->offset -= size;
+  packet->size += size;
+
+  return &packet->buffer[packet->offset];
+}
+
+unsigned char* serial_packet_get_data(const serial_packet_t* packet) {
+  return &packet->buffer[packet->offset];
+}
+
+size_t serial_packet_get_size(const serial_packet_t* packet) {
+  return packet->size;
+}
+
+int serial_packet_write(serial_device_t* dev, const serial_packet_t*
+    packet) {
+  return serial_device_write(dev, &packet->buffer[packet->offset],
+    packet->size);
+}
+
+int serial_packet_grow(serial_packet_t* packet, size_t capacity) {
+  unsigned char* buffer;
+
+  if (!(buffer = realloc(packet->buffer, capacity)))
+    return SERIAL_ERROR_NO_MEMORY;
+
+  packet->buffer = buffer;
+  packet->capacity = capacity;
+
+  return SERIAL_ERROR_NONE;
+}
@@ -0,0 +1,130 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SERIAL_PACKET_H
+#define SERIAL_PACKET_H
+
+/** \file serial/packet.h
+  * \ingroup serial
+  * \brief Serial packet builder
+  * \author Ralf Kaestner
+  * 
+  * The packet builder assembles a packet in a single contiguous buffer
+  * which reserves space in front of the payload. Protocol layers append
+  * their payload and trailers, such as checksums, at the end and prepend
+  * their headers into the reserved space, each writing directly into
+  * the buffer. The finished packet is then written to the device without
+  * being copied.
+  */
+
+#include <stdlib.h>
+
+#include "serial/serial.h"
+
+/** \brief Serial packet structure
+  */
+typedef struct serial_packet_t {
+  unsigned char* buffer;          //!< The packet buffer.
+  size_t capacity;                //!< The capacity of the buffer.
+
+  size_t offset;                  //!< The offset of the packet data.
+  size_t size;                    //!< The size of the packet data.
+} serial_packet_t;
+
+/** \brief Initialize serial packet
+  * \param[in] packet The packet to be initialized.
+  * \param[in] headroom The space in bytes reserved for headers.
+  * \param[in] capacity The initial capacity of the packet buffer in bytes,
+  *   including the headroom.
+  */
+void serial_packet_init(
+  serial_packet_t* packet,
+  size_t headroom,
+  size_t capacity);
+
+/** \brief Destroy serial packet
+  * \param[in] packet The initialized packet to be destroyed.
+  */
+void serial_packet_destroy(
+  serial_packet_t* packet);
+
+/** \brief Reset serial packet
+  * \param[in] packet The initialized packet to be reset.
+  * \param[in] headroom The space in bytes reserved for headers.
+  * 
+  * Resetting empties the packet, such that its buffer may be reused for
+  * building the next packet.
+  */
+void serial_packet_reset(
+  serial_packet_t* packet,
+  size_t headroom);
+
+/** \brief Append space to serial packet
+  * \param[in] packet The initialized packet to append the space to.
+  * \param[in] size The size of the space to be appended in bytes.
+  * \return The appended space, which the caller fills with data, or null
+  *   if the packet buffer failed to grow.
+  * 
+  * The packet buffer grows as required, which invalidates the pointers
+  * returned before. If growing fails, the packet remains unchanged.
+  */
+unsigned char* serial_packet_put(
+  serial_packet_t* packet,
+  size_t size);
+
+/** \brief Prepend space to serial packet
+  * \param[in] packet The initialized packet to prepend the space to.
+  * \param[in] size The size of the space to be prepended in bytes.
+  * \return The prepended space, which the caller fills with data, or null
+  *   if the packet buffer failed to grow.
+  * 
+  * The space is taken from the headroom of the packet. Only if the
+  * headroom is insufficient, the packet data is moved, which invalidates
+  * the pointers returned before.
+  */
+unsigned char* serial_packet_push(
+  serial_packet_t* packet,
+  size_t size);
+
+/** \brief Retrieve the data of serial packet
+  * \param[in] packet The initialized packet to retrieve the data for.
+  * \return The contiguous packet data.
+  */
+unsigned char* serial_packet_get_data(
+  const serial_packet_t* packet);
+
+/** \brief Retrieve the size of serial packet
+  * \param[in] packet The initialized packet to retrieve the size for.
+  * \return The size of the packet data in bytes.
+  */
+size_t serial_packet_get_size(
+  const serial_packet_t* packet);
+
+/** \brief Write serial packet to open serial device
+  * \param[in] dev The open serial device to write the packet to.
+  * \param[in] packet The packet to be written.
+  * \return The number of bytes written to the serial device or the
+  *   negative error code.
+  */
+int serial_packet_write(
+  serial_device_t* dev,
+  const serial_packet_t* packet);
+
+#endif
@@ -0,0 +1,207 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <string.h>
+
+#include "recorder.h"
+
+#include "timer/timer.h"
+
+#define SERIAL_RECORDER_HEADER_SIZE       8
+#define SERIAL_RECORDER_RECORD_SIZE       12
+
+void serial_recorder_encode(unsigned char* data, uint64_t value, size_t
+  size);
+uint64_t serial_recorder_decode(const unsigned char* data, size_t size);
+
+void serial_recorder_init(serial_recorder_t* recorder, const char*
+    filename) {
+  file_init_name(&recorder->file, filename);
+  recorder->dev = 0;
+
+  recorder->start = 0;
+  recorder->num_records = 0;
+  recorder->num_bytes = 0;
+
+  thread_mutex_init(&recorder->mutex);
+
+  error_init(&recorder->error, serial_errors);
+}
+
+void serial_recorder_destroy(serial_recorder_t* recorder) {
+  if (recorder->dev)
+    serial_recorder_stop(recorder);
+
+  file_destroy(&recorder->file);
+  thread_mutex_destroy(&recorder->mutex);
+
+  error_destroy(&recorder->error);
+}
+
+int serial_recorder_start(serial_recorder_t* recorder, serial_device_t*
+    dev) {
+  unsigned char header[SERIAL_RECORDER_HEADER_SIZE];
+
+  error_clear(&recorder->error);
+
+  if (recorder->dev)
+    serial_recorder_stop(recorder);
+
+  memcpy(header, SERIAL_RECORDER_MAGIC, 4);
+  serial_recorder_encode(&header[4], (uint32_t)dev->baud_rate, 4);
+
+  if (file_open(&recorder->file, file_mode_write) ||
+      (file_write(&recorder->file, header, sizeof(header)) !=
+        sizeof(header))) {
+    file_close(&recorder->file);
+
+    error_setf(&recorder->error, SERIAL_ERROR_RECORD, recorder->file.name);
+    return error_get(&recorder->error);
+  }
+
+  recorder->dev = dev;
+  recorder->start = timer_get_monotonic_ns();
+  recorder->num_records = 0;
+  recorder->num_bytes = 0;
+
+  dev->recorder = recorder;
+
+  return error_get(&recorder->error);
+}
+
+int serial_recorder_stop(serial_recorder_t* recorder) {
+  if (recorder->dev) {
+    thread_mutex_lock(&recorder->mutex);
+
+    recorder->dev->recorder = 0;
+    recorder->dev = 0;
+
+    if (file_flush(&recorder->file) && !error_get(&recorder->error))
+      error_setf(&recorder->error, SERIAL_ERROR_RECORD,
+        recorder->file.name);
+    file_close(&recorder->file);
+
+    thread_mutex_unlock(&recorder->mutex);
+  }
+
+  return error_get(&recorder->error);
+}
+
+void serial_recorder_record(serial_recorder_t* recorder,
+    serial_record_type_t type, const unsigned char* data, size_t size) {
+  struct iovec iov;
+
+  iov.iov_base = (void*)data;
+  iov.iov_len = size;
+
+  serial_recorder_recordv(recorder, type, &iov, 1, size);
+}
+
+void serial_recorder_recordv(serial_recorder_t* recorder,
+    serial_record_type_t type, const struct iovec* iov, int iovcnt, size_t
+    size) {
+  unsigned char header[SERIAL_RECORDER_RECORD_SIZE];
+  int64_t timestamp = timer_get_monotonic_ns();
+  size_t num, num_recorded = 0;
+  int i;
+
+  if (!size)
+    return;
+
+  thread_mutex_lock(&recorder->mutex);
+
+  if (recorder->dev && !error_get(&recorder->error)) {
+    serial_recorder_encode(header, timestamp-recorder->start, 8);
+    serial_recorder_encode(&header[8], ((uint64_t)size << 1) |
+      (type == serial_record_write), 4);
+
+    if (file_write(&recorder->file, header, sizeof(header)) !=
+        sizeof(header))
+      error_setf(&recorder->error, SERIAL_ERROR_RECORD,
+        recorder->file.name);
+
+    for (i = 0; (i < iovcnt) && (num_recorded < size) &&
+        !error_get(&recorder->error); ++i) {
+      num = (iov[i].iov_len < size-num_recorded) ? iov[i].iov_len :
+        size-num_recorded;
+
+      if (file_write(&recorder->file, iov[i].iov_base, num) != num)
+        error_setf(&recorder->error, SERIAL_ERROR_RECORD,
+          recorder->file.name);
+      num_recorded += num;
+    }
+
+    if (!error_get(&recorder->error)) {
+      ++recorder->num_records;
+      recorder->num_bytes += size;
+    }
+  }
+
+  thread_mutex_unlock(&recorder->mutex);
+}
+
+int serial_recorder_read_header(file_t* file, int* baud_rate) {
+  unsigned char header[SERIAL_RECORDER_HEADER_SIZE];
+
+  if ((file_read(file, header, sizeof(header)) != sizeof(header)) ||
+      memcmp(header, SERIAL_RECORDER_MAGIC, 4))
+    return SERIAL_ERROR_REPLAY;
+
+  *baud_rate = (int32_t)serial_recorder_decode(&header[4], 4);
+
+  return SERIAL_ERROR_NONE;
+}
+
+int serial_recorder_read_record(file_t* file, serial_record_t* record) {
+  unsigned char header[SERIAL_RECORDER_RECORD_SIZE];
+  ssize_t result;
+  uint64_t word;
+
+  result = file_read(file, header, sizeof(header));
+  if ((result <= 0) && file_eof(file))
+    return 0;
+  else if (result != sizeof(header))
+    return -SERIAL_ERROR_REPLAY;
+
+  record->timestamp = serial_recorder_decode(header, 8);
+  word = serial_recorder_decode(&header[8], 4);
+  record->type = (word & 1) ? serial_record_write : serial_record_read;
+  record->size = word >> 1;
+
+  return 1;
+}
+
+void serial_recorder_encode(unsigned char* data, uint64_t value, size_t
+    size) {
+  size_t i;
+
+  for (i = 0; i < size; ++i)
+    data[i] = value >> (8*i);
+}
+
+uint64_t serial_recorder_decode(const unsigned char* data, size_t size) {
+  uint64_t value = 0;
+  size_t i;
+
+  for (i = 0; i < size; ++i)
+    value |= (uint64_t)data[i] << (8*i);
+
+  return value;
+}
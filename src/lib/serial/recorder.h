@@ -0,0 +1,187 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SERIAL_RECORDER_H
+#define SERIAL_RECORDER_H
+
+/** \file serial/recorder.h
+  * \ingroup serial
+  * \brief Serial traffic recorder
+  * \author Ralf Kaestner
+  * 
+  * The serial traffic recorder logs every chunk of data read from or
+  * written to a serial device, together with its monotonic timestamp in
+  * [ns], into a compact binary file. The log file may be compressed
+  * according to its name suffix and can be replayed by a serial replay
+  * backend in the absence of the actual device.
+  * 
+  * A log starts with the 4-byte magic "TSR1" followed by the recorded
+  * baud rate as 32-bit integer. Each chunk is then stored as a 64-bit
+  * timestamp relative to the start of the recording, a 32-bit word
+  * holding the chunk size shifted left by one bit and the chunk type in
+  * its least significant bit, and the chunk data. All integers are stored
+  * in little-endian byte order.
+  */
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "serial/serial.h"
+
+#include "file/file.h"
+#include "thread/mutex.h"
+
+/** \brief Magic bytes identifying a serial traffic log
+  */
+#define SERIAL_RECORDER_MAGIC             "TSR1"
+
+/** \brief Serial record type enumerable type
+  */
+typedef enum {
+  serial_record_read,             //!< Data read from the device.
+  serial_record_write             //!< Data written to the device.
+} serial_record_type_t;
+
+/** \brief Serial record structure
+  */
+typedef struct serial_record_t {
+  int64_t timestamp;              //!< The timestamp of the record in [ns].
+  serial_record_type_t type;      //!< The type of the record.
+  size_t size;                    //!< The size of the record data.
+} serial_record_t;
+
+/** \brief Serial traffic recorder structure
+  */
+typedef struct serial_recorder_t {
+  file_t file;                    //!< The log file.
+  serial_device_t* dev;           //!< The device being recorded.
+
+  int64_t start;                  //!< The start of the recording in [ns].
+  size_t num_records;             //!< Number of records logged.
+  size_t num_bytes;               //!< Number of data bytes logged.
+
+  thread_mutex_t mutex;           //!< The recorder mutex.
+
+  error_t error;                  //!< The most recent recorder error.
+} serial_recorder_t;
+
+/** \brief Initialize serial traffic recorder
+  * \param[in] recorder The recorder to be initialized.
+  * \param[in] filename The name of the log file, whose compression will
+  *   be inferred from its suffix.
+  * 
+  * In order to not delay the device operations by compressing the log,
+  * the caller may enable asynchronous writing of the recorder's file by
+  * calling file_set_async() before the recording is started.
+  */
+void serial_recorder_init(
+  serial_recorder_t* recorder,
+  const char* filename);
+
+/** \brief Destroy serial traffic recorder
+  * \param[in] recorder The initialized recorder to be destroyed.
+  * 
+  * An active recording will be stopped before destruction.
+  */
+void serial_recorder_destroy(
+  serial_recorder_t* recorder);
+
+/** \brief Start recording serial traffic
+  * \param[in] recorder The initialized recorder to be started.
+  * \param[in] dev The open serial device to be recorded.
+  * \return The resulting error code.
+  * 
+  * The log file will be created or truncated, and all subsequent reads
+  * from and writes to the device, including those performed by a serial
+  * event loop, will be recorded until the recording is stopped.
+  */
+int serial_recorder_start(
+  serial_recorder_t* recorder,
+  serial_device_t* dev);
+
+/** \brief Stop recording serial traffic
+  * \param[in] recorder The started recorder to be stopped.
+  * \return The resulting error code, reporting the first error which
+  *   occurred during the recording.
+  * 
+  * The recorder will be detached from the device, and the log file will
+  * be flushed and closed.
+  */
+int serial_recorder_stop(
+  serial_recorder_t* recorder);
+
+/** \brief Record a chunk of serial traffic
+  * \param[in] recorder The started recorder to log the chunk with.
+  * \param[in] type The type of the chunk.
+  * \param[in] data The data of the chunk.
+  * \param[in] size The size of the chunk in bytes.
+  * 
+  * This function is called by the serial device operations and may be
+  * called from multiple threads. Once an error has occurred, subsequent
+  * chunks will be ignored.
+  */
+void serial_recorder_record(
+  serial_recorder_t* recorder,
+  serial_record_type_t type,
+  const unsigned char* data,
+  size_t size);
+
+/** \brief Record a gathered chunk of serial traffic
+  * \param[in] recorder The started recorder to log the chunk with.
+  * \param[in] type The type of the chunk.
+  * \param[in] iov An array of buffers containing the data of the chunk.
+  * \param[in] iovcnt The number of buffers.
+  * \param[in] size The size of the chunk in bytes, which may be smaller
+  *   than the total size of the buffers.
+  * 
+  * This function behaves like serial_recorder_record(), but logs data
+  * scattered across multiple buffers as a single chunk.
+  */
+void serial_recorder_recordv(
+  serial_recorder_t* recorder,
+  serial_record_type_t type,
+  const struct iovec* iov,
+  int iovcnt,
+  size_t size);
+
+/** \brief Read header of serial traffic log
+  * \param[in] file The log file opened for reading.
+  * \param[out] baud_rate The recorded baud rate of the device.
+  * \return The resulting error code.
+  */
+int serial_recorder_read_header(
+  file_t* file,
+  int* baud_rate);
+
+/** \brief Read record from serial traffic log
+  * \param[in] file The log file opened for reading, positioned after
+  *   the header or after a previous record's data.
+  * \param[out] record The record read from the log.
+  * \return One if a record has been read, zero at the end of the log, or
+  *   the negative error code.
+  * 
+  * The caller is expected to read or skip the record data from the file
+  * before reading the next record.
+  */
+int serial_recorder_read_record(
+  file_t* file,
+  serial_record_t* record);
+
+#endif
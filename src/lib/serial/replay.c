@@ -0,0 +1,279 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+
+#include "replay.h"
+
+#include "string/string.h"
+#include "timer/timer.h"
+
+#define SERIAL_REPLAY_DRAIN_SIZE          4096
+
+void* serial_replay_run(void* arg);
+int serial_replay_poll(serial_replay_t* replay, short events, int64_t
+  deadline);
+int serial_replay_feed(serial_replay_t* replay, const unsigned char* data,
+  size_t size);
+
+void serial_replay_init(serial_replay_t* replay, const char* filename) {
+  file_init_name(&replay->file, filename);
+  replay->name = 0;
+  replay->baud_rate = 0;
+
+  replay->master = -1;
+  replay->slave = -1;
+  replay->speed = 0.0;
+
+  replay->wakeup_fd = -1;
+  replay->started = 0;
+  atomic_init(&replay->exit_request, 0);
+  atomic_init(&replay->finished, 0);
+
+  replay->num_records = 0;
+  replay->num_read = 0;
+  replay->num_written = 0;
+
+  error_init(&replay->error, serial_errors);
+}
+
+void serial_replay_destroy(serial_replay_t* replay) {
+  serial_replay_close(replay);
+
+  file_destroy(&replay->file);
+  error_destroy(&replay->error);
+}
+
+int serial_replay_open(serial_replay_t* replay) {
+  struct termios tio;
+  int unlock = 0, index;
+
+  error_clear(&replay->error);
+
+  if (replay->master >= 0)
+    serial_replay_close(replay);
+
+  if (file_open(&replay->file, file_mode_read) ||
+      serial_recorder_read_header(&replay->file, &replay->baud_rate)) {
+    file_close(&replay->file);
+
+    error_setf(&replay->error, SERIAL_ERROR_REPLAY, replay->file.name);
+    return error_get(&replay->error);
+  }
+
+  if (((replay->master = open("/dev/ptmx", O_RDWR | O_NOCTTY |
+        O_NONBLOCK)) < 0) ||
+      (ioctl(replay->master, TIOCSPTLCK, &unlock) < 0) ||
+      (ioctl(replay->master, TIOCGPTN, &index) < 0) ||
+      !string_printf(&replay->name, "/dev/pts/%d", index) ||
+      ((replay->slave = open(replay->name, O_RDWR | O_NOCTTY)) < 0) ||
+      tcgetattr(replay->slave, &tio) ||
+      ((replay->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)) {
+    serial_replay_close(replay);
+
+    error_setf(&replay->error, SERIAL_ERROR_REPLAY, replay->file.name);
+    return error_get(&replay->error);
+  }
+
+  cfmakeraw(&tio);
+  tcsetattr(replay->slave, TCSANOW, &tio);
+
+  return error_get(&replay->error);
+}
+
+int serial_replay_close(serial_replay_t* replay) {
+  serial_replay_stop(replay);
+
+  if (replay->wakeup_fd >= 0)
+    close(replay->wakeup_fd);
+  if (replay->slave >= 0)
+    close(replay->slave);
+  if (replay->master >= 0)
+    close(replay->master);
+
+  replay->wakeup_fd = -1;
+  replay->slave = -1;
+  replay->master = -1;
+
+  string_destroy(&replay->name);
+  file_close(&replay->file);
+
+  return error_get(&replay->error);
+}
+
+int serial_replay_start(serial_replay_t* replay, double speed) {
+  error_clear(&replay->error);
+
+  if (replay->started || (replay->master < 0)) {
+    error_setf(&replay->error, SERIAL_ERROR_REPLAY, replay->file.name);
+    return error_get(&replay->error);
+  }
+
+  replay->speed = speed;
+  replay->num_records = 0;
+  replay->num_read = 0;
+  replay->num_written = 0;
+
+  atomic_store(&replay->exit_request, 0);
+  atomic_store(&replay->finished, 0);
+
+  if (pthread_create(&replay->thread, 0, serial_replay_run, replay)) {
+    error_setf(&replay->error, SERIAL_ERROR_REPLAY, replay->file.name);
+    return error_get(&replay->error);
+  }
+  replay->started = 1;
+
+  return error_get(&replay->error);
+}
+
+void serial_replay_stop(serial_replay_t* replay) {
+  uint64_t value = 1;
+
+  if (replay->started) {
+    atomic_store(&replay->exit_request, 1);
+    if (write(replay->wakeup_fd, &value, sizeof(value)) < 0) {}
+
+    pthread_join(replay->thread, 0);
+    replay->started = 0;
+  }
+}
+
+int serial_replay_wait(serial_replay_t* replay) {
+  if (replay->started) {
+    pthread_join(replay->thread, 0);
+    replay->started = 0;
+  }
+
+  return error_get(&replay->error);
+}
+
+int serial_replay_test_finished(serial_replay_t* replay) {
+  return atomic_load(&replay->finished);
+}
+
+void* serial_replay_run(void* arg) {
+  serial_replay_t* replay = arg;
+  serial_record_t record;
+  unsigned char* data = 0;
+  size_t capacity = 0;
+  int64_t start = timer_get_monotonic_ns(), origin = -1, deadline;
+  int result = SERIAL_ERROR_NONE;
+
+  while (!atomic_load(&replay->exit_request) &&
+      ((result = serial_recorder_read_record(&replay->file, &record)) > 0)) {
+    if (record.size > capacity) {
+      capacity = record.size;
+      data = realloc(data, capacity);
+    }
+
+    if (file_read(&replay->file, data, record.size) != record.size) {
+      result = -SERIAL_ERROR_REPLAY;
+      break;
+    }
+    if (record.type != serial_record_read)
+      continue;
+
+    if (replay->speed > 0.0) {
+      if (origin < 0)
+        origin = record.timestamp;
+      deadline = start+(int64_t)((record.timestamp-origin)/replay->speed);
+
+      if (!serial_replay_poll(replay, 0, deadline))
+        break;
+    }
+
+    if ((result = serial_replay_feed(replay, data, record.size)) <= 0)
+      break;
+    ++replay->num_records;
+  }
+
+  if (result < 0)
+    error_setf(&replay->error, SERIAL_ERROR_REPLAY, replay->file.name);
+
+  free(data);
+  atomic_store(&replay->finished, 1);
+
+  return 0;
+}
+
+int serial_replay_poll(serial_replay_t* replay, short events, int64_t
+    deadline) {
+  unsigned char data[SERIAL_REPLAY_DRAIN_SIZE];
+  struct pollfd fds[2];
+  int64_t remaining;
+  int timeout = -1;
+  ssize_t n;
+
+  fds[0].fd = replay->master;
+  fds[0].events = events | POLLIN;
+  fds[1].fd = replay->wakeup_fd;
+  fds[1].events = POLLIN;
+
+  while (!atomic_load(&replay->exit_request)) {
+    if (deadline >= 0) {
+      remaining = deadline-timer_get_monotonic_ns();
+      if (remaining < timer_get_spin_threshold()+1000000) {
+        timer_sleep_until(deadline);
+        return 1;
+      }
+
+      timeout = (remaining-timer_get_spin_threshold())/1000000;
+    }
+
+    if ((poll(fds, 2, timeout) < 0) && (errno != EINTR))
+      return 0;
+
+    if (fds[0].revents & POLLIN) {
+      while ((n = read(replay->master, data, sizeof(data))) > 0)
+        replay->num_written += n;
+    }
+    if (fds[0].revents & events)
+      return 1;
+  }
+
+  return 0;
+}
+
+int serial_replay_feed(serial_replay_t* replay, const unsigned char* data,
+    size_t size) {
+  size_t offset = 0;
+  ssize_t n;
+
+  while (offset < size) {
+    n = write(replay->master, &data[offset], size-offset);
+
+    if (n > 0) {
+      offset += n;
+      replay->num_read += n;
+    }
+    else if ((n < 0) && (errno != EWOULDBLOCK) && (errno != EINTR))
+      return -SERIAL_ERROR_REPLAY;
+    else if (!serial_replay_poll(replay, POLLOUT, -1))
+      return 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef SERIAL_REPLAY_H
+#define SERIAL_REPLAY_H
+
+/** \file serial/replay.h
+  * \ingroup serial
+  * \brief Serial traffic replay backend
+  * \author Ralf Kaestner
+  * 
+  * The serial replay backend presents a log recorded by the serial
+  * traffic recorder as a serial device. It creates a pseudo-terminal whose
+  * slave may be opened as a serial device, and a replay thread feeds the
+  * recorded device reads into its master at the original or an
+  * accelerated speed. Data written to the device is consumed and
+  * discarded, such that parsers and protocol stacks can be exercised and
+  * benchmarked deterministically without the actual hardware.
+  */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "serial/recorder.h"
+
+/** \brief Serial replay structure
+  */
+typedef struct serial_replay_t {
+  file_t file;                    //!< The log file.
+  char* name;                     //!< The name of the replayed device.
+  int baud_rate;                  //!< The recorded baud rate in [baud].
+
+  int master;                     //!< Pseudo-terminal master descriptor.
+  int slave;                      //!< Pseudo-terminal slave descriptor.
+  double speed;                   //!< The replay speed factor.
+
+  pthread_t thread;               //!< The replay thread.
+  int wakeup_fd;                  //!< The event waking the replay thread.
+  int started;                    //!< Flag signaling the replay has started.
+  atomic_int exit_request;        //!< Flag signaling a pending exit request.
+  atomic_int finished;            //!< Flag signaling the replay has finished.
+
+  size_t num_records;             //!< Number of records replayed.
+  size_t num_read;                //!< Number of bytes fed to the device.
+  size_t num_written;             //!< Number of bytes written by the device.
+
+  error_t error;                  //!< The most recent replay error.
+} serial_replay_t;
+
+/** \brief Initialize serial replay
+  * \param[in] replay The replay to be initialized.
+  * \param[in] filename The name of the log file, whose compression will
+  *   be inferred from its suffix.
+  */
+void serial_replay_init(
+  serial_replay_t* replay,
+  const char* filename);
+
+/** \brief Destroy serial replay
+  * \param[in] replay The initialized replay to be destroyed.
+  * 
+  * An open replay will be closed before destruction.
+  */
+void serial_replay_destroy(
+  serial_replay_t* replay);
+
+/** \brief Open serial replay
+  * \param[in] replay The initialized replay to be opened.
+  * \return The resulting error code.
+  * 
+  * Opening the replay reads the log header and creates the
+  * pseudo-terminal, whose slave is configured for raw transmission.
+  * Afterwards, the name of the replayed device may be passed to
+  * serial_device_init().
+  */
+int serial_replay_open(
+  serial_replay_t* replay);
+
+/** \brief Close serial replay
+  * \param[in] replay The opened replay to be closed.
+  * \return The resulting error code.
+  * 
+  * A running replay will be stopped before the pseudo-terminal and the
+  * log file are closed.
+  */
+int serial_replay_close(
+  serial_replay_t* replay);
+
+/** \brief Start serial replay
+  * \param[in] replay The opened replay to be started.
+  * \param[in] speed The factor by which the replay is accelerated with
+  *   respect to the recorded timing. A factor of one reproduces the
+  *   original timing, whereas a factor smaller or equal to zero replays
+  *   the log as fast as the device is being read.
+  * \return The resulting error code.
+  * 
+  * The replay should be started after the replayed device has been
+  * opened and set up.
+  */
+int serial_replay_start(
+  serial_replay_t* replay,
+  double speed);
+
+/** \brief Stop serial replay
+  * \param[in] replay The started replay to be stopped.
+  */
+void serial_replay_stop(
+  serial_replay_t* replay);
+
+/** \brief Wait for serial replay to finish
+  * \param[in] replay The started replay to wait for.
+  * \return The resulting error code.
+  * 
+  * This function blocks until all records have been replayed. Note that
+  * the device may still need to read the remaining data thereafter.
+  */
+int serial_replay_wait(
+  serial_replay_t* replay);
+
+/** \brief Test if serial replay has finished
+  * \param[in] replay The started replay to be tested.
+  * \return One if all records have been replayed, zero otherwise.
+  */
+int serial_replay_test_finished(
+  serial_replay_t* replay);
+
+#endif
@@ -24,10 +24,20 @@
 #include <termios.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
 
 #include "serial.h"
+#include "recorder.h"
 
 #include "string/string.h"
+#include "timer/timer.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX UIO_MAXIOV
+#endif
 
 const char* serial_errors[] = {
   "Success",
@@ -41,11 +51,25 @@ const char* serial_errors[] = {
   "Invalid parity",
   "Invalid flow control",
   "Error setting serial device parameters",
-  "Serial device select timeout",
+  "Serial device timeout",
   "Error reading from serial device",
   "Error writing to serial device",
+  "Serial event loop error",
+  "Invalid or oversized serial frame",
+  "Error recording serial device traffic",
+  "Error replaying serial device traffic",
+  "Insufficient memory",
 };
 
+int serial_device_poll(serial_device_t* dev, short events, int64_t
+  deadline);
+int serial_device_apply_low_latency(serial_device_t* dev, int low_latency);
+void serial_device_record(serial_device_t* dev, serial_record_type_t type,
+  const unsigned char* data, size_t size);
+void serial_device_recordv(serial_device_t* dev, serial_record_type_t type,
+  const struct iovec* iov, int iovcnt, size_t size);
+int serial_termios2_set_baud_rate(int fd, int baud_rate);
+
 void serial_device_init(serial_device_t* dev, const char* name) {
   dev->fd = 0;
   string_init_copy(&dev->name, name);
@@ -57,9 +81,15 @@ void serial_device_init(serial_device_t* dev, const char* name) {
   dev->flow_ctrl = serial_flow_ctrl_off;
 
   dev->timeout = 0.0;
+  dev->vmin = 0;
+  dev->vtime = 0;
+  dev->low_latency = 0;
+  serial_buffer_init(&dev->buffer, SERIAL_DEVICE_BUFFER_SIZE);
   
   dev->num_read = 0;
   dev->num_written = 0;
+
+  dev->recorder = 0;
   
   error_init(&dev->error, serial_errors);
 }
@@ -69,6 +99,7 @@ void serial_device_destroy(serial_device_t* dev) {
     serial_device_close(dev);
   
   string_destroy(&dev->name);
+  serial_buffer_destroy(&dev->buffer);
   error_destroy(&dev->error);
 }
 
@@ -76,6 +107,7 @@ int serial_device_open(serial_device_t* dev) {
   error_clear(&dev->error);
   
   dev->fd = open(dev->name, O_RDWR | O_NDELAY);
+  serial_buffer_clear(&dev->buffer);
 
   if (dev->fd < 0) {
     error_setf(&dev->error, SERIAL_ERROR_OPEN, dev->name);
@@ -108,6 +140,7 @@ int serial_device_setup(serial_device_t* dev, int baud_rate, int data_bits,
     int stop_bits, serial_parity_t parity, serial_flow_ctrl_t flow_ctrl,
     double timeout) {
   struct termios tio;
+  int custom_baud_rate = 0;
   memset(&tio, 0, sizeof(struct termios));
   
   error_clear(&dev->error);
@@ -167,10 +200,74 @@ int serial_device_setup(serial_device_t* dev, int baud_rate, int data_bits,
     case 230400:
       tio.c_cflag |= B230400;
       break;
+#ifdef B460800
+    case 460800:
+      tio.c_cflag |= B460800;
+      break;
+#endif
+#ifdef B500000
+    case 500000:
+      tio.c_cflag |= B500000;
+      break;
+#endif
+#ifdef B576000
+    case 576000:
+      tio.c_cflag |= B576000;
+      break;
+#endif
+#ifdef B921600
+    case 921600:
+      tio.c_cflag |= B921600;
+      break;
+#endif
+#ifdef B1000000
+    case 1000000:
+      tio.c_cflag |= B1000000;
+      break;
+#endif
+#ifdef B1152000
+    case 1152000:
+      tio.c_cflag |= B1152000;
+      break;
+#endif
+#ifdef B1500000
+    case 1500000:
+      tio.c_cflag |= B1500000;
+      break;
+#endif
+#ifdef B2000000
+    case 2000000:
+      tio.c_cflag |= B2000000;
+      break;
+#endif
+#ifdef B2500000
+    case 2500000:
+      tio.c_cflag |= B2500000;
+      break;
+#endif
+#ifdef B3000000
+    case 3000000:
+      tio.c_cflag |= B3000000;
+      break;
+#endif
+#ifdef B3500000
+    case 3500000:
+      tio.c_cflag |= B3500000;
+      break;
+#endif
+#ifdef B4000000
+    case 4000000:
+      tio.c_cflag |= B4000000;
+      break;
+#endif
     default:
-      error_setf(&dev->error, SERIAL_ERROR_INVALID_BAUD_RATE, "%d",
-        baud_rate);
-      return error_get(&dev->error);
+      if (baud_rate <= 0) {
+        error_setf(&dev->error, SERIAL_ERROR_INVALID_BAUD_RATE, "%d",
+          baud_rate);
+        return error_get(&dev->error);
+      }
+      tio.c_cflag |= B38400;
+      custom_baud_rate = 1;
   }
   dev->baud_rate = baud_rate;
   
@@ -226,7 +323,7 @@ int serial_device_setup(serial_device_t* dev, int baud_rate, int data_bits,
     case serial_flow_ctrl_off:
       break;
     case serial_flow_ctrl_xon_xoff:
-      tio.c_cflag |= IXON | IXOFF;
+      tio.c_iflag |= IXON | IXOFF;
       break;
     case serial_flow_ctrl_rts_cts:
       tio.c_cflag |= CRTSCTS;
@@ -239,76 +336,330 @@ int serial_device_setup(serial_device_t* dev, int baud_rate, int data_bits,
   
   dev->timeout = timeout;
 
-  tio.c_cflag |= CLOCAL;
-  tio.c_iflag = IGNPAR;
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_iflag |= IGNPAR;
+  tio.c_cc[VMIN] = dev->vmin;
+  tio.c_cc[VTIME] = dev->vtime;
   
+  serial_buffer_clear(&dev->buffer);
   if (tcflush(dev->fd, TCIOFLUSH) < 0)
     error_setf(&dev->error, SERIAL_ERROR_FLUSH, dev->name);
   else if (tcsetattr(dev->fd, TCSANOW, &tio) < 0)
     error_setf(&dev->error, SERIAL_ERROR_SETUP, dev->name);
+  else if (custom_baud_rate &&
+      serial_termios2_set_baud_rate(dev->fd, baud_rate))
+    error_setf(&dev->error, SERIAL_ERROR_INVALID_BAUD_RATE, "%d",
+      baud_rate);
+  else
+    serial_device_apply_low_latency(dev, 1);
   
   return error_get(&dev->error);
 }
 
 int serial_device_read(serial_device_t* dev, unsigned char* data,
     size_t num) {
-  size_t num_read = 0;
-  struct timeval time;
-  fd_set set;
-  int error;
+  size_t num_read;
+  int64_t deadline = timer_get_monotonic_ns()+
+    timer_seconds_to_ns(dev->timeout);
+  ssize_t n;
 
   error_clear(&dev->error);
+
+  num_read = serial_buffer_read(&dev->buffer, data, num);
   
   while (num_read < num) {
-    time.tv_sec = 0;
-    time.tv_usec = dev->timeout*1e6;
-
-    FD_ZERO(&set);
-    FD_SET(dev->fd, &set);
-
-    error = select(dev->fd+1, &set, NULL, NULL, &time);
-    if (error == 0) {
+    if (!serial_device_poll(dev, POLLIN, deadline)) {
       error_setf(&dev->error, SERIAL_ERROR_TIMEOUT, dev->name);
       return -error_get(&dev->error);
     }
 
-    ssize_t n;
     n = read(dev->fd, &data[num_read], num-num_read);
-    if ((n < 0) && (errno != EWOULDBLOCK)) {
+    if ((n < 0) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
       error_setf(&dev->error, SERIAL_ERROR_READ, dev->name);
       return -error_get(&dev->error);
     }
     if (n > 0) {
+      serial_device_record(dev, serial_record_read, &data[num_read], n);
       num_read += n;
       dev->num_read += n;
     }
+    else if (timer_get_monotonic_ns() >= deadline) {
+      error_setf(&dev->error, SERIAL_ERROR_TIMEOUT, dev->name);
+      return -error_get(&dev->error);
+    }
   }
   
   return num_read;
 }
 
+int serial_device_read_until(serial_device_t* dev, unsigned char* data,
+    size_t num, unsigned char delim) {
+  int64_t deadline = timer_get_monotonic_ns()+
+    timer_seconds_to_ns(dev->timeout);
+  size_t offset = 0;
+  ssize_t end;
+  int result;
+
+  error_clear(&dev->error);
+
+  while ((end = serial_buffer_find(&dev->buffer, delim, offset)) < 0) {
+    offset = serial_buffer_get_size(&dev->buffer);
+
+    if ((offset >= num) || !serial_buffer_get_space(&dev->buffer)) {
+      serial_buffer_read(&dev->buffer, data, num);
+      error_setf(&dev->error, SERIAL_ERROR_FRAME, dev->name);
+      return -error_get(&dev->error);
+    }
+
+    if ((result = serial_device_fill(dev, timer_ns_to_seconds(deadline-
+        timer_get_monotonic_ns()))) < 0)
+      return result;
+  }
+
+  if (end >= num) {
+    serial_buffer_read(&dev->buffer, data, num);
+    error_setf(&dev->error, SERIAL_ERROR_FRAME, dev->name);
+    return -error_get(&dev->error);
+  }
+
+  return serial_buffer_read(&dev->buffer, data, end+1);
+}
+
+int serial_device_fill(serial_device_t* dev, double timeout) {
+  int64_t deadline = timer_get_monotonic_ns()+timer_seconds_to_ns(timeout);
+  struct iovec iov[2];
+  size_t offset;
+  ssize_t n;
+
+  error_clear(&dev->error);
+
+  if (!serial_buffer_get_space(&dev->buffer))
+    return 0;
+
+  while (1) {
+    if (!serial_device_poll(dev, POLLIN, deadline)) {
+      error_setf(&dev->error, SERIAL_ERROR_TIMEOUT, dev->name);
+      return -error_get(&dev->error);
+    }
+
+    offset = dev->buffer.head & (dev->buffer.capacity-1);
+    n = serial_buffer_fill(&dev->buffer, dev->fd);
+    if ((n < 0) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+      error_setf(&dev->error, SERIAL_ERROR_READ, dev->name);
+      return -error_get(&dev->error);
+    }
+    if (n > 0) {
+      iov[0].iov_base = &dev->buffer.data[offset];
+      iov[0].iov_len = dev->buffer.capacity-offset;
+      iov[1].iov_base = dev->buffer.data;
+      iov[1].iov_len = n;
+      serial_device_recordv(dev, serial_record_read, iov, 2, n);
+
+      dev->num_read += n;
+      return n;
+    }
+    else if (timer_get_monotonic_ns() >= deadline) {
+      error_setf(&dev->error, SERIAL_ERROR_TIMEOUT, dev->name);
+      return -error_get(&dev->error);
+    }
+  }
+}
+
+int serial_device_set_blocking(serial_device_t* dev, size_t min, double
+    timeout) {
+  struct termios tio;
+  int flags;
+
+  error_clear(&dev->error);
+
+  if ((min > 255) || (timeout < 0.0) || (timeout > 25.5)) {
+    error_setf(&dev->error, SERIAL_ERROR_SETUP, dev->name);
+    return error_get(&dev->error);
+  }
+
+  dev->vmin = min;
+  dev->vtime = (timeout > 0.0) ? (unsigned char)(timeout*10.0+0.999) : 0;
+
+  if (tcgetattr(dev->fd, &tio) < 0)
+    error_setf(&dev->error, SERIAL_ERROR_SETUP, dev->name);
+  else {
+    tio.c_cc[VMIN] = dev->vmin;
+    tio.c_cc[VTIME] = dev->vtime;
+
+    flags = fcntl(dev->fd, F_GETFL);
+    if (dev->vmin || dev->vtime)
+      flags &= ~O_NDELAY;
+    else
+      flags |= O_NDELAY;
+
+    if ((tcsetattr(dev->fd, TCSANOW, &tio) < 0) ||
+        (fcntl(dev->fd, F_SETFL, flags) < 0))
+      error_setf(&dev->error, SERIAL_ERROR_SETUP, dev->name);
+  }
+
+  return error_get(&dev->error);
+}
+
+int serial_device_set_low_latency(serial_device_t* dev, int low_latency) {
+  error_clear(&dev->error);
+
+  if (serial_device_apply_low_latency(dev, low_latency))
+    error_setf(&dev->error, SERIAL_ERROR_SETUP, dev->name);
+
+  return error_get(&dev->error);
+}
+
+void serial_device_set_buffer_size(serial_device_t* dev, size_t size) {
+  serial_buffer_resize(&dev->buffer, size);
+}
+
 int serial_device_write(serial_device_t* dev, unsigned char* data,
     size_t num) {
   size_t num_written = 0;
+  int64_t deadline = (dev->timeout > 0.0) ? timer_get_monotonic_ns()+
+    timer_seconds_to_ns(dev->timeout) : -1;
+  ssize_t n;
 
   error_clear(&dev->error);
   
   while (num_written < num) {
-    ssize_t n;
-    while ((n = write(dev->fd, &data[num_written], num-num_written)) == 0);
-    if ((n < 0) && (errno != EWOULDBLOCK)) {
+    n = write(dev->fd, &data[num_written], num-num_written);
+    if ((n < 0) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
       error_setf(&dev->error, SERIAL_ERROR_WRITE, dev->name);
       return -error_get(&dev->error);
     }
     if (n > 0) {
+      serial_device_record(dev, serial_record_write, &data[num_written], n);
       num_written += n;
       dev->num_written += n;
     }
+    else if (!serial_device_poll(dev, POLLOUT, deadline)) {
+      error_setf(&dev->error, SERIAL_ERROR_TIMEOUT, dev->name);
+      return -error_get(&dev->error);
+    }
   }
   
   return num_written;
 }
 
+int serial_device_writev(serial_device_t* dev, const struct iovec* iov,
+    int iovcnt) {
+  size_t num = 0, num_written = 0;
+  int64_t deadline = (dev->timeout > 0.0) ? timer_get_monotonic_ns()+
+    timer_seconds_to_ns(dev->timeout) : -1;
+  ssize_t n;
+  int i;
+
+  error_clear(&dev->error);
+
+  if ((iovcnt <= 0) || (iovcnt > IOV_MAX)) {
+    error_setf(&dev->error, SERIAL_ERROR_WRITE, dev->name);
+    return -error_get(&dev->error);
+  }
+
+  struct iovec vector[iovcnt];
+  struct iovec* current = vector;
+
+  for (i = 0; i < iovcnt; ++i) {
+    vector[i] = iov[i];
+    num += iov[i].iov_len;
+  }
+
+  while (num_written < num) {
+    n = writev(dev->fd, current, iovcnt);
+    if ((n < 0) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+      error_setf(&dev->error, SERIAL_ERROR_WRITE, dev->name);
+      return -error_get(&dev->error);
+    }
+    if (n > 0) {
+      serial_device_recordv(dev, serial_record_write, current, iovcnt, n);
+      num_written += n;
+      dev->num_written += n;
+
+      while (iovcnt && (n >= current->iov_len)) {
+        n -= current->iov_len;
+        ++current;
+        --iovcnt;
+      }
+      if (iovcnt) {
+        current->iov_base = (unsigned char*)current->iov_base+n;
+        current->iov_len -= n;
+      }
+    }
+    else if (!serial_device_poll(dev, POLLOUT, deadline)) {
+      error_setf(&dev->error, SERIAL_ERROR_TIMEOUT, dev->name);
+      return -error_get(&dev->error);
+    }
+  }
+
+  return num_written;
+}
+
 void serial_device_print(FILE* stream, const serial_device_t* dev) {
   fputs(dev->name, stream);
 }
+
+int serial_device_poll(serial_device_t* dev, short events, int64_t
+    deadline) {
+  struct pollfd pfd;
+  int64_t remaining;
+  int result;
+
+  if (dev->vmin || dev->vtime)
+    return 1;
+
+  pfd.fd = dev->fd;
+  pfd.events = events;
+
+  do {
+    remaining = (deadline >= 0) ? deadline-timer_get_monotonic_ns() : -1;
+    if ((deadline >= 0) && (remaining < 0))
+      remaining = 0;
+
+    result = poll(&pfd, 1, (remaining >= 0) ? (remaining+999999)/1000000 :
+      -1);
+  }
+  while (((result < 0) && (errno == EINTR)) || (!result && (remaining > 0) &&
+    (timer_get_monotonic_ns() < deadline)));
+
+  return (result != 0);
+}
+
+int serial_device_apply_low_latency(serial_device_t* dev, int low_latency) {
+#ifdef ASYNC_LOW_LATENCY
+  struct serial_struct serial;
+
+  if (ioctl(dev->fd, TIOCGSERIAL, &serial) < 0)
+    return -1;
+
+  if (low_latency)
+    serial.flags |= ASYNC_LOW_LATENCY;
+  else
+    serial.flags &= ~ASYNC_LOW_LATENCY;
+
+  if (ioctl(dev->fd, TIOCSSERIAL, &serial) < 0)
+    return -1;
+
+  dev->low_latency = low_latency;
+
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+void serial_device_record(serial_device_t* dev, serial_record_type_t type,
+    const unsigned char* data, size_t size) {
+  serial_recorder_t* recorder = dev->recorder;
+
+  if (recorder)
+    serial_recorder_record(recorder, type, data, size);
+}
+
+void serial_device_recordv(serial_device_t* dev, serial_record_type_t type,
+    const struct iovec* iov, int iovcnt, size_t size) {
+  serial_recorder_t* recorder = dev->recorder;
+
+  if (recorder)
+    serial_recorder_recordv(recorder, type, iov, iovcnt, size);
+}
@@ -38,9 +38,12 @@
   */
 
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include "error/error.h"
 
+#include "serial/buffer.h"
+
 /** \name Error Codes
   * \brief Predefined serial error codes
   */
@@ -68,17 +71,31 @@
 #define SERIAL_ERROR_SETUP                10
 //!< Error setting serial device parameters
 #define SERIAL_ERROR_TIMEOUT              11
-//!< Serial device select timeout
+//!< Serial device timeout
 #define SERIAL_ERROR_READ                 12
 //!< Error reading from serial device
 #define SERIAL_ERROR_WRITE                13
 //!< Error writing to serial device
+#define SERIAL_ERROR_EVENT_LOOP           14
+//!< Serial event loop error
+#define SERIAL_ERROR_FRAME                15
+//!< Invalid or oversized serial frame
+#define SERIAL_ERROR_RECORD               16
+//!< Error recording serial device traffic
+#define SERIAL_ERROR_REPLAY               17
+//!< Error replaying serial device traffic
+#define SERIAL_ERROR_NO_MEMORY            18
+//!< Insufficient memory
 //@}
 
 /** \brief Predefined serial error descriptions
   */
 extern const char* serial_errors[];
 
+/** \brief Default size of the receive buffer of a serial device
+  */
+#define SERIAL_DEVICE_BUFFER_SIZE         4096
+
 /** \brief Parity enumerable type
   */
 typedef enum {
@@ -107,10 +124,17 @@ typedef struct serial_device_t {
   serial_parity_t parity;         //!< Device parity.
   serial_flow_ctrl_t flow_ctrl;   //!< Device flow control.
 
-  double timeout;                 //!< Device select timeout in [s].
+  double timeout;                 //!< Device read timeout in [s].
+  unsigned char vmin;             //!< Minimum bytes of a blocking read.
+  unsigned char vtime;            //!< Blocking read timeout in [ds].
+  int low_latency;                //!< Flag signaling low-latency mode.
+
+  serial_buffer_t buffer;         //!< Device receive buffer.
 
   size_t num_read;                //!< Number of bytes read from device.
   size_t num_written;             //!< Number of bytes written to device.
+
+  struct serial_recorder_t* recorder; //!< The device traffic recorder.
   
   error_t error;                  //!< The most recent device error.
 } serial_device_t;
@@ -147,12 +171,14 @@ int serial_device_close(
 
 /** \brief Setup serial device
   * \param[in] dev The open serial device to be set up.
-  * \param[in] baud_rate The device baud rate to be set in [baud].
+  * \param[in] baud_rate The device baud rate to be set in [baud]. Baud
+  *   rates without a standard terminal speed constant will be set through
+  *   the kernel's termios2 interface, if supported by the driver.
   * \param[in] data_bits The device's number of data bits to be set.
   * \param[in] stop_bits The device's number of stop bits to be set.
   * \param[in] parity The device parity to be set.
   * \param[in] flow_ctrl The device flow control to be set.
-  * \param[in] timeout The device select timeout to be set in [s].
+  * \param[in] timeout The device read timeout to be set in [s].
   * \return The resulting error code.
   */
 int serial_device_setup(
@@ -170,24 +196,134 @@ int serial_device_setup(
   * \param[in] num The number of data bytes to be read.
   * \return The number of bytes read from the serial device or the
   *   negative error code.
+  * 
+  * The device timeout bounds the overall duration of the read operation,
+  * regardless of the number of partial reads required to receive the
+  * requested number of bytes.
   */
 int serial_device_read(
   serial_device_t* dev,
   unsigned char* data,
   size_t num);
 
+/** \brief Read data from open serial device until a delimiter
+  * \param[in] dev The open serial device to read data from.
+  * \param[in,out] data An array containing the data read from the device.
+  * \param[in] num The maximum number of data bytes to be read.
+  * \param[in] delim The delimiter terminating the data.
+  * \return The number of bytes read from the serial device, including the
+  *   delimiter, or the negative error code. If no delimiter is found
+  *   within the maximum number of bytes, these bytes are consumed and
+  *   -SERIAL_ERROR_FRAME is returned.
+  * 
+  * All data available from the device is collected in the receive buffer
+  * with a single system call, and the buffer is scanned for the
+  * delimiter. Data following the delimiter remains buffered for
+  * subsequent read operations. The device timeout bounds the overall
+  * duration of the read operation.
+  */
+int serial_device_read_until(
+  serial_device_t* dev,
+  unsigned char* data,
+  size_t num,
+  unsigned char delim);
+
+/** \brief Fill the receive buffer of open serial device
+  * \param[in] dev The open serial device to fill the receive buffer of.
+  * \param[in] timeout The maximum duration in [s] to wait for data.
+  * \return The number of bytes read into the receive buffer or the
+  *   negative error code. If the receive buffer is full, 0 is returned.
+  * 
+  * All data available from the device is read into the free space of the
+  * receive buffer with a single system call.
+  */
+int serial_device_fill(
+  serial_device_t* dev,
+  double timeout);
+
+/** \brief Set the blocking read mode of open serial device
+  * \param[in] dev The open serial device to set the read mode for.
+  * \param[in] min The minimum number of bytes a read operation waits for,
+  *   at most 255.
+  * \param[in] timeout The timeout of a read operation in [s], at most
+  *   25.5 s and rounded up to a multiple of 0.1 s. With a minimum number
+  *   of bytes, the timeout starts with the first byte received and
+  *   applies between subsequent bytes.
+  * \return The resulting error code.
+  * 
+  * If the minimum number of bytes or the timeout are non-zero, reads block
+  * in the terminal driver as defined by its VMIN and VTIME parameters,
+  * instead of polling the device. Without a minimum number of bytes, the
+  * device timeout is enforced with the granularity of the read timeout,
+  * whereas with a minimum number of bytes, reads wait indefinitely for
+  * the first byte. If both are zero, the device returns to non-blocking
+  * reads. Blocking devices must not be added to a serial event loop.
+  */
+int serial_device_set_blocking(
+  serial_device_t* dev,
+  size_t min,
+  double timeout);
+
+/** \brief Set the low-latency mode of open serial device
+  * \param[in] dev The open serial device to set the low-latency mode for.
+  * \param[in] low_latency If non-zero, the driver will pass received data
+  *   on immediately instead of deferring it. This reduces the latency of
+  *   USB adapters such as FTDI devices to about 1 ms.
+  * \return The resulting error code. If the driver does not support the
+  *   low-latency mode, SERIAL_ERROR_SETUP will be returned.
+  * 
+  * serial_device_setup() enables the low-latency mode if the driver
+  * supports it.
+  */
+int serial_device_set_low_latency(
+  serial_device_t* dev,
+  int low_latency);
+
+/** \brief Set the receive buffer size of serial device
+  * \param[in] dev The initialized serial device to set the buffer size for.
+  * \param[in] size The requested size of the receive buffer in bytes,
+  *   which limits the size of frames to be read from the device. The
+  *   size will be rounded up to the next power of two.
+  */
+void serial_device_set_buffer_size(
+  serial_device_t* dev,
+  size_t size);
+
 /** \brief Write data to open serial device
   * \param[in] dev The open serial device to write data to.
   * \param[in] data An array containing the data to be written to the device.
   * \param[in] num The number of data bytes to be written.
   * \return The number of bytes written to the serial device or the
   *   negative error code.
+  * 
+  * If the device's output buffer is full, the calling thread sleeps until
+  * the device becomes writable. A positive device timeout bounds the
+  * overall duration of the write operation.
   */
 int serial_device_write(
   serial_device_t* dev,
   unsigned char* data,
   size_t num);
 
+/** \brief Write gathered data to open serial device
+  * \param[in] dev The open serial device to write data to.
+  * \param[in] iov An array of buffers containing the data to be written
+  *   to the device in order.
+  * \param[in] iovcnt The number of buffers, at least one and at most
+  *   IOV_MAX.
+  * \return The number of bytes written to the serial device or the
+  *   negative error code.
+  * 
+  * The buffers are passed to the device with a single system call as far
+  * as the device accepts them, such that protocol layers do not need to
+  * assemble packets from their header, payload, and checksum. Partial
+  * writes are handled as by serial_device_write().
+  */
+int serial_device_writev(
+  serial_device_t* dev,
+  const struct iovec* iov,
+  int iovcnt);
+
 /** \brief Print serial device
   * \param[in] stream The output stream that will be used for printing the
   *   serial device.
@@ -0,0 +1,63 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+/* The kernel's termios2 interface is kept apart from the remaining serial
+   implementation, since its definitions conflict with the C library's
+   termios. */
+
+int serial_termios2_set_baud_rate(int fd, int baud_rate);
+int serial_termios2_get_baud_rate(int fd);
+
+int serial_termios2_set_baud_rate(int fd, int baud_rate) {
+#ifdef BOTHER
+  struct termios2 tio;
+
+  if (ioctl(fd, TCGETS2, &tio) < 0)
+    return -1;
+
+  tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+  tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+  tio.c_ispeed = baud_rate;
+  tio.c_ospeed = baud_rate;
+
+  if (ioctl(fd, TCSETS2, &tio) < 0)
+    return -1;
+
+  return (serial_termios2_get_baud_rate(fd) == baud_rate) ? 0 : -1;
+#else
+  return -1;
+#endif
+}
+
+int serial_termios2_get_baud_rate(int fd) {
+#ifdef BOTHER
+  struct termios2 tio;
+
+  if (ioctl(fd, TCGETS2, &tio) < 0)
+    return -1;
+
+  return tio.c_ospeed;
+#else
+  return -1;
+#endif
+}
@@ -22,30 +22,51 @@
 #include <errno.h>
 
 #include <time.h>
-#include <sys/time.h>
 
 #include "condition.h"
 
+#ifdef THREAD_INSTRUMENT
+#include "instrument.h"
+#endif
+
 const char* thread_condition_errors[] = {
   "Success",
   "Mutex operation error",
   "Wait operation timed out",
 };
 
+void thread_condition_get_deadline(double timeout, struct timespec*
+  deadline);
+int thread_condition_wait_deadline(thread_condition_t* condition, const
+  struct timespec* deadline);
+
 void thread_condition_init(thread_condition_t* condition) {
-  pthread_cond_init(&condition->handle, 0);
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&condition->handle, &attr);
+  pthread_condattr_destroy(&attr);
+
   thread_mutex_init(&condition->mutex);
 }
 
 void thread_condition_destroy(thread_condition_t* condition) {
   pthread_cond_destroy(&condition->handle);
   thread_mutex_destroy(&condition->mutex);
+#ifdef THREAD_INSTRUMENT
+  thread_instrument_retire(condition);
+#endif
 }
 
 void thread_condition_signal(thread_condition_t* condition) {
   pthread_cond_signal(&condition->handle);
 }
 
+void thread_condition_broadcast(thread_condition_t* condition) {
+  pthread_cond_broadcast(&condition->handle);
+}
+
 void thread_condition_lock(thread_condition_t* condition) {
   thread_mutex_lock(&condition->mutex);
 }
@@ -55,29 +76,74 @@ void thread_condition_unlock(thread_condition_t* condition) {
 }
 
 int thread_condition_wait(thread_condition_t* condition, double timeout) {
-  int result = THREAD_CONDITION_ERROR_NONE;
+  struct timespec deadline;
 
-  if (timeout < 0.0) {
-    if (pthread_cond_wait(&condition->handle, &condition->mutex.handle))
-      result = THREAD_CONDITION_ERROR_MUTEX;
-  }
+  if (timeout < 0.0)
+    return thread_condition_wait_deadline(condition, 0);
   else {
-    struct timeval now;
-    gettimeofday(&now, 0);
-
-    double seconds = now.tv_sec+now.tv_usec/1e6+timeout;
-
-    struct timespec time;
-    time.tv_sec = (time_t)seconds;
-    time.tv_nsec = (seconds-(time_t)seconds)*1e9;
-    
-    int error = pthread_cond_timedwait(&condition->handle,
-      &condition->mutex.handle, &time);
-    if (error == ETIMEDOUT)
-      result = THREAD_CONDITION_ERROR_WAIT_TIMEOUT;
-    else if (error)
-      result = THREAD_CONDITION_ERROR_MUTEX;
+    thread_condition_get_deadline(timeout, &deadline);
+    return thread_condition_wait_deadline(condition, &deadline);
+  }
+}
+
+int thread_condition_wait_until(thread_condition_t* condition, int
+    (*predicate)(void*), void* arg, double timeout) {
+  struct timespec deadline;
+  int result = THREAD_CONDITION_ERROR_NONE;
+
+  if (timeout >= 0.0)
+    thread_condition_get_deadline(timeout, &deadline);
+
+  while (!predicate(arg)) {
+    if ((result = thread_condition_wait_deadline(condition,
+        (timeout >= 0.0) ? &deadline : 0))) {
+      if ((result == THREAD_CONDITION_ERROR_WAIT_TIMEOUT) && predicate(arg))
+        result = THREAD_CONDITION_ERROR_NONE;
+      break;
+    }
   }
 
   return result;
 }
+
+void thread_condition_get_deadline(double timeout, struct timespec*
+    deadline) {
+  double seconds = floor(timeout);
+
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+
+  deadline->tv_sec += (time_t)seconds;
+  deadline->tv_nsec += (long)((timeout-seconds)*1e9);
+  if (deadline->tv_nsec >= 1000000000) {
+    ++deadline->tv_sec;
+    deadline->tv_nsec -= 1000000000;
+  }
+}
+
+int thread_condition_wait_deadline(thread_condition_t* condition, const
+    struct timespec* deadline) {
+  int error;
+#ifdef THREAD_INSTRUMENT
+  int64_t start = thread_instrument_get_time();
+
+  thread_instrument_unlock(&condition->mutex);
+#endif
+
+  if (deadline)
+    error = pthread_cond_timedwait(&condition->handle,
+      &condition->mutex.handle, deadline);
+  else
+    error = pthread_cond_wait(&condition->handle, &condition->mutex.handle);
+
+#ifdef THREAD_INSTRUMENT
+  thread_instrument_wait(condition, start);
+  thread_instrument_relock(&condition->mutex);
+#endif
+
+  if (error == ETIMEDOUT)
+    return THREAD_CONDITION_ERROR_WAIT_TIMEOUT;
+  else if (error)
+    return THREAD_CONDITION_ERROR_MUTEX;
+  else
+    return THREAD_CONDITION_ERROR_NONE;
+}
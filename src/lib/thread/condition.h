@@ -29,6 +29,9 @@
   * Wait conditions are highly useful in cases where multiple threads must
   * be synchronized. They basically employ mutexes which may be signaled to
   * trigger a race of the involved threads for acquiring that mutex.
+  * 
+  * Timeouts are measured on the monotonic system clock, such that wait
+  * operations are unaffected by adjustments of the system time.
   */
 
 #include <pthread.h>
@@ -83,6 +86,13 @@ void thread_condition_destroy(
 void thread_condition_signal(
   thread_condition_t* condition);
 
+/** \brief Broadcast a condition
+  * \param[in] condition The initialized condition to be broadcast to all
+  *   waiting threads.
+  */
+void thread_condition_broadcast(
+  thread_condition_t* condition);
+
 /** \brief Lock a thread condition mutex
   * \param[in] condition The initialized thread condition to lock the
   *   mutex for.
@@ -101,9 +111,31 @@ void thread_condition_unlock(
   * \param[in] condition The initialized condition to wait for.
   * \param[in] timeout The timeout of the wait operation in [s].
   * \return The resulting error code.
+  * 
+  * The wait operation may return without the condition having been
+  * signaled. Use thread_condition_wait_until() to wait for a predicate.
   */
 int thread_condition_wait(
   thread_condition_t* condition,
   double timeout);
 
+/** \brief Wait for a predicate guarded by a condition to become true
+  * \note The condition mutex must be locked by the caller.
+  * \param[in] condition The initialized condition to wait for.
+  * \param[in] predicate The predicate to be tested with the condition
+  *   mutex locked, returning non-zero if the wait operation is complete.
+  * \param[in] arg The argument to be passed on to the predicate.
+  * \param[in] timeout The timeout of the wait operation in [s]. A negative
+  *   timeout makes the operation wait forever.
+  * \return The resulting error code.
+  * 
+  * The deadline is fixed when the operation starts, such that spurious
+  * wake-ups neither end the wait operation nor extend its timeout.
+  */
+int thread_condition_wait_until(
+  thread_condition_t* condition,
+  int (*predicate)(void*),
+  void* arg,
+  double timeout);
+
 #endif
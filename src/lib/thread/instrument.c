@@ -0,0 +1,446 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "instrument.h"
+
+#include "timer/timer.h"
+
+#define THREAD_INSTRUMENT_RETIRED               ((uintptr_t)1)
+
+/* Name assigned to an instrumented object */
+typedef struct thread_instrument_name_t {
+  const void* object;
+  char* name;
+} thread_instrument_name_t;
+
+static _Atomic(thread_instrument_record_t*) thread_instrument_records = 0;
+static __thread thread_instrument_record_t* thread_instrument_current = 0;
+
+static pthread_once_t thread_instrument_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_instrument_key;
+
+static pthread_mutex_t thread_instrument_names_mutex =
+  PTHREAD_MUTEX_INITIALIZER;
+static thread_instrument_name_t* thread_instrument_names = 0;
+static size_t thread_instrument_num_names = 0;
+
+static const char* thread_instrument_types[] = {
+  "mutex",
+  "condition",
+  "thread",
+};
+
+void thread_instrument_init_key(void);
+void thread_instrument_release_record(void* record);
+thread_instrument_record_t* thread_instrument_get_record(void);
+thread_instrument_entry_t* thread_instrument_get_entry(const void* object,
+  thread_instrument_type_t type);
+int thread_instrument_claim_entry(thread_instrument_entry_t* entry, const
+  void* object, thread_instrument_type_t type);
+int thread_instrument_alloc_histogram(_Atomic(timer_histogram_t*)*
+  histogram);
+const char* thread_instrument_get_name(const void* object,
+  thread_stats_format_t format, char* name, size_t size);
+void thread_instrument_dump_histogram(FILE* stream, thread_stats_format_t
+  format, const char* label, _Atomic(timer_histogram_t*)* histogram);
+
+void thread_stats_set_name(const void* object, const char* name) {
+  size_t i;
+
+  pthread_mutex_lock(&thread_instrument_names_mutex);
+
+  for (i = 0; i < thread_instrument_num_names; ++i)
+    if (thread_instrument_names[i].object == object)
+      break;
+
+  if (i == thread_instrument_num_names) {
+    thread_instrument_names = realloc(thread_instrument_names,
+      (thread_instrument_num_names+1)*sizeof(thread_instrument_name_t));
+    thread_instrument_names[i].object = object;
+    thread_instrument_names[i].name = 0;
+    ++thread_instrument_num_names;
+  }
+
+  free(thread_instrument_names[i].name);
+  thread_instrument_names[i].name = strdup(name);
+
+  pthread_mutex_unlock(&thread_instrument_names_mutex);
+}
+
+size_t thread_stats_dump(FILE* stream, thread_stats_format_t format) {
+  thread_instrument_record_t* record;
+  thread_instrument_entry_t* entry;
+  const void* object;
+  char name[256];
+  size_t i, num_objects = 0, num_records = 0;
+  int retired;
+
+  if (format == thread_stats_format_json)
+    fprintf(stream, "{\"threads\": [");
+
+  for (record = atomic_load(&thread_instrument_records); record;
+      record = record->next) {
+    object = atomic_load(&record->thread);
+
+    if (format == thread_stats_format_json)
+      fprintf(stream, "%s\n  {\"tid\": %ld, \"name\": \"%s\", "
+        "\"dropped\": %zu, \"objects\": [", num_records ? "," : "",
+        record->tid, thread_instrument_get_name(object, format, name,
+        sizeof(name)), atomic_load(&record->num_dropped));
+    else
+      fprintf(stream, "thread %ld %s (%zu objects dropped)\n", record->tid,
+        thread_instrument_get_name(object, format, name, sizeof(name)),
+        atomic_load(&record->num_dropped));
+
+    for (i = 0; i < THREAD_INSTRUMENT_NUM_ENTRIES; ++i) {
+      entry = &record->entries[i];
+      if (!(object = atomic_load_explicit(&entry->object,
+          memory_order_acquire)))
+        continue;
+      retired = ((uintptr_t)object & THREAD_INSTRUMENT_RETIRED) != 0;
+      object = (const void*)((uintptr_t)object & ~THREAD_INSTRUMENT_RETIRED);
+
+      if (format == thread_stats_format_json)
+        fprintf(stream, "%s\n    {\"type\": \"%s\", \"object\": \"%p\", "
+          "\"name\": \"%s\", \"retired\": %s, \"contended\": %zu, "
+          "\"overruns\": %zu", num_objects ? "," : "",
+          thread_instrument_types[entry->type], object,
+          thread_instrument_get_name(object, format, name, sizeof(name)),
+          retired ? "true" : "false",
+          atomic_load_explicit(&entry->num_contended, memory_order_relaxed),
+          atomic_load_explicit(&entry->num_overruns, memory_order_relaxed));
+      else
+        fprintf(stream, "  %s %p %s%s: %zu contended, %zu overruns\n",
+          thread_instrument_types[entry->type], object,
+          thread_instrument_get_name(object, format, name, sizeof(name)),
+          retired ? " (retired)" : "",
+          atomic_load_explicit(&entry->num_contended, memory_order_relaxed),
+          atomic_load_explicit(&entry->num_overruns, memory_order_relaxed));
+
+      if (entry->type != thread_instrument_thread)
+        thread_instrument_dump_histogram(stream, format, "wait",
+          &entry->wait);
+      if (entry->type == thread_instrument_mutex)
+        thread_instrument_dump_histogram(stream, format, "hold",
+          &entry->hold);
+      else if (entry->type == thread_instrument_thread)
+        thread_instrument_dump_histogram(stream, format, "run",
+          &entry->hold);
+
+      if (format == thread_stats_format_json)
+        fprintf(stream, "}");
+      ++num_objects;
+    }
+
+    if (format == thread_stats_format_json)
+      fprintf(stream, "]}");
+    num_objects = 0;
+    ++num_records;
+  }
+
+  if (format == thread_stats_format_json)
+    fprintf(stream, "\n]}\n");
+
+  for (record = atomic_load(&thread_instrument_records); record;
+      record = record->next)
+    for (i = 0; i < THREAD_INSTRUMENT_NUM_ENTRIES; ++i)
+      num_objects += (atomic_load(&record->entries[i].object) != 0);
+
+  return num_objects;
+}
+
+int64_t thread_instrument_get_time(void) {
+  return timer_get_monotonic_ns();
+}
+
+void thread_instrument_lock(const void* object, int64_t start) {
+  thread_instrument_entry_t* entry = thread_instrument_get_entry(object,
+    thread_instrument_mutex);
+  int64_t now = thread_instrument_get_time();
+
+  if (!entry)
+    return;
+
+  if (start >= 0) {
+    atomic_store_explicit(&entry->num_contended, atomic_load_explicit(
+      &entry->num_contended, memory_order_relaxed)+1, memory_order_relaxed);
+    timer_histogram_add(atomic_load_explicit(&entry->wait,
+      memory_order_relaxed), now-start);
+  }
+  else
+    timer_histogram_add(atomic_load_explicit(&entry->wait,
+      memory_order_relaxed), 0);
+
+  entry->acquired = now;
+}
+
+void thread_instrument_relock(const void* object) {
+  thread_instrument_entry_t* entry = thread_instrument_get_entry(object,
+    thread_instrument_mutex);
+
+  if (entry)
+    entry->acquired = thread_instrument_get_time();
+}
+
+void thread_instrument_unlock(const void* object) {
+  thread_instrument_entry_t* entry = thread_instrument_get_entry(object,
+    thread_instrument_mutex);
+
+  if (entry && entry->acquired) {
+    timer_histogram_add(atomic_load_explicit(&entry->hold,
+      memory_order_relaxed), thread_instrument_get_time()-entry->acquired);
+    entry->acquired = 0;
+  }
+}
+
+void thread_instrument_wait(const void* object, int64_t start) {
+  thread_instrument_entry_t* entry = thread_instrument_get_entry(object,
+    thread_instrument_condition);
+
+  if (entry)
+    timer_histogram_add(atomic_load_explicit(&entry->wait,
+      memory_order_relaxed), thread_instrument_get_time()-start);
+}
+
+void thread_instrument_cycle(const void* object, int64_t start, int
+    overrun) {
+  thread_instrument_entry_t* entry = thread_instrument_get_entry(object,
+    thread_instrument_thread);
+
+  if (!entry)
+    return;
+
+  atomic_store_explicit(&thread_instrument_current->thread, object,
+    memory_order_relaxed);
+
+  timer_histogram_add(atomic_load_explicit(&entry->hold,
+    memory_order_relaxed), thread_instrument_get_time()-start);
+  if (overrun)
+    atomic_store_explicit(&entry->num_overruns, atomic_load_explicit(
+      &entry->num_overruns, memory_order_relaxed)+1, memory_order_relaxed);
+}
+
+void thread_instrument_retire(const void* object) {
+  thread_instrument_record_t* record;
+  const void* entry_object;
+  size_t i;
+
+  for (record = atomic_load(&thread_instrument_records); record;
+      record = record->next)
+    for (i = 0; i < THREAD_INSTRUMENT_NUM_ENTRIES; ++i) {
+      entry_object = object;
+      atomic_compare_exchange_strong(&record->entries[i].object,
+        &entry_object, (const void*)((uintptr_t)object |
+        THREAD_INSTRUMENT_RETIRED));
+    }
+}
+
+void thread_instrument_init_key(void) {
+  pthread_key_create(&thread_instrument_key,
+    thread_instrument_release_record);
+}
+
+void thread_instrument_release_record(void* record) {
+  thread_instrument_current = 0;
+  atomic_store(&((thread_instrument_record_t*)record)->active, 0);
+}
+
+thread_instrument_record_t* thread_instrument_get_record(void) {
+  thread_instrument_record_t* record = thread_instrument_current;
+  int active;
+  size_t i;
+
+  if (!record) {
+    pthread_once(&thread_instrument_once, thread_instrument_init_key);
+
+    for (record = atomic_load(&thread_instrument_records); record;
+        record = record->next) {
+      active = 0;
+      if (atomic_compare_exchange_strong(&record->active, &active, 1))
+        break;
+    }
+
+    if (record) {
+      atomic_store(&record->thread, 0);
+      atomic_store(&record->num_dropped, 0);
+      for (i = 0; i < THREAD_INSTRUMENT_NUM_ENTRIES; ++i)
+        atomic_store(&record->entries[i].object, 0);
+
+      record->tid = syscall(SYS_gettid);
+    }
+    else {
+      if (!(record = calloc(1, sizeof(thread_instrument_record_t))))
+        return 0;
+
+      record->tid = syscall(SYS_gettid);
+      atomic_init(&record->active, 1);
+
+      record->next = atomic_load(&thread_instrument_records);
+      while (!atomic_compare_exchange_weak(&thread_instrument_records,
+        &record->next, record));
+    }
+
+    pthread_setspecific(thread_instrument_key, record);
+    thread_instrument_current = record;
+  }
+
+  return record;
+}
+
+thread_instrument_entry_t* thread_instrument_get_entry(const void* object,
+    thread_instrument_type_t type) {
+  thread_instrument_record_t* record = thread_instrument_get_record();
+  thread_instrument_entry_t* entry, * reusable = 0;
+  const void* entry_object;
+  size_t i, index = ((uintptr_t)object >> 3)*0x9e3779b97f4a7c15ULL >> 32;
+
+  if (!record)
+    return 0;
+
+  for (i = 0; i < THREAD_INSTRUMENT_NUM_ENTRIES; ++i) {
+    entry = &record->entries[(index+i) % THREAD_INSTRUMENT_NUM_ENTRIES];
+    entry_object = atomic_load_explicit(&entry->object,
+      memory_order_relaxed);
+
+    if ((entry_object == object) && (entry->type == type))
+      return entry;
+    else if (!entry_object) {
+      if (!reusable)
+        reusable = entry;
+      break;
+    }
+    else if (!reusable &&
+        ((uintptr_t)entry_object & THREAD_INSTRUMENT_RETIRED))
+      reusable = entry;
+  }
+
+  if (reusable && !thread_instrument_claim_entry(reusable, object, type))
+    return reusable;
+
+  atomic_store_explicit(&record->num_dropped, atomic_load_explicit(
+    &record->num_dropped, memory_order_relaxed)+1, memory_order_relaxed);
+
+  return 0;
+}
+
+int thread_instrument_claim_entry(thread_instrument_entry_t* entry, const
+    void* object, thread_instrument_type_t type) {
+  timer_histogram_t* histogram;
+
+  if (((type != thread_instrument_thread) &&
+      thread_instrument_alloc_histogram(&entry->wait)) ||
+      ((type != thread_instrument_condition) &&
+      thread_instrument_alloc_histogram(&entry->hold)))
+    return -1;
+
+  atomic_store_explicit(&entry->object, 0, memory_order_relaxed);
+
+  entry->type = type;
+  atomic_store_explicit(&entry->num_contended, 0, memory_order_relaxed);
+  atomic_store_explicit(&entry->num_overruns, 0, memory_order_relaxed);
+  if ((histogram = atomic_load_explicit(&entry->wait, memory_order_relaxed)))
+    timer_histogram_init(histogram);
+  if ((histogram = atomic_load_explicit(&entry->hold, memory_order_relaxed)))
+    timer_histogram_init(histogram);
+  entry->acquired = 0;
+
+  atomic_store_explicit(&entry->object, object, memory_order_release);
+
+  return 0;
+}
+
+int thread_instrument_alloc_histogram(_Atomic(timer_histogram_t*)*
+    histogram) {
+  timer_histogram_t* allocated = atomic_load_explicit(histogram,
+    memory_order_relaxed);
+
+  if (!allocated) {
+    if (!(allocated = malloc(sizeof(timer_histogram_t))))
+      return -1;
+    timer_histogram_init(allocated);
+
+    atomic_store_explicit(histogram, allocated, memory_order_release);
+  }
+
+  return 0;
+}
+
+const char* thread_instrument_get_name(const void* object,
+    thread_stats_format_t format, char* name, size_t size) {
+  const char* source;
+  size_t i, length = 0;
+
+  name[0] = 0;
+  if (!object)
+    return name;
+
+  pthread_mutex_lock(&thread_instrument_names_mutex);
+
+  for (i = 0; i < thread_instrument_num_names; ++i)
+    if (thread_instrument_names[i].object == object) {
+      for (source = thread_instrument_names[i].name;
+          *source && (length+2 < size); ++source) {
+        if ((format == thread_stats_format_json) && ((*source == '"') ||
+            (*source == '\\')))
+          name[length++] = '\\';
+        name[length++] = *source;
+      }
+      name[length] = 0;
+
+      break;
+    }
+
+  pthread_mutex_unlock(&thread_instrument_names_mutex);
+
+  return name;
+}
+
+void thread_instrument_dump_histogram(FILE* stream, thread_stats_format_t
+    format, const char* label, _Atomic(timer_histogram_t*)* histogram) {
+  timer_histogram_t* source = atomic_load_explicit(histogram,
+    memory_order_acquire);
+
+  if (!source)
+    return;
+
+  if (format == thread_stats_format_json)
+    fprintf(stream, ", \"%s\": {\"count\": %zu, \"mean\": %.0f, "
+      "\"max\": %lld, \"p50\": %lld, \"p90\": %lld, \"p99\": %lld}",
+      label, timer_histogram_get_count(source),
+      timer_histogram_get_mean(source),
+      (long long)timer_histogram_get_max(source),
+      (long long)timer_histogram_get_percentile(source, 0.5),
+      (long long)timer_histogram_get_percentile(source, 0.9),
+      (long long)timer_histogram_get_percentile(source, 0.99));
+  else
+    fprintf(stream, "    %-4s %10zu x, mean %10.3f us, p50 %10.3f us, "
+      "p90 %10.3f us, p99 %10.3f us, max %10.3f us\n", label,
+      timer_histogram_get_count(source),
+      timer_histogram_get_mean(source)*1e-3,
+      timer_histogram_get_percentile(source, 0.5)*1e-3,
+      timer_histogram_get_percentile(source, 0.9)*1e-3,
+      timer_histogram_get_percentile(source, 0.99)*1e-3,
+      timer_histogram_get_max(source)*1e-3);
+}
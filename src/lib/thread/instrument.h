@@ -0,0 +1,192 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef THREAD_INSTRUMENT_H
+#define THREAD_INSTRUMENT_H
+
+/** \file thread/instrument.h
+  * \ingroup thread
+  * \brief Thread instrumentation
+  * \author Ralf Kaestner
+  * 
+  * If the thread library is built with THREAD_INSTRUMENT defined, mutex
+  * locks, condition waits, and the cycles of periodic threads are timed
+  * and recorded into the latency histograms of the timer module. Each
+  * thread records into its own table without locking, and the tables of
+  * all threads may be dumped at any time, including those of terminated
+  * threads. The table of a terminated thread is retained until it is
+  * reused by a thread recording later, such that the memory is bounded
+  * by the number of concurrently instrumented threads.
+  * 
+  * Objects are identified by their address and may be given a name for
+  * the dump. Destroying a mutex or condition, or joining a thread,
+  * retires its entries, such that an object created later at the same
+  * address is recorded separately.
+  * 
+  * For mutexes, the instrumentation records the time spent waiting for
+  * a contended lock, the number of contended locks, and the time the
+  * lock is held. For conditions, the time spent waiting is recorded,
+  * whereas re-acquiring the mutex after the wait merely starts its hold.
+  * For periodic threads, the execution time of each cycle and the number
+  * of overruns are recorded. Without THREAD_INSTRUMENT, none of the
+  * instrumented functions incurs any overhead and the dump is empty.
+  */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "timer/profile.h"
+
+/** \brief Number of objects recorded per thread
+  */
+#define THREAD_INSTRUMENT_NUM_ENTRIES           64
+
+/** \brief Instrumented object type enumerable type
+  */
+typedef enum {
+  thread_instrument_mutex,                  //!< Mutex locks and holds.
+  thread_instrument_condition,              //!< Condition waits.
+  thread_instrument_thread                  //!< Periodic thread cycles.
+} thread_instrument_type_t;
+
+/** \brief Statistics dump format enumerable type
+  */
+typedef enum {
+  thread_stats_format_text,                 //!< Human-readable text.
+  thread_stats_format_json                  //!< JSON document.
+} thread_stats_format_t;
+
+/** \brief Structure defining the record of an instrumented object
+  * 
+  * The histograms are written by the owning thread only and allocated
+  * when the object is first recorded.
+  */
+typedef struct thread_instrument_entry_t {
+  _Atomic(const void*) object;              //!< The instrumented object.
+  thread_instrument_type_t type;            //!< The type of the object.
+
+  atomic_size_t num_contended;              //!< The number of contentions.
+  atomic_size_t num_overruns;               //!< The number of overruns.
+  _Atomic(timer_histogram_t*) wait;         //!< The wait durations.
+  _Atomic(timer_histogram_t*) hold;         //!< The hold or run durations.
+
+  int64_t acquired;                         //!< The time of the last lock.
+} thread_instrument_entry_t;
+
+/** \brief Structure defining the instrumentation record of a thread
+  */
+typedef struct thread_instrument_record_t {
+  long tid;                                 //!< The kernel thread ID.
+  atomic_int active;                        //!< Flag signaling a live thread.
+  _Atomic(const void*) thread;              //!< The library thread, if any.
+  atomic_size_t num_dropped;                //!< The number of dropped objects.
+
+  thread_instrument_entry_t entries[THREAD_INSTRUMENT_NUM_ENTRIES];
+  //!< The table of recorded objects.
+
+  struct thread_instrument_record_t* next;  //!< The next thread's record.
+} thread_instrument_record_t;
+
+/** \brief Assign a name to an instrumented object
+  * \param[in] object The mutex, condition, or thread to be named.
+  * \param[in] name The name of the object in the dump. The string is
+  *   copied.
+  */
+void thread_stats_set_name(
+  const void* object,
+  const char* name);
+
+/** \brief Dump the instrumentation records of all threads
+  * \param[in] stream The stream to dump the records to.
+  * \param[in] format The format of the dump.
+  * \return The number of dumped objects.
+  * 
+  * Durations are reported in nanoseconds for JSON and microseconds for
+  * text output. Percentiles are upper bounds given by the histogram
+  * bucket boundaries.
+  */
+size_t thread_stats_dump(
+  FILE* stream,
+  thread_stats_format_t format);
+
+/** \brief Retrieve the instrumentation clock
+  * \note This function is called by the instrumented library functions.
+  * \return The monotonic time in [ns].
+  */
+int64_t thread_instrument_get_time(void);
+
+/** \brief Record the acquisition of a lock
+  * \note This function is called by the instrumented library functions.
+  * \param[in] object The acquired mutex.
+  * \param[in] start The time the calling thread started waiting for the
+  *   contended lock, or a negative value if the lock was not contended.
+  */
+void thread_instrument_lock(
+  const void* object,
+  int64_t start);
+
+/** \brief Record the re-acquisition of a lock after a wait operation
+  * \note This function is called by the instrumented library functions.
+  * \param[in] object The re-acquired mutex.
+  */
+void thread_instrument_relock(
+  const void* object);
+
+/** \brief Record the release of a lock
+  * \note This function is called by the instrumented library functions.
+  * \param[in] object The released mutex.
+  */
+void thread_instrument_unlock(
+  const void* object);
+
+/** \brief Record a wait operation
+  * \note This function is called by the instrumented library functions.
+  * \param[in] object The condition waited for.
+  * \param[in] start The time the calling thread started waiting.
+  */
+void thread_instrument_wait(
+  const void* object,
+  int64_t start);
+
+/** \brief Record a cycle of a periodic thread
+  * \note This function is called by the instrumented library functions.
+  * \param[in] object The calling thread.
+  * \param[in] start The time the cycle started.
+  * \param[in] overrun Non-zero if the cycle missed its deadline.
+  */
+void thread_instrument_cycle(
+  const void* object,
+  int64_t start,
+  int overrun);
+
+/** \brief Retire the entries of an instrumented object
+  * \note This function is called by the instrumented library functions.
+  * \param[in] object The destroyed mutex or condition, or the joined
+  *   thread.
+  * 
+  * The entries of the object remain in the dump, but will no longer
+  * record the object.
+  */
+void thread_instrument_retire(
+  const void* object);
+
+#endif
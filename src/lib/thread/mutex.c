@@ -18,8 +18,14 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#define _GNU_SOURCE
+
 #include "mutex.h"
 
+#ifdef THREAD_INSTRUMENT
+#include "instrument.h"
+#endif
+
 const char* thread_mutex_errors[] = {
   "Success",
   "Failed to acquire mutex lock",
@@ -29,21 +35,68 @@ void thread_mutex_init(thread_mutex_t* mutex) {
   pthread_mutex_init(&mutex->handle, 0);
 }
 
+thread_mutex_type_t thread_mutex_init_type(thread_mutex_t* mutex,
+    thread_mutex_type_t type) {
+  pthread_mutexattr_t attr;
+  int error = 0;
+
+  pthread_mutexattr_init(&attr);
+
+  if (type == thread_mutex_adaptive) {
+#ifdef PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP
+    error = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+#else
+    error = 1;
+#endif
+  }
+  else if (type == thread_mutex_inherit)
+    error = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+
+  if (error || pthread_mutex_init(&mutex->handle, &attr)) {
+    pthread_mutex_init(&mutex->handle, 0);
+    type = thread_mutex_default;
+  }
+
+  pthread_mutexattr_destroy(&attr);
+
+  return type;
+}
+
 void thread_mutex_destroy(thread_mutex_t* mutex) {
   pthread_mutex_destroy(&mutex->handle);
+#ifdef THREAD_INSTRUMENT
+  thread_instrument_retire(mutex);
+#endif
 }
 
 void thread_mutex_lock(thread_mutex_t* mutex) {
+#ifdef THREAD_INSTRUMENT
+  int64_t start = -1;
+
+  if (pthread_mutex_trylock(&mutex->handle)) {
+    start = thread_instrument_get_time();
+    pthread_mutex_lock(&mutex->handle);
+  }
+  thread_instrument_lock(mutex, start);
+#else
   pthread_mutex_lock(&mutex->handle);
+#endif
 }
 
 void thread_mutex_unlock(thread_mutex_t* mutex) {
+#ifdef THREAD_INSTRUMENT
+  thread_instrument_unlock(mutex);
+#endif
   pthread_mutex_unlock(&mutex->handle);
 }
 
 int thread_mutex_try_lock(thread_mutex_t* mutex) {
-  if (!pthread_mutex_trylock(&mutex->handle))
+  if (!pthread_mutex_trylock(&mutex->handle)) {
+#ifdef THREAD_INSTRUMENT
+    thread_instrument_lock(mutex, -1);
+#endif
     return THREAD_MUTEX_ERROR_NONE;
+  }
   else
     return THREAD_MUTEX_ERROR_LOCK;
 }
@@ -29,6 +29,12 @@
   * Mutexes typically ensure that no two threads may enter a critical section,
   * e.g., involving non-atomic access to memory objects, at the same time.
   * They thus provide the fundamental means to ensuring thread safety.
+  * 
+  * Besides the default type, adaptive mutexes spin briefly before
+  * blocking, which benefits short critical sections under contention.
+  * Priority-inheritance mutexes temporarily raise the priority of the
+  * lock owner to that of the highest-priority waiter, thus preventing
+  * priority inversion among real-time threads.
   */
 
 #include <pthread.h>
@@ -47,6 +53,14 @@
   */
 extern const char* thread_mutex_errors[];
 
+/** \brief Mutex type enumerable type
+  */
+typedef enum {
+  thread_mutex_default,         //!< Default mutex.
+  thread_mutex_adaptive,        //!< Mutex spinning before it blocks.
+  thread_mutex_inherit          //!< Mutex with priority inheritance.
+} thread_mutex_type_t;
+
 /** \brief Structure defining the thread mutex
   */
 typedef struct thread_mutex_t {
@@ -59,6 +73,17 @@ typedef struct thread_mutex_t {
 void thread_mutex_init(
   thread_mutex_t* mutex);
 
+/** \brief Initialize a thread mutex of the specified type
+  * \param[in] mutex The thread mutex to be initialized.
+  * \param[in] type The type of the thread mutex.
+  * \return The type the mutex has actually been initialized with, which
+  *   falls back to thread_mutex_default if the requested type is not
+  *   supported by the system.
+  */
+thread_mutex_type_t thread_mutex_init_type(
+  thread_mutex_t* mutex,
+  thread_mutex_type_t type);
+
 /** \brief Destroy a thread mutex
   * \param[in] mutex The initialized thread mutex to be destroyed.
   */
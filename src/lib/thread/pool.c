@@ -0,0 +1,469 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <string.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+const char* thread_pool_errors[] = {
+  "Success",
+  "Error creating worker thread",
+};
+
+/* Subrange of a parallel loop */
+typedef struct thread_pool_range_t {
+  thread_pool_t* pool;
+  thread_pool_group_t* group;
+  size_t begin;
+  size_t end;
+  size_t grain_size;
+  void (*routine)(size_t, size_t, void*);
+  void* arg;
+} thread_pool_range_t;
+
+static __thread thread_pool_worker_t* thread_pool_current_worker = 0;
+
+void thread_pool_deque_init(thread_pool_deque_t* deque);
+void thread_pool_deque_destroy(thread_pool_deque_t* deque);
+void thread_pool_deque_push(thread_pool_deque_t* deque, thread_pool_task_t*
+  task);
+thread_pool_task_t* thread_pool_deque_take(thread_pool_deque_t* deque);
+thread_pool_task_t* thread_pool_deque_steal(thread_pool_deque_t* deque);
+thread_pool_task_t* thread_pool_find(thread_pool_t* pool,
+  thread_pool_worker_t* worker);
+void thread_pool_execute(thread_pool_task_t* task);
+void* thread_pool_run(void* arg);
+void thread_pool_range_run(void* arg);
+
+int thread_pool_init(thread_pool_t* pool, size_t num_workers) {
+  return thread_pool_init_attr(pool, num_workers, 0);
+}
+
+int thread_pool_init_attr(thread_pool_t* pool, size_t num_workers, const
+    thread_attr_t* attr) {
+  thread_attr_t worker_attr;
+  size_t i, j, num_cpus = 0;
+  int cpu = -1;
+
+  if (attr) {
+    for (i = 0; i < THREAD_ATTR_MAX_CPUS; ++i)
+      num_cpus += thread_attr_test_cpu(attr, i);
+    if (!num_workers)
+      num_workers = num_cpus;
+  }
+
+  if (!num_workers) {
+    long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = (num_processors > 0) ? num_processors : 1;
+  }
+
+  pool->workers = malloc(num_workers*sizeof(thread_pool_worker_t));
+  pool->num_workers = num_workers;
+
+  thread_mutex_init(&pool->queue_mutex);
+  atomic_init(&pool->queue_first, 0);
+  pool->queue_last = 0;
+
+  thread_pool_group_init(&pool->group);
+
+  thread_condition_init(&pool->condition);
+  atomic_init(&pool->num_queued, 0);
+  atomic_init(&pool->num_sleeping, 0);
+  atomic_init(&pool->exit_request, 0);
+
+  for (i = 0; i < num_workers; ++i) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].index = i;
+    pool->workers[i].seed = i+1;
+
+    thread_pool_deque_init(&pool->workers[i].deque);
+  }
+
+  for (i = 0; i < num_workers; ++i) {
+    if (attr) {
+      worker_attr = *attr;
+
+      if (num_cpus > 1) {
+        do {
+          cpu = (cpu+1)%THREAD_ATTR_MAX_CPUS;
+        }
+        while (!thread_attr_test_cpu(attr, cpu));
+
+        memset(worker_attr.cpus, 0, sizeof(worker_attr.cpus));
+        thread_attr_set_cpu(&worker_attr, cpu);
+      }
+    }
+
+    if (thread_start_attr(&pool->workers[i].thread, thread_pool_run, 0,
+        &pool->workers[i], 0.0, attr ? &worker_attr : 0)) {
+      for (j = i; j < num_workers; ++j)
+        thread_pool_deque_destroy(&pool->workers[j].deque);
+      pool->num_workers = i;
+      thread_pool_destroy(pool);
+
+      return THREAD_POOL_ERROR_CREATE;
+    }
+  }
+
+  return THREAD_POOL_ERROR_NONE;
+}
+
+void thread_pool_destroy(thread_pool_t* pool) {
+  size_t i;
+
+  atomic_store(&pool->exit_request, 1);
+
+  thread_condition_lock(&pool->condition);
+  thread_condition_broadcast(&pool->condition);
+  thread_condition_unlock(&pool->condition);
+
+  for (i = 0; i < pool->num_workers; ++i)
+    thread_wait_exit(&pool->workers[i].thread);
+
+  for (i = 0; i < pool->num_workers; ++i)
+    thread_pool_deque_destroy(&pool->workers[i].deque);
+  free(pool->workers);
+  pool->workers = 0;
+  pool->num_workers = 0;
+
+  thread_mutex_destroy(&pool->queue_mutex);
+  thread_pool_group_destroy(&pool->group);
+  thread_condition_destroy(&pool->condition);
+}
+
+void thread_pool_group_init(thread_pool_group_t* group) {
+  atomic_init(&group->num_pending, 0);
+  thread_condition_init(&group->condition);
+}
+
+void thread_pool_group_destroy(thread_pool_group_t* group) {
+  thread_condition_destroy(&group->condition);
+}
+
+void thread_pool_submit(thread_pool_t* pool, thread_pool_group_t* group,
+    void (*routine)(void*), void* arg) {
+  thread_pool_worker_t* worker = thread_pool_current_worker;
+  thread_pool_task_t* task = malloc(sizeof(thread_pool_task_t));
+
+  if (!group)
+    group = &pool->group;
+
+  task->routine = routine;
+  task->arg = arg;
+  task->group = group;
+  task->next = 0;
+
+  atomic_fetch_add(&group->num_pending, 1);
+  atomic_fetch_add(&pool->num_queued, 1);
+
+  if (worker && (worker->pool == pool))
+    thread_pool_deque_push(&worker->deque, task);
+  else {
+    thread_condition_lock(&group->condition);
+
+    thread_mutex_lock(&pool->queue_mutex);
+    if (pool->queue_last)
+      pool->queue_last->next = task;
+    else
+      atomic_store_explicit(&pool->queue_first, task, memory_order_relaxed);
+    pool->queue_last = task;
+    thread_mutex_unlock(&pool->queue_mutex);
+
+    thread_condition_broadcast(&group->condition);
+    thread_condition_unlock(&group->condition);
+  }
+
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&pool->num_sleeping, memory_order_relaxed)) {
+    thread_condition_lock(&pool->condition);
+    thread_condition_signal(&pool->condition);
+    thread_condition_unlock(&pool->condition);
+  }
+}
+
+void thread_pool_wait(thread_pool_t* pool, thread_pool_group_t* group) {
+  thread_pool_task_t* task;
+
+  if (!group)
+    group = &pool->group;
+
+  while (atomic_load(&group->num_pending)) {
+    if ((task = thread_pool_find(pool, thread_pool_current_worker))) {
+      thread_pool_execute(task);
+      continue;
+    }
+
+    thread_condition_lock(&group->condition);
+    if (atomic_load(&group->num_pending) && !atomic_load(&pool->num_queued))
+      thread_condition_wait(&group->condition,
+        THREAD_CONDITION_WAIT_FOREVER);
+    thread_condition_unlock(&group->condition);
+  }
+
+  thread_condition_lock(&group->condition);
+  thread_condition_unlock(&group->condition);
+}
+
+void thread_pool_parallel_for(thread_pool_t* pool, size_t begin, size_t end,
+    size_t grain_size, void (*routine)(size_t, size_t, void*), void* arg) {
+  thread_pool_group_t group;
+  thread_pool_range_t* range;
+
+  if (end <= begin)
+    return;
+
+  if (!grain_size) {
+    grain_size = (end-begin)/(8*pool->num_workers);
+    if (!grain_size)
+      grain_size = 1;
+  }
+
+  thread_pool_group_init(&group);
+
+  range = malloc(sizeof(thread_pool_range_t));
+  range->pool = pool;
+  range->group = &group;
+  range->begin = begin;
+  range->end = end;
+  range->grain_size = grain_size;
+  range->routine = routine;
+  range->arg = arg;
+
+  thread_pool_submit(pool, &group, thread_pool_range_run, range);
+  thread_pool_wait(pool, &group);
+
+  thread_pool_group_destroy(&group);
+}
+
+void thread_pool_deque_init(thread_pool_deque_t* deque) {
+  thread_pool_array_t* array = malloc(sizeof(thread_pool_array_t)+
+    THREAD_POOL_DEQUE_CAPACITY*sizeof(thread_pool_task_t*));
+
+  array->capacity = THREAD_POOL_DEQUE_CAPACITY;
+  array->previous = 0;
+
+  atomic_init(&deque->top, 0);
+  atomic_init(&deque->bottom, 0);
+  atomic_init(&deque->array, array);
+}
+
+void thread_pool_deque_destroy(thread_pool_deque_t* deque) {
+  thread_pool_array_t* array = atomic_load(&deque->array);
+  thread_pool_array_t* previous;
+
+  while (array) {
+    previous = array->previous;
+    free(array);
+    array = previous;
+  }
+}
+
+void thread_pool_deque_push(thread_pool_deque_t* deque, thread_pool_task_t*
+    task) {
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  thread_pool_array_t* array = atomic_load_explicit(&deque->array,
+    memory_order_relaxed);
+  thread_pool_array_t* grown;
+  long i;
+
+  if (bottom-top > (long)array->capacity-1) {
+    grown = malloc(sizeof(thread_pool_array_t)+2*array->capacity*
+      sizeof(thread_pool_task_t*));
+    grown->capacity = 2*array->capacity;
+    grown->previous = array;
+
+    for (i = top; i < bottom; ++i)
+      atomic_store_explicit(&grown->tasks[i % grown->capacity],
+        atomic_load_explicit(&array->tasks[i % array->capacity],
+        memory_order_relaxed), memory_order_relaxed);
+
+    atomic_store_explicit(&deque->array, grown, memory_order_release);
+    array = grown;
+  }
+
+  atomic_store_explicit(&array->tasks[bottom % array->capacity], task,
+    memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&deque->bottom, bottom+1, memory_order_relaxed);
+}
+
+thread_pool_task_t* thread_pool_deque_take(thread_pool_deque_t* deque) {
+  long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed)-1;
+  thread_pool_array_t* array = atomic_load_explicit(&deque->array,
+    memory_order_relaxed);
+  thread_pool_task_t* task = 0;
+  long top;
+
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+  if (top <= bottom) {
+    task = atomic_load_explicit(&array->tasks[bottom % array->capacity],
+      memory_order_relaxed);
+
+    if (top == bottom) {
+      if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top+1,
+          memory_order_seq_cst, memory_order_relaxed))
+        task = 0;
+      atomic_store_explicit(&deque->bottom, bottom+1, memory_order_relaxed);
+    }
+  }
+  else
+    atomic_store_explicit(&deque->bottom, bottom+1, memory_order_relaxed);
+
+  return task;
+}
+
+thread_pool_task_t* thread_pool_deque_steal(thread_pool_deque_t* deque) {
+  long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  thread_pool_array_t* array;
+  thread_pool_task_t* task;
+  long bottom;
+
+  atomic_thread_fence(memory_order_seq_cst);
+  bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+  if (top < bottom) {
+    array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    task = atomic_load_explicit(&array->tasks[top % array->capacity],
+      memory_order_relaxed);
+
+    if (atomic_compare_exchange_strong_explicit(&deque->top, &top, top+1,
+        memory_order_seq_cst, memory_order_relaxed))
+      return task;
+  }
+
+  return 0;
+}
+
+thread_pool_task_t* thread_pool_find(thread_pool_t* pool,
+    thread_pool_worker_t* worker) {
+  thread_pool_task_t* task = 0;
+  size_t i, victim = 0;
+
+  if (worker && (worker->pool != pool))
+    worker = 0;
+
+  if (worker)
+    task = thread_pool_deque_take(&worker->deque);
+
+  if (!task && atomic_load_explicit(&pool->queue_first,
+      memory_order_relaxed)) {
+    thread_mutex_lock(&pool->queue_mutex);
+    if ((task = atomic_load_explicit(&pool->queue_first,
+        memory_order_relaxed))) {
+      atomic_store_explicit(&pool->queue_first, task->next,
+        memory_order_relaxed);
+      if (!task->next)
+        pool->queue_last = 0;
+    }
+    thread_mutex_unlock(&pool->queue_mutex);
+  }
+
+  if (!task) {
+    if (worker) {
+      worker->seed = worker->seed*1103515245+12345;
+      victim = (worker->seed >> 16) % pool->num_workers;
+    }
+
+    for (i = 0; (i < pool->num_workers) && !task; ++i)
+      if (!worker || ((victim+i) % pool->num_workers != worker->index))
+        task = thread_pool_deque_steal(
+          &pool->workers[(victim+i) % pool->num_workers].deque);
+  }
+
+  if (task)
+    atomic_fetch_sub(&pool->num_queued, 1);
+
+  return task;
+}
+
+void thread_pool_execute(thread_pool_task_t* task) {
+  thread_pool_group_t* group = task->group;
+  size_t num_pending;
+
+  task->routine(task->arg);
+  free(task);
+
+  num_pending = atomic_load(&group->num_pending);
+  while (num_pending > 1)
+    if (atomic_compare_exchange_weak(&group->num_pending, &num_pending,
+        num_pending-1))
+      return;
+
+  thread_condition_lock(&group->condition);
+  atomic_fetch_sub(&group->num_pending, 1);
+  thread_condition_broadcast(&group->condition);
+  thread_condition_unlock(&group->condition);
+}
+
+void* thread_pool_run(void* arg) {
+  thread_pool_worker_t* worker = arg;
+  thread_pool_t* pool = worker->pool;
+  thread_pool_task_t* task;
+
+  thread_pool_current_worker = worker;
+
+  while (1) {
+    if ((task = thread_pool_find(pool, worker))) {
+      thread_pool_execute(task);
+      continue;
+    }
+
+    if (atomic_load(&pool->exit_request) && !atomic_load(&pool->num_queued))
+      break;
+
+    thread_condition_lock(&pool->condition);
+    atomic_fetch_add(&pool->num_sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!atomic_load(&pool->num_queued) && !atomic_load(&pool->exit_request))
+      thread_condition_wait(&pool->condition, THREAD_CONDITION_WAIT_FOREVER);
+
+    atomic_fetch_sub(&pool->num_sleeping, 1);
+    thread_condition_unlock(&pool->condition);
+  }
+
+  thread_pool_current_worker = 0;
+
+  return 0;
+}
+
+void thread_pool_range_run(void* arg) {
+  thread_pool_range_t* range = arg;
+  thread_pool_range_t* half;
+
+  while (range->end-range->begin > range->grain_size) {
+    half = malloc(sizeof(thread_pool_range_t));
+    *half = *range;
+
+    half->begin = range->begin+(range->end-range->begin)/2;
+    range->end = half->begin;
+
+    thread_pool_submit(range->pool, range->group, thread_pool_range_run,
+      half);
+  }
+
+  range->routine(range->begin, range->end, range->arg);
+  free(range);
+}
@@ -0,0 +1,227 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/** \file thread/pool.h
+  * \ingroup thread
+  * \brief Work-stealing thread pool implementation
+  * \author Ralf Kaestner
+  * 
+  * The thread pool executes tasks on a fixed set of worker threads. Each
+  * worker owns a Chase-Lev deque from which it executes the most recently
+  * submitted task, whereas idle workers steal the oldest tasks from the
+  * deques of other workers. Tasks submitted by threads outside the pool
+  * are enqueued in a shared queue. Tasks may be collected in groups, and
+  * any thread waiting for a group's completion participates in executing
+  * the pending tasks.
+  */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "thread/thread.h"
+
+/** \name Error Codes
+  * \brief Predefined thread pool error codes
+  */
+//@{
+#define THREAD_POOL_ERROR_NONE                  0
+//!< Success
+#define THREAD_POOL_ERROR_CREATE                1
+//!< Error creating worker thread
+//@}
+
+/** \brief Predefined thread pool error descriptions
+  */
+extern const char* thread_pool_errors[];
+
+/** \brief Initial capacity of the work-stealing deques
+  */
+#define THREAD_POOL_DEQUE_CAPACITY              256
+
+/** \brief Structure defining a thread pool task
+  */
+typedef struct thread_pool_task_t {
+  void (*routine)(void*);                   //!< The task routine.
+  void* arg;                                //!< The task routine argument.
+  struct thread_pool_group_t* group;        //!< The group of the task.
+
+  struct thread_pool_task_t* next;          //!< The next task in the queue.
+} thread_pool_task_t;
+
+/** \brief Structure defining a group of thread pool tasks
+  */
+typedef struct thread_pool_group_t {
+  atomic_size_t num_pending;                //!< The number of pending tasks.
+  thread_condition_t condition;             //!< The completion condition.
+} thread_pool_group_t;
+
+/** \brief Structure defining the storage of a work-stealing deque
+  * 
+  * Storage which has been replaced by a larger array is retained until
+  * the deque is destroyed, since concurrent thieves may still access it.
+  */
+typedef struct thread_pool_array_t {
+  size_t capacity;                          //!< The capacity of the array.
+  struct thread_pool_array_t* previous;     //!< The replaced array.
+  _Atomic(thread_pool_task_t*) tasks[];     //!< The array of tasks.
+} thread_pool_array_t;
+
+/** \brief Structure defining a Chase-Lev work-stealing deque
+  */
+typedef struct thread_pool_deque_t {
+  atomic_long top;                          //!< The index stolen from.
+  char padding[64];                         //!< Separation of the indices.
+  atomic_long bottom;                       //!< The index of the owner.
+  _Atomic(thread_pool_array_t*) array;      //!< The array of tasks.
+} thread_pool_deque_t;
+
+/** \brief Structure defining a thread pool worker
+  */
+typedef struct thread_pool_worker_t {
+  thread_t thread;                          //!< The worker thread.
+  struct thread_pool_t* pool;               //!< The pool of the worker.
+  size_t index;                             //!< The index of the worker.
+  unsigned int seed;                        //!< The victim selection seed.
+
+  thread_pool_deque_t deque;                //!< The deque of the worker.
+} thread_pool_worker_t;
+
+/** \brief Structure defining the thread pool
+  */
+typedef struct thread_pool_t {
+  thread_pool_worker_t* workers;            //!< The pool workers.
+  size_t num_workers;                       //!< The number of workers.
+
+  thread_mutex_t queue_mutex;               //!< The shared queue mutex.
+  _Atomic(thread_pool_task_t*) queue_first; //!< The first shared task.
+  thread_pool_task_t* queue_last;           //!< The last shared task.
+
+  thread_pool_group_t group;                //!< The default task group.
+
+  thread_condition_t condition;             //!< The worker wake-up condition.
+  atomic_size_t num_queued;                 //!< The number of queued tasks.
+  atomic_size_t num_sleeping;               //!< The number of idle workers.
+  atomic_int exit_request;                  //!< Flag requesting exit.
+} thread_pool_t;
+
+/** \brief Initialize a thread pool
+  * \param[in] pool The thread pool to be initialized.
+  * \param[in] num_workers The number of worker threads. If zero, the
+  *   number of online processors will be used.
+  * \return The resulting error code.
+  */
+int thread_pool_init(
+  thread_pool_t* pool,
+  size_t num_workers);
+
+/** \brief Initialize a thread pool with worker attributes
+  * \param[in] pool The thread pool to be initialized.
+  * \param[in] num_workers The number of worker threads. If zero, the
+  *   number of CPUs in the affinity mask of the attributes or, if the
+  *   mask is empty, the number of online processors will be used.
+  * \param[in] attr The attributes the workers are started with. If the
+  *   affinity mask contains several CPUs, each worker is pinned to one
+  *   of them in turn.
+  * \return The resulting error code.
+  */
+int thread_pool_init_attr(
+  thread_pool_t* pool,
+  size_t num_workers,
+  const thread_attr_t* attr);
+
+/** \brief Destroy a thread pool
+  * \param[in] pool The initialized thread pool to be destroyed.
+  * 
+  * All queued tasks will be executed before the workers terminate.
+  */
+void thread_pool_destroy(
+  thread_pool_t* pool);
+
+/** \brief Initialize a task group
+  * \param[in] group The task group to be initialized.
+  */
+void thread_pool_group_init(
+  thread_pool_group_t* group);
+
+/** \brief Destroy a task group
+  * \param[in] group The initialized task group to be destroyed. The group
+  *   must not have any pending tasks.
+  */
+void thread_pool_group_destroy(
+  thread_pool_group_t* group);
+
+/** \brief Submit a task to the thread pool
+  * \param[in] pool The initialized thread pool to submit the task to.
+  * \param[in] group The initialized group the task will be added to. If
+  *   null, the task will be added to the pool's default group.
+  * \param[in] routine The task routine to be executed.
+  * \param[in] arg The argument passed to the task routine.
+  * 
+  * When called from within a task, the task is pushed onto the deque of
+  * the executing worker. Otherwise, it is appended to the pool's queue
+  * and the threads waiting for the group are woken to help execute it.
+  */
+void thread_pool_submit(
+  thread_pool_t* pool,
+  thread_pool_group_t* group,
+  void (*routine)(void*),
+  void* arg);
+
+/** \brief Wait for the completion of a task group
+  * \param[in] pool The initialized thread pool executing the tasks.
+  * \param[in] group The group to wait for. If null, the function waits
+  *   for the pool's default group.
+  * 
+  * While waiting, the calling thread executes pending tasks of the pool.
+  * The function may therefore safely be called from within a task. Once
+  * no pending task is left to execute, the calling thread sleeps until
+  * the last task of the group has completed.
+  */
+void thread_pool_wait(
+  thread_pool_t* pool,
+  thread_pool_group_t* group);
+
+/** \brief Execute a loop in parallel
+  * \param[in] pool The initialized thread pool executing the loop.
+  * \param[in] begin The first index of the loop.
+  * \param[in] end The index following the last index of the loop.
+  * \param[in] grain_size The maximum number of indices executed by a
+  *   single invocation of the loop routine. If zero, the grain size will
+  *   be chosen such as to provide eight ranges per worker.
+  * \param[in] routine The loop routine which is invoked for disjoint
+  *   subranges [range_begin, range_end) of the loop.
+  * \param[in] arg The argument passed to the loop routine.
+  * 
+  * The index range is split recursively, such that idle workers steal
+  * large subranges. The function returns after the entire range has been
+  * processed.
+  */
+void thread_pool_parallel_for(
+  thread_pool_t* pool,
+  size_t begin,
+  size_t end,
+  size_t grain_size,
+  void (*routine)(size_t, size_t, void*),
+  void* arg);
+
+#endif
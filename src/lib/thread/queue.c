@@ -0,0 +1,430 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "queue.h"
+
+const char* thread_queue_errors[] = {
+  "Success",
+  "Wait operation timed out",
+};
+
+static atomic_int thread_queue_spin_count = -1;
+
+size_t thread_queue_capacity(size_t capacity);
+int thread_queue_get_spin_count(void);
+int64_t thread_queue_get_time(void);
+void thread_queue_event_init(thread_queue_event_t* event);
+void thread_queue_event_signal(thread_queue_event_t* event, size_t
+  num_waiters);
+int thread_queue_event_wait(thread_queue_event_t* event, int (*ready)(void*),
+  void* queue, int64_t deadline);
+ssize_t thread_queue_wait(void* queue, size_t (*transfer)(void*, void*,
+  size_t), int (*ready)(void*), thread_queue_event_t* event, unsigned char*
+  elements, size_t element_size, size_t num_elements, int all, double
+  timeout);
+size_t thread_queue_spsc_push_transfer(void* queue, void* elements, size_t
+  num_elements);
+size_t thread_queue_spsc_pop_transfer(void* queue, void* elements, size_t
+  num_elements);
+int thread_queue_spsc_writable(void* queue);
+int thread_queue_spsc_readable(void* queue);
+size_t thread_queue_mpmc_push_transfer(void* queue, void* elements, size_t
+  num_elements);
+size_t thread_queue_mpmc_pop_transfer(void* queue, void* elements, size_t
+  num_elements);
+int thread_queue_mpmc_writable(void* queue);
+int thread_queue_mpmc_readable(void* queue);
+
+void thread_queue_spsc_init(thread_queue_spsc_t* queue, size_t capacity,
+    size_t element_size) {
+  queue->capacity = thread_queue_capacity(capacity);
+  queue->element_size = element_size;
+  queue->data = malloc(queue->capacity*element_size);
+
+  thread_queue_event_init(&queue->data_event);
+  thread_queue_event_init(&queue->space_event);
+
+  atomic_init(&queue->head, 0);
+  queue->tail_cache = 0;
+  atomic_init(&queue->tail, 0);
+  queue->head_cache = 0;
+}
+
+void thread_queue_spsc_destroy(thread_queue_spsc_t* queue) {
+  free(queue->data);
+
+  queue->data = 0;
+  queue->capacity = 0;
+}
+
+size_t thread_queue_spsc_push(thread_queue_spsc_t* queue, const void*
+    elements, size_t num_elements) {
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  size_t space = queue->capacity-(head-queue->tail_cache);
+  size_t offset, length;
+
+  if (space < num_elements) {
+    queue->tail_cache = atomic_load_explicit(&queue->tail,
+      memory_order_acquire);
+    space = queue->capacity-(head-queue->tail_cache);
+  }
+  if (num_elements > space)
+    num_elements = space;
+  if (!num_elements)
+    return 0;
+
+  offset = head & (queue->capacity-1);
+  length = (num_elements < queue->capacity-offset) ? num_elements :
+    queue->capacity-offset;
+
+  memcpy(&queue->data[offset*queue->element_size], elements,
+    length*queue->element_size);
+  if (length < num_elements)
+    memcpy(queue->data, (const unsigned char*)elements+
+      length*queue->element_size, (num_elements-length)*queue->element_size);
+
+  atomic_store_explicit(&queue->head, head+num_elements,
+    memory_order_release);
+  thread_queue_event_signal(&queue->data_event, 1);
+
+  return num_elements;
+}
+
+size_t thread_queue_spsc_pop(thread_queue_spsc_t* queue, void* elements,
+    size_t max_elements) {
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  size_t available = queue->head_cache-tail;
+  size_t offset, length;
+
+  if (available < max_elements) {
+    queue->head_cache = atomic_load_explicit(&queue->head,
+      memory_order_acquire);
+    available = queue->head_cache-tail;
+  }
+  if (max_elements > available)
+    max_elements = available;
+  if (!max_elements)
+    return 0;
+
+  offset = tail & (queue->capacity-1);
+  length = (max_elements < queue->capacity-offset) ? max_elements :
+    queue->capacity-offset;
+
+  memcpy(elements, &queue->data[offset*queue->element_size],
+    length*queue->element_size);
+  if (length < max_elements)
+    memcpy((unsigned char*)elements+length*queue->element_size, queue->data,
+      (max_elements-length)*queue->element_size);
+
+  atomic_store_explicit(&queue->tail, tail+max_elements,
+    memory_order_release);
+  thread_queue_event_signal(&queue->space_event, 1);
+
+  return max_elements;
+}
+
+ssize_t thread_queue_spsc_push_wait(thread_queue_spsc_t* queue, const void*
+    elements, size_t num_elements, double timeout) {
+  return thread_queue_wait(queue, thread_queue_spsc_push_transfer,
+    thread_queue_spsc_writable, &queue->space_event, (unsigned char*)elements,
+    queue->element_size, num_elements, 1, timeout);
+}
+
+ssize_t thread_queue_spsc_pop_wait(thread_queue_spsc_t* queue, void*
+    elements, size_t max_elements, double timeout) {
+  return thread_queue_wait(queue, thread_queue_spsc_pop_transfer,
+    thread_queue_spsc_readable, &queue->data_event, elements,
+    queue->element_size, max_elements, 0, timeout);
+}
+
+void thread_queue_mpmc_init(thread_queue_mpmc_t* queue, size_t capacity,
+    size_t element_size) {
+  size_t i;
+
+  queue->capacity = thread_queue_capacity(capacity);
+  queue->element_size = element_size;
+  queue->data = malloc(queue->capacity*element_size);
+  queue->sequences = malloc(queue->capacity*sizeof(atomic_size_t));
+
+  for (i = 0; i < queue->capacity; ++i)
+    atomic_init(&queue->sequences[i], i);
+
+  thread_queue_event_init(&queue->data_event);
+  thread_queue_event_init(&queue->space_event);
+
+  atomic_init(&queue->enqueue_pos, 0);
+  atomic_init(&queue->dequeue_pos, 0);
+}
+
+void thread_queue_mpmc_destroy(thread_queue_mpmc_t* queue) {
+  free(queue->data);
+  free(queue->sequences);
+
+  queue->data = 0;
+  queue->sequences = 0;
+  queue->capacity = 0;
+}
+
+size_t thread_queue_mpmc_push(thread_queue_mpmc_t* queue, const void*
+    elements, size_t num_elements) {
+  size_t num_pushed = 0, pos, seq;
+  intptr_t diff;
+
+  pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+  while (num_pushed < num_elements) {
+    seq = atomic_load_explicit(&queue->sequences[pos & (queue->capacity-1)],
+      memory_order_acquire);
+    diff = (intptr_t)seq-(intptr_t)pos;
+
+    if (!diff) {
+      if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos,
+          pos+1, memory_order_relaxed, memory_order_relaxed)) {
+        memcpy(&queue->data[(pos & (queue->capacity-1))*queue->element_size],
+          (const unsigned char*)elements+num_pushed*queue->element_size,
+          queue->element_size);
+        atomic_store_explicit(&queue->sequences[pos & (queue->capacity-1)],
+          pos+1, memory_order_release);
+
+        ++num_pushed;
+        ++pos;
+      }
+    }
+    else if (diff < 0)
+      break;
+    else
+      pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+  }
+
+  if (num_pushed)
+    thread_queue_event_signal(&queue->data_event, num_pushed);
+
+  return num_pushed;
+}
+
+size_t thread_queue_mpmc_pop(thread_queue_mpmc_t* queue, void* elements,
+    size_t max_elements) {
+  size_t num_popped = 0, pos, seq;
+  intptr_t diff;
+
+  pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+  while (num_popped < max_elements) {
+    seq = atomic_load_explicit(&queue->sequences[pos & (queue->capacity-1)],
+      memory_order_acquire);
+    diff = (intptr_t)seq-(intptr_t)(pos+1);
+
+    if (!diff) {
+      if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos,
+          pos+1, memory_order_relaxed, memory_order_relaxed)) {
+        memcpy((unsigned char*)elements+num_popped*queue->element_size,
+          &queue->data[(pos & (queue->capacity-1))*queue->element_size],
+          queue->element_size);
+        atomic_store_explicit(&queue->sequences[pos & (queue->capacity-1)],
+          pos+queue->capacity, memory_order_release);
+
+        ++num_popped;
+        ++pos;
+      }
+    }
+    else if (diff < 0)
+      break;
+    else
+      pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+  }
+
+  if (num_popped)
+    thread_queue_event_signal(&queue->space_event, num_popped);
+
+  return num_popped;
+}
+
+ssize_t thread_queue_mpmc_push_wait(thread_queue_mpmc_t* queue, const void*
+    elements, size_t num_elements, double timeout) {
+  return thread_queue_wait(queue, thread_queue_mpmc_push_transfer,
+    thread_queue_mpmc_writable, &queue->space_event, (unsigned char*)elements,
+    queue->element_size, num_elements, 1, timeout);
+}
+
+ssize_t thread_queue_mpmc_pop_wait(thread_queue_mpmc_t* queue, void*
+    elements, size_t max_elements, double timeout) {
+  return thread_queue_wait(queue, thread_queue_mpmc_pop_transfer,
+    thread_queue_mpmc_readable, &queue->data_event, elements,
+    queue->element_size, max_elements, 0, timeout);
+}
+
+size_t thread_queue_capacity(size_t capacity) {
+  size_t result = 1;
+
+  while (result < capacity)
+    result <<= 1;
+
+  return result;
+}
+
+int thread_queue_get_spin_count(void) {
+  int spin_count = atomic_load_explicit(&thread_queue_spin_count,
+    memory_order_relaxed);
+
+  /* Spinning on a single processor only delays the other side */
+  if (spin_count < 0) {
+    spin_count = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ?
+      THREAD_QUEUE_SPIN_COUNT : 1;
+    atomic_store_explicit(&thread_queue_spin_count, spin_count,
+      memory_order_relaxed);
+  }
+
+  return spin_count;
+}
+
+int64_t thread_queue_get_time(void) {
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+
+  return (int64_t)time.tv_sec*1000000000+time.tv_nsec;
+}
+
+void thread_queue_event_init(thread_queue_event_t* event) {
+  atomic_init(&event->seq, 0);
+  atomic_init(&event->num_waiters, 0);
+}
+
+void thread_queue_event_signal(thread_queue_event_t* event, size_t
+    num_waiters) {
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (atomic_load_explicit(&event->num_waiters, memory_order_relaxed)) {
+    atomic_fetch_add(&event->seq, 1);
+    syscall(SYS_futex, &event->seq, FUTEX_WAKE_PRIVATE,
+      (num_waiters < INT_MAX) ? (int)num_waiters : INT_MAX, 0, 0, 0);
+  }
+}
+
+int thread_queue_event_wait(thread_queue_event_t* event, int (*ready)(void*),
+    void* queue, int64_t deadline) {
+  unsigned int seq = atomic_load(&event->seq);
+  struct timespec timeout;
+  int64_t remaining = 0;
+  int result = THREAD_QUEUE_ERROR_NONE;
+
+  atomic_fetch_add(&event->num_waiters, 1);
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (!ready(queue)) {
+    if (deadline >= 0) {
+      remaining = deadline-thread_queue_get_time();
+      timeout.tv_sec = remaining/1000000000;
+      timeout.tv_nsec = remaining%1000000000;
+    }
+
+    if ((deadline >= 0) && (remaining <= 0))
+      result = THREAD_QUEUE_ERROR_TIMEOUT;
+    else if (syscall(SYS_futex, &event->seq, FUTEX_WAIT_PRIVATE, seq,
+        (deadline >= 0) ? &timeout : 0, 0, 0) && (errno == ETIMEDOUT))
+      result = THREAD_QUEUE_ERROR_TIMEOUT;
+  }
+
+  atomic_fetch_sub(&event->num_waiters, 1);
+
+  return result;
+}
+
+ssize_t thread_queue_wait(void* queue, size_t (*transfer)(void*, void*,
+    size_t), int (*ready)(void*), thread_queue_event_t* event, unsigned char*
+    elements, size_t element_size, size_t num_elements, int all, double
+    timeout) {
+  int64_t deadline = (timeout >= 0.0) ?
+    thread_queue_get_time()+(int64_t)(timeout*1e9) : -1;
+  size_t num_transferred = 0;
+  int i, spin_count = thread_queue_get_spin_count();
+
+  if (!num_elements)
+    return 0;
+
+  while (1) {
+    for (i = 0; i < spin_count; ++i) {
+      num_transferred += transfer(queue, &elements[num_transferred*
+        element_size], num_elements-num_transferred);
+
+      if ((num_transferred == num_elements) || (num_transferred && !all))
+        return num_transferred;
+    }
+
+    if (thread_queue_event_wait(event, ready, queue, deadline))
+      return num_transferred ? num_transferred : -THREAD_QUEUE_ERROR_TIMEOUT;
+  }
+}
+
+size_t thread_queue_spsc_push_transfer(void* queue, void* elements, size_t
+    num_elements) {
+  return thread_queue_spsc_push(queue, elements, num_elements);
+}
+
+size_t thread_queue_spsc_pop_transfer(void* queue, void* elements, size_t
+    num_elements) {
+  return thread_queue_spsc_pop(queue, elements, num_elements);
+}
+
+int thread_queue_spsc_writable(void* queue) {
+  thread_queue_spsc_t* spsc = queue;
+
+  return atomic_load_explicit(&spsc->head, memory_order_relaxed)-
+    atomic_load_explicit(&spsc->tail, memory_order_acquire) < spsc->capacity;
+}
+
+int thread_queue_spsc_readable(void* queue) {
+  thread_queue_spsc_t* spsc = queue;
+
+  return atomic_load_explicit(&spsc->head, memory_order_acquire) !=
+    atomic_load_explicit(&spsc->tail, memory_order_relaxed);
+}
+
+size_t thread_queue_mpmc_push_transfer(void* queue, void* elements, size_t
+    num_elements) {
+  return thread_queue_mpmc_push(queue, elements, num_elements);
+}
+
+size_t thread_queue_mpmc_pop_transfer(void* queue, void* elements, size_t
+    num_elements) {
+  return thread_queue_mpmc_pop(queue, elements, num_elements);
+}
+
+int thread_queue_mpmc_writable(void* queue) {
+  thread_queue_mpmc_t* mpmc = queue;
+  size_t pos = atomic_load(&mpmc->enqueue_pos);
+
+  return (intptr_t)(atomic_load(&mpmc->sequences[pos & (mpmc->capacity-1)])-
+    pos) >= 0;
+}
+
+int thread_queue_mpmc_readable(void* queue) {
+  thread_queue_mpmc_t* mpmc = queue;
+  size_t pos = atomic_load(&mpmc->dequeue_pos);
+
+  return (intptr_t)(atomic_load(&mpmc->sequences[pos & (mpmc->capacity-1)])-
+    (pos+1)) >= 0;
+}
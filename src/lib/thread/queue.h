@@ -0,0 +1,280 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef THREAD_QUEUE_H
+#define THREAD_QUEUE_H
+
+/** \file thread/queue.h
+  * \ingroup thread
+  * \brief Lock-free bounded queue implementation
+  * \author Ralf Kaestner
+  * 
+  * The bounded queues exchange fixed-size elements between threads without
+  * locking. The single-producer single-consumer ring keeps the indices of
+  * the producer and the consumer on separate cache lines, each along with
+  * a cached copy of the other side's index. The multi-producer
+  * multi-consumer queue follows Dmitry Vyukov's design, in which every
+  * cell carries a sequence number that arbitrates between the producers
+  * and consumers racing for it.
+  * 
+  * Both queues support transferring batches of elements in a single
+  * operation. The blocking operations spin briefly and only sleep on a
+  * futex if the queue remains empty or full, such that the other side
+  * merely pays for a memory fence as long as nobody is waiting.
+  */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+/** \name Error Codes
+  * \brief Predefined queue error codes
+  */
+//@{
+#define THREAD_QUEUE_ERROR_NONE                 0
+//!< Success
+#define THREAD_QUEUE_ERROR_TIMEOUT              1
+//!< Wait operation timed out
+//@}
+
+/** \brief Predefined queue error descriptions
+  */
+extern const char* thread_queue_errors[];
+
+/** \brief Cache line size assumed for padding the queue indices
+  */
+#define THREAD_QUEUE_CACHE_LINE_SIZE            64
+
+/** \brief Number of attempts of a blocking operation before sleeping
+  *   on a multi-processor system
+  */
+#define THREAD_QUEUE_SPIN_COUNT                 128
+
+/** \brief Queue event structure
+  * 
+  * The event is an event count, on whose sequence number threads sleep
+  * using a futex. The sequence number is only advanced if the number of
+  * waiters is non-zero.
+  */
+typedef struct thread_queue_event_t {
+  atomic_uint seq;                          //!< The event sequence number.
+  atomic_uint num_waiters;                  //!< The number of waiters.
+} thread_queue_event_t;
+
+/** \brief Single-producer single-consumer queue structure
+  */
+typedef struct thread_queue_spsc_t {
+  unsigned char* data;                      //!< The queue elements.
+  size_t element_size;                      //!< The size of an element.
+  size_t capacity;                          //!< The capacity of the queue.
+
+  char data_padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+  thread_queue_event_t data_event;          //!< Event signaling elements.
+  char space_padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+  thread_queue_event_t space_event;         //!< Event signaling space.
+
+  char head_padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+  atomic_size_t head;                       //!< The producer's index.
+  size_t tail_cache;                        //!< The producer's tail copy.
+  char tail_padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+  atomic_size_t tail;                       //!< The consumer's index.
+  size_t head_cache;                        //!< The consumer's head copy.
+  char padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+} thread_queue_spsc_t;
+
+/** \brief Multi-producer multi-consumer queue structure
+  */
+typedef struct thread_queue_mpmc_t {
+  unsigned char* data;                      //!< The queue elements.
+  atomic_size_t* sequences;                 //!< The cell sequence numbers.
+  size_t element_size;                      //!< The size of an element.
+  size_t capacity;                          //!< The capacity of the queue.
+
+  char data_padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+  thread_queue_event_t data_event;          //!< Event signaling elements.
+  char space_padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+  thread_queue_event_t space_event;         //!< Event signaling space.
+
+  char enqueue_padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+  atomic_size_t enqueue_pos;                //!< The next enqueue position.
+  char dequeue_padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+  atomic_size_t dequeue_pos;                //!< The next dequeue position.
+  char padding[THREAD_QUEUE_CACHE_LINE_SIZE];
+} thread_queue_mpmc_t;
+
+/** \brief Initialize a single-producer single-consumer queue
+  * \param[in] queue The queue to be initialized.
+  * \param[in] capacity The requested number of elements the queue can
+  *   hold, which will be rounded up to the next power of two.
+  * \param[in] element_size The size of a queue element in bytes.
+  */
+void thread_queue_spsc_init(
+  thread_queue_spsc_t* queue,
+  size_t capacity,
+  size_t element_size);
+
+/** \brief Destroy a single-producer single-consumer queue
+  * \param[in] queue The initialized queue to be destroyed.
+  */
+void thread_queue_spsc_destroy(
+  thread_queue_spsc_t* queue);
+
+/** \brief Push elements to a single-producer single-consumer queue
+  * \note This function must only be called by the producer.
+  * \param[in] queue The initialized queue to push the elements to.
+  * \param[in] elements An array holding the elements to be pushed.
+  * \param[in] num_elements The number of elements to be pushed.
+  * \return The number of elements actually pushed, which may be less
+  *   than requested if the queue is full.
+  */
+size_t thread_queue_spsc_push(
+  thread_queue_spsc_t* queue,
+  const void* elements,
+  size_t num_elements);
+
+/** \brief Pop elements from a single-producer single-consumer queue
+  * \note This function must only be called by the consumer.
+  * \param[in] queue The initialized queue to pop the elements from.
+  * \param[out] elements An array of sufficient size to hold the popped
+  *   elements.
+  * \param[in] max_elements The maximum number of elements to be popped.
+  * \return The number of elements actually popped, which is zero if the
+  *   queue is empty.
+  */
+size_t thread_queue_spsc_pop(
+  thread_queue_spsc_t* queue,
+  void* elements,
+  size_t max_elements);
+
+/** \brief Push elements to a single-producer single-consumer queue,
+  *   waiting for space if the queue is full
+  * \note This function must only be called by the producer.
+  * \param[in] queue The initialized queue to push the elements to.
+  * \param[in] elements An array holding the elements to be pushed.
+  * \param[in] num_elements The number of elements to be pushed.
+  * \param[in] timeout The timeout of the wait operation in [s]. A negative
+  *   timeout makes the operation wait forever.
+  * \return The number of elements pushed or, if the operation timed out
+  *   before any element could be pushed, the negative error code.
+  */
+ssize_t thread_queue_spsc_push_wait(
+  thread_queue_spsc_t* queue,
+  const void* elements,
+  size_t num_elements,
+  double timeout);
+
+/** \brief Pop elements from a single-producer single-consumer queue,
+  *   waiting for elements if the queue is empty
+  * \note This function must only be called by the consumer.
+  * \param[in] queue The initialized queue to pop the elements from.
+  * \param[out] elements An array of sufficient size to hold the popped
+  *   elements.
+  * \param[in] max_elements The maximum number of elements to be popped.
+  * \param[in] timeout The timeout of the wait operation in [s]. A negative
+  *   timeout makes the operation wait forever.
+  * \return The non-zero number of elements popped or the negative error
+  *   code.
+  */
+ssize_t thread_queue_spsc_pop_wait(
+  thread_queue_spsc_t* queue,
+  void* elements,
+  size_t max_elements,
+  double timeout);
+
+/** \brief Initialize a multi-producer multi-consumer queue
+  * \param[in] queue The queue to be initialized.
+  * \param[in] capacity The requested number of elements the queue can
+  *   hold, which will be rounded up to the next power of two.
+  * \param[in] element_size The size of a queue element in bytes.
+  */
+void thread_queue_mpmc_init(
+  thread_queue_mpmc_t* queue,
+  size_t capacity,
+  size_t element_size);
+
+/** \brief Destroy a multi-producer multi-consumer queue
+  * \param[in] queue The initialized queue to be destroyed.
+  */
+void thread_queue_mpmc_destroy(
+  thread_queue_mpmc_t* queue);
+
+/** \brief Push elements to a multi-producer multi-consumer queue
+  * \param[in] queue The initialized queue to push the elements to.
+  * \param[in] elements An array holding the elements to be pushed.
+  * \param[in] num_elements The number of elements to be pushed.
+  * \return The number of elements actually pushed, which may be less
+  *   than requested if the queue is full.
+  * 
+  * The elements are enqueued one after another, such that elements of
+  * concurrent producers may interleave. Waiting consumers are however
+  * signaled only once per batch.
+  */
+size_t thread_queue_mpmc_push(
+  thread_queue_mpmc_t* queue,
+  const void* elements,
+  size_t num_elements);
+
+/** \brief Pop elements from a multi-producer multi-consumer queue
+  * \param[in] queue The initialized queue to pop the elements from.
+  * \param[out] elements An array of sufficient size to hold the popped
+  *   elements.
+  * \param[in] max_elements The maximum number of elements to be popped.
+  * \return The number of elements actually popped, which is zero if the
+  *   queue is empty.
+  */
+size_t thread_queue_mpmc_pop(
+  thread_queue_mpmc_t* queue,
+  void* elements,
+  size_t max_elements);
+
+/** \brief Push elements to a multi-producer multi-consumer queue,
+  *   waiting for space if the queue is full
+  * \param[in] queue The initialized queue to push the elements to.
+  * \param[in] elements An array holding the elements to be pushed.
+  * \param[in] num_elements The number of elements to be pushed.
+  * \param[in] timeout The timeout of the wait operation in [s]. A negative
+  *   timeout makes the operation wait forever.
+  * \return The number of elements pushed or, if the operation timed out
+  *   before any element could be pushed, the negative error code.
+  */
+ssize_t thread_queue_mpmc_push_wait(
+  thread_queue_mpmc_t* queue,
+  const void* elements,
+  size_t num_elements,
+  double timeout);
+
+/** \brief Pop elements from a multi-producer multi-consumer queue,
+  *   waiting for elements if the queue is empty
+  * \param[in] queue The initialized queue to pop the elements from.
+  * \param[out] elements An array of sufficient size to hold the popped
+  *   elements.
+  * \param[in] max_elements The maximum number of elements to be popped.
+  * \param[in] timeout The timeout of the wait operation in [s]. A negative
+  *   timeout makes the operation wait forever.
+  * \return The non-zero number of elements popped or the negative error
+  *   code.
+  */
+ssize_t thread_queue_mpmc_pop_wait(
+  thread_queue_mpmc_t* queue,
+  void* elements,
+  size_t max_elements,
+  double timeout);
+
+#endif
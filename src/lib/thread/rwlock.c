@@ -0,0 +1,71 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "rwlock.h"
+
+const char* thread_rwlock_errors[] = {
+  "Success",
+  "Failed to acquire reader-writer lock",
+};
+
+void thread_rwlock_init(thread_rwlock_t* rwlock, int prefer_writers) {
+  pthread_rwlockattr_t attr;
+
+  pthread_rwlockattr_init(&attr);
+#ifdef PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+  if (prefer_writers)
+    pthread_rwlockattr_setkind_np(&attr,
+      PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+  pthread_rwlock_init(&rwlock->handle, &attr);
+  pthread_rwlockattr_destroy(&attr);
+}
+
+void thread_rwlock_destroy(thread_rwlock_t* rwlock) {
+  pthread_rwlock_destroy(&rwlock->handle);
+}
+
+void thread_rwlock_read_lock(thread_rwlock_t* rwlock) {
+  pthread_rwlock_rdlock(&rwlock->handle);
+}
+
+void thread_rwlock_write_lock(thread_rwlock_t* rwlock) {
+  pthread_rwlock_wrlock(&rwlock->handle);
+}
+
+void thread_rwlock_unlock(thread_rwlock_t* rwlock) {
+  pthread_rwlock_unlock(&rwlock->handle);
+}
+
+int thread_rwlock_try_read_lock(thread_rwlock_t* rwlock) {
+  if (!pthread_rwlock_tryrdlock(&rwlock->handle))
+    return THREAD_RWLOCK_ERROR_NONE;
+  else
+    return THREAD_RWLOCK_ERROR_LOCK;
+}
+
+int thread_rwlock_try_write_lock(thread_rwlock_t* rwlock) {
+  if (!pthread_rwlock_trywrlock(&rwlock->handle))
+    return THREAD_RWLOCK_ERROR_NONE;
+  else
+    return THREAD_RWLOCK_ERROR_LOCK;
+}
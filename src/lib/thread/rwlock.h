@@ -0,0 +1,111 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef THREAD_RWLOCK_H
+#define THREAD_RWLOCK_H
+
+/** \file thread/rwlock.h
+  * \ingroup thread
+  * \brief Thread reader-writer lock implementation
+  * \author Ralf Kaestner
+  * 
+  * Reader-writer locks allow any number of threads to concurrently read
+  * shared data, whereas a thread modifying the data gains exclusive
+  * access. They are preferable over mutexes for data which is read
+  * frequently but rarely modified.
+  */
+
+#include <pthread.h>
+
+/** \name Error Codes
+  * \brief Predefined reader-writer lock error codes
+  */
+//@{
+#define THREAD_RWLOCK_ERROR_NONE       0
+//!< Success
+#define THREAD_RWLOCK_ERROR_LOCK       1
+//!< Failed to acquire reader-writer lock
+//@}
+
+/** \brief Predefined reader-writer lock error descriptions
+  */
+extern const char* thread_rwlock_errors[];
+
+/** \brief Structure defining the thread reader-writer lock
+  */
+typedef struct thread_rwlock_t {
+  pthread_rwlock_t handle;      //!< The reader-writer lock handle.
+} thread_rwlock_t;
+
+/** \brief Initialize a thread reader-writer lock
+  * \param[in] rwlock The thread reader-writer lock to be initialized.
+  * \param[in] prefer_writers If non-zero, pending writers will block
+  *   new readers such that writers cannot starve, otherwise readers
+  *   are preferred.
+  */
+void thread_rwlock_init(
+  thread_rwlock_t* rwlock,
+  int prefer_writers);
+
+/** \brief Destroy a thread reader-writer lock
+  * \param[in] rwlock The initialized thread reader-writer lock to be
+  *   destroyed.
+  */
+void thread_rwlock_destroy(
+  thread_rwlock_t* rwlock);
+
+/** \brief Lock a thread reader-writer lock for reading
+  * \param[in] rwlock The initialized thread reader-writer lock to be
+  *   locked.
+  */
+void thread_rwlock_read_lock(
+  thread_rwlock_t* rwlock);
+
+/** \brief Lock a thread reader-writer lock for writing
+  * \param[in] rwlock The initialized thread reader-writer lock to be
+  *   locked.
+  */
+void thread_rwlock_write_lock(
+  thread_rwlock_t* rwlock);
+
+/** \brief Unlock a thread reader-writer lock
+  * \param[in] rwlock The initialized thread reader-writer lock to be
+  *   unlocked.
+  */
+void thread_rwlock_unlock(
+  thread_rwlock_t* rwlock);
+
+/** \brief Try to lock a thread reader-writer lock for reading
+  * \param[in] rwlock The initialized thread reader-writer lock to be
+  *   locked.
+  * \return The resulting error code.
+  */
+int thread_rwlock_try_read_lock(
+  thread_rwlock_t* rwlock);
+
+/** \brief Try to lock a thread reader-writer lock for writing
+  * \param[in] rwlock The initialized thread reader-writer lock to be
+  *   locked.
+  * \return The resulting error code.
+  */
+int thread_rwlock_try_write_lock(
+  thread_rwlock_t* rwlock);
+
+#endif
@@ -0,0 +1,79 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <string.h>
+
+#include "seqlock.h"
+
+void thread_seqlock_init(thread_seqlock_t* seqlock) {
+  atomic_init(&seqlock->seq, 0);
+  thread_spinlock_init(&seqlock->writer);
+}
+
+void thread_seqlock_write_lock(thread_seqlock_t* seqlock) {
+  thread_spinlock_lock(&seqlock->writer);
+
+  atomic_store_explicit(&seqlock->seq, atomic_load_explicit(&seqlock->seq,
+    memory_order_relaxed)+1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+void thread_seqlock_write_unlock(thread_seqlock_t* seqlock) {
+  atomic_store_explicit(&seqlock->seq, atomic_load_explicit(&seqlock->seq,
+    memory_order_relaxed)+1, memory_order_release);
+
+  thread_spinlock_unlock(&seqlock->writer);
+}
+
+unsigned int thread_seqlock_read_begin(const thread_seqlock_t* seqlock) {
+  unsigned int seq, num_spins = 0;
+
+  while ((seq = atomic_load_explicit((atomic_uint*)&seqlock->seq,
+      memory_order_acquire)) & 1)
+    thread_spinlock_pause(&num_spins);
+
+  return seq;
+}
+
+int thread_seqlock_read_retry(const thread_seqlock_t* seqlock, unsigned int
+    seq) {
+  atomic_thread_fence(memory_order_acquire);
+
+  return atomic_load_explicit((atomic_uint*)&seqlock->seq,
+    memory_order_relaxed) != seq;
+}
+
+void thread_seqlock_read(const thread_seqlock_t* seqlock, void* data, const
+    void* source, size_t size) {
+  unsigned int seq;
+
+  do {
+    seq = thread_seqlock_read_begin(seqlock);
+    memcpy(data, source, size);
+  }
+  while (thread_seqlock_read_retry(seqlock, seq));
+}
+
+void thread_seqlock_write(thread_seqlock_t* seqlock, void* destination,
+    const void* data, size_t size) {
+  thread_seqlock_write_lock(seqlock);
+  memcpy(destination, data, size);
+  thread_seqlock_write_unlock(seqlock);
+}
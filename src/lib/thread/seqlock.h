@@ -0,0 +1,113 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef THREAD_SEQLOCK_H
+#define THREAD_SEQLOCK_H
+
+/** \file thread/seqlock.h
+  * \ingroup thread
+  * \brief Thread sequence lock implementation
+  * \author Ralf Kaestner
+  * 
+  * Sequence locks protect small data structures which are read far more
+  * frequently than they are written, e.g., the latest sensor reading.
+  * Readers never block writers nor modify shared memory; instead, they
+  * retry reading if the sequence number reveals a concurrent write.
+  * Writers are serialized by a spinlock and should therefore keep
+  * their critical sections short.
+  * 
+  * The protected data must not contain pointers which readers follow,
+  * since a reader may observe inconsistent data before retrying.
+  */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "thread/spinlock.h"
+
+/** \brief Structure defining the thread sequence lock
+  */
+typedef struct thread_seqlock_t {
+  atomic_uint seq;              //!< The sequence number, odd while writing.
+  thread_spinlock_t writer;     //!< The spinlock serializing writers.
+} thread_seqlock_t;
+
+/** \brief Initialize a sequence lock
+  * \param[in] seqlock The sequence lock to be initialized.
+  */
+void thread_seqlock_init(
+  thread_seqlock_t* seqlock);
+
+/** \brief Lock a sequence lock for writing
+  * \param[in] seqlock The initialized sequence lock to be locked.
+  */
+void thread_seqlock_write_lock(
+  thread_seqlock_t* seqlock);
+
+/** \brief Unlock a sequence lock locked for writing
+  * \param[in] seqlock The initialized sequence lock to be unlocked.
+  */
+void thread_seqlock_write_unlock(
+  thread_seqlock_t* seqlock);
+
+/** \brief Begin reading data protected by a sequence lock
+  * \param[in] seqlock The initialized sequence lock protecting the data.
+  * \return The sequence number to be passed on to
+  *   thread_seqlock_read_retry() after reading.
+  */
+unsigned int thread_seqlock_read_begin(
+  const thread_seqlock_t* seqlock);
+
+/** \brief Test whether reading data protected by a sequence lock must be
+  *   retried
+  * \param[in] seqlock The initialized sequence lock protecting the data.
+  * \param[in] seq The sequence number returned by
+  *   thread_seqlock_read_begin().
+  * \return 1 if the data has been modified while reading, 0 otherwise.
+  */
+int thread_seqlock_read_retry(
+  const thread_seqlock_t* seqlock,
+  unsigned int seq);
+
+/** \brief Read a consistent copy of data protected by a sequence lock
+  * \param[in] seqlock The initialized sequence lock protecting the data.
+  * \param[out] data The memory to copy the protected data to.
+  * \param[in] source The protected data to be copied.
+  * \param[in] size The size of the protected data in bytes.
+  */
+void thread_seqlock_read(
+  const thread_seqlock_t* seqlock,
+  void* data,
+  const void* source,
+  size_t size);
+
+/** \brief Write data protected by a sequence lock
+  * \param[in] seqlock The initialized sequence lock protecting the data.
+  * \param[out] destination The protected data to be written.
+  * \param[in] data The data to be copied to the protected memory.
+  * \param[in] size The size of the protected data in bytes.
+  */
+void thread_seqlock_write(
+  thread_seqlock_t* seqlock,
+  void* destination,
+  const void* data,
+  size_t size);
+
+#endif
@@ -0,0 +1,99 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <sched.h>
+
+#include "spinlock.h"
+
+const char* thread_spinlock_errors[] = {
+  "Success",
+  "Failed to acquire spinlock",
+};
+
+void thread_spinlock_init(thread_spinlock_t* spinlock) {
+  atomic_init(&spinlock->locked, 0);
+}
+
+void thread_spinlock_lock(thread_spinlock_t* spinlock) {
+  unsigned int num_spins = 0;
+
+  while (atomic_exchange_explicit(&spinlock->locked, 1,
+      memory_order_acquire)) {
+    while (atomic_load_explicit(&spinlock->locked, memory_order_relaxed))
+      thread_spinlock_pause(&num_spins);
+  }
+}
+
+void thread_spinlock_unlock(thread_spinlock_t* spinlock) {
+  atomic_store_explicit(&spinlock->locked, 0, memory_order_release);
+}
+
+int thread_spinlock_try_lock(thread_spinlock_t* spinlock) {
+  if (!atomic_load_explicit(&spinlock->locked, memory_order_relaxed) &&
+      !atomic_exchange_explicit(&spinlock->locked, 1, memory_order_acquire))
+    return THREAD_SPINLOCK_ERROR_NONE;
+  else
+    return THREAD_SPINLOCK_ERROR_LOCK;
+}
+
+void thread_ticket_lock_init(thread_ticket_lock_t* lock) {
+  atomic_init(&lock->next, 0);
+  atomic_init(&lock->owner, 0);
+}
+
+void thread_ticket_lock_lock(thread_ticket_lock_t* lock) {
+  unsigned int ticket = atomic_fetch_add_explicit(&lock->next, 1,
+    memory_order_relaxed);
+  unsigned int num_spins = 0;
+
+  while (atomic_load_explicit(&lock->owner, memory_order_acquire) != ticket)
+    thread_spinlock_pause(&num_spins);
+}
+
+void thread_ticket_lock_unlock(thread_ticket_lock_t* lock) {
+  atomic_store_explicit(&lock->owner, atomic_load_explicit(&lock->owner,
+    memory_order_relaxed)+1, memory_order_release);
+}
+
+int thread_ticket_lock_try_lock(thread_ticket_lock_t* lock) {
+  unsigned int ticket = atomic_load_explicit(&lock->owner,
+    memory_order_relaxed);
+  unsigned int next = ticket;
+
+  if (atomic_compare_exchange_strong_explicit(&lock->next, &next, ticket+1,
+      memory_order_acquire, memory_order_relaxed))
+    return THREAD_SPINLOCK_ERROR_NONE;
+  else
+    return THREAD_SPINLOCK_ERROR_LOCK;
+}
+
+void thread_spinlock_pause(unsigned int* num_spins) {
+  if (++(*num_spins) < THREAD_SPINLOCK_SPIN_COUNT) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+  }
+  else {
+    *num_spins = 0;
+    sched_yield();
+  }
+}
@@ -0,0 +1,128 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef THREAD_SPINLOCK_H
+#define THREAD_SPINLOCK_H
+
+/** \file thread/spinlock.h
+  * \ingroup thread
+  * \brief Thread spinlock implementation
+  * \author Ralf Kaestner
+  * 
+  * Spinlocks busy-wait instead of blocking the calling thread and are
+  * therefore only suitable for very short critical sections. The
+  * test-and-test-and-set spinlock waits on a shared read of the lock word
+  * and is cheapest if contention is rare. The ticket spinlock grants the
+  * lock in the order of arrival and is thus fair under contention. Both
+  * spinlocks yield the processor if the lock is not acquired within a
+  * bounded number of attempts.
+  */
+
+#include <stdatomic.h>
+
+/** \name Error Codes
+  * \brief Predefined spinlock error codes
+  */
+//@{
+#define THREAD_SPINLOCK_ERROR_NONE     0
+//!< Success
+#define THREAD_SPINLOCK_ERROR_LOCK     1
+//!< Failed to acquire spinlock
+//@}
+
+/** \brief Predefined spinlock error descriptions
+  */
+extern const char* thread_spinlock_errors[];
+
+/** \brief Number of attempts before a waiting thread yields the processor
+  */
+#define THREAD_SPINLOCK_SPIN_COUNT     1024
+
+/** \brief Structure defining the test-and-test-and-set spinlock
+  */
+typedef struct thread_spinlock_t {
+  atomic_int locked;            //!< Flag signaling a locked spinlock.
+} thread_spinlock_t;
+
+/** \brief Structure defining the ticket spinlock
+  */
+typedef struct thread_ticket_lock_t {
+  atomic_uint next;             //!< The next ticket to be drawn.
+  atomic_uint owner;            //!< The ticket currently owning the lock.
+} thread_ticket_lock_t;
+
+/** \brief Initialize a spinlock
+  * \param[in] spinlock The spinlock to be initialized.
+  */
+void thread_spinlock_init(
+  thread_spinlock_t* spinlock);
+
+/** \brief Lock a spinlock
+  * \param[in] spinlock The initialized spinlock to be locked.
+  */
+void thread_spinlock_lock(
+  thread_spinlock_t* spinlock);
+
+/** \brief Unlock a spinlock
+  * \param[in] spinlock The initialized spinlock to be unlocked.
+  */
+void thread_spinlock_unlock(
+  thread_spinlock_t* spinlock);
+
+/** \brief Try to lock a spinlock
+  * \param[in] spinlock The initialized spinlock to be locked.
+  * \return The resulting error code.
+  */
+int thread_spinlock_try_lock(
+  thread_spinlock_t* spinlock);
+
+/** \brief Initialize a ticket spinlock
+  * \param[in] lock The ticket spinlock to be initialized.
+  */
+void thread_ticket_lock_init(
+  thread_ticket_lock_t* lock);
+
+/** \brief Lock a ticket spinlock
+  * \param[in] lock The initialized ticket spinlock to be locked.
+  */
+void thread_ticket_lock_lock(
+  thread_ticket_lock_t* lock);
+
+/** \brief Unlock a ticket spinlock
+  * \param[in] lock The initialized ticket spinlock to be unlocked.
+  */
+void thread_ticket_lock_unlock(
+  thread_ticket_lock_t* lock);
+
+/** \brief Try to lock a ticket spinlock
+  * \param[in] lock The initialized ticket spinlock to be locked.
+  * \return The resulting error code.
+  */
+int thread_ticket_lock_try_lock(
+  thread_ticket_lock_t* lock);
+
+/** \brief Pause a spinning thread
+  * \param[in,out] num_spins The number of attempts made so far, which
+  *   will be incremented and reset once the processor has been yielded.
+  */
+void thread_spinlock_pause(
+  unsigned int* num_spins);
+
+#endif
@@ -18,12 +18,31 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#define _GNU_SOURCE
+
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
 
 #include "thread.h"
 
 #include "timer/timer.h"
 
+#ifdef THREAD_INSTRUMENT
+#include "instrument.h"
+#endif
+
 const char* thread_errors[] = {
   "Success",
   "Error creating thread",
@@ -31,10 +50,69 @@ const char* thread_errors[] = {
   "State error",
 };
 
+#define THREAD_ATTR_CPU_BITS            (8*sizeof(unsigned long))
+
+static pthread_mutex_t thread_isolation_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t thread_num_isolated = 0;
+static size_t thread_isolated[THREAD_ATTR_MAX_CPUS];
+
+int thread_lock_memory(void);
+void thread_apply_attr(thread_t* thread);
+void thread_apply_affinity(thread_t* thread);
+void thread_apply_sched(thread_t* thread);
+void thread_release_attr(thread_t* thread);
+void thread_close_wakeup(thread_t* thread);
+int thread_test_started(void* arg);
+int thread_test_stopped(void* arg);
+int64_t thread_get_time(void);
+void thread_sleep_until(thread_t* thread, int64_t deadline);
+void thread_record_cycle(thread_t* thread, int64_t period, int64_t latency);
+void thread_publish_stats(thread_t* thread);
+
+void thread_attr_init(thread_attr_t* attr) {
+  memset(attr, 0, sizeof(thread_attr_t));
+  attr->policy = thread_sched_other;
+}
+
+void thread_attr_set_cpu(thread_attr_t* attr, int cpu) {
+  if ((cpu >= 0) && (cpu < THREAD_ATTR_MAX_CPUS))
+    attr->cpus[cpu/THREAD_ATTR_CPU_BITS] |= 1UL << (cpu%THREAD_ATTR_CPU_BITS);
+}
+
+int thread_attr_test_cpu(const thread_attr_t* attr, int cpu) {
+  if ((cpu >= 0) && (cpu < THREAD_ATTR_MAX_CPUS))
+    return (attr->cpus[cpu/THREAD_ATTR_CPU_BITS] >>
+      (cpu%THREAD_ATTR_CPU_BITS)) & 1;
+  else
+    return 0;
+}
+
 int thread_start(thread_t* thread, void* (*thread_routine)(void*),
-  void (*thread_cleanup)(void*), void* thread_arg, double frequency) {
+    void (*thread_cleanup)(void*), void* thread_arg, double frequency) {
+  return thread_start_attr(thread, thread_routine, thread_cleanup,
+    thread_arg, frequency, 0);
+}
+
+int thread_start_attr(thread_t* thread, void* (*thread_routine)(void*),
+    void (*thread_cleanup)(void*), void* thread_arg, double frequency,
+    const thread_attr_t* attr) {
   int result = THREAD_ERROR_NONE;
+  pthread_attr_t thread_attr;
   
+  if (attr)
+    thread->attr = *attr;
+  else
+    thread_attr_init(&thread->attr);
+
+  pthread_attr_init(&thread_attr);
+  if (thread->attr.stack_size && ((thread->attr.stack_size <
+      PTHREAD_STACK_MIN) || pthread_attr_setstacksize(&thread_attr,
+      thread->attr.stack_size)))
+    thread->attr.stack_size = 0;
+
+  if (thread->attr.lock_memory && thread_lock_memory())
+    thread->attr.lock_memory = 0;
+
   thread->routine = thread_routine;
   thread->cleanup = thread_cleanup;
   thread->arg = thread_arg;
@@ -43,14 +121,40 @@ int thread_start(thread_t* thread, void* (*thread_routine)(void*),
 
   thread->frequency = frequency;
   thread->start_time = 0.0;
-  thread->state = thread_state_stopped;
+  atomic_init(&thread->state, thread_state_stopped);
+  thread->started = 0;
+
+  atomic_init(&thread->overrun_policy, thread_overrun_realign);
+  memset(&thread->stats, 0, sizeof(thread_stats_t));
+  thread->period_m2 = 0.0;
+  memset(&thread->published_stats, 0, sizeof(thread_stats_t));
+  thread_seqlock_init(&thread->stats_seqlock);
 
-  thread->exit_request = 0;
+  atomic_init(&thread->exit_request, 0);
+
+  if (frequency > 0.0) {
+    thread->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    thread->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK |
+      TFD_CLOEXEC);
+  }
+  else {
+    thread->wakeup_fd = -1;
+    thread->timer_fd = -1;
+  }
 
   thread_condition_lock(&thread->condition);
-  if (thread->state == thread_state_stopped) {
-    if (!pthread_create(&thread->thread, NULL, thread_run, thread))
-      thread_condition_wait(&thread->condition, THREAD_CONDITION_WAIT_FOREVER);
+  if (atomic_load(&thread->state) == thread_state_stopped) {
+    int error = pthread_create(&thread->thread, &thread_attr, thread_run,
+      thread);
+
+    if (error && thread->attr.stack_size) {
+      thread->attr.stack_size = 0;
+      error = pthread_create(&thread->thread, NULL, thread_run, thread);
+    }
+
+    if (!error)
+      thread_condition_wait_until(&thread->condition, thread_test_started,
+        thread, THREAD_CONDITION_WAIT_FOREVER);
     else
       result = THREAD_ERROR_CREATE;
   }
@@ -58,18 +162,46 @@ int thread_start(thread_t* thread, void* (*thread_routine)(void*),
     result = THREAD_ERROR_STATE;
   thread_condition_unlock(&thread->condition);
   
+  pthread_attr_destroy(&thread_attr);
+  if (result) {
+    thread_condition_destroy(&thread->condition);
+    thread_close_wakeup(thread);
+  }
+
   return result;
 }
 
+void thread_get_attr(thread_t* thread, thread_attr_t* attr) {
+  thread_condition_lock(&thread->condition);
+  *attr = thread->attr;
+  thread_condition_unlock(&thread->condition);
+}
+
+void thread_set_overrun_policy(thread_t* thread, thread_overrun_policy_t
+    policy) {
+  atomic_store(&thread->overrun_policy, policy);
+}
+
+void thread_get_stats(thread_t* thread, thread_stats_t* stats) {
+  thread_seqlock_read(&thread->stats_seqlock, stats,
+    &thread->published_stats, sizeof(thread_stats_t));
+}
+
 int thread_exit(thread_t* thread, int wait) {
   int result = THREAD_ERROR_NONE;
   
-  thread_condition_lock(&thread->condition);
-  if (thread->state == thread_state_running)
-    thread->exit_request = 1;
+  if (atomic_load(&thread->state) == thread_state_running) {
+    atomic_store(&thread->exit_request, 1);
+
+    if (thread->wakeup_fd >= 0) {
+      uint64_t value = 1;
+      
+      while ((write(thread->wakeup_fd, &value, sizeof(value)) < 0) &&
+        (errno == EINTR));
+    }
+  }
   else
     result = THREAD_ERROR_STATE;
-  thread_condition_unlock(&thread->condition);
 
 #ifdef HAVE_LIBGCC_S
   pthread_cancel(thread->thread);
@@ -91,12 +223,12 @@ void thread_cleanup(void* arg) {
   if (thread->cleanup)
     thread->cleanup(thread->arg);
 
+  thread_release_attr(thread);
+
   thread_condition_lock(&thread->condition);
-  thread->state = thread_state_stopped;
-  thread_condition_signal(&thread->condition);
+  atomic_store(&thread->state, thread_state_stopped);
+  thread_condition_broadcast(&thread->condition);
   thread_condition_unlock(&thread->condition);
-
-  thread_condition_destroy(&thread->condition);
 }
 
 void* thread_run(void* arg) {
@@ -112,21 +244,52 @@ void* thread_run(void* arg) {
   pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
 #endif 
 
+  thread_apply_attr(thread);
+
   thread_condition_lock(&thread->condition);
-  thread->state = thread_state_running;
+  atomic_store(&thread->state, thread_state_running);
+  thread->started = 1;
   thread_condition_signal(&thread->condition);
   thread_condition_unlock(&thread->condition);
   
   timer_start(&thread->start_time);
 
   if (thread->frequency > 0.0) {
+    int64_t period = 1e9/thread->frequency;
+    int64_t deadline = thread_get_time(), wakeup = deadline, previous, now;
+    thread_overrun_policy_t policy;
+
     while (!thread_test_exit(thread)) {
-      double timestamp;
-      timer_start(&timestamp);
+      previous = wakeup;
+      wakeup = thread_get_time();
+      thread_record_cycle(thread, wakeup-previous, wakeup-deadline);
 
       result = thread->routine(thread->arg);
 
-      timer_wait(timestamp, thread->frequency);
+      deadline += period;
+      now = thread_get_time();
+#ifdef THREAD_INSTRUMENT
+      thread_instrument_cycle(thread, wakeup, now > deadline);
+#endif
+
+      if (now > deadline) {
+        policy = atomic_load_explicit(&thread->overrun_policy,
+          memory_order_relaxed);
+        ++thread->stats.num_overruns;
+
+        if (policy == thread_overrun_skip) {
+          int64_t num_skipped = (now-deadline)/period+1;
+          
+          thread->stats.num_skipped += num_skipped;
+          deadline += num_skipped*period;
+        }
+        else if (policy == thread_overrun_realign)
+          deadline = now;
+
+        thread_publish_stats(thread);
+      }
+
+      thread_sleep_until(thread, deadline);
     }
   }
   else
@@ -138,13 +301,7 @@ void* thread_run(void* arg) {
 }
 
 int thread_test_exit(thread_t* thread) {
-  int result;
-
-  thread_condition_lock(&thread->condition);
-  result = thread->exit_request;
-  thread_condition_unlock(&thread->condition);
-
-  return result;
+  return atomic_load_explicit(&thread->exit_request, memory_order_acquire);
 }
 
 void thread_self_test_exit() {
@@ -153,14 +310,21 @@ void thread_self_test_exit() {
 
 void thread_wait_exit(thread_t* thread) {
   pthread_join(thread->thread, NULL);
+
+  thread_condition_destroy(&thread->condition);
+  thread_close_wakeup(thread);
+#ifdef THREAD_INSTRUMENT
+  thread_instrument_retire(thread);
+#endif
 }
 
 int thread_wait(thread_t* thread, double timeout) {
   int result = THREAD_ERROR_NONE;
   
   thread_condition_lock(&thread->condition);
-  if (thread->state == thread_state_running) {
-    if (thread_condition_wait(&thread->condition, timeout))
+  if (atomic_load(&thread->state) == thread_state_running) {
+    if (thread_condition_wait_until(&thread->condition, thread_test_stopped,
+        thread, timeout))
       result = THREAD_ERROR_WAIT_TIMEOUT;
   }
   else
@@ -169,3 +333,208 @@ int thread_wait(thread_t* thread, double timeout) {
 
   return result;
 }
+
+int thread_lock_memory(void) {
+  struct rlimit limit;
+
+  /* Locking future mappings under a finite limit would let subsequent
+     allocations, including thread stacks, fail */
+  if (geteuid() && (getrlimit(RLIMIT_MEMLOCK, &limit) ||
+      (limit.rlim_cur != RLIM_INFINITY)))
+    return -1;
+
+  return mlockall(MCL_CURRENT | MCL_FUTURE);
+}
+
+void thread_apply_attr(thread_t* thread) {
+  thread_apply_affinity(thread);
+  thread_apply_sched(thread);
+}
+
+void thread_apply_affinity(thread_t* thread) {
+  cpu_set_t set;
+  int i, pinned = 0, excluded = 0;
+
+  CPU_ZERO(&set);
+  for (i = 0; (i < THREAD_ATTR_MAX_CPUS) && (i < CPU_SETSIZE); ++i)
+    if (thread_attr_test_cpu(&thread->attr, i)) {
+      CPU_SET(i, &set);
+      pinned = 1;
+    }
+
+  pthread_mutex_lock(&thread_isolation_mutex);
+
+  if (pinned) {
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set)) {
+      memset(thread->attr.cpus, 0, sizeof(thread->attr.cpus));
+      thread->attr.isolate = 0;
+    }
+    else if (thread->attr.isolate) {
+      for (i = 0; i < THREAD_ATTR_MAX_CPUS; ++i)
+        if (thread_attr_test_cpu(&thread->attr, i) && !thread_isolated[i]++)
+          ++thread_num_isolated;
+    }
+  }
+  else {
+    thread->attr.isolate = 0;
+
+    if (thread_num_isolated &&
+        !pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &set)) {
+      for (i = 0; (i < THREAD_ATTR_MAX_CPUS) && (i < CPU_SETSIZE); ++i)
+        if (thread_isolated[i] && CPU_ISSET(i, &set)) {
+          CPU_CLR(i, &set);
+          excluded = 1;
+        }
+
+      if (excluded && !CPU_COUNT(&set)) {
+        long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+
+        for (i = 0; (i < num_cpus) && (i < THREAD_ATTR_MAX_CPUS) &&
+            (i < CPU_SETSIZE); ++i)
+          if (!thread_isolated[i])
+            CPU_SET(i, &set);
+      }
+
+      if (excluded && CPU_COUNT(&set))
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+    }
+  }
+
+  pthread_mutex_unlock(&thread_isolation_mutex);
+}
+
+void thread_apply_sched(thread_t* thread) {
+  struct sched_param param;
+  int policy, min_priority, max_priority;
+
+  if (thread->attr.policy == thread_sched_fifo)
+    policy = SCHED_FIFO;
+  else if (thread->attr.policy == thread_sched_rr)
+    policy = SCHED_RR;
+  else {
+    thread->attr.priority = 0;
+    return;
+  }
+
+  min_priority = sched_get_priority_min(policy);
+  max_priority = sched_get_priority_max(policy);
+  if (thread->attr.priority < min_priority)
+    thread->attr.priority = min_priority;
+  else if (thread->attr.priority > max_priority)
+    thread->attr.priority = max_priority;
+
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = thread->attr.priority;
+
+  if (pthread_setschedparam(pthread_self(), policy, &param)) {
+    thread->attr.policy = thread_sched_other;
+    thread->attr.priority = 0;
+  }
+}
+
+void thread_release_attr(thread_t* thread) {
+  int i;
+
+  if (thread->attr.isolate) {
+    pthread_mutex_lock(&thread_isolation_mutex);
+    for (i = 0; i < THREAD_ATTR_MAX_CPUS; ++i)
+      if (thread_attr_test_cpu(&thread->attr, i) && !--thread_isolated[i])
+        --thread_num_isolated;
+    pthread_mutex_unlock(&thread_isolation_mutex);
+  }
+}
+
+int64_t thread_get_time(void) {
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+
+  return (int64_t)time.tv_sec*1000000000+time.tv_nsec;
+}
+
+int thread_test_started(void* arg) {
+  thread_t* thread = arg;
+
+  return thread->started;
+}
+
+int thread_test_stopped(void* arg) {
+  thread_t* thread = arg;
+
+  return atomic_load(&thread->state) == thread_state_stopped;
+}
+
+void thread_close_wakeup(thread_t* thread) {
+  if (thread->wakeup_fd >= 0) {
+    close(thread->wakeup_fd);
+    thread->wakeup_fd = -1;
+  }
+  if (thread->timer_fd >= 0) {
+    close(thread->timer_fd);
+    thread->timer_fd = -1;
+  }
+}
+
+void thread_sleep_until(thread_t* thread, int64_t deadline) {
+  struct itimerspec timer;
+  struct pollfd fds[2];
+  uint64_t expirations;
+
+  memset(&timer, 0, sizeof(timer));
+  timer.it_value.tv_sec = deadline/1000000000;
+  timer.it_value.tv_nsec = deadline%1000000000;
+
+  if ((thread->wakeup_fd < 0) || (thread->timer_fd < 0) ||
+      timerfd_settime(thread->timer_fd, TFD_TIMER_ABSTIME, &timer, 0)) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &timer.it_value,
+      0) == EINTR);
+    return;
+  }
+
+  fds[0].fd = thread->timer_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = thread->wakeup_fd;
+  fds[1].events = POLLIN;
+
+  while (!atomic_load_explicit(&thread->exit_request, memory_order_acquire) &&
+    (poll(fds, 2, -1) < 0) && (errno == EINTR));
+
+  while ((read(thread->timer_fd, &expirations, sizeof(expirations)) < 0) &&
+    (errno == EINTR));
+}
+
+void thread_record_cycle(thread_t* thread, int64_t period, int64_t latency) {
+  thread_stats_t* stats = &thread->stats;
+  double seconds = period*1e-9, delta;
+
+  if (stats->num_cycles) {
+    if (stats->num_cycles == 1) {
+      stats->period_min = seconds;
+      stats->period_max = seconds;
+    }
+    else if (seconds < stats->period_min)
+      stats->period_min = seconds;
+    else if (seconds > stats->period_max)
+      stats->period_max = seconds;
+
+    delta = seconds-stats->period_mean;
+    stats->period_mean += delta/stats->num_cycles;
+    thread->period_m2 += delta*(seconds-stats->period_mean);
+  }
+
+  if (latency*1e-9 > stats->jitter_max)
+    stats->jitter_max = latency*1e-9;
+  stats->jitter_mean += (latency*1e-9-stats->jitter_mean)/
+    (stats->num_cycles+1);
+
+  ++stats->num_cycles;
+  if (stats->num_cycles > 2)
+    stats->period_stddev = sqrt(thread->period_m2/(stats->num_cycles-2));
+
+  thread_publish_stats(thread);
+}
+
+void thread_publish_stats(thread_t* thread) {
+  thread_seqlock_write(&thread->stats_seqlock, &thread->published_stats,
+    &thread->stats, sizeof(thread_stats_t));
+}
@@ -22,9 +22,11 @@
 #define THREAD_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include "thread/mutex.h"
 #include "thread/condition.h"
+#include "thread/seqlock.h"
 
 /** \defgroup thread Threading Module
   * \brief Library functions for managing threads, mutexes, and conditions
@@ -42,7 +44,22 @@
   * 
   * This simple thread interface mainly aims to support the implementation
   * of periodic worker tasks, e.g., in sensor acquisition or control
-  * applications.
+  * applications. Periodic threads are scheduled against absolute
+  * deadlines on the monotonic system clock, such that the period does
+  * not drift. Deadlines missed by the thread routine are handled according
+  * to a configurable overrun policy, and the timing of each thread is
+  * recorded in its statistics.
+  *
+  * The exit request and state of a thread are accessed atomically, such
+  * that testing for a pending exit request never contends with waiting
+  * threads. A periodic thread sleeping until its next deadline is woken
+  * immediately by an exit request.
+  *
+  * Threads may further be started with real-time attributes, i.e., a
+  * scheduling policy and priority, CPU affinity, stack size, and memory
+  * locking. Attributes which cannot be applied due to missing privileges
+  * fall back to their defaults, and the attributes effectively in place
+  * may be queried once the thread is running.
   */
 
 /** \name Error Codes
@@ -70,6 +87,56 @@ typedef enum {
   thread_state_running,          //!< Thread is running.
 } thread_state_t;
 
+/** \brief Thread overrun policy enumerable type
+  */
+typedef enum {
+  thread_overrun_realign,        //!< Next period starts after the overrun.
+  thread_overrun_skip,           //!< Missed periods are skipped.
+  thread_overrun_catch_up        //!< Missed periods are executed at once.
+} thread_overrun_policy_t;
+
+/** \brief Thread scheduling policy enumerable type
+  */
+typedef enum {
+  thread_sched_other,            //!< Default time-sharing scheduling.
+  thread_sched_fifo,             //!< Real-time first-in first-out scheduling.
+  thread_sched_rr                //!< Real-time round-robin scheduling.
+} thread_sched_policy_t;
+
+/** \brief Maximum number of CPUs addressable by thread attributes
+  */
+#define THREAD_ATTR_MAX_CPUS           1024
+
+/** \brief Structure defining the attributes of a thread
+  */
+typedef struct thread_attr_t {
+  thread_sched_policy_t policy;  //!< The scheduling policy.
+  int priority;                  //!< The real-time scheduling priority.
+
+  unsigned long cpus[THREAD_ATTR_MAX_CPUS/(8*sizeof(unsigned long))];
+  //!< The CPU affinity mask, where an empty mask leaves the thread unpinned.
+
+  size_t stack_size;             //!< The stack size in [B], 0 for default.
+  int lock_memory;               //!< Lock the process memory into RAM.
+  int isolate;                   //!< Keep unpinned threads off the CPUs.
+} thread_attr_t;
+
+/** \brief Structure defining the timing statistics of a periodic thread
+  */
+typedef struct thread_stats_t {
+  size_t num_cycles;             //!< The number of executed cycles.
+  size_t num_overruns;           //!< The number of missed deadlines.
+  size_t num_skipped;            //!< The number of skipped periods.
+
+  double period_min;             //!< The minimum cycle period in [s].
+  double period_max;             //!< The maximum cycle period in [s].
+  double period_mean;            //!< The mean cycle period in [s].
+  double period_stddev;          //!< The standard deviation of the period.
+
+  double jitter_max;             //!< The maximum wake-up latency in [s].
+  double jitter_mean;            //!< The mean wake-up latency in [s].
+} thread_stats_t;
+
 /** \brief Structure defining the thread context
   */
 typedef struct thread_t {
@@ -82,9 +149,20 @@ typedef struct thread_t {
 
   double frequency;               //!< The thread cycle frequency in [Hz].
   double start_time;              //!< The thread start timestamp.
-  thread_state_t state;           //!< The state of the thread.
+  _Atomic(thread_state_t) state;  //!< The state of the thread.
+  int started;                    //!< Flag signaling the thread has started.
+  thread_attr_t attr;             //!< The effective thread attributes.
 
-  int exit_request;               //!< Flag signaling a pending exit request.
+  _Atomic(thread_overrun_policy_t) overrun_policy;
+  //!< The thread overrun policy.
+  thread_stats_t stats;           //!< The statistics owned by the thread.
+  double period_m2;               //!< The sum of squared period deviations.
+  thread_stats_t published_stats; //!< The statistics published by the thread.
+  thread_seqlock_t stats_seqlock; //!< The sequence lock of published stats.
+
+  atomic_int exit_request;        //!< Flag signaling a pending exit request.
+  int wakeup_fd;                  //!< The event waking a sleeping thread.
+  int timer_fd;                   //!< The timer of a periodic thread.
 } thread_t;
 
 /** \brief Start a thread
@@ -99,6 +177,11 @@ typedef struct thread_t {
   * \param[in] frequency The thread cycle frequency in [Hz]. If the frequency 
   *   is 0, the thread routine will be executed once.
   * \return The resulting error code.
+  * 
+  * A periodic thread starts with the overrun policy thread_overrun_realign
+  * and cleared statistics. Every started thread must eventually be joined
+  * by thread_wait_exit() or thread_exit() with wait set, since its
+  * condition and wake-up descriptors are only released after the join.
   */
 int thread_start(
   thread_t* thread,
@@ -107,11 +190,104 @@ int thread_start(
   void* thread_arg,
   double frequency);
 
+/** \brief Initialize thread attributes
+  * \param[in] attr The thread attributes to be initialized with the
+  *   default time-sharing policy, no CPU affinity, the default stack
+  *   size, and without memory locking or isolation.
+  */
+void thread_attr_init(
+  thread_attr_t* attr);
+
+/** \brief Add a CPU to the affinity mask of thread attributes
+  * \param[in] attr The initialized thread attributes to add the CPU to.
+  * \param[in] cpu The zero-based index of the CPU to be added.
+  */
+void thread_attr_set_cpu(
+  thread_attr_t* attr,
+  int cpu);
+
+/** \brief Test a CPU for being in the affinity mask of thread attributes
+  * \param[in] attr The initialized thread attributes to be tested.
+  * \param[in] cpu The zero-based index of the CPU to be tested.
+  * \return 1 if the CPU is in the affinity mask, 0 otherwise.
+  */
+int thread_attr_test_cpu(
+  const thread_attr_t* attr,
+  int cpu);
+
+/** \brief Start a thread with attributes
+  * \param[in] thread The thread to be started.
+  * \param[in] thread_routine The thread routine that will be executed
+  *   within the thread.
+  * \param[in] thread_cleanup The optional thread cleanup handler that will 
+  *   be executed upon thread termination.
+  * \param[in] thread_arg The argument to be passed on to the thread
+  *   routine.
+  * \param[in] frequency The thread cycle frequency in [Hz]. If the frequency 
+  *   is 0, the thread routine will be executed once.
+  * \param[in] attr The requested thread attributes. If null, the thread
+  *   is started with default attributes.
+  * \return The resulting error code.
+  * 
+  * The attributes are applied by the thread itself before its routine is
+  * executed. If the process lacks the privileges for real-time scheduling
+  * or memory locking, or if the requested CPUs or stack size are invalid,
+  * the respective attributes fall back to their defaults without failing
+  * the thread start. Use thread_get_attr() to query the attributes in
+  * effect. An isolating thread excludes its CPUs from the affinity of
+  * unpinned threads started while it is running.
+  */
+int thread_start_attr(
+  thread_t* thread,
+  void* (*thread_routine)(void*),
+  void (*thread_cleanup)(void*),
+  void* thread_arg,
+  double frequency,
+  const thread_attr_t* attr);
+
+/** \brief Retrieve the effective attributes of a thread
+  * \param[in] thread The started thread to retrieve the attributes for.
+  * \param[out] attr The attributes in effect for the thread.
+  */
+void thread_get_attr(
+  thread_t* thread,
+  thread_attr_t* attr);
+
+/** \brief Set the overrun policy of a periodic thread
+  * \param[in] thread The started thread to set the overrun policy for.
+  * \param[in] policy The policy applied if the thread routine does not
+  *   return before the deadline of the next cycle.
+  */
+void thread_set_overrun_policy(
+  thread_t* thread,
+  thread_overrun_policy_t policy);
+
+/** \brief Retrieve the timing statistics of a periodic thread
+  * \param[in] thread The started thread to retrieve the statistics for.
+  * \param[out] stats The statistics of the thread.
+  * 
+  * The period of a cycle is measured between consecutive wake-ups of the
+  * thread, and the wake-up latency is the delay of the wake-up with
+  * respect to the cycle's deadline.
+  * 
+  * The statistics are updated by the thread alone and published through
+  * a sequence lock once per cycle. Retrieving them returns a consistent
+  * snapshot without ever blocking the thread.
+  */
+void thread_get_stats(
+  thread_t* thread,
+  thread_stats_t* stats);
+
 /** \brief Exit a thread
   * \param[in] thread The thread to be cancelled.
   * \param[in] wait If 0, return instantly, wait for thread termination
   *   otherwise.
   * \return The resulting error code.
+  * 
+  * A periodic thread sleeping until its next deadline will be woken
+  * and terminate without completing the period. If the function returns
+  * instantly, the caller remains responsible for joining the thread by
+  * thread_wait_exit().
   */
 int thread_exit(
   thread_t* thread,
@@ -142,6 +318,12 @@ void thread_self_test_exit();
 
 /** \brief Exit the thread and wait for its termination
   * \param[in] thread The running thread to exit and wait for.
+  * 
+  * Waiting for termination releases the resources of the thread,
+  * including its condition and wake-up descriptors, and is therefore
+  * required for every started thread. The exiting thread itself does not
+  * release them, since thread_start() and thread_wait() may still be
+  * waiting on its condition.
   */
 void thread_wait_exit(
   thread_t* thread);
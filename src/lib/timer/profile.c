@@ -0,0 +1,363 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "profile.h"
+
+#include "timer.h"
+
+#define TIMER_HISTOGRAM_SUB_COUNT     (1 << (TIMER_HISTOGRAM_SUB_BITS-1))
+#define TIMER_HISTOGRAM_MAX_VALUE     \
+  ((1ULL << TIMER_HISTOGRAM_MAX_BITS)-1)
+
+/* Profiling record of a thread */
+typedef struct timer_profile_record_t {
+  _Atomic(timer_histogram_t*) histograms[TIMER_PROFILE_MAX_SPANS];
+  atomic_int active;
+  struct timer_profile_record_t* next;
+} timer_profile_record_t;
+
+static _Atomic(timer_profile_record_t*) timer_profile_records = 0;
+static __thread timer_profile_record_t* timer_profile_current = 0;
+
+static pthread_once_t timer_profile_once = PTHREAD_ONCE_INIT;
+static pthread_key_t timer_profile_key;
+
+static pthread_mutex_t timer_profile_names_mutex =
+  PTHREAD_MUTEX_INITIALIZER;
+static _Atomic(const char*) timer_profile_names[TIMER_PROFILE_MAX_SPANS];
+static atomic_int timer_profile_num_names = 0;
+
+size_t timer_histogram_get_bucket(unsigned long long value);
+unsigned long long timer_histogram_get_bound(size_t bucket);
+int timer_profile_register(timer_profile_span_t* span);
+void timer_profile_init_key(void);
+void timer_profile_release_record(void* record);
+timer_profile_record_t* timer_profile_get_record(void);
+timer_histogram_t* timer_profile_get_record_histogram(int id);
+void timer_profile_print_name(FILE* stream, const char* name,
+  timer_profile_format_t format);
+
+void timer_histogram_init(timer_histogram_t* histogram) {
+  size_t i;
+
+  atomic_init(&histogram->count, 0);
+  atomic_init(&histogram->sum, 0);
+  atomic_init(&histogram->max, 0);
+
+  for (i = 0; i < TIMER_HISTOGRAM_NUM_BUCKETS; ++i)
+    atomic_init(&histogram->buckets[i], 0);
+}
+
+void timer_histogram_add(timer_histogram_t* histogram, int64_t duration) {
+  unsigned long long value = (duration > 0) ? duration : 0;
+  size_t bucket;
+
+  if (value > TIMER_HISTOGRAM_MAX_VALUE)
+    value = TIMER_HISTOGRAM_MAX_VALUE;
+  bucket = timer_histogram_get_bucket(value);
+
+  atomic_store_explicit(&histogram->buckets[bucket], atomic_load_explicit(
+    &histogram->buckets[bucket], memory_order_relaxed)+1,
+    memory_order_relaxed);
+  atomic_store_explicit(&histogram->sum, atomic_load_explicit(
+    &histogram->sum, memory_order_relaxed)+value, memory_order_relaxed);
+  if (value > atomic_load_explicit(&histogram->max, memory_order_relaxed))
+    atomic_store_explicit(&histogram->max, value, memory_order_relaxed);
+  atomic_store_explicit(&histogram->count, atomic_load_explicit(
+    &histogram->count, memory_order_relaxed)+1, memory_order_release);
+}
+
+void timer_histogram_merge(timer_histogram_t* dst, const timer_histogram_t*
+    src) {
+  timer_histogram_t* source = (timer_histogram_t*)src;
+  unsigned long long max = atomic_load(&source->max);
+  size_t i;
+
+  atomic_store_explicit(&dst->count, atomic_load_explicit(&dst->count,
+    memory_order_relaxed)+atomic_load_explicit(&source->count,
+    memory_order_acquire), memory_order_relaxed);
+  atomic_store_explicit(&dst->sum, atomic_load_explicit(&dst->sum,
+    memory_order_relaxed)+atomic_load_explicit(&source->sum,
+    memory_order_relaxed), memory_order_relaxed);
+  if (max > atomic_load_explicit(&dst->max, memory_order_relaxed))
+    atomic_store_explicit(&dst->max, max, memory_order_relaxed);
+
+  for (i = 0; i < TIMER_HISTOGRAM_NUM_BUCKETS; ++i)
+    atomic_store_explicit(&dst->buckets[i], atomic_load_explicit(
+      &dst->buckets[i], memory_order_relaxed)+atomic_load_explicit(
+      &source->buckets[i], memory_order_relaxed), memory_order_relaxed);
+}
+
+size_t timer_histogram_get_count(const timer_histogram_t* histogram) {
+  return atomic_load(&((timer_histogram_t*)histogram)->count);
+}
+
+double timer_histogram_get_mean(const timer_histogram_t* histogram) {
+  timer_histogram_t* source = (timer_histogram_t*)histogram;
+  size_t count = atomic_load(&source->count);
+
+  return count ? (double)atomic_load(&source->sum)/count : 0.0;
+}
+
+int64_t timer_histogram_get_max(const timer_histogram_t* histogram) {
+  return atomic_load(&((timer_histogram_t*)histogram)->max);
+}
+
+int64_t timer_histogram_get_percentile(const timer_histogram_t* histogram,
+    double percentile) {
+  timer_histogram_t* source = (timer_histogram_t*)histogram;
+  unsigned long long count = atomic_load(&source->count);
+  unsigned long long max = atomic_load(&source->max);
+  unsigned long long cumulative = 0, bound;
+  size_t i;
+
+  if (!count)
+    return 0;
+
+  for (i = 0; i < TIMER_HISTOGRAM_NUM_BUCKETS; ++i) {
+    cumulative += atomic_load_explicit(&source->buckets[i],
+      memory_order_relaxed);
+
+    if (cumulative && (cumulative >= percentile*count)) {
+      bound = timer_histogram_get_bound(i);
+      return (bound < max) ? bound : max;
+    }
+  }
+
+  return max;
+}
+
+int64_t timer_profile_get_time(void) {
+  return timer_get_fast_ns();
+}
+
+void timer_profile_end(timer_profile_span_t* span, int64_t start) {
+  timer_profile_record(span, timer_get_fast_ns()-start);
+}
+
+void timer_profile_record(timer_profile_span_t* span, int64_t duration) {
+  timer_histogram_t* histogram;
+  int id = atomic_load_explicit(&span->id, memory_order_relaxed);
+
+  if (!id)
+    id = timer_profile_register(span);
+
+  if ((id > 0) && (histogram = timer_profile_get_record_histogram(id-1)))
+    timer_histogram_add(histogram, duration);
+}
+
+size_t timer_profile_get_histogram(const char* name, timer_histogram_t*
+    histogram) {
+  timer_profile_record_t* record;
+  timer_histogram_t* record_histogram;
+  int i, num_names = atomic_load(&timer_profile_num_names);
+  size_t num_threads = 0;
+
+  timer_histogram_init(histogram);
+
+  for (i = 0; i < num_names; ++i)
+    if (!strcmp(atomic_load(&timer_profile_names[i]), name))
+      break;
+  if (i == num_names)
+    return 0;
+
+  for (record = atomic_load(&timer_profile_records); record;
+      record = record->next)
+    if ((record_histogram = atomic_load_explicit(&record->histograms[i],
+        memory_order_acquire))) {
+      timer_histogram_merge(histogram, record_histogram);
+      ++num_threads;
+    }
+
+  return num_threads;
+}
+
+size_t timer_profile_dump(FILE* stream, timer_profile_format_t format) {
+  timer_histogram_t* histogram = malloc(sizeof(timer_histogram_t));
+  const char* name;
+  size_t num_threads;
+  int i, num_names = atomic_load(&timer_profile_num_names);
+
+  if (format == timer_profile_format_json)
+    fprintf(stream, "{\"spans\": [");
+
+  for (i = 0; i < num_names; ++i) {
+    name = atomic_load(&timer_profile_names[i]);
+    num_threads = timer_profile_get_histogram(name, histogram);
+
+    if (format == timer_profile_format_json) {
+      fprintf(stream, "%s\n  {\"name\": \"", i ? "," : "");
+      timer_profile_print_name(stream, name, format);
+      fprintf(stream, "\", \"threads\": %zu, \"count\": %zu, "
+        "\"mean\": %.0f, \"p50\": %lld, \"p99\": %lld, \"p999\": %lld, "
+        "\"max\": %lld}", num_threads, timer_histogram_get_count(histogram),
+        timer_histogram_get_mean(histogram),
+        (long long)timer_histogram_get_percentile(histogram, 0.5),
+        (long long)timer_histogram_get_percentile(histogram, 0.99),
+        (long long)timer_histogram_get_percentile(histogram, 0.999),
+        (long long)timer_histogram_get_max(histogram));
+    }
+    else
+      fprintf(stream, "%-24s %10zu x, mean %10.3f us, p50 %10.3f us, "
+        "p99 %10.3f us, p99.9 %10.3f us, max %10.3f us\n", name,
+        timer_histogram_get_count(histogram),
+        timer_histogram_get_mean(histogram)*1e-3,
+        timer_histogram_get_percentile(histogram, 0.5)*1e-3,
+        timer_histogram_get_percentile(histogram, 0.99)*1e-3,
+        timer_histogram_get_percentile(histogram, 0.999)*1e-3,
+        timer_histogram_get_max(histogram)*1e-3);
+  }
+
+  if (format == timer_profile_format_json)
+    fprintf(stream, "\n]}\n");
+
+  free(histogram);
+
+  return num_names;
+}
+
+size_t timer_histogram_get_bucket(unsigned long long value) {
+  int shift;
+
+  if (value < 2*TIMER_HISTOGRAM_SUB_COUNT)
+    return value;
+
+  shift = 64-__builtin_clzll(value)-TIMER_HISTOGRAM_SUB_BITS;
+
+  return (shift+1)*TIMER_HISTOGRAM_SUB_COUNT+(value >> shift)-
+    TIMER_HISTOGRAM_SUB_COUNT;
+}
+
+unsigned long long timer_histogram_get_bound(size_t bucket) {
+  int shift;
+
+  if (bucket < 2*TIMER_HISTOGRAM_SUB_COUNT)
+    return bucket;
+
+  shift = bucket/TIMER_HISTOGRAM_SUB_COUNT-1;
+
+  return ((bucket % TIMER_HISTOGRAM_SUB_COUNT+TIMER_HISTOGRAM_SUB_COUNT+
+    1ULL) << shift)-1;
+}
+
+int timer_profile_register(timer_profile_span_t* span) {
+  int i, num_names, id;
+
+  pthread_mutex_lock(&timer_profile_names_mutex);
+
+  if (!(id = atomic_load(&span->id))) {
+    num_names = atomic_load(&timer_profile_num_names);
+
+    for (i = 0; i < num_names; ++i)
+      if (!strcmp(atomic_load(&timer_profile_names[i]), span->name))
+        break;
+
+    if (i < TIMER_PROFILE_MAX_SPANS) {
+      if (i == num_names) {
+        atomic_store(&timer_profile_names[i], span->name);
+        atomic_store(&timer_profile_num_names, num_names+1);
+      }
+      id = i+1;
+    }
+    else
+      id = -1;
+
+    atomic_store(&span->id, id);
+  }
+
+  pthread_mutex_unlock(&timer_profile_names_mutex);
+
+  return id;
+}
+
+void timer_profile_init_key(void) {
+  pthread_key_create(&timer_profile_key, timer_profile_release_record);
+}
+
+void timer_profile_release_record(void* record) {
+  timer_profile_current = 0;
+  atomic_store(&((timer_profile_record_t*)record)->active, 0);
+}
+
+timer_profile_record_t* timer_profile_get_record(void) {
+  timer_profile_record_t* record = timer_profile_current;
+  int active;
+
+  if (!record) {
+    pthread_once(&timer_profile_once, timer_profile_init_key);
+
+    for (record = atomic_load(&timer_profile_records); record;
+        record = record->next) {
+      active = 0;
+      if (atomic_compare_exchange_strong(&record->active, &active, 1))
+        break;
+    }
+
+    if (!record) {
+      if (!(record = calloc(1, sizeof(timer_profile_record_t))))
+        return 0;
+
+      atomic_init(&record->active, 1);
+
+      record->next = atomic_load(&timer_profile_records);
+      while (!atomic_compare_exchange_weak(&timer_profile_records,
+        &record->next, record));
+    }
+
+    pthread_setspecific(timer_profile_key, record);
+    timer_profile_current = record;
+  }
+
+  return record;
+}
+
+timer_histogram_t* timer_profile_get_record_histogram(int id) {
+  timer_profile_record_t* record = timer_profile_get_record();
+  timer_histogram_t* histogram;
+
+  if (!record)
+    return 0;
+
+  if (!(histogram = atomic_load_explicit(&record->histograms[id],
+      memory_order_relaxed))) {
+    if (!(histogram = malloc(sizeof(timer_histogram_t))))
+      return 0;
+    timer_histogram_init(histogram);
+
+    atomic_store_explicit(&record->histograms[id], histogram,
+      memory_order_release);
+  }
+
+  return histogram;
+}
+
+void timer_profile_print_name(FILE* stream, const char* name,
+    timer_profile_format_t format) {
+  for ( ; *name; ++name) {
+    if ((format == timer_profile_format_json) && ((*name == '"') ||
+        (*name == '\\')))
+      fputc('\\', stream);
+    fputc(*name, stream);
+  }
+}
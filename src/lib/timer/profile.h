@@ -0,0 +1,223 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TIMER_PROFILE_H
+#define TIMER_PROFILE_H
+
+/** \file timer/profile.h
+  * \ingroup timer
+  * \brief Latency histograms and profiling spans
+  * \author Ralf Kaestner
+  * 
+  * A span times a section of code, such as the read, evaluate, and write
+  * stages of a control loop, and records the durations into a latency
+  * histogram. The histograms are log-linear in the manner of HDR
+  * histograms: each power-of-two range of nanoseconds is divided into
+  * the same number of linear sub-buckets, such that any recorded
+  * duration is represented with a bounded relative error.
+  * 
+  * Each thread records into its own histograms without locking. Spans
+  * are identified by their name, and the histograms of all threads are
+  * merged whenever percentiles are queried or the spans are dumped,
+  * which may happen at any time, also for threads which have terminated.
+  * Durations are measured with the fast clock of the timer module, such
+  * that a span costs a few tens of nanoseconds once timer_calibrate_fast()
+  * has been called.
+  */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/** \brief Number of bits of the sub-bucket index of a histogram
+  * 
+  * The relative error of a recorded duration is bounded by 2^(1-bits).
+  */
+#define TIMER_HISTOGRAM_SUB_BITS                7
+/** \brief Number of bits of the largest duration in [ns] of a histogram
+  * 
+  * Longer durations, i.e., beyond 18 minutes, are clamped.
+  */
+#define TIMER_HISTOGRAM_MAX_BITS                40
+/** \brief Number of buckets of a histogram
+  */
+#define TIMER_HISTOGRAM_NUM_BUCKETS             \
+  ((TIMER_HISTOGRAM_MAX_BITS-TIMER_HISTOGRAM_SUB_BITS+2) << \
+  (TIMER_HISTOGRAM_SUB_BITS-1))
+
+/** \brief Maximum number of distinct span names
+  */
+#define TIMER_PROFILE_MAX_SPANS                 64
+
+/** \brief Begin a profiling span
+  * \param[in] span The name of the span, given as an identifier.
+  * 
+  * The span must be ended within the same scope by TIMER_PROFILE_END().
+  */
+#define TIMER_PROFILE_BEGIN(span) \
+  static timer_profile_span_t timer_profile_span_##span = \
+    {#span, 0}; \
+  int64_t timer_profile_start_##span = timer_profile_get_time()
+
+/** \brief End a profiling span
+  * \param[in] span The name of the span, given as an identifier.
+  */
+#define TIMER_PROFILE_END(span) \
+  timer_profile_end(&timer_profile_span_##span, \
+    timer_profile_start_##span)
+
+/** \brief Profile dump format enumerable type
+  */
+typedef enum {
+  timer_profile_format_text,                //!< Human-readable text.
+  timer_profile_format_json                 //!< JSON document.
+} timer_profile_format_t;
+
+/** \brief Latency histogram structure
+  * 
+  * The histogram may be written by a single thread and read concurrently
+  * by any number of threads.
+  */
+typedef struct timer_histogram_t {
+  atomic_ullong count;                      //!< The number of durations.
+  atomic_ullong sum;                        //!< The sum of durations in [ns].
+  atomic_ullong max;                        //!< The maximum duration in [ns].
+  atomic_ullong buckets[TIMER_HISTOGRAM_NUM_BUCKETS];
+  //!< The number of durations per bucket.
+} timer_histogram_t;
+
+/** \brief Profiling span structure
+  * 
+  * Spans are usually defined by TIMER_PROFILE_BEGIN(). Spans of the same
+  * name share their histograms.
+  */
+typedef struct timer_profile_span_t {
+  const char* name;                         //!< The name of the span.
+  atomic_int id;                            //!< The registered span ID.
+} timer_profile_span_t;
+
+/** \brief Initialize latency histogram
+  * \param[in] histogram The histogram to be initialized.
+  */
+void timer_histogram_init(
+  timer_histogram_t* histogram);
+
+/** \brief Record a duration in latency histogram
+  * \param[in] histogram The initialized histogram to record the duration
+  *   in.
+  * \param[in] duration The duration to be recorded in [ns]. Negative
+  *   durations are recorded as zero.
+  */
+void timer_histogram_add(
+  timer_histogram_t* histogram,
+  int64_t duration);
+
+/** \brief Merge latency histograms
+  * \param[in] dst The initialized histogram to merge the source into.
+  *   It must not be written concurrently.
+  * \param[in] src The histogram to be merged into the destination.
+  */
+void timer_histogram_merge(
+  timer_histogram_t* dst,
+  const timer_histogram_t* src);
+
+/** \brief Retrieve the number of durations of latency histogram
+  * \param[in] histogram The histogram to retrieve the count for.
+  * \return The number of recorded durations.
+  */
+size_t timer_histogram_get_count(
+  const timer_histogram_t* histogram);
+
+/** \brief Retrieve the mean duration of latency histogram
+  * \param[in] histogram The histogram to retrieve the mean for.
+  * \return The mean of the recorded durations in [ns].
+  */
+double timer_histogram_get_mean(
+  const timer_histogram_t* histogram);
+
+/** \brief Retrieve the maximum duration of latency histogram
+  * \param[in] histogram The histogram to retrieve the maximum for.
+  * \return The maximum of the recorded durations in [ns].
+  */
+int64_t timer_histogram_get_max(
+  const timer_histogram_t* histogram);
+
+/** \brief Retrieve a percentile of latency histogram
+  * \param[in] histogram The histogram to retrieve the percentile for.
+  * \param[in] percentile The percentile in the range [0, 1].
+  * \return The percentile of the recorded durations in [ns]. The value
+  *   is the upper bound of the bucket the percentile falls into, but no
+  *   larger than the maximum duration.
+  */
+int64_t timer_histogram_get_percentile(
+  const timer_histogram_t* histogram,
+  double percentile);
+
+/** \brief Retrieve the profiling clock
+  * \return The time of the fast clock of the timer module in [ns].
+  */
+int64_t timer_profile_get_time(void);
+
+/** \brief End a profiling span
+  * \param[in] span The span to be ended.
+  * \param[in] start The time the span began, as returned by
+  *   timer_profile_get_time().
+  */
+void timer_profile_end(
+  timer_profile_span_t* span,
+  int64_t start);
+
+/** \brief Record a duration for a profiling span
+  * \param[in] span The span to record the duration for.
+  * \param[in] duration The duration to be recorded in [ns].
+  * 
+  * The duration is recorded into the calling thread's histogram of the
+  * span. If the maximum number of span names has been registered, the
+  * duration of a span with a new name is dropped.
+  */
+void timer_profile_record(
+  timer_profile_span_t* span,
+  int64_t duration);
+
+/** \brief Retrieve the merged histogram of a profiling span
+  * \param[in] name The name of the span to retrieve the histogram for.
+  * \param[out] histogram The histogram that will contain the durations
+  *   recorded by all threads.
+  * \return The number of thread records which contain durations for the
+  *   span. The record of a terminated thread is reused by the next thread
+  *   starting to profile, which continues to record into its histograms.
+  */
+size_t timer_profile_get_histogram(
+  const char* name,
+  timer_histogram_t* histogram);
+
+/** \brief Dump the merged histograms of all profiling spans
+  * \param[in] stream The stream to dump the spans to.
+  * \param[in] format The format of the dump.
+  * \return The number of dumped spans.
+  * 
+  * Durations are reported in nanoseconds for JSON and microseconds for
+  * text output.
+  */
+size_t timer_profile_dump(
+  FILE* stream,
+  timer_profile_format_t format);
+
+#endif
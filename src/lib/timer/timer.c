@@ -18,16 +18,44 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <sys/time.h>
+#include <sys/prctl.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 
 #include "timer.h"
 
+#define TIMER_FAST_SHIFT              32
+#define TIMER_SPIN_THRESHOLD          100000
+#define TIMER_SPIN_CALIBRATION_SLEEP  200000
+
 const char* timer_errors[] = {
   "Success",
-  "Timer fault"
+  "Timer fault",
+  "Invariant time-stamp counter unavailable",
 };
 
+static int timer_fast_calibrated = 0;
+static uint64_t timer_fast_base_ticks = 0;
+static int64_t timer_fast_base_ns = 0;
+static uint64_t timer_fast_mult = 0;
+static double timer_fast_frequency = 0.0;
+static _Atomic int64_t timer_spin_threshold = TIMER_SPIN_THRESHOLD;
+
+int64_t timer_get_clock_ns(clockid_t clock);
+int timer_test_invariant_tsc(void);
+void timer_nanosleep_until(int64_t deadline);
+void timer_pause(void);
+int timer_compare_ns(const void* a, const void* b);
+
 void timer_start(double* timestamp) {
   struct timeval time;
   double million = 1e6;
@@ -67,9 +95,195 @@ int timer_wait(double timestamp, double frequency) {
 
 int timer_sleep(
   double seconds) {
+  struct timespec time, remaining;
+
   if (seconds < 0.0) return TIMER_ERROR_FAULT;
 
-  usleep((int)(seconds*1e6));
+  time.tv_sec = (time_t)seconds;
+  time.tv_nsec = (seconds-time.tv_sec)*1e9;
+
+  while (nanosleep(&time, &remaining) && (errno == EINTR))
+    time = remaining;
+
+  return TIMER_ERROR_NONE;
+}
+
+int64_t timer_sleep_until(int64_t deadline) {
+  int64_t now = timer_get_clock_ns(CLOCK_MONOTONIC);
+  int64_t threshold = timer_get_spin_threshold();
+
+  if (deadline-now > threshold) {
+    timer_nanosleep_until(deadline-threshold);
+    now = timer_get_clock_ns(CLOCK_MONOTONIC);
+  }
+
+  while (now < deadline) {
+    timer_pause();
+    now = timer_get_clock_ns(CLOCK_MONOTONIC);
+  }
+
+  return now-deadline;
+}
+
+void timer_set_spin_threshold(int64_t threshold) {
+  atomic_store_explicit(&timer_spin_threshold, (threshold > 0) ?
+    threshold : 0, memory_order_relaxed);
+}
+
+int64_t timer_get_spin_threshold(void) {
+  return atomic_load_explicit(&timer_spin_threshold, memory_order_relaxed);
+}
+
+int64_t timer_calibrate_spin(size_t num_samples) {
+  int64_t deadline, *oversleeps;
+  size_t i;
+
+  if (!num_samples ||
+      !(oversleeps = malloc(num_samples*sizeof(int64_t))))
+    return timer_get_spin_threshold();
+
+  for (i = 0; i < num_samples; ++i) {
+    deadline = timer_get_clock_ns(CLOCK_MONOTONIC)+
+      TIMER_SPIN_CALIBRATION_SLEEP;
+    timer_nanosleep_until(deadline);
+
+    oversleeps[i] = timer_get_clock_ns(CLOCK_MONOTONIC)-deadline;
+  }
+
+  qsort(oversleeps, num_samples, sizeof(int64_t), timer_compare_ns);
+  timer_set_spin_threshold(oversleeps[num_samples*9/10]);
+  free(oversleeps);
+
+  return timer_get_spin_threshold();
+}
+
+int timer_set_slack(int64_t slack) {
+  if ((slack < 0) || prctl(PR_SET_TIMERSLACK, (unsigned long)slack, 0, 0, 0))
+    return TIMER_ERROR_FAULT;
+
+  return TIMER_ERROR_NONE;
+}
+
+int64_t timer_get_ns(timer_clock_t clock) {
+  if (clock == timer_clock_fast)
+    return timer_get_fast_ns();
+  else if (clock == timer_clock_raw)
+    return timer_get_clock_ns(CLOCK_MONOTONIC_RAW);
+  else
+    return timer_get_clock_ns(CLOCK_MONOTONIC);
+}
+
+int64_t timer_get_monotonic_ns(void) {
+  return timer_get_clock_ns(CLOCK_MONOTONIC);
+}
+
+int64_t timer_get_fast_ns(void) {
+#if defined(__x86_64__)
+  if (timer_fast_calibrated)
+    return timer_fast_base_ns+(int64_t)(((unsigned __int128)(__rdtsc()-
+      timer_fast_base_ticks)*timer_fast_mult) >> TIMER_FAST_SHIFT);
+#endif
+
+  return timer_get_clock_ns(CLOCK_MONOTONIC_RAW);
+}
+
+int timer_calibrate_fast(double duration) {
+#if defined(__x86_64__)
+  uint64_t start_ticks, end_ticks;
+  int64_t start_ns, end_ns;
+
+  timer_fast_calibrated = 0;
+  timer_fast_frequency = 0.0;
+
+  if (!timer_test_invariant_tsc())
+    return TIMER_ERROR_TSC;
+
+  start_ns = timer_get_clock_ns(CLOCK_MONOTONIC_RAW);
+  start_ticks = __rdtsc();
+  timer_sleep(duration);
+  end_ns = timer_get_clock_ns(CLOCK_MONOTONIC_RAW);
+  end_ticks = __rdtsc();
+
+  if ((end_ticks <= start_ticks) || (end_ns <= start_ns))
+    return TIMER_ERROR_TSC;
+
+  timer_fast_mult = (((unsigned __int128)(end_ns-start_ns)) <<
+    TIMER_FAST_SHIFT)/(end_ticks-start_ticks);
+  timer_fast_frequency = (end_ticks-start_ticks)*1e9/(end_ns-start_ns);
+
+  timer_fast_base_ns = timer_get_clock_ns(CLOCK_MONOTONIC_RAW);
+  timer_fast_base_ticks = __rdtsc();
+  timer_fast_calibrated = 1;
 
   return TIMER_ERROR_NONE;
+#else
+  return TIMER_ERROR_TSC;
+#endif
+}
+
+double timer_get_fast_frequency(void) {
+  return timer_fast_frequency;
+}
+
+void timer_start_ns(int64_t* timestamp) {
+  *timestamp = timer_get_clock_ns(CLOCK_MONOTONIC);
+}
+
+int64_t timer_stop_ns(int64_t timestamp) {
+  return timer_get_clock_ns(CLOCK_MONOTONIC)-timestamp;
+}
+
+double timer_ns_to_seconds(int64_t nanoseconds) {
+  return nanoseconds*1e-9;
+}
+
+int64_t timer_seconds_to_ns(double seconds) {
+  return (int64_t)(seconds*1e9+((seconds < 0.0) ? -0.5 : 0.5));
+}
+
+int64_t timer_get_clock_ns(clockid_t clock) {
+  struct timespec time;
+
+  clock_gettime(clock, &time);
+
+  return (int64_t)time.tv_sec*1000000000+time.tv_nsec;
+}
+
+int timer_test_invariant_tsc(void) {
+#if defined(__x86_64__)
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) ||
+      (eax < 0x80000007))
+    return 0;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    return 0;
+
+  return (edx >> 8) & 1;
+#else
+  return 0;
+#endif
+}
+
+void timer_nanosleep_until(int64_t deadline) {
+  struct timespec time;
+
+  time.tv_sec = deadline/1000000000;
+  time.tv_nsec = deadline%1000000000;
+
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, 0) == EINTR);
+}
+
+void timer_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+int timer_compare_ns(const void* a, const void* b) {
+  int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+
+  return (x > y)-(x < y);
 }
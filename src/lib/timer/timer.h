@@ -37,8 +37,23 @@
   * implementation specifically targets periodic tasks which require
   * to measure and delay time in order to ensure relatively constant
   * frequencies.
+  * 
+  * Besides the timestamps in seconds of the system time, the timer
+  * provides integer nanosecond timestamps of the monotonic system clocks,
+  * which are unaffected by adjustments of the system time and do not
+  * lose precision with the magnitude of the timestamp. On processors with
+  * an invariant time-stamp counter, a fast clock may further be calibrated
+  * against the raw monotonic clock, which reads the counter directly
+  * instead of entering the C library.
+  * 
+  * Sleeping until an absolute deadline combines a kernel sleep for the
+  * bulk of the interval with busy-waiting for its final stretch, such
+  * that the wake-up error is no longer dominated by the timer slack and
+  * scheduling latency of the kernel.
   */
 
+#include <stdint.h>
+
 /** \name Error Codes
   * \brief Predefined timer error codes
   */
@@ -47,12 +62,22 @@
 //!< Success
 #define TIMER_ERROR_FAULT             1
 //!< Timer fault
+#define TIMER_ERROR_TSC               2
+//!< Invariant time-stamp counter unavailable
 //@}
 
 /** \brief Predefined timer error descriptions
   */
 extern const char* timer_errors[];
 
+/** \brief Timer clock enumerable type
+  */
+typedef enum {
+  timer_clock_monotonic,        //!< Monotonic clock, slewed by NTP.
+  timer_clock_raw,              //!< Raw monotonic hardware clock.
+  timer_clock_fast              //!< Calibrated time-stamp counter.
+} timer_clock_t;
+
 /** \brief Start the timer
   * \param[out] timestamp The timestamp that will contain the start time.
   */
@@ -92,9 +117,132 @@ int timer_wait(
 
 /** \brief Sleep for a specified amount of time
   * \param[in] seconds The sleep duration in [s].
-  * \return The resulting error code.
+  * \return The resulting error code. If the duration is negative,
+  *   TIMER_ERROR_FAULT will be returned.
   */
 int timer_sleep(
   double seconds);
 
+/** \brief Sleep until a deadline of the monotonic clock
+  * \param[in] deadline The deadline in [ns] of the monotonic clock. If the
+  *   deadline has passed, the function returns immediately.
+  * \return The wake-up error in [ns], i.e., the delay of the return with
+  *   respect to the deadline.
+  * 
+  * The calling thread sleeps in the kernel until the spin threshold
+  * before the deadline and busy-waits for the remaining interval.
+  */
+int64_t timer_sleep_until(
+  int64_t deadline);
+
+/** \brief Set the spin threshold of timer_sleep_until()
+  * \param[in] threshold The interval before the deadline in [ns] during
+  *   which the calling thread busy-waits. A threshold of zero disables
+  *   busy-waiting.
+  * 
+  * The threshold is shared by all threads of the process.
+  */
+void timer_set_spin_threshold(
+  int64_t threshold);
+
+/** \brief Retrieve the spin threshold of timer_sleep_until()
+  * \return The interval before the deadline in [ns] during which the
+  *   calling thread busy-waits.
+  */
+int64_t timer_get_spin_threshold(void);
+
+/** \brief Calibrate the spin threshold of timer_sleep_until()
+  * \param[in] num_samples The number of kernel sleeps to be measured.
+  * \return The calibrated spin threshold in [ns], or the unchanged
+  *   threshold if the samples could not be allocated.
+  * 
+  * The threshold is set to the 90th percentile of the oversleep observed
+  * for short kernel sleeps of the calling thread, such that rare outliers
+  * do not inflate the busy-waiting. The oversleep depends on the timer
+  * slack and scheduling policy of the calling thread, such that the
+  * calibration should be performed from within the thread using
+  * timer_sleep_until(). Since the threshold is shared by all threads,
+  * threads sleeping with a different slack or policy should not rely on
+  * it.
+  */
+int64_t timer_calibrate_spin(
+  size_t num_samples);
+
+/** \brief Set the timer slack of the calling thread
+  * \param[in] slack The timer slack in [ns] by which the kernel may delay
+  *   the expiration of timers, or zero to restore the default slack.
+  * \return The resulting error code.
+  */
+int timer_set_slack(
+  int64_t slack);
+
+/** \brief Retrieve the time of a clock
+  * \param[in] clock The clock to be read. If the fast clock has not been
+  *   calibrated, the raw monotonic clock will be read instead.
+  * \return The time of the clock in [ns].
+  */
+int64_t timer_get_ns(
+  timer_clock_t clock);
+
+/** \brief Retrieve the time of the monotonic clock
+  * \return The time of the monotonic clock in [ns].
+  */
+int64_t timer_get_monotonic_ns(void);
+
+/** \brief Retrieve the time of the fast clock
+  * \return The time of the fast clock in [ns]. If the fast clock has not
+  *   been calibrated, the time of the raw monotonic clock is returned.
+  * 
+  * The fast clock shares the epoch of the raw monotonic clock, against
+  * which it has been calibrated.
+  */
+int64_t timer_get_fast_ns(void);
+
+/** \brief Calibrate the fast clock
+  * \param[in] duration The duration of the calibration in [s]. Longer
+  *   calibrations yield a more accurate counter frequency.
+  * \return The resulting error code. If the processor does not provide
+  *   an invariant time-stamp counter, TIMER_ERROR_TSC will be returned
+  *   and the fast clock falls back to the raw monotonic clock.
+  * 
+  * The calibration should be performed once at startup, before any other
+  * thread reads the fast clock.
+  */
+int timer_calibrate_fast(
+  double duration);
+
+/** \brief Retrieve the calibrated time-stamp counter frequency
+  * \return The frequency of the time-stamp counter in [Hz] or 0 if the
+  *   fast clock has not been calibrated.
+  */
+double timer_get_fast_frequency(void);
+
+/** \brief Start the nanosecond timer
+  * \param[out] timestamp The timestamp that will contain the start time
+  *   of the monotonic clock in [ns].
+  */
+void timer_start_ns(
+  int64_t* timestamp);
+
+/** \brief Stop the nanosecond timer and return the elapsed time
+  * \param[in] timestamp The timestamp containing the timer's start time.
+  * \return The elapsed time in [ns].
+  */
+int64_t timer_stop_ns(
+  int64_t timestamp);
+
+/** \brief Convert nanoseconds to seconds
+  * \param[in] nanoseconds The duration or time in [ns].
+  * \return The duration or time in [s].
+  */
+double timer_ns_to_seconds(
+  int64_t nanoseconds);
+
+/** \brief Convert seconds to nanoseconds
+  * \param[in] seconds The duration or time in [s].
+  * \return The duration or time in [ns].
+  */
+int64_t timer_seconds_to_ns(
+  double seconds);
+
 #endif
@@ -0,0 +1,372 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/timerfd.h>
+
+#include "wheel.h"
+
+#include "timer.h"
+
+#define TIMER_WHEEL_SLOT_MASK         (TIMER_WHEEL_NUM_SLOTS-1)
+#define TIMER_WHEEL_MAX_TICKS         \
+  (((int64_t)1 << (TIMER_WHEEL_SLOT_BITS*TIMER_WHEEL_NUM_LEVELS))-1)
+
+const char* timer_wheel_errors[] = {
+  "Success",
+  "Failed to start timer wheel thread",
+};
+
+void timer_wheel_insert(timer_wheel_t* wheel, timer_wheel_timeout_t*
+  timeout);
+void timer_wheel_link(timer_wheel_timeout_t** head, timer_wheel_timeout_t*
+  timeout);
+void timer_wheel_unlink(timer_wheel_t* wheel, timer_wheel_timeout_t*
+  timeout);
+void timer_wheel_cascade(timer_wheel_t* wheel, int level, int slot);
+int64_t timer_wheel_get_next_tick(timer_wheel_t* wheel);
+int64_t timer_wheel_get_deadline(timer_wheel_t* wheel, int64_t tick);
+void timer_wheel_arm(timer_wheel_t* wheel, int64_t tick);
+void* timer_wheel_run(void* arg);
+
+void timer_wheel_init(timer_wheel_t* wheel, double resolution) {
+  int i, j;
+
+  for (i = 0; i < TIMER_WHEEL_NUM_LEVELS; ++i)
+    for (j = 0; j < TIMER_WHEEL_NUM_SLOTS; ++j)
+      wheel->slots[i][j] = 0;
+  wheel->expired = 0;
+
+  wheel->origin = timer_get_monotonic_ns();
+  wheel->resolution = timer_seconds_to_ns(resolution);
+  if (wheel->resolution < 1)
+    wheel->resolution = 1;
+  wheel->current = 0;
+  wheel->num_timeouts = 0;
+
+  pthread_mutex_init(&wheel->mutex, 0);
+
+  wheel->timer_fd = -1;
+  wheel->armed = INT64_MAX;
+  atomic_init(&wheel->exit_request, 0);
+}
+
+void timer_wheel_destroy(timer_wheel_t* wheel) {
+  if (wheel->timer_fd >= 0)
+    timer_wheel_stop(wheel);
+
+  pthread_mutex_destroy(&wheel->mutex);
+}
+
+void timer_wheel_timeout_init(timer_wheel_timeout_t* timeout, void
+    (*callback)(timer_wheel_timeout_t*, void*), void* arg) {
+  timeout->next = 0;
+  timeout->pprev = 0;
+
+  timeout->expires = 0;
+
+  timeout->callback = callback;
+  timeout->arg = arg;
+}
+
+void timer_wheel_add(timer_wheel_t* wheel, timer_wheel_timeout_t* timeout,
+    int64_t deadline) {
+  int64_t elapsed = deadline-wheel->origin;
+
+  pthread_mutex_lock(&wheel->mutex);
+
+  if (timeout->pprev)
+    timer_wheel_unlink(wheel, timeout);
+
+  timeout->expires = (elapsed > 0) ? elapsed/wheel->resolution+
+    (elapsed%wheel->resolution != 0) : 0;
+  timer_wheel_insert(wheel, timeout);
+
+  if ((wheel->timer_fd >= 0) && (timeout->expires < wheel->armed))
+    timer_wheel_arm(wheel, timeout->expires);
+
+  pthread_mutex_unlock(&wheel->mutex);
+}
+
+void timer_wheel_add_after(timer_wheel_t* wheel, timer_wheel_timeout_t*
+    timeout, double seconds) {
+  timer_wheel_add(wheel, timeout, timer_get_monotonic_ns()+
+    timer_seconds_to_ns(seconds));
+}
+
+int timer_wheel_cancel(timer_wheel_t* wheel, timer_wheel_timeout_t*
+    timeout) {
+  int pending;
+
+  pthread_mutex_lock(&wheel->mutex);
+
+  if ((pending = (timeout->pprev != 0)))
+    timer_wheel_unlink(wheel, timeout);
+
+  pthread_mutex_unlock(&wheel->mutex);
+
+  return pending;
+}
+
+int timer_wheel_test_pending(timer_wheel_t* wheel, timer_wheel_timeout_t*
+    timeout) {
+  int pending;
+
+  pthread_mutex_lock(&wheel->mutex);
+  pending = (timeout->pprev != 0);
+  pthread_mutex_unlock(&wheel->mutex);
+
+  return pending;
+}
+
+size_t timer_wheel_advance(timer_wheel_t* wheel, int64_t now) {
+  timer_wheel_timeout_t* timeout;
+  int64_t target = (now-wheel->origin)/wheel->resolution;
+  size_t num_fired = 0;
+  int level, slot;
+
+  pthread_mutex_lock(&wheel->mutex);
+
+  while (wheel->current <= target) {
+    if (!wheel->num_timeouts) {
+      wheel->current = target+1;
+      break;
+    }
+
+    for (level = 1; level < TIMER_WHEEL_NUM_LEVELS; ++level) {
+      if ((wheel->current >> (TIMER_WHEEL_SLOT_BITS*(level-1))) &
+          TIMER_WHEEL_SLOT_MASK)
+        break;
+      timer_wheel_cascade(wheel, level, (wheel->current >>
+        (TIMER_WHEEL_SLOT_BITS*level)) & TIMER_WHEEL_SLOT_MASK);
+    }
+
+    slot = wheel->current & TIMER_WHEEL_SLOT_MASK;
+    while ((timeout = wheel->slots[0][slot])) {
+      timer_wheel_unlink(wheel, timeout);
+      timer_wheel_link(&wheel->expired, timeout);
+      ++wheel->num_timeouts;
+    }
+
+    ++wheel->current;
+  }
+
+  while ((timeout = wheel->expired)) {
+    timer_wheel_unlink(wheel, timeout);
+
+    pthread_mutex_unlock(&wheel->mutex);
+    timeout->callback(timeout, timeout->arg);
+    pthread_mutex_lock(&wheel->mutex);
+
+    ++num_fired;
+  }
+
+  pthread_mutex_unlock(&wheel->mutex);
+
+  return num_fired;
+}
+
+int64_t timer_wheel_get_next(timer_wheel_t* wheel) {
+  int64_t tick;
+
+  pthread_mutex_lock(&wheel->mutex);
+  tick = timer_wheel_get_next_tick(wheel);
+  pthread_mutex_unlock(&wheel->mutex);
+
+  return (tick >= 0) ? timer_wheel_get_deadline(wheel, tick) : -1;
+}
+
+int timer_wheel_start(timer_wheel_t* wheel) {
+  if ((wheel->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0)
+    return TIMER_WHEEL_ERROR_THREAD;
+
+  atomic_store(&wheel->exit_request, 0);
+
+  pthread_mutex_lock(&wheel->mutex);
+  wheel->armed = INT64_MAX;
+  timer_wheel_arm(wheel, timer_wheel_get_next_tick(wheel));
+  pthread_mutex_unlock(&wheel->mutex);
+
+  if (pthread_create(&wheel->thread, 0, timer_wheel_run, wheel)) {
+    close(wheel->timer_fd);
+    wheel->timer_fd = -1;
+
+    return TIMER_WHEEL_ERROR_THREAD;
+  }
+
+  return TIMER_WHEEL_ERROR_NONE;
+}
+
+void timer_wheel_stop(timer_wheel_t* wheel) {
+  struct itimerspec value = {{0, 0}, {0, 1}};
+
+  if (wheel->timer_fd < 0)
+    return;
+
+  pthread_mutex_lock(&wheel->mutex);
+  atomic_store(&wheel->exit_request, 1);
+  timerfd_settime(wheel->timer_fd, TFD_TIMER_ABSTIME, &value, 0);
+  wheel->armed = INT64_MIN;
+  pthread_mutex_unlock(&wheel->mutex);
+
+  pthread_join(wheel->thread, 0);
+
+  pthread_mutex_lock(&wheel->mutex);
+  close(wheel->timer_fd);
+  wheel->timer_fd = -1;
+  wheel->armed = INT64_MAX;
+  pthread_mutex_unlock(&wheel->mutex);
+}
+
+void timer_wheel_insert(timer_wheel_t* wheel, timer_wheel_timeout_t*
+    timeout) {
+  int64_t delta = timeout->expires-wheel->current;
+  int level = 0;
+
+  if (delta < 0) {
+    timeout->expires = wheel->current;
+    delta = 0;
+  }
+  else if (delta > TIMER_WHEEL_MAX_TICKS) {
+    timeout->expires = wheel->current+TIMER_WHEEL_MAX_TICKS;
+    delta = TIMER_WHEEL_MAX_TICKS;
+  }
+
+  while (delta >> (TIMER_WHEEL_SLOT_BITS*(level+1)))
+    ++level;
+
+  timer_wheel_link(&wheel->slots[level][(timeout->expires >>
+    (TIMER_WHEEL_SLOT_BITS*level)) & TIMER_WHEEL_SLOT_MASK], timeout);
+  ++wheel->num_timeouts;
+}
+
+void timer_wheel_link(timer_wheel_timeout_t** head, timer_wheel_timeout_t*
+    timeout) {
+  timeout->next = *head;
+  if (timeout->next)
+    timeout->next->pprev = &timeout->next;
+
+  timeout->pprev = head;
+  *head = timeout;
+}
+
+void timer_wheel_unlink(timer_wheel_t* wheel, timer_wheel_timeout_t*
+    timeout) {
+  *timeout->pprev = timeout->next;
+  if (timeout->next)
+    timeout->next->pprev = timeout->pprev;
+
+  timeout->next = 0;
+  timeout->pprev = 0;
+
+  --wheel->num_timeouts;
+}
+
+void timer_wheel_cascade(timer_wheel_t* wheel, int level, int slot) {
+  timer_wheel_timeout_t* timeout;
+
+  while ((timeout = wheel->slots[level][slot])) {
+    timer_wheel_unlink(wheel, timeout);
+    timer_wheel_insert(wheel, timeout);
+  }
+}
+
+int64_t timer_wheel_get_next_tick(timer_wheel_t* wheel) {
+  int64_t next = INT64_MAX, block;
+  int level, shift, i;
+
+  if (!wheel->num_timeouts)
+    return -1;
+  if (wheel->expired)
+    return wheel->current;
+
+  for (i = 0; i < TIMER_WHEEL_NUM_SLOTS; ++i) {
+    if (wheel->slots[0][(wheel->current+i) & TIMER_WHEEL_SLOT_MASK]) {
+      next = wheel->current+i;
+      break;
+    }
+  }
+
+  for (level = 1; level < TIMER_WHEEL_NUM_LEVELS; ++level) {
+    shift = TIMER_WHEEL_SLOT_BITS*level;
+
+    for (i = 0; i < TIMER_WHEEL_NUM_SLOTS; ++i) {
+      block = (wheel->current >> shift)+i;
+      if (!wheel->slots[level][block & TIMER_WHEEL_SLOT_MASK])
+        continue;
+
+      if (!i && (wheel->current & (((int64_t)1 << shift)-1)))
+        block += TIMER_WHEEL_NUM_SLOTS;
+      if ((block << shift) < next)
+        next = block << shift;
+      break;
+    }
+  }
+
+  return next;
+}
+
+int64_t timer_wheel_get_deadline(timer_wheel_t* wheel, int64_t tick) {
+  if (tick > (INT64_MAX-wheel->origin)/wheel->resolution)
+    return INT64_MAX;
+  else
+    return wheel->origin+tick*wheel->resolution;
+}
+
+void timer_wheel_arm(timer_wheel_t* wheel, int64_t tick) {
+  struct itimerspec value = {{0, 0}, {0, 0}};
+  int64_t deadline;
+
+  if (atomic_load(&wheel->exit_request))
+    return;
+
+  if (tick >= 0) {
+    deadline = timer_wheel_get_deadline(wheel, tick);
+    value.it_value.tv_sec = deadline/1000000000;
+    value.it_value.tv_nsec = deadline%1000000000;
+  }
+  else
+    tick = INT64_MAX;
+
+  if (!timerfd_settime(wheel->timer_fd, TFD_TIMER_ABSTIME, &value, 0))
+    wheel->armed = tick;
+}
+
+void* timer_wheel_run(void* arg) {
+  timer_wheel_t* wheel = arg;
+  uint64_t num_expirations;
+
+  while (!atomic_load(&wheel->exit_request)) {
+    if ((read(wheel->timer_fd, &num_expirations, sizeof(num_expirations)) <
+        0) && (errno != EINTR) && (errno != EAGAIN))
+      break;
+    if (atomic_load(&wheel->exit_request))
+      break;
+
+    timer_wheel_advance(wheel, timer_get_monotonic_ns());
+
+    pthread_mutex_lock(&wheel->mutex);
+    timer_wheel_arm(wheel, timer_wheel_get_next_tick(wheel));
+    pthread_mutex_unlock(&wheel->mutex);
+  }
+
+  return 0;
+}
@@ -0,0 +1,234 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+/** \file timer/wheel.h
+  * \ingroup timer
+  * \brief Hierarchical timer wheel implementation
+  * \author Ralf Kaestner
+  * 
+  * The timer wheel manages large numbers of software timeouts at a fixed
+  * resolution. Each level of the wheel covers a range of ticks that is
+  * a power of the number of slots per level larger than the range of the
+  * level below, and pending timeouts are kept in intrusive lists attached
+  * to the slots. Adding and cancelling a timeout thus takes constant time
+  * and never allocates memory. Advancing the wheel fires the timeouts of
+  * the elapsed ticks and cascades the timeouts of the higher levels down
+  * as their slots come due.
+  * 
+  * The wheel may either be advanced by the application, e.g., from within
+  * its event loop, or by a dedicated thread which sleeps on a timerfd
+  * armed for the next due slot. All operations on a wheel are serialized
+  * by a mutex, and timeout callbacks are invoked without holding it, such
+  * that a callback may add or cancel timeouts itself.
+  */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/** \brief Number of bits of the slot index per wheel level
+  */
+#define TIMER_WHEEL_SLOT_BITS         6
+/** \brief Number of slots per wheel level
+  */
+#define TIMER_WHEEL_NUM_SLOTS         (1 << TIMER_WHEEL_SLOT_BITS)
+/** \brief Number of wheel levels
+  * 
+  * Timeouts further ahead than the range of all levels, i.e., 2^36 ticks,
+  * are clamped to the end of this range.
+  */
+#define TIMER_WHEEL_NUM_LEVELS        6
+
+/** \name Error Codes
+  * \brief Predefined timer wheel error codes
+  */
+//@{
+#define TIMER_WHEEL_ERROR_NONE        0
+//!< Success
+#define TIMER_WHEEL_ERROR_THREAD      1
+//!< Failed to start timer wheel thread
+//@}
+
+/** \brief Predefined timer wheel error descriptions
+  */
+extern const char* timer_wheel_errors[];
+
+/** \brief Timer wheel timeout structure
+  * 
+  * The timeout structure is owned by the caller and linked into the
+  * wheel while pending. It must not be freed or re-initialized before it
+  * has fired or has been cancelled.
+  */
+typedef struct timer_wheel_timeout_t {
+  struct timer_wheel_timeout_t* next;   //!< The next timeout in the slot.
+  struct timer_wheel_timeout_t** pprev; //!< The link pointing to the timeout.
+
+  int64_t expires;                      //!< The expiration tick.
+
+  void (*callback)(struct timer_wheel_timeout_t*, void*);
+  //!< The callback invoked when the timeout fires.
+  void* arg;                            //!< The argument of the callback.
+} timer_wheel_timeout_t;
+
+/** \brief Timer wheel structure
+  */
+typedef struct timer_wheel_t {
+  timer_wheel_timeout_t* slots[TIMER_WHEEL_NUM_LEVELS][TIMER_WHEEL_NUM_SLOTS];
+  //!< The heads of the timeout lists of all slots.
+  timer_wheel_timeout_t* expired;       //!< The expired timeouts to fire.
+
+  int64_t origin;                       //!< The time of tick zero in [ns].
+  int64_t resolution;                   //!< The duration of a tick in [ns].
+  int64_t current;                      //!< The next tick to be processed.
+  size_t num_timeouts;                  //!< The number of pending timeouts.
+
+  pthread_mutex_t mutex;                //!< The mutex serializing access.
+
+  pthread_t thread;                     //!< The wheel thread.
+  int timer_fd;                         //!< The timerfd of the wheel thread.
+  int64_t armed;                        //!< The tick the timerfd is armed for.
+  atomic_int exit_request;              //!< Flag requesting thread exit.
+} timer_wheel_t;
+
+/** \brief Initialize timer wheel
+  * \param[in] wheel The timer wheel to be initialized.
+  * \param[in] resolution The duration of a tick in [s]. Timeouts never
+  *   fire early, but may fire up to one tick late.
+  */
+void timer_wheel_init(
+  timer_wheel_t* wheel,
+  double resolution);
+
+/** \brief Destroy timer wheel
+  * \param[in] wheel The initialized timer wheel to be destroyed.
+  * 
+  * The wheel thread will be stopped if running. Pending timeouts are
+  * discarded without firing.
+  */
+void timer_wheel_destroy(
+  timer_wheel_t* wheel);
+
+/** \brief Initialize timer wheel timeout
+  * \param[in] timeout The timeout to be initialized.
+  * \param[in] callback The callback invoked with the timeout and the
+  *   argument when the timeout fires.
+  * \param[in] arg The argument passed to the callback.
+  */
+void timer_wheel_timeout_init(
+  timer_wheel_timeout_t* timeout,
+  void (*callback)(timer_wheel_timeout_t*, void*),
+  void* arg);
+
+/** \brief Add timeout to timer wheel
+  * \param[in] wheel The initialized timer wheel to add the timeout to.
+  * \param[in] timeout The initialized timeout to be added. If the timeout
+  *   is pending already, it will be re-scheduled.
+  * \param[in] deadline The deadline of the timeout in [ns] of the
+  *   monotonic clock. A deadline which has passed fires with the next
+  *   advance of the wheel.
+  */
+void timer_wheel_add(
+  timer_wheel_t* wheel,
+  timer_wheel_timeout_t* timeout,
+  int64_t deadline);
+
+/** \brief Add timeout to timer wheel relative to the current time
+  * \param[in] wheel The initialized timer wheel to add the timeout to.
+  * \param[in] timeout The initialized timeout to be added. If the timeout
+  *   is pending already, it will be re-scheduled.
+  * \param[in] seconds The duration until the timeout fires in [s].
+  */
+void timer_wheel_add_after(
+  timer_wheel_t* wheel,
+  timer_wheel_timeout_t* timeout,
+  double seconds);
+
+/** \brief Cancel timeout of timer wheel
+  * \param[in] wheel The initialized timer wheel to cancel the timeout of.
+  * \param[in] timeout The timeout to be cancelled.
+  * \return Non-zero if the timeout was pending, zero if it has fired or
+  *   was never added. A callback which is being invoked concurrently
+  *   is not waited for.
+  */
+int timer_wheel_cancel(
+  timer_wheel_t* wheel,
+  timer_wheel_timeout_t* timeout);
+
+/** \brief Test if timeout is pending
+  * \param[in] wheel The initialized timer wheel to test the timeout of.
+  * \param[in] timeout The timeout to be tested.
+  * \return Non-zero if the timeout is pending, zero otherwise.
+  */
+int timer_wheel_test_pending(
+  timer_wheel_t* wheel,
+  timer_wheel_timeout_t* timeout);
+
+/** \brief Advance timer wheel
+  * \param[in] wheel The initialized timer wheel to be advanced.
+  * \param[in] now The current time in [ns] of the monotonic clock.
+  * \return The number of timeouts fired.
+  * 
+  * The callbacks of all timeouts expired until the given time are invoked
+  * from within the calling thread. The cost of advancing is linear in the
+  * number of elapsed ticks while timeouts are pending.
+  */
+size_t timer_wheel_advance(
+  timer_wheel_t* wheel,
+  int64_t now);
+
+/** \brief Retrieve the next due time of timer wheel
+  * \param[in] wheel The initialized timer wheel to retrieve the due
+  *   time for.
+  * \return The time in [ns] of the monotonic clock by which the wheel
+  *   should be advanced next, or -1 if no timeouts are pending.
+  * 
+  * The due time is a lower bound of the earliest deadline: it is exact
+  * for timeouts in the lowest level, whereas the timeouts of the higher
+  * levels are due when their slot cascades.
+  */
+int64_t timer_wheel_get_next(
+  timer_wheel_t* wheel);
+
+/** \brief Start timer wheel thread
+  * \param[in] wheel The initialized timer wheel to start the thread for.
+  * \return The resulting error code.
+  * 
+  * The wheel thread sleeps on a timerfd armed for the next due time of
+  * the wheel and advances the wheel whenever it expires. Timeout
+  * callbacks are thus invoked from within the wheel thread. Adding an
+  * earlier timeout re-arms the timerfd.
+  */
+int timer_wheel_start(
+  timer_wheel_t* wheel);
+
+/** \brief Stop timer wheel thread
+  * \param[in] wheel The timer wheel to stop the thread for.
+  * 
+  * Stopping waits for a callback being invoked by the wheel thread to
+  * return. Pending timeouts remain in the wheel.
+  */
+void timer_wheel_stop(
+  timer_wheel_t* wheel);
+
+#endif
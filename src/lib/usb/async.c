@@ -0,0 +1,537 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include <libusb.h>
+
+#include "async.h"
+
+#define USB_ASYNC_EVENT_TIMEOUT           100000
+
+#define libusb_error(e) (e < 0 ? (e > -13 ? -e : 13) : e)
+
+void* usb_async_run(void* arg);
+usb_async_transfer_t* usb_async_acquire(usb_async_t* async, size_t num);
+int usb_async_submit(usb_async_t* async, usb_async_transfer_t* transfer);
+void usb_async_release(usb_async_t* async, usb_async_transfer_t* transfer);
+int usb_async_get_error(enum libusb_transfer_status status);
+double usb_async_get_time(void);
+void LIBUSB_CALL usb_async_complete(struct libusb_transfer*
+  libusb_transfer);
+
+int usb_async_init(usb_async_t* async, usb_device_t* dev, size_t
+    queue_depth, size_t buffer_size) {
+  pthread_condattr_t attr;
+  int i;
+
+  async->dev = dev;
+
+  async->queue_depth = queue_depth;
+  async->buffer_size = buffer_size;
+  async->transfers = calloc(queue_depth, sizeof(usb_async_transfer_t));
+  async->free = 0;
+  async->num_pending = 0;
+
+  async->streaming = 0;
+  async->start_time = usb_async_get_time();
+  async->num_bytes = 0;
+
+  pthread_mutex_init(&async->mutex, 0);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&async->condition, &attr);
+  pthread_condattr_destroy(&attr);
+
+  atomic_init(&async->exit_request, 0);
+
+  error_init(&async->error, usb_errors);
+
+  if (!queue_depth)
+    error_setf(&async->error, USB_ERROR_INVALID_PARAMETER, "%03d:%03d",
+      dev->bus, dev->address);
+
+  for (i = queue_depth-1; (i >= 0) && !error_get(&async->error); --i) {
+    async->transfers[i].async = async;
+    async->transfers[i].libusb_transfer = libusb_alloc_transfer(0);
+    async->transfers[i].buffer = malloc(LIBUSB_CONTROL_SETUP_SIZE+
+      buffer_size);
+
+    if (!async->transfers[i].libusb_transfer ||
+        !async->transfers[i].buffer) {
+      error_setf(&async->error, USB_ERROR_NO_MEMORY, "%03d:%03d",
+        dev->bus, dev->address);
+      continue;
+    }
+
+    async->transfers[i].next = async->free;
+    async->free = &async->transfers[i];
+  }
+
+  if (!error_get(&async->error) &&
+      pthread_create(&async->thread, 0, usb_async_run, async))
+    error_setf(&async->error, USB_ERROR_OTHER, "%03d:%03d",
+      dev->bus, dev->address);
+
+  if (error_get(&async->error)) {
+    for (i = 0; i < queue_depth; ++i) {
+      if (async->transfers[i].libusb_transfer)
+        libusb_free_transfer(async->transfers[i].libusb_transfer);
+      free(async->transfers[i].buffer);
+    }
+    free(async->transfers);
+
+    async->queue_depth = 0;
+    async->transfers = 0;
+    async->free = 0;
+  }
+
+  return error_get(&async->error);
+}
+
+void usb_async_destroy(usb_async_t* async) {
+  int i;
+
+  if (async->transfers) {
+    usb_async_stop_stream(async);
+    usb_async_cancel(async);
+    usb_async_wait(async, -1.0);
+
+    atomic_store(&async->exit_request, 1);
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+    libusb_interrupt_event_handler(async->dev->context->libusb_context);
+#endif
+    pthread_join(async->thread, 0);
+
+    for (i = 0; i < async->queue_depth; ++i) {
+      libusb_free_transfer(async->transfers[i].libusb_transfer);
+      free(async->transfers[i].buffer);
+      free(async->transfers[i].packets);
+    }
+    free(async->transfers);
+
+    async->queue_depth = 0;
+    async->transfers = 0;
+    async->free = 0;
+  }
+
+  pthread_cond_destroy(&async->condition);
+  pthread_mutex_destroy(&async->mutex);
+
+  error_destroy(&async->error);
+}
+
+int usb_async_control_transfer(usb_async_t* async, const
+    usb_control_transfer_t* transfer, usb_async_callback_t callback,
+    void* arg) {
+  usb_device_t* dev = async->dev;
+  usb_async_transfer_t* async_transfer;
+  unsigned char request_type = transfer->recipient |
+    (transfer->request_type << 5) | (transfer->direction << 7);
+
+  error_clear(&async->error);
+
+  if (!(async_transfer = usb_async_acquire(async, transfer->num)))
+    return error_get(&async->error);
+
+  async_transfer->direction = transfer->direction;
+  async_transfer->control = 1;
+  async_transfer->callback = callback;
+  async_transfer->arg = arg;
+
+  libusb_fill_control_setup(async_transfer->buffer, request_type,
+    transfer->request, transfer->value, transfer->index, transfer->num);
+  if (transfer->direction == usb_direction_out)
+    memcpy(&async_transfer->buffer[LIBUSB_CONTROL_SETUP_SIZE],
+      transfer->data, transfer->num);
+  libusb_fill_control_transfer(async_transfer->libusb_transfer,
+    dev->libusb_handle, async_transfer->buffer, usb_async_complete,
+    async_transfer, dev->timeout*1e3);
+
+  return usb_async_submit(async, async_transfer);
+}
+
+int usb_async_bulk_transfer(usb_async_t* async, const usb_bulk_transfer_t*
+    transfer, usb_async_callback_t callback, void* arg) {
+  usb_device_t* dev = async->dev;
+  usb_async_transfer_t* async_transfer;
+  unsigned char endpoint_address = transfer->endpoint_number |
+    (transfer->direction << 7);
+
+  error_clear(&async->error);
+
+  if (!(async_transfer = usb_async_acquire(async, transfer->num)))
+    return error_get(&async->error);
+
+  async_transfer->direction = transfer->direction;
+  async_transfer->control = 0;
+  async_transfer->callback = callback;
+  async_transfer->arg = arg;
+
+  if (transfer->direction == usb_direction_out)
+    memcpy(async_transfer->buffer, transfer->data, transfer->num);
+  libusb_fill_bulk_transfer(async_transfer->libusb_transfer,
+    dev->libusb_handle, endpoint_address, async_transfer->buffer,
+    transfer->num, usb_async_complete, async_transfer, dev->timeout*1e3);
+
+  return usb_async_submit(async, async_transfer);
+}
+
+int usb_async_interrupt_transfer(usb_async_t* async, const
+    usb_interrupt_transfer_t* transfer, usb_async_callback_t callback,
+    void* arg) {
+  usb_device_t* dev = async->dev;
+  usb_async_transfer_t* async_transfer;
+  unsigned char endpoint_address = transfer->endpoint_number |
+    (transfer->direction << 7);
+
+  error_clear(&async->error);
+
+  if (!(async_transfer = usb_async_acquire(async, transfer->num)))
+    return error_get(&async->error);
+
+  async_transfer->direction = transfer->direction;
+  async_transfer->control = 0;
+  async_transfer->callback = callback;
+  async_transfer->arg = arg;
+
+  if (transfer->direction == usb_direction_out)
+    memcpy(async_transfer->buffer, transfer->data, transfer->num);
+  libusb_fill_interrupt_transfer(async_transfer->libusb_transfer,
+    dev->libusb_handle, endpoint_address, async_transfer->buffer,
+    transfer->num, usb_async_complete, async_transfer, dev->timeout*1e3);
+
+  return usb_async_submit(async, async_transfer);
+}
+
+int usb_async_iso_transfer(usb_async_t* async, const usb_iso_transfer_t*
+    transfer, usb_async_iso_callback_t callback, void* arg) {
+  usb_device_t* dev = async->dev;
+  usb_async_transfer_t* async_transfer;
+  struct libusb_transfer* libusb_transfer;
+  size_t num = transfer->num_packets*transfer->packet_size;
+  unsigned char endpoint_address = transfer->endpoint_number |
+    (transfer->direction << 7);
+
+  error_clear(&async->error);
+
+  if (!(async_transfer = usb_async_acquire(async, num)))
+    return error_get(&async->error);
+
+  if (async_transfer->num_iso_packets < transfer->num_packets) {
+    if (!(libusb_transfer = libusb_alloc_transfer(transfer->num_packets))) {
+      usb_async_release(async, async_transfer);
+
+      error_setf(&async->error, USB_ERROR_NO_MEMORY, "%03d:%03d",
+        dev->bus, dev->address);
+      return error_get(&async->error);
+    }
+
+    libusb_free_transfer(async_transfer->libusb_transfer);
+    async_transfer->libusb_transfer = libusb_transfer;
+    async_transfer->packets = realloc(async_transfer->packets,
+      transfer->num_packets*sizeof(usb_iso_packet_t));
+    async_transfer->num_iso_packets = transfer->num_packets;
+  }
+
+  async_transfer->direction = transfer->direction;
+  async_transfer->control = 0;
+  async_transfer->iso_callback = callback;
+  async_transfer->arg = arg;
+
+  if (transfer->direction == usb_direction_out)
+    memcpy(async_transfer->buffer, transfer->data, num);
+  libusb_fill_iso_transfer(async_transfer->libusb_transfer,
+    dev->libusb_handle, endpoint_address, async_transfer->buffer, num,
+    transfer->num_packets, usb_async_complete, async_transfer,
+    dev->timeout*1e3);
+  libusb_set_iso_packet_lengths(async_transfer->libusb_transfer,
+    transfer->packet_size);
+
+  return usb_async_submit(async, async_transfer);
+}
+
+void usb_async_start_stream(usb_async_t* async) {
+  pthread_mutex_lock(&async->mutex);
+
+  async->streaming = 1;
+  async->start_time = usb_async_get_time();
+  async->num_bytes = 0;
+
+  pthread_mutex_unlock(&async->mutex);
+}
+
+void usb_async_stop_stream(usb_async_t* async) {
+  int i;
+
+  pthread_mutex_lock(&async->mutex);
+  async->streaming = 0;
+  pthread_mutex_unlock(&async->mutex);
+
+  for (i = 0; i < async->queue_depth; ++i)
+    if (async->transfers[i].stream)
+      libusb_cancel_transfer(async->transfers[i].libusb_transfer);
+}
+
+double usb_async_get_throughput(usb_async_t* async) {
+  double throughput, duration;
+
+  pthread_mutex_lock(&async->mutex);
+
+  duration = usb_async_get_time()-async->start_time;
+  throughput = (duration > 0.0) ? async->num_bytes/duration : 0.0;
+
+  pthread_mutex_unlock(&async->mutex);
+
+  return throughput;
+}
+
+void usb_async_cancel(usb_async_t* async) {
+  int i;
+
+  for (i = 0; i < async->queue_depth; ++i)
+    libusb_cancel_transfer(async->transfers[i].libusb_transfer);
+}
+
+int usb_async_wait(usb_async_t* async, double timeout) {
+  struct timespec deadline;
+  int result = 0;
+
+  error_clear(&async->error);
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += (time_t)timeout;
+  deadline.tv_nsec += (timeout-(time_t)timeout)*1e9;
+  if (deadline.tv_nsec >= 1000000000) {
+    ++deadline.tv_sec;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&async->mutex);
+  while (async->num_pending && !result) {
+    if (timeout < 0.0)
+      pthread_cond_wait(&async->condition, &async->mutex);
+    else
+      result = pthread_cond_timedwait(&async->condition, &async->mutex,
+        &deadline);
+  }
+  pthread_mutex_unlock(&async->mutex);
+
+  if (result)
+    error_setf(&async->error, USB_ERROR_TIMEOUT, "%03d:%03d",
+      async->dev->bus, async->dev->address);
+
+  return error_get(&async->error);
+}
+
+size_t usb_async_get_pending(usb_async_t* async) {
+  size_t num_pending;
+
+  pthread_mutex_lock(&async->mutex);
+  num_pending = async->num_pending;
+  pthread_mutex_unlock(&async->mutex);
+
+  return num_pending;
+}
+
+void* usb_async_run(void* arg) {
+  usb_async_t* async = arg;
+  struct timeval timeout;
+
+  while (!atomic_load(&async->exit_request)) {
+    timeout.tv_sec = 0;
+    timeout.tv_usec = USB_ASYNC_EVENT_TIMEOUT;
+
+    libusb_handle_events_timeout_completed(
+      async->dev->context->libusb_context, &timeout, 0);
+  }
+
+  return 0;
+}
+
+usb_async_transfer_t* usb_async_acquire(usb_async_t* async, size_t num) {
+  usb_async_transfer_t* transfer = 0;
+
+  if (num > async->buffer_size) {
+    error_setf(&async->error, USB_ERROR_INVALID_PARAMETER, "%03d:%03d",
+      async->dev->bus, async->dev->address);
+    return 0;
+  }
+
+  pthread_mutex_lock(&async->mutex);
+
+  if (pthread_equal(pthread_self(), async->thread)) {
+    if ((transfer = async->free))
+      async->free = transfer->next;
+  }
+  else {
+    while (!async->free)
+      pthread_cond_wait(&async->condition, &async->mutex);
+
+    transfer = async->free;
+    async->free = transfer->next;
+  }
+
+  if (transfer) {
+    transfer->callback = 0;
+    transfer->iso_callback = 0;
+    transfer->stream = async->streaming;
+
+    ++async->num_pending;
+  }
+
+  pthread_mutex_unlock(&async->mutex);
+
+  if (!transfer)
+    error_setf(&async->error, USB_ERROR_BUSY, "%03d:%03d",
+      async->dev->bus, async->dev->address);
+
+  return transfer;
+}
+
+int usb_async_submit(usb_async_t* async, usb_async_transfer_t* transfer) {
+  int error = libusb_submit_transfer(transfer->libusb_transfer);
+
+  if (error) {
+    usb_async_release(async, transfer);
+
+    error_setf(&async->error, libusb_error(error), "%03d:%03d",
+      async->dev->bus, async->dev->address);
+  }
+
+  return error_get(&async->error);
+}
+
+void usb_async_release(usb_async_t* async, usb_async_transfer_t* transfer) {
+  pthread_mutex_lock(&async->mutex);
+
+  transfer->stream = 0;
+  transfer->next = async->free;
+  async->free = transfer;
+  --async->num_pending;
+
+  pthread_cond_broadcast(&async->condition);
+  pthread_mutex_unlock(&async->mutex);
+}
+
+int usb_async_get_error(enum libusb_transfer_status status) {
+  switch (status) {
+    case LIBUSB_TRANSFER_COMPLETED:
+      return USB_ERROR_NONE;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+      return USB_ERROR_TIMEOUT;
+    case LIBUSB_TRANSFER_CANCELLED:
+      return USB_ERROR_INTERRUPTED;
+    case LIBUSB_TRANSFER_STALL:
+      return USB_ERROR_PIPE;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+      return USB_ERROR_NO_DEVICE;
+    case LIBUSB_TRANSFER_OVERFLOW:
+      return USB_ERROR_OVERFLOW;
+    default:
+      return USB_ERROR_IO;
+  }
+}
+
+double usb_async_get_time(void) {
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+
+  return time.tv_sec+time.tv_nsec*1e-9;
+}
+
+void LIBUSB_CALL usb_async_complete(struct libusb_transfer*
+    libusb_transfer) {
+  usb_async_transfer_t* transfer = libusb_transfer->user_data;
+  usb_async_t* async = transfer->async;
+  usb_device_t* dev = async->dev;
+  unsigned char* data = libusb_transfer->buffer;
+  ssize_t result = -usb_async_get_error(libusb_transfer->status);
+  size_t num_packets = 0, num_lost = 0;
+  int i;
+
+  if (transfer->control)
+    data = libusb_control_transfer_get_data(libusb_transfer);
+
+  if (libusb_transfer->type == LIBUSB_TRANSFER_TYPE_ISOCHRONOUS) {
+    num_packets = libusb_transfer->num_iso_packets;
+
+    for (i = 0; i < num_packets; ++i) {
+      transfer->packets[i].data =
+        libusb_get_iso_packet_buffer_simple(libusb_transfer, i);
+      transfer->packets[i].num =
+        libusb_transfer->iso_packet_desc[i].actual_length;
+      transfer->packets[i].error = (result < 0) ? -result :
+        usb_async_get_error(libusb_transfer->iso_packet_desc[i].status);
+
+      if (transfer->packets[i].error) {
+        transfer->packets[i].num = 0;
+        ++num_lost;
+      }
+      else if (result >= 0)
+        result += transfer->packets[i].num;
+    }
+  }
+  else if (!result)
+    result = libusb_transfer->actual_length;
+
+  if (libusb_transfer->status == LIBUSB_TRANSFER_CANCELLED) {
+    num_packets = 0;
+    num_lost = 0;
+  }
+
+  pthread_mutex_lock(&async->mutex);
+
+  if (result > 0) {
+    if (transfer->direction == usb_direction_out)
+      dev->num_written += result;
+    else
+      dev->num_read += result;
+    async->num_bytes += result;
+  }
+  dev->num_packets += num_packets;
+  dev->num_lost += num_lost;
+
+  pthread_mutex_unlock(&async->mutex);
+
+  if (transfer->iso_callback)
+    transfer->iso_callback(dev, transfer->packets,
+      libusb_transfer->num_iso_packets, transfer->arg);
+  else if (transfer->callback)
+    transfer->callback(dev, data, result, transfer->arg);
+
+  pthread_mutex_lock(&async->mutex);
+
+  if (transfer->stream && async->streaming &&
+      (libusb_transfer->status != LIBUSB_TRANSFER_CANCELLED) &&
+      (libusb_transfer->status != LIBUSB_TRANSFER_NO_DEVICE) &&
+      !libusb_submit_transfer(libusb_transfer)) {
+    pthread_mutex_unlock(&async->mutex);
+    return;
+  }
+
+  pthread_mutex_unlock(&async->mutex);
+
+  usb_async_release(async, transfer);
+}
@@ -0,0 +1,287 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by Ralf Kaestner                                   *
+ *   ralf.kaestner@gmail.com                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef USB_ASYNC_H
+#define USB_ASYNC_H
+
+/** \file usb/async.h
+  * \ingroup usb
+  * \brief Asynchronous USB transfers
+  * \author Ralf Kaestner
+  * 
+  * The asynchronous USB transfer interface keeps multiple requests in
+  * flight on a USB device, thus avoiding the idle bus time between the
+  * synchronous transfers of usb_device_bulk_transfer() and
+  * usb_device_control_transfer(). A queue pre-allocates a configurable
+  * number of transfers and their buffers, and a dedicated thread handles
+  * the libusb events of the device's context and reports completed
+  * transfers to their callbacks.
+  * 
+  * Besides control and bulk transfers, the queue supports interrupt and
+  * isochronous transfers, whose packets report their status individually.
+  * For continuous streaming, the queue may resubmit each completed
+  * transfer, such that a given number of transfers remains queued at all
+  * times.
+  */
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "usb/usb.h"
+
+/** \brief USB asynchronous transfer completion callback
+  * \param[in] dev The USB device the transfer has completed on.
+  * \param[in] data The transferred data. For transfers from the device,
+  *   the data is only valid until the callback returns.
+  * \param[in] result The number of transferred bytes or the negative
+  *   error code of the transfer.
+  * \param[in] arg The argument passed on submission of the transfer.
+  * 
+  * Callbacks are invoked from the event thread of the queue. They may
+  * submit further transfers, but such submissions fail with
+  * USB_ERROR_BUSY instead of blocking if the queue is full.
+  */
+typedef void (*usb_async_callback_t)(
+  usb_device_t* dev,
+  unsigned char* data,
+  ssize_t result,
+  void* arg);
+
+/** \brief USB asynchronous isochronous transfer completion callback
+  * \param[in] dev The USB device the transfer has completed on.
+  * \param[in] packets The packets of the transfer. For transfers from the
+  *   device, the packet data is only valid until the callback returns.
+  * \param[in] num_packets The number of packets of the transfer.
+  * \param[in] arg The argument passed on submission of the transfer.
+  * 
+  * Packets which failed to transfer report their error code, whereas the
+  * remaining packets may be shorter than requested. The restrictions of
+  * usb_async_callback_t apply.
+  */
+typedef void (*usb_async_iso_callback_t)(
+  usb_device_t* dev,
+  usb_iso_packet_t* packets,
+  size_t num_packets,
+  void* arg);
+
+/** \brief USB asynchronous transfer structure
+  */
+typedef struct usb_async_transfer_t {
+  struct usb_async_t* async;      //!< The queue owning the transfer.
+  void* libusb_transfer;          //!< The libusb transfer.
+
+  unsigned char* buffer;          //!< The pre-allocated transfer buffer.
+  usb_direction_t direction;      //!< The direction of the transfer.
+  int control;                    //!< Flag signaling a control transfer.
+
+  usb_async_callback_t callback;  //!< The completion callback.
+  usb_async_iso_callback_t iso_callback; //!< The isochronous callback.
+  void* arg;                      //!< The completion callback argument.
+
+  usb_iso_packet_t* packets;      //!< The isochronous packets.
+  size_t num_iso_packets;         //!< The number of allocated packets.
+  int stream;                     //!< Flag signaling a streaming transfer.
+
+  struct usb_async_transfer_t* next; //!< The next free transfer.
+} usb_async_transfer_t;
+
+/** \brief USB asynchronous transfer queue structure
+  */
+typedef struct usb_async_t {
+  usb_device_t* dev;              //!< The open device of the queue.
+
+  size_t queue_depth;             //!< The number of transfers.
+  size_t buffer_size;             //!< The size of the transfer buffers.
+  usb_async_transfer_t* transfers; //!< The pre-allocated transfers.
+  usb_async_transfer_t* free;     //!< The list of free transfers.
+  size_t num_pending;             //!< The number of transfers in flight.
+
+  int streaming;                  //!< Flag signaling an active stream.
+  double start_time;              //!< The stream start time in [s].
+  size_t num_bytes;               //!< The number of bytes streamed.
+
+  pthread_mutex_t mutex;          //!< The queue mutex.
+  pthread_cond_t condition;       //!< The condition signaling completions.
+
+  pthread_t thread;               //!< The event handling thread.
+  atomic_int exit_request;        //!< Flag signaling a pending exit request.
+
+  error_t error;                  //!< The most recent queue error.
+} usb_async_t;
+
+/** \brief Initialize USB asynchronous transfer queue
+  * \param[in] async The queue to be initialized.
+  * \param[in] dev The open USB device to perform the transfers on.
+  * \param[in] queue_depth The maximum number of transfers in flight.
+  * \param[in] buffer_size The size of each transfer's buffer in bytes,
+  *   which limits the size of the submitted transfers.
+  * \return The resulting error code.
+  * 
+  * The transfers and their buffers are allocated once, and the event
+  * thread is started.
+  */
+int usb_async_init(
+  usb_async_t* async,
+  usb_device_t* dev,
+  size_t queue_depth,
+  size_t buffer_size);
+
+/** \brief Destroy USB asynchronous transfer queue
+  * \param[in] async The initialized queue to be destroyed.
+  * 
+  * Streaming is stopped and transfers in flight are cancelled and their
+  * callbacks invoked before the event thread is stopped.
+  */
+void usb_async_destroy(
+  usb_async_t* async);
+
+/** \brief Submit asynchronous USB control transfer
+  * \param[in] async The initialized queue to submit the transfer to.
+  * \param[in] transfer The control transfer to be submitted. Data to be
+  *   written to the device will be copied, whereas the data field is
+  *   ignored for transfers from the device.
+  * \param[in] callback The callback to be invoked on completion.
+  * \param[in] arg The argument passed to the callback.
+  * \return The resulting error code.
+  * 
+  * If all transfers of the queue are in flight, this function blocks
+  * until a transfer has completed.
+  */
+int usb_async_control_transfer(
+  usb_async_t* async,
+  const usb_control_transfer_t* transfer,
+  usb_async_callback_t callback,
+  void* arg);
+
+/** \brief Submit asynchronous USB bulk transfer
+  * \param[in] async The initialized queue to submit the transfer to.
+  * \param[in] transfer The bulk transfer to be submitted. Data to be
+  *   written to the device will be copied, whereas the data field is
+  *   ignored for transfers from the device.
+  * \param[in] callback The callback to be invoked on completion.
+  * \param[in] arg The argument passed to the callback.
+  * \return The resulting error code.
+  * 
+  * If all transfers of the queue are in flight, this function blocks
+  * until a transfer has completed.
+  */
+int usb_async_bulk_transfer(
+  usb_async_t* async,
+  const usb_bulk_transfer_t* transfer,
+  usb_async_callback_t callback,
+  void* arg);
+
+/** \brief Submit asynchronous USB interrupt transfer
+  * \param[in] async The initialized queue to submit the transfer to.
+  * \param[in] transfer The interrupt transfer to be submitted. Data to be
+  *   written to the device will be copied, whereas the data field is
+  *   ignored for transfers from the device.
+  * \param[in] callback The callback to be invoked on completion.
+  * \param[in] arg The argument passed to the callback.
+  * \return The resulting error code.
+  * 
+  * If all transfers of the queue are in flight, this function blocks
+  * until a transfer has completed.
+  */
+int usb_async_interrupt_transfer(
+  usb_async_t* async,
+  const usb_interrupt_transfer_t* transfer,
+  usb_async_callback_t callback,
+  void* arg);
+
+/** \brief Submit asynchronous USB isochronous transfer
+  * \param[in] async The initialized queue to submit the transfer to.
+  * \param[in] transfer The isochronous transfer to be submitted, whose
+  *   packets must fit into the buffer of a queued transfer. Data to be
+  *   written to the device will be copied, whereas the data field is
+  *   ignored for transfers from the device.
+  * \param[in] callback The callback to be invoked on completion.
+  * \param[in] arg The argument passed to the callback.
+  * \return The resulting error code.
+  * 
+  * If all transfers of the queue are in flight, this function blocks
+  * until a transfer has completed. Every packet which fails to transfer
+  * is accounted for as lost by the device, unless the transfer has been
+  * cancelled.
+  */
+int usb_async_iso_transfer(
+  usb_async_t* async,
+  const usb_iso_transfer_t* transfer,
+  usb_async_iso_callback_t callback,
+  void* arg);
+
+/** \brief Start streaming asynchronous USB transfers
+  * \param[in] async The initialized queue to start streaming.
+  * 
+  * While streaming, every transfer submitted to the queue will be
+  * resubmitted as soon as its callback returns. Submitting N transfers
+  * thus keeps N transfers queued until the stream is stopped or a
+  * transfer fails because it was cancelled or the device has vanished.
+  * For transfers to the device, the callback may refill the transfer
+  * data before it is being resubmitted. Starting the stream also resets
+  * its throughput measurement.
+  */
+void usb_async_start_stream(
+  usb_async_t* async);
+
+/** \brief Stop streaming asynchronous USB transfers
+  * \param[in] async The initialized queue to stop streaming.
+  * 
+  * Streaming transfers in flight will be cancelled. Use usb_async_wait()
+  * to wait for their callbacks to return.
+  */
+void usb_async_stop_stream(
+  usb_async_t* async);
+
+/** \brief Retrieve the throughput of the asynchronous USB stream
+  * \param[in] async The initialized queue to retrieve the throughput for.
+  * \return The number of bytes per second transferred by the queue since
+  *   the stream has been started.
+  */
+double usb_async_get_throughput(
+  usb_async_t* async);
+
+/** \brief Cancel all asynchronous USB transfers in flight
+  * \param[in] async The initialized queue to cancel the transfers of.
+  * 
+  * The callbacks of the cancelled transfers will be invoked with an
+  * error result once the cancellation has completed.
+  */
+void usb_async_cancel(
+  usb_async_t* async);
+
+/** \brief Wait for asynchronous USB transfers to complete
+  * \param[in] async The initialized queue to wait for.
+  * \param[in] timeout The maximum time to wait in [s]. A negative timeout
+  *   waits indefinitely.
+  * \return The resulting error code.
+  */
+int usb_async_wait(
+  usb_async_t* async,
+  double timeout);
+
+/** \brief Retrieve the number of asynchronous USB transfers in flight
+  * \param[in] async The initialized queue to retrieve the number for.
+  * \return The number of submitted transfers which have not completed.
+  */
+size_t usb_async_get_pending(
+  usb_async_t* async);
+
+#endif
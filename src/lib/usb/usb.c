@@ -80,7 +80,8 @@ const char* usb_classes[] = {
   "Unknown",
 };
 
-void usb_device_init(usb_device_t* dev, libusb_device* libus_device);
+void usb_device_init(usb_device_t* dev, usb_context_t* context,
+  libusb_device* libus_device);
 void usb_device_destroy(usb_device_t* dev);
 
 int usb_context_init(usb_context_t* context) {
@@ -177,7 +178,7 @@ int usb_context_refresh(usb_context_t* context) {
     if (context->num_devices) {
       context->devices = malloc(context->num_devices*sizeof(usb_device_t));
       for (i = 0; i < context->num_devices; ++i)
-        usb_device_init(&context->devices[i], libusb_devices[i]);
+        usb_device_init(&context->devices[i], context, libusb_devices[i]);
     }
 
     if (libusb_devices)
@@ -232,9 +233,11 @@ usb_device_t* usb_context_match_vendor_product(const usb_context_t* context,
   return 0;
 }
 
-void usb_device_init(usb_device_t* dev, libusb_device* libus_device) {
+void usb_device_init(usb_device_t* dev, usb_context_t* context,
+    libusb_device* libus_device) {
   struct libusb_device_descriptor descriptor;
   
+  dev->context = context;
   dev->libusb_device = libus_device;
   dev->libusb_handle = 0;
 
@@ -314,6 +317,8 @@ void usb_device_init(usb_device_t* dev, libusb_device* libus_device) {
 
   dev->num_read = 0;
   dev->num_written = 0;
+  dev->num_packets = 0;
+  dev->num_lost = 0;
       
   error_init(&dev->error, usb_errors);
 }
@@ -426,6 +431,32 @@ int usb_device_bulk_write(usb_device_t* dev, unsigned char endpoint_number,
   return usb_device_bulk_transfer(dev, &transfer);
 }
 
+int usb_device_interrupt_read(usb_device_t* dev, unsigned char
+    endpoint_number, unsigned char* data, size_t num) {
+  usb_interrupt_transfer_t transfer;
+
+  transfer.endpoint_number = endpoint_number;
+  transfer.direction = usb_direction_in;
+  
+  transfer.num = num;
+  transfer.data = data;
+  
+  return usb_device_interrupt_transfer(dev, &transfer);
+}
+
+int usb_device_interrupt_write(usb_device_t* dev, unsigned char
+    endpoint_number, unsigned char* data, size_t num) {
+  usb_interrupt_transfer_t transfer;
+
+  transfer.endpoint_number = endpoint_number;
+  transfer.direction = usb_direction_out;
+  
+  transfer.num = num;
+  transfer.data = data;
+  
+  return usb_device_interrupt_transfer(dev, &transfer);
+}
+
 int usb_device_control_transfer(usb_device_t* dev, usb_control_transfer_t*
     transfer) {
   ssize_t result;
@@ -480,6 +511,33 @@ int usb_device_bulk_transfer(usb_device_t* dev, usb_bulk_transfer_t*
   return -error_get(&dev->error);      
 }
 
+int usb_device_interrupt_transfer(usb_device_t* dev,
+    usb_interrupt_transfer_t* transfer) {
+  ssize_t result;
+  int transferred = 0;
+  unsigned char endpoint_address = transfer->endpoint_number |
+    (transfer->direction << 7);
+
+  error_clear(&dev->error);
+    
+  result = libusb_interrupt_transfer(dev->libusb_handle, endpoint_address,
+    transfer->data, transfer->num, &transferred, dev->timeout*1e3);
+  
+  if (!result) {
+    if (transfer->direction == usb_direction_out)
+      dev->num_written += transferred;
+    else
+      dev->num_read += transferred;
+    
+    return transferred;
+  }
+  else
+    error_setf(&dev->error, libusb_error(result), "%03d:%03d",
+      dev->bus, dev->address);
+
+  return -error_get(&dev->error);      
+}
+
 void usb_device_print(FILE* stream, const usb_device_t* dev) {
   fprintf(stream, "Bus %03d Device %03d: ID %04x:%04x Class %s",
     dev->bus, dev->address, dev->vendor_id, dev->product_id,
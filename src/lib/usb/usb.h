@@ -148,6 +148,7 @@ typedef enum {
   * \note The life-cycle of a USB device is managed by its context.
   */
 typedef struct usb_device_t {
+  struct usb_context_t* context;  //!< The context of the device.
   void* libusb_device;            //!< The libusb device.
   void* libusb_handle;            //!< The libusb handle.
 
@@ -162,6 +163,8 @@ typedef struct usb_device_t {
   
   size_t num_read;                //!< Number of bytes read from device.
   size_t num_written;             //!< Number of bytes written to device.
+  size_t num_packets;             //!< Number of isochronous packets.
+  size_t num_lost;                //!< Number of isochronous packets lost.
   
   error_t error;                  //!< The most recent device error.
 } usb_device_t;
@@ -210,6 +213,38 @@ typedef struct usb_bulk_transfer_t {
   unsigned char* data;              //!< Bulk transfer data field.
 } usb_bulk_transfer_t;
 
+/** \brief USB interrupt transfer structure
+  */
+typedef struct usb_interrupt_transfer_t {
+  unsigned char endpoint_number;    //!< Interrupt transfer endpoint number.
+  usb_direction_t direction;        //!< Interrupt transfer direction.
+  
+  size_t num;                       //!< Number of interrupt data bytes.
+  unsigned char* data;              //!< Interrupt transfer data field.
+} usb_interrupt_transfer_t;
+
+/** \brief USB isochronous transfer structure
+  * 
+  * An isochronous transfer consists of a number of packets of equal size,
+  * which are laid out consecutively in the transfer data.
+  */
+typedef struct usb_iso_transfer_t {
+  unsigned char endpoint_number;    //!< Isochronous transfer endpoint number.
+  usb_direction_t direction;        //!< Isochronous transfer direction.
+  
+  size_t num_packets;               //!< Number of isochronous packets.
+  size_t packet_size;               //!< Size of each packet in bytes.
+  unsigned char* data;              //!< Isochronous transfer data field.
+} usb_iso_transfer_t;
+
+/** \brief USB isochronous packet structure
+  */
+typedef struct usb_iso_packet_t {
+  unsigned char* data;              //!< Isochronous packet data.
+  size_t num;                       //!< Number of transferred packet bytes.
+  int error;                        //!< Error code of the packet.
+} usb_iso_packet_t;
+
 /** \brief Initialize a USB context
   * \param[in] context The USB context to be initialized.
   * \return The resulting error code.
@@ -360,6 +395,38 @@ int usb_device_bulk_write(
   unsigned char* data,
   size_t num);
 
+/** \brief Read interrupt data from open USB device
+  * \param[in] dev The open USB device to read interrupt data from.
+  * \param[in] endpoint_number The number of the endpoint to read interrupt
+  *   data from.
+  * \param[in,out] data An array containing the interrupt data read from
+  *   the device.
+  * \param[in] num The number of interrupt data bytes to be read.
+  * \return The number of interrupt data bytes read from the USB device or
+  *   the negative error code.
+  */
+int usb_device_interrupt_read(
+  usb_device_t* dev,
+  unsigned char endpoint_number,
+  unsigned char* data,
+  size_t num);
+
+/** \brief Write interrupt data to open USB device
+  * \param[in] dev The open USB device to write interrupt data to.
+  * \param[in] endpoint_number The number of the endpoint to write interrupt
+  *   data to.
+  * \param[in] data An array containing the interrupt data to be written to
+  *   the device.
+  * \param[in] num The number of interrupt data bytes to be written.
+  * \return The number of interrupt data bytes written to the USB device or
+  *   the negative error code.
+  */
+int usb_device_interrupt_write(
+  usb_device_t* dev,
+  unsigned char endpoint_number,
+  unsigned char* data,
+  size_t num);
+
 /** \brief Perform synchronous USB control transfer
   * \param[in] dev The open USB device to communicate with.
   * \param[in,out] transfer The control transfer to be performed.
@@ -378,6 +445,18 @@ int usb_device_bulk_transfer(
   usb_device_t* dev,
   usb_bulk_transfer_t* transfer);
 
+/** \brief Perform synchronous USB interrupt transfer
+  * \param[in] dev The open USB device to communicate with.
+  * \param[in,out] transfer The interrupt transfer to be performed.
+  * \return The resulting error code.
+  * 
+  * Isochronous transfers are only supported asynchronously, see
+  * usb_async_iso_transfer().
+  */
+int usb_device_interrupt_transfer(
+  usb_device_t* dev,
+  usb_interrupt_transfer_t* transfer);
+
 /** \brief Print USB device
   * \param[in] stream The output stream that will be used for printing the
   *   USB device.